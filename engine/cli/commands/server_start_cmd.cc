@@ -13,18 +13,9 @@ namespace commands {
 
 namespace {
 bool TryConnectToServer(const std::string& host, int port) {
-  constexpr const auto kMaxRetry = 4u;
-  auto count = 0u;
-  // Check if server is started
-  while (true) {
-    if (IsServerAlive(host, port))
-      break;
-    // Wait for server up
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    if (count++ == kMaxRetry) {
-      std::cerr << "Could not start server" << std::endl;
-      return false;
-    }
+  if (!WaitForServerReady(host, port)) {
+    std::cerr << "Could not start server" << std::endl;
+    return false;
   }
   return true;
 }
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
 #include <optional>
 #include <string>
+#include <thread>
 #include "utils/curl_utils.h"
 #include "utils/logging_utils.h"
 #include "utils/url_parser.h"
@@ -22,6 +25,68 @@ inline bool IsServerAlive(const std::string& host, int port) {
   return true;
 }
 
+/**
+ * Wait until the server has finished its background startup work. The
+ * server holds /healthz?ready until it is ready, so this only retries (with a
+ * short backoff) while the listener is not up yet or answers not ready (503).
+ */
+inline bool WaitForServerReady(
+    const std::string& host, int port,
+    std::chrono::milliseconds timeout = std::chrono::seconds(30)) {
+  using namespace std::chrono;
+  constexpr const auto kMaxWaitPerRequest = milliseconds(5000);
+  constexpr const auto kMaxBackoff = milliseconds(200);
+  auto deadline = steady_clock::now() + timeout;
+  auto backoff = milliseconds(10);
+  while (steady_clock::now() < deadline) {
+    auto wait = std::min(kMaxWaitPerRequest,
+                         duration_cast<milliseconds>(deadline -
+                                                     steady_clock::now()));
+    auto url = url_parser::Url{
+        .protocol = "http",
+        .host = host + ":" + std::to_string(port),
+        .pathParams = {"healthz"},
+        .queries = {{"ready", "true"},
+                    {"wait_ms", std::to_string(wait.count())}},
+    };
+    auto res = curl_utils::GetStatusCode(
+        url.ToFullPath(), static_cast<int>(wait.count() / 1000 + 2));
+    if (res.has_value() && res.value() >= 200 && res.value() < 300) {
+      return true;
+    }
+    std::this_thread::sleep_for(backoff);
+    backoff = std::min(backoff * 2, kMaxBackoff);
+  }
+  return false;
+}
+
+/**
+ * Wait until nothing listens on [port] anymore, so that a new server can bind
+ * it once the previous one has shut down.
+ */
+inline bool WaitForPortReleased(
+    const std::string& host, int port,
+    std::chrono::milliseconds timeout = std::chrono::seconds(30)) {
+  using namespace std::chrono;
+  constexpr const auto kMaxBackoff = milliseconds(200);
+  auto deadline = steady_clock::now() + timeout;
+  auto backoff = milliseconds(10);
+  auto url = url_parser::Url{
+      .protocol = "http",
+      .host = host + ":" + std::to_string(port),
+      .pathParams = {"healthz"},
+  };
+  while (steady_clock::now() < deadline) {
+    // any response means the port is still bound
+    if (curl_utils::GetStatusCode(url.ToFullPath(), 1).has_error()) {
+      return true;
+    }
+    std::this_thread::sleep_for(backoff);
+    backoff = std::min(backoff * 2, kMaxBackoff);
+  }
+  return false;
+}
+
 class ServerStartCmd {
  public:
   bool Exec(const std::string& host, int port,
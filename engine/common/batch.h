@@ -0,0 +1,132 @@
+#pragma once
+
+#include <json/value.h>
+#include <string>
+#include "common/json_serializable.h"
+
+namespace OpenAi {
+
+/**
+ * A batch of requests read from a JSONL file, processed in the background at
+ * the lowest scheduling priority.
+ */
+struct Batch : public JsonSerializable {
+  /**
+   * The identifier, which can be referenced in API endpoints.
+   */
+  std::string id;
+
+  /**
+   * The object type, which is always batch.
+   */
+  std::string object = "batch";
+
+  /**
+   * The API endpoint used by the batch, /v1/chat/completions or
+   * /v1/embeddings.
+   */
+  std::string endpoint;
+
+  /**
+   * The ID of the input file for the batch.
+   */
+  std::string input_file_id;
+
+  /**
+   * The time frame within which the batch should be processed.
+   */
+  std::string completion_window = "24h";
+
+  /**
+   * The current status of the batch: validating, failed, in_progress,
+   * finalizing, completed, expired, cancelling or cancelled.
+   */
+  std::string status = "validating";
+
+  /**
+   * The ID of the file containing the outputs of successfully executed
+   * requests.
+   */
+  std::string output_file_id;
+
+  /**
+   * The ID of the file containing the outputs of requests with errors.
+   */
+  std::string error_file_id;
+
+  /**
+   * Unix timestamps (in seconds) of the batch lifecycle, 0 when not reached.
+   */
+  uint64_t created_at = 0;
+  uint64_t in_progress_at = 0;
+  uint64_t completed_at = 0;
+  uint64_t failed_at = 0;
+  uint64_t cancelled_at = 0;
+
+  /**
+   * Number of requests in total, completed successfully and failed.
+   */
+  uint64_t total = 0;
+  uint64_t completed = 0;
+  uint64_t failed = 0;
+
+  /**
+   * Byte offset in the input file up to which every line has been
+   * processed. Processing resumes from here after a restart.
+   */
+  uint64_t input_offset = 0;
+
+  /**
+   * Reason the batch failed, empty otherwise.
+   */
+  std::string error;
+
+  /**
+   * Set of 16 key-value pairs that can be attached to an object.
+   */
+  Json::Value metadata{Json::objectValue};
+
+  bool IsFinished() const {
+    return status == "completed" || status == "failed" ||
+           status == "cancelled" || status == "expired";
+  }
+
+  cpp::result<Json::Value, std::string> ToJson() override {
+    auto or_null = [](const std::string& s) {
+      return s.empty() ? Json::Value() : Json::Value(s);
+    };
+    auto ts_or_null = [](uint64_t ts) {
+      return ts == 0 ? Json::Value() : Json::Value(ts);
+    };
+
+    Json::Value root;
+    root["id"] = id;
+    root["object"] = object;
+    root["endpoint"] = endpoint;
+    root["input_file_id"] = input_file_id;
+    root["completion_window"] = completion_window;
+    root["status"] = status;
+    root["output_file_id"] = or_null(output_file_id);
+    root["error_file_id"] = or_null(error_file_id);
+    root["created_at"] = created_at;
+    root["in_progress_at"] = ts_or_null(in_progress_at);
+    root["completed_at"] = ts_or_null(completed_at);
+    root["failed_at"] = ts_or_null(failed_at);
+    root["cancelled_at"] = ts_or_null(cancelled_at);
+    root["request_counts"]["total"] = total;
+    root["request_counts"]["completed"] = completed;
+    root["request_counts"]["failed"] = failed;
+    if (error.empty()) {
+      root["errors"] = Json::Value();
+    } else {
+      Json::Value err;
+      err["code"] = "batch_failed";
+      err["message"] = error;
+      root["errors"]["object"] = "list";
+      root["errors"]["data"].append(err);
+    }
+    root["metadata"] = metadata;
+    return root;
+  }
+};
+}  // namespace OpenAi
@@ -2,9 +2,11 @@
 
 #include <json/json.h>
 #include <filesystem>
+#include <memory>
 #include <optional>
 #include <sstream>
 #include <string>
+#include "utils/result.hpp"
 
 enum class DownloadType {
   Model,
@@ -15,6 +17,27 @@ enum class DownloadType {
   Environments
 };
 
+/**
+ * Consumes the bytes of a DownloadItem as they arrive, in place of the file
+ * at its localPath. Only honored by tasks queued with
+ * DownloadService::AddTask.
+ */
+class DownloadSink {
+ public:
+  virtual ~DownloadSink() = default;
+
+  /**
+   * Returning false aborts the download.
+   */
+  virtual bool Write(const char* data, size_t size) = 0;
+
+  /**
+   * Called once the transfer is over, [success] is false if it failed or
+   * was stopped. An error fails the task.
+   */
+  virtual cpp::result<void, std::string> Close(bool success) = 0;
+};
+
 struct DownloadItem {
 
   std::string id;
@@ -32,6 +55,8 @@ struct DownloadItem {
 
   std::optional<uint64_t> downloadedBytes;
 
+  std::shared_ptr<DownloadSink> sink;
+
   std::string ToString() const {
     std::ostringstream output;
     output << "DownloadItem{id: " << id << ", downloadUrl: " << downloadUrl
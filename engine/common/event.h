@@ -11,6 +11,8 @@ namespace cortex::event {
 enum class EventType {
   DownloadEvent,
   ExitEvent,
+  BatchEvent,
+  ImportEvent,
 };
 
 struct Event {};
@@ -74,6 +76,88 @@ struct DownloadEvent : public cortex::event::Event {
   }
 };
 
+enum class BatchEventType {
+  BatchInProgress,
+  BatchUpdated,
+  BatchCompleted,
+  BatchFailed,
+  BatchCancelled,
+};
+
+inline std::string BatchEventTypeToString(BatchEventType type) {
+  switch (type) {
+    case BatchEventType::BatchInProgress:
+      return "BatchInProgress";
+    case BatchEventType::BatchUpdated:
+      return "BatchUpdated";
+    case BatchEventType::BatchCompleted:
+      return "BatchCompleted";
+    case BatchEventType::BatchFailed:
+      return "BatchFailed";
+    case BatchEventType::BatchCancelled:
+      return "BatchCancelled";
+    default:
+      return "Unknown";
+  }
+}
+
+/**
+ * Progress of a /v1/batches job, [batch_] is the batch object as returned
+ * by the API.
+ */
+struct BatchEvent : public cortex::event::Event {
+  BatchEventType type_;
+  Json::Value batch_;
+
+  std::string ToJsonString() const {
+    Json::Value root;
+    root["type"] = BatchEventTypeToString(type_);
+    root["batch"] = batch_;
+    return json_helper::DumpJsonString(root);
+  }
+};
+
+enum class ImportEventType {
+  ImportStarted,
+  ImportUpdated,
+  ImportSuccess,
+  ImportStopped,
+  ImportError,
+};
+
+inline std::string ImportEventTypeToString(ImportEventType type) {
+  switch (type) {
+    case ImportEventType::ImportStarted:
+      return "ImportStarted";
+    case ImportEventType::ImportUpdated:
+      return "ImportUpdated";
+    case ImportEventType::ImportSuccess:
+      return "ImportSuccess";
+    case ImportEventType::ImportStopped:
+      return "ImportStopped";
+    case ImportEventType::ImportError:
+      return "ImportError";
+    default:
+      return "Unknown";
+  }
+}
+
+/**
+ * Progress of a model import, [task_] is the import task as returned by
+ * /v1/models/import.
+ */
+struct ImportEvent : public cortex::event::Event {
+  ImportEventType type_;
+  Json::Value task_;
+
+  std::string ToJsonString() const {
+    Json::Value root;
+    root["type"] = ImportEventTypeToString(type_);
+    root["task"] = task_;
+    return json_helper::DumpJsonString(root);
+  }
+};
+
 inline DownloadEvent GetDownloadEventFromJson(const Json::Value& item_json) {
   DownloadEvent ev;
   if (!item_json["type"].isNull()) {
@@ -89,4 +173,5 @@ inline DownloadEvent GetDownloadEventFromJson(const Json::Value& item_json) {
 
 constexpr std::size_t eventMaxSize =
     eventpp::maxSizeOf<cortex::event::Event, cortex::event::DownloadEvent,
-                       cortex::event::ExitEvent, std::string>();
+                       cortex::event::ExitEvent, cortex::event::BatchEvent,
+                       cortex::event::ImportEvent, std::string>();
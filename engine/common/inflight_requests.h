@@ -0,0 +1,76 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Stop flags of the requests an engine is running, by the "request_id" the
+ * server gave them, so that StopRequest stops one request and leaves the
+ * other requests of the model running.
+ */
+class InflightRequests {
+ public:
+  using StopFlag = std::shared_ptr<std::atomic<bool>>;
+
+  /**
+   * Flag of the request [request_id], tracked as long as the flag is held.
+   * A request without id gets a flag nothing sets.
+   */
+  StopFlag Add(const std::string& request_id) {
+    auto flag = std::make_shared<std::atomic<bool>>(false);
+    if (request_id.empty()) {
+      return flag;
+    }
+    std::lock_guard<std::mutex> l(mtx_);
+    // requests which finished without being stopped
+    for (auto it = flags_.begin(); it != flags_.end();) {
+      it = it->second.expired() ? flags_.erase(it) : std::next(it);
+    }
+    flags_[request_id] = flag;
+    return flag;
+  }
+
+  // False if the request is not running
+  bool Stop(const std::string& request_id) {
+    std::lock_guard<std::mutex> l(mtx_);
+    auto it = flags_.find(request_id);
+    if (it == flags_.end()) {
+      return false;
+    }
+    auto flag = it->second.lock();
+    flags_.erase(it);
+    if (!flag) {
+      return false;
+    }
+    *flag = true;
+    return true;
+  }
+
+ private:
+  std::mutex mtx_;
+  std::unordered_map<std::string, std::weak_ptr<std::atomic<bool>>> flags_;
+};
+
+// CURLOPT_XFERINFOFUNCTION aborting the transfer once the flag is set
+inline int AbortIfStopped(void* stop, curl_off_t, curl_off_t, curl_off_t,
+                          curl_off_t) {
+  return static_cast<const std::atomic<bool>*>(stop)->load() ? 1 : 0;
+}
+
+/**
+ * Abort the transfer of [curl] with CURLE_ABORTED_BY_CALLBACK once [stop] is
+ * set. curl checks it at least once a second, and whenever data moves.
+ */
+inline void AbortTransferOnStop(CURL* curl, const std::atomic<bool>* stop) {
+  if (stop == nullptr) {
+    return;
+  }
+  curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+  curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, AbortIfStopped);
+  curl_easy_setopt(curl, CURLOPT_XFERINFODATA,
+                   const_cast<std::atomic<bool>*>(stop));
+}
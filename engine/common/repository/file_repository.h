@@ -1,5 +1,6 @@
 #pragma once
 
+#include <filesystem>
 #include "common/file.h"
 #include "utils/result.hpp"
 
@@ -9,6 +10,13 @@ class FileRepository {
                                                    const char* content,
                                                    uint64_t length) = 0;
 
+  /**
+   * Move the file at [src] into the file store, without reading it into
+   * memory.
+   */
+  virtual cpp::result<void, std::string> StoreFileFromPath(
+      OpenAi::File& file_metadata, const std::filesystem::path& src) = 0;
+
   virtual cpp::result<std::vector<OpenAi::File>, std::string> ListFiles(
       const std::string& purpose, uint8_t limit, const std::string& order,
       const std::string& after) const = 0;
@@ -22,6 +30,12 @@ class FileRepository {
   virtual cpp::result<std::pair<std::unique_ptr<char[]>, size_t>, std::string>
   RetrieveFileContentByPath(const std::string& path) const = 0;
 
+  /**
+   * Local path of a stored file, for reading it as a stream.
+   */
+  virtual cpp::result<std::filesystem::path, std::string> GetFileLocalPath(
+      const std::string& file_id) const = 0;
+
   virtual cpp::result<void, std::string> DeleteFileLocal(
       const std::string& file_id) = 0;
 
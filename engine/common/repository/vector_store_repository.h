@@ -0,0 +1,52 @@
+#pragma once
+
+#include <filesystem>
+#include "common/vector_store.h"
+#include "utils/result.hpp"
+
+class VectorStoreRepository {
+ public:
+  virtual cpp::result<void, std::string> CreateVectorStore(
+      OpenAi::VectorStore& store) = 0;
+
+  virtual cpp::result<std::vector<OpenAi::VectorStore>, std::string>
+  ListVectorStores(uint8_t limit, const std::string& order,
+                   const std::string& after) const = 0;
+
+  virtual cpp::result<OpenAi::VectorStore, std::string> RetrieveVectorStore(
+      const std::string& store_id) const = 0;
+
+  virtual cpp::result<void, std::string> ModifyVectorStore(
+      OpenAi::VectorStore& store) = 0;
+
+  virtual cpp::result<void, std::string> DeleteVectorStore(
+      const std::string& store_id) = 0;
+
+  virtual cpp::result<std::vector<OpenAi::VectorStoreFile>, std::string>
+  ListVectorStoreFiles(const std::string& store_id) const = 0;
+
+  virtual cpp::result<void, std::string> SaveVectorStoreFile(
+      OpenAi::VectorStoreFile& file) = 0;
+
+  virtual cpp::result<std::vector<OpenAi::VectorStoreChunk>, std::string>
+  LoadChunks(const std::string& store_id) const = 0;
+
+  virtual cpp::result<void, std::string> AppendChunks(
+      const std::string& store_id,
+      const std::vector<OpenAi::VectorStoreChunk>& chunks) = 0;
+
+  /**
+   * Drop every chunk after the first [count], used to realign the chunks with
+   * the vectors after an interrupted ingestion.
+   */
+  virtual cpp::result<void, std::string> TruncateChunks(
+      const std::string& store_id, size_t count) = 0;
+
+  /**
+   * Folder holding the vectors and index of a store.
+   */
+  virtual std::filesystem::path GetIndexPath(
+      const std::string& store_id) const = 0;
+
+  virtual ~VectorStoreRepository() = default;
+};
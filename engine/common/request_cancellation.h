@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+/**
+ * Cancellation of one inference request.
+ *
+ * The server cancels a request when its client goes away or its deadline
+ * passes. A request still waiting in the scheduler is then dropped instead
+ * of dispatched, and one the engine already runs is stopped through the
+ * callbacks registered with OnCancel, which target that request alone rather
+ * than every generation of the model.
+ */
+class RequestCancellation {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class Reason { kNone, kClientClosed, kDeadlineExceeded };
+
+  RequestCancellation(std::string request_id,
+                      std::optional<Clock::time_point> deadline)
+      : request_id_{std::move(request_id)}, deadline_{deadline} {}
+
+  RequestCancellation(const RequestCancellation&) = delete;
+  RequestCancellation& operator=(const RequestCancellation&) = delete;
+
+  // Passed to the engines as the "request_id" of the body
+  const std::string& request_id() const { return request_id_; }
+
+  std::optional<Clock::time_point> deadline() const { return deadline_; }
+
+  /**
+   * Cancel the request if its client is gone or its deadline passed. The
+   * reason is returned by the call which cancelled it only, kNone otherwise.
+   */
+  Reason Check(bool client_connected, Clock::time_point now = Clock::now()) {
+    if (!client_connected) {
+      return Cancel(Reason::kClientClosed) ? Reason::kClientClosed
+                                           : Reason::kNone;
+    }
+    if (deadline_ && now >= *deadline_) {
+      return Cancel(Reason::kDeadlineExceeded) ? Reason::kDeadlineExceeded
+                                               : Reason::kNone;
+    }
+    return Reason::kNone;
+  }
+
+  // False if the request was already cancelled
+  bool Cancel(Reason reason) {
+    auto expected = Reason::kNone;
+    if (reason == Reason::kNone ||
+        !reason_.compare_exchange_strong(expected, reason)) {
+      return false;
+    }
+    std::vector<std::function<void()>> callbacks;
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      callbacks.swap(callbacks_);
+    }
+    for (auto const& cb : callbacks) {
+      cb();
+    }
+    return true;
+  }
+
+  bool IsCancelled() const { return reason_.load() != Reason::kNone; }
+
+  Reason reason() const { return reason_.load(); }
+
+  // Status a cancelled request is answered with: 408 past its deadline, 499
+  // when its client went away
+  int status_code() const {
+    return reason() == Reason::kDeadlineExceeded ? 408 : 499;
+  }
+
+  std::string message() const {
+    return reason() == Reason::kDeadlineExceeded ? "Request deadline exceeded"
+                                                 : "Client closed request";
+  }
+
+  /**
+   * Run [cb] when the request is cancelled, right away if it already is.
+   */
+  void OnCancel(std::function<void()> cb) {
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      if (!IsCancelled()) {
+        callbacks_.push_back(std::move(cb));
+        return;
+      }
+    }
+    cb();
+  }
+
+ private:
+  std::string request_id_;
+  std::optional<Clock::time_point> deadline_;
+  std::atomic<Reason> reason_{Reason::kNone};
+  std::mutex mtx_;
+  std::vector<std::function<void()>> callbacks_;
+};
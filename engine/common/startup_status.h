@@ -0,0 +1,86 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace cortex {
+
+// Startup tasks
+constexpr const auto kHardwareStartupTask = "hardware";
+constexpr const auto kModelsStartupTask = "models";
+
+/**
+ * Tracks the startup work that runs after the server starts listening
+ * (hardware probing, model list indexing). The server is ready once every
+ * registered task has finished.
+ */
+class StartupStatus {
+ public:
+  StartupStatus(StartupStatus const&) = delete;
+  StartupStatus& operator=(StartupStatus const&) = delete;
+
+  static StartupStatus& GetInstance() {
+    static StartupStatus ss;
+    return ss;
+  }
+
+  void AddTask(const std::string& name) {
+    std::lock_guard<std::mutex> l(mtx_);
+    pending_.insert(name);
+  }
+
+  void FinishTask(const std::string& name) {
+    std::vector<std::function<void()>> waiters;
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      pending_.erase(name);
+      if (!pending_.empty()) {
+        return;
+      }
+      waiters.swap(waiters_);
+    }
+    for (auto const& w : waiters) {
+      w();
+    }
+  }
+
+  bool IsReady() const {
+    std::lock_guard<std::mutex> l(mtx_);
+    return pending_.empty();
+  }
+
+  bool IsPending(const std::string& name) const {
+    std::lock_guard<std::mutex> l(mtx_);
+    return pending_.count(name) > 0;
+  }
+
+  std::vector<std::string> GetPendingTasks() const {
+    std::lock_guard<std::mutex> l(mtx_);
+    return {pending_.begin(), pending_.end()};
+  }
+
+  /**
+   * Run [cb] once the server is ready, immediately if it already is.
+   */
+  void OnReady(std::function<void()> cb) {
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      if (!pending_.empty()) {
+        waiters_.push_back(std::move(cb));
+        return;
+      }
+    }
+    cb();
+  }
+
+ private:
+  StartupStatus() {}
+
+  mutable std::mutex mtx_;
+  std::set<std::string> pending_;
+  std::vector<std::function<void()>> waiters_;
+};
+}  // namespace cortex
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <json/value.h>
+#include <string>
+#include "common/json_serializable.h"
+
+namespace OpenAi {
+
+/**
+ * A vector store is a collection of processed files that can be used by
+ * the file_search tool.
+ */
+struct VectorStore : public JsonSerializable {
+  /**
+   * The identifier, which can be referenced in API endpoints.
+   */
+  std::string id;
+
+  /**
+   * The object type, which is always vector_store.
+   */
+  std::string object = "vector_store";
+
+  /**
+   * The Unix timestamp (in seconds) for when the vector store was created.
+   */
+  uint64_t created_at = 0;
+
+  /**
+   * The name of the vector store.
+   */
+  std::string name;
+
+  /**
+   * The total number of bytes used by the files in the vector store.
+   */
+  uint64_t usage_bytes = 0;
+
+  /**
+   * Number of files per status: in_progress, completed, failed, cancelled
+   * and total.
+   */
+  Json::Value file_counts;
+
+  /**
+   * The status of the vector store, which can be either expired,
+   * in_progress, or completed.
+   */
+  std::string status = "completed";
+
+  /**
+   * The embedding model used to embed the chunks of this store. Queries are
+   * embedded with the same model.
+   */
+  std::string embedding_model;
+
+  /**
+   * Maximum number of characters per chunk and the overlap between
+   * consecutive chunks.
+   */
+  uint32_t max_chunk_size_chars = 3200;
+  uint32_t chunk_overlap_chars = 800;
+
+  /**
+   * Set of 16 key-value pairs that can be attached to an object.
+   */
+  Json::Value metadata{Json::objectValue};
+
+  static cpp::result<VectorStore, std::string> FromJson(
+      const Json::Value& json) {
+    VectorStore store;
+    store.id = json["id"].asString();
+    store.created_at = json["created_at"].asUInt64();
+    store.name = json["name"].asString();
+    store.usage_bytes = json["usage_bytes"].asUInt64();
+    store.file_counts = json["file_counts"];
+    store.status = json.get("status", "completed").asString();
+    store.embedding_model = json["embedding_model"].asString();
+    store.max_chunk_size_chars =
+        json["chunking_strategy"]["static"]
+            .get("max_chunk_size_chars", store.max_chunk_size_chars)
+            .asUInt();
+    store.chunk_overlap_chars =
+        json["chunking_strategy"]["static"]
+            .get("chunk_overlap_chars", store.chunk_overlap_chars)
+            .asUInt();
+    if (json["metadata"].isObject()) {
+      store.metadata = json["metadata"];
+    }
+    return store;
+  }
+
+  cpp::result<Json::Value, std::string> ToJson() override {
+    Json::Value root;
+    root["id"] = id;
+    root["object"] = object;
+    root["created_at"] = created_at;
+    root["name"] = name;
+    root["usage_bytes"] = usage_bytes;
+    root["file_counts"] = file_counts;
+    root["status"] = status;
+    root["embedding_model"] = embedding_model;
+    root["chunking_strategy"]["type"] = "static";
+    root["chunking_strategy"]["static"]["max_chunk_size_chars"] =
+        max_chunk_size_chars;
+    root["chunking_strategy"]["static"]["chunk_overlap_chars"] =
+        chunk_overlap_chars;
+    root["metadata"] = metadata;
+    return root;
+  }
+};
+
+/**
+ * A file attached to a vector store.
+ */
+struct VectorStoreFile : public JsonSerializable {
+  /**
+   * The identifier of the file, same as the id in /v1/files.
+   */
+  std::string id;
+
+  /**
+   * The object type, which is always vector_store.file.
+   */
+  std::string object = "vector_store.file";
+
+  /**
+   * The total vector store usage in bytes.
+   */
+  uint64_t usage_bytes = 0;
+
+  /**
+   * The Unix timestamp (in seconds) for when the file was attached.
+   */
+  uint64_t created_at = 0;
+
+  /**
+   * The ID of the vector store that the file is attached to.
+   */
+  std::string vector_store_id;
+
+  /**
+   * The status of the file: in_progress, completed, cancelled or failed.
+   */
+  std::string status = "in_progress";
+
+  /**
+   * The last error of this file, null when there was none.
+   */
+  Json::Value last_error;
+
+  static cpp::result<VectorStoreFile, std::string> FromJson(
+      const Json::Value& json) {
+    VectorStoreFile file;
+    file.id = json["id"].asString();
+    file.usage_bytes = json["usage_bytes"].asUInt64();
+    file.created_at = json["created_at"].asUInt64();
+    file.vector_store_id = json["vector_store_id"].asString();
+    file.status = json.get("status", "in_progress").asString();
+    file.last_error = json["last_error"];
+    return file;
+  }
+
+  cpp::result<Json::Value, std::string> ToJson() override {
+    Json::Value root;
+    root["id"] = id;
+    root["object"] = object;
+    root["usage_bytes"] = usage_bytes;
+    root["created_at"] = created_at;
+    root["vector_store_id"] = vector_store_id;
+    root["status"] = status;
+    root["last_error"] = last_error;
+    return root;
+  }
+};
+
+/**
+ * A piece of a file's text, embedded as one vector. Chunks are stored in the
+ * order their vectors were added to the store's index.
+ */
+struct VectorStoreChunk {
+  std::string file_id;
+  std::string text;
+};
+}  // namespace OpenAi
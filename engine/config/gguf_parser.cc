@@ -169,7 +169,7 @@ size_t GGUFHandler::ReadArray(std::size_t offset, const std::string& key) {
   uint64_t array_length =
       *reinterpret_cast<const uint64_t*>(data_ + offset + 4);
   // std::memcpy(&array_length, data_ + offset + 4, sizeof(uint64_t));
-  LOG_INFO << "\n"
+  LOG_DEBUG << "\n"
            << "Parsing array type: " << array_type
            << ", array length:" << array_length << "\n";
   std::size_t array_offset = 12;
@@ -284,7 +284,7 @@ size_t GGUFHandler::ReadArray(std::size_t offset, const std::string& key) {
 
 void GGUFHandler::Parse(const std::string& file_path) {
   OpenFile(file_path);
-  LOG_INFO << "GGUF magic number: " << *reinterpret_cast<const uint32_t*>(data_)
+  LOG_DEBUG << "GGUF magic number: " << *reinterpret_cast<const uint32_t*>(data_)
            << "\n";
   if (*reinterpret_cast<const uint32_t*>(data_) != GGUF_MAGIC_NUMBER) {
     throw std::runtime_error("Not a valid GGUF file");
@@ -293,25 +293,29 @@ void GGUFHandler::Parse(const std::string& file_path) {
   version_ = *reinterpret_cast<const uint32_t*>(data_ + 4);
   tensor_count_ = *reinterpret_cast<const uint64_t*>(data_ + 8);
   uint64_t metadata_kv_count = *reinterpret_cast<const uint64_t*>(data_ + 16);
-  LOG_INFO << "version: " << version_ << "\ntensor count: " << tensor_count_
+  LOG_DEBUG << "version: " << version_ << "\ntensor count: " << tensor_count_
            << "\nmetadata key-value pairs: " << metadata_kv_count << "\n";
 
   std::size_t offset = 24;
 
   for (uint64_t i = 0; i < metadata_kv_count; ++i) {
-    LOG_INFO << "Parsing key-value number " << i << "\n";
+    LOG_DEBUG << "Parsing key-value number " << i << "\n";
     auto [key_byte_length, key] = ReadString(offset);
     offset += key_byte_length;
-    LOG_INFO << "key: " << key << "\n";
+    LOG_DEBUG << "key: " << key << "\n";
     uint32_t value_type = *reinterpret_cast<const uint32_t*>(data_ + offset);
     offset += 4;
-    LOG_INFO << "value type number: " << value_type << "\n";
+    LOG_DEBUG << "value type number: " << value_type << "\n";
     size_t value_byte_length = ReadMetadataValue(value_type, offset, key);
     offset += value_byte_length;
-    LOG_INFO << "-------------------------------------------- " << "\n";
+    LOG_DEBUG << "-------------------------------------------- " << "\n";
   }
+  // Dumping the metadata renders the chat template, only pay for it when
+  // the output is wanted
   try {
-    PrintMetadata();
+    if (trantor::Logger::logLevel() <= trantor::Logger::kDebug) {
+      PrintMetadata();
+    }
   } catch (const std::exception& e) {
     LOG_ERROR << "Error parsing metadata: " << e.what() << "\n";
   }
@@ -320,60 +324,60 @@ void GGUFHandler::Parse(const std::string& file_path) {
 }
 
 void GGUFHandler::PrintMetadata() {
-  LOG_INFO << "GGUF Metadata:" << "\n";
+  LOG_DEBUG << "GGUF Metadata:" << "\n";
   for (const auto& [key, value] : metadata_uint8_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_int8_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_uint16_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_int16_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_uint32_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_int32_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_float_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_bool_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_string_) {
 
     if (key.compare("tokenizer.chat_template") == 0) {
-      LOG_INFO << key << ": " << "\n" << value << "\n";
+      LOG_DEBUG << key << ": " << "\n" << value << "\n";
 
       std::vector<llama_chat_msg> messages{
           llama_chat_msg{"system", "{system_message}"},
           llama_chat_msg{"user", "{prompt}"}};
       std::string result = llama_chat_apply_template(value, messages, true);
-      LOG_INFO << "result jinja render: " << result << "\n";
+      LOG_DEBUG << "result jinja render: " << result << "\n";
     } else {
-      LOG_INFO << key << ": " << value << "\n";
+      LOG_DEBUG << key << ": " << value << "\n";
     }
   }
 
   for (const auto& [key, value] : metadata_uint64_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_int64_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_double_)
-    LOG_INFO << key << ": " << value << "\n";
+    LOG_DEBUG << key << ": " << value << "\n";
 
   for (const auto& [key, value] : metadata_array_float_)
-    LOG_INFO << key << "num elements: " << value.size() << "\n";
+    LOG_DEBUG << key << "num elements: " << value.size() << "\n";
 
   for (const auto& [key, value] : metadata_array_string_)
-    LOG_INFO << key << " num elements: " << value.size() << "\n";
+    LOG_DEBUG << key << " num elements: " << value.size() << "\n";
 }
 
 void GGUFHandler::ModelConfigFromMetadata() {
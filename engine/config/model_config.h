@@ -492,6 +492,10 @@ struct PythonModelConfig {
 
   // Model Load Parameters
   std::string port;
+  // "tcp" (default) or "unix" to serve the model over a Unix domain socket
+  std::string transport;
+  // number of processes serving the model, each on its own port or socket
+  int replicas = 1;
   std::string script;
   std::string log_path;
   std::string log_level;
@@ -543,6 +547,9 @@ struct PythonModelConfig {
 
     // Model Load Parameters
     out << YAML::Key << "port" << YAML::Value << port;
+    if (!transport.empty())
+      out << YAML::Key << "transport" << YAML::Value << transport;
+    out << YAML::Key << "replicas" << YAML::Value << replicas;
     out << YAML::Key << "script" << YAML::Value << script;
     out << YAML::Key << "log_path" << YAML::Value << log_path;
     out << YAML::Key << "log_level" << YAML::Value << log_level;
@@ -633,6 +640,10 @@ struct PythonModelConfig {
     auto mlp = config;
     if (mlp["port"])
       port = mlp["port"].as<std::string>();
+    if (mlp["transport"])
+      transport = mlp["transport"].as<std::string>();
+    if (mlp["replicas"])
+      replicas = mlp["replicas"].as<int>();
     if (mlp["script"])
       script = mlp["script"].as<std::string>();
     if (mlp["log_path"])
@@ -701,6 +712,9 @@ struct PythonModelConfig {
 
     // Model Load Parameters
     root["port"] = port;
+    if (!transport.empty())
+      root["transport"] = transport;
+    root["replicas"] = replicas;
     root["log_path"] = log_path;
     root["log_level"] = log_level;
     root["environment"] = environment;
@@ -770,6 +784,10 @@ struct PythonModelConfig {
     const Json::Value& mlp = root;
     if (mlp.isMember("port"))
       port = mlp["port"].asString();
+    if (mlp.isMember("transport"))
+      transport = mlp["transport"].asString();
+    if (mlp.isMember("replicas"))
+      replicas = mlp["replicas"].asInt();
     if (mlp.isMember("log_path"))
       log_path = mlp["log_path"].asString();
     if (mlp.isMember("log_level"))
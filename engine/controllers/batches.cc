@@ -0,0 +1,101 @@
+#include "batches.h"
+#include <algorithm>
+#include "utils/cortex_utils.h"
+#include "utils/logging_utils.h"
+
+namespace {
+constexpr const int kMaxListLimit = 100;
+
+HttpResponsePtr CreateErrorResponse(const std::string& message,
+                                    HttpStatusCode code = k400BadRequest) {
+  Json::Value ret;
+  ret["message"] = message;
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+  resp->setStatusCode(code);
+  return resp;
+}
+}  // namespace
+
+void Batches::CreateBatch(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  auto json_body = req->getJsonObject();
+  if (json_body == nullptr) {
+    callback(CreateErrorResponse("Request body can't be empty"));
+    return;
+  }
+  for (auto const& field : {"input_file_id", "endpoint"}) {
+    if (!(*json_body)[field].isString()) {
+      callback(CreateErrorResponse(std::string(field) + " is required"));
+      return;
+    }
+  }
+
+  auto res = batch_service_->CreateBatch(
+      (*json_body)["input_file_id"].asString(),
+      (*json_body)["endpoint"].asString(),
+      json_body->get("completion_window", "24h").asString(),
+      (*json_body)["metadata"]);
+  if (res.has_error()) {
+    callback(CreateErrorResponse(res.error()));
+    return;
+  }
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(res->ToJson().value());
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void Batches::ListBatches(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    std::optional<std::string> limit, std::optional<std::string> after) const {
+  auto n = std::clamp(std::stoi(limit.value_or("20")), 1, kMaxListLimit);
+  auto res = batch_service_->ListBatches(n, after.value_or(""));
+  if (res.has_error()) {
+    callback(CreateErrorResponse(res.error()));
+    return;
+  }
+
+  Json::Value data(Json::arrayValue);
+  for (auto& batch : res.value()) {
+    data.append(batch.ToJson().value());
+  }
+  Json::Value root;
+  root["object"] = "list";
+  root["data"] = data;
+  if (!res->empty()) {
+    root["first_id"] = res->front().id;
+    root["last_id"] = res->back().id;
+  }
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(root);
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void Batches::RetrieveBatch(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& batch_id) const {
+  auto res = batch_service_->RetrieveBatch(batch_id);
+  if (res.has_error()) {
+    callback(CreateErrorResponse(res.error(), k404NotFound));
+    return;
+  }
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(res->ToJson().value());
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void Batches::CancelBatch(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& batch_id) {
+  auto res = batch_service_->CancelBatch(batch_id);
+  if (res.has_error()) {
+    callback(CreateErrorResponse(res.error()));
+    return;
+  }
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(res->ToJson().value());
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <drogon/HttpController.h>
+#include <trantor/utils/Logger.h>
+#include <optional>
+#include "services/batch_service.h"
+
+using namespace drogon;
+
+class Batches : public drogon::HttpController<Batches, false> {
+ public:
+  METHOD_LIST_BEGIN
+  ADD_METHOD_TO(Batches::CreateBatch, "/v1/batches", Options, Post);
+
+  ADD_METHOD_TO(Batches::ListBatches, "/v1/batches?limit={limit}&after={after}",
+                Get);
+
+  ADD_METHOD_TO(Batches::RetrieveBatch, "/v1/batches/{batch_id}", Get);
+
+  ADD_METHOD_TO(Batches::CancelBatch, "/v1/batches/{batch_id}/cancel", Options,
+                Post);
+  METHOD_LIST_END
+
+  explicit Batches(std::shared_ptr<BatchService> batch_srv)
+      : batch_service_{batch_srv} {}
+
+  void CreateBatch(const HttpRequestPtr& req,
+                   std::function<void(const HttpResponsePtr&)>&& callback);
+
+  void ListBatches(const HttpRequestPtr& req,
+                   std::function<void(const HttpResponsePtr&)>&& callback,
+                   std::optional<std::string> limit,
+                   std::optional<std::string> after) const;
+
+  void RetrieveBatch(const HttpRequestPtr& req,
+                     std::function<void(const HttpResponsePtr&)>&& callback,
+                     const std::string& batch_id) const;
+
+  void CancelBatch(const HttpRequestPtr& req,
+                   std::function<void(const HttpResponsePtr&)>&& callback,
+                   const std::string& batch_id);
+
+ private:
+  std::shared_ptr<BatchService> batch_service_;
+};
@@ -11,6 +11,8 @@ using namespace drogon;
 using Event = cortex::event::Event;
 using ExitEvent = cortex::event::ExitEvent;
 using DownloadEvent = cortex::event::DownloadEvent;
+using BatchEvent = cortex::event::BatchEvent;
+using ImportEvent = cortex::event::ImportEvent;
 using EventType = cortex::event::EventType;
 using EventQueue =
     eventpp::EventQueue<EventType, void(const eventpp::AnyData<eventMaxSize>&)>;
@@ -28,6 +30,14 @@ class Events : public drogon::WebSocketController<Events, false> {
         EventType::DownloadEvent,
         [this](const DownloadEvent& e) { this->broadcast(e.ToJsonString()); });
 
+    event_queue_->appendListener(
+        EventType::BatchEvent,
+        [this](const BatchEvent& e) { this->broadcast(e.ToJsonString()); });
+
+    event_queue_->appendListener(
+        EventType::ImportEvent,
+        [this](const ImportEvent& e) { this->broadcast(e.ToJsonString()); });
+
     event_queue_->appendListener(
         EventType::ExitEvent,
         [this](const ExitEvent& e) { this->broadcast(e.message); });
@@ -1,9 +1,68 @@
 #include "health.h"
+#include <drogon/HttpAppFramework.h>
+#include <algorithm>
+#include <atomic>
+#include "common/startup_status.h"
 #include "utils/cortex_utils.h"
 
+namespace {
+// Upper bound for how long a readiness request may be held
+constexpr const int kMaxReadyWaitMs = 30000;
+
+HttpResponsePtr CreateReadinessResponse(bool ready) {
+  Json::Value ret;
+  ret["ready"] = ready;
+  Json::Value pending(Json::arrayValue);
+  for (auto const& t : cortex::StartupStatus::GetInstance().GetPendingTasks()) {
+    pending.append(t);
+  }
+  ret["pending"] = pending;
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+  resp->setStatusCode(ready ? k200OK : k503ServiceUnavailable);
+  return resp;
+}
+}  // namespace
+
 void health::asyncHandleHttpRequest(
     const HttpRequestPtr &req,
     std::function<void(const HttpResponsePtr &)> &&callback) {
+  // /healthz?ready reports whether the background startup work is done.
+  // With wait_ms the request is held until the server is ready or the wait
+  // expires, so clients don't have to poll.
+  if (!req->getParameter("ready").empty()) {
+    auto &startup = cortex::StartupStatus::GetInstance();
+    int wait_ms = 0;
+    try {
+      auto w = req->getParameter("wait_ms");
+      wait_ms = w.empty() ? 0 : std::min(std::stoi(w), kMaxReadyWaitMs);
+    } catch (const std::exception &e) {
+      wait_ms = 0;
+    }
+    if (wait_ms <= 0 || startup.IsReady()) {
+      callback(CreateReadinessResponse(startup.IsReady()));
+      return;
+    }
+
+    auto responded = std::make_shared<std::atomic<bool>>(false);
+    auto cb = std::make_shared<std::function<void(const HttpResponsePtr &)>>(
+        std::move(callback));
+    auto loop = drogon::app().getLoop();
+    startup.OnReady([responded, cb, loop] {
+      loop->queueInLoop([responded, cb] {
+        if (!responded->exchange(true)) {
+          (*cb)(CreateReadinessResponse(true));
+        }
+      });
+    });
+    loop->runAfter(wait_ms / 1000.0, [responded, cb] {
+      if (!responded->exchange(true)) {
+        (*cb)(CreateReadinessResponse(
+            cortex::StartupStatus::GetInstance().IsReady()));
+      }
+    });
+    return;
+  }
+
   auto resp = cortex_utils::CreateCortexHttpResponse();
   resp->setStatusCode(k200OK);
   resp->setContentTypeCode(CT_TEXT_HTML);
@@ -2,7 +2,7 @@
 #include <drogon/HttpTypes.h>
 #include <filesystem>
 #include <optional>
-#include "config/gguf_parser.h"
+#include "common/startup_status.h"
 #include "config/yaml_config.h"
 #include "models.h"
 #include "trantor/utils/Logger.h"
@@ -13,14 +13,6 @@
 #include "utils/logging_utils.h"
 #include "utils/string_utils.h"
 
-namespace {
-std::string ToJsonStringWithPrecision(Json::Value& input, int precision = 2) {
-  Json::StreamWriterBuilder wbuilder;
-  wbuilder.settings_["precision"] = 2;
-  return Json::writeString(wbuilder, input);
-}
-}  // namespace
-
 void Models::PullModel(const HttpRequestPtr& req,
                        std::function<void(const HttpResponsePtr&)>&& callback) {
   if (!http_util::HasFieldInReq(req, callback, "model")) {
@@ -171,97 +163,60 @@ void Models::AbortPullModel(
 void Models::ListModel(
     const HttpRequestPtr& req,
     std::function<void(const HttpResponsePtr&)>&& callback) const {
-  namespace fs = std::filesystem;
-  namespace fmu = file_manager_utils;
-  Json::Value ret;
-  ret["object"] = "list";
-  Json::Value data(Json::arrayValue);
-  model_service_->ForceIndexingModelList();
-  // Iterate through directory
-
-  config::YamlHandler yaml_handler;
-
-  auto list_entry = db_service_->LoadModelList();
-  if (list_entry) {
-    for (const auto& model_entry : list_entry.value()) {
-      try {
-        if (model_entry.status == cortex::db::ModelStatus::Downloadable) {
-          Json::Value obj;
-          obj["id"] = model_entry.model;
-          obj["model"] = model_entry.model;
-          auto status_to_string = [](cortex::db::ModelStatus status) {
-            switch (status) {
-              case cortex::db::ModelStatus::Remote:
-                return "remote";
-              case cortex::db::ModelStatus::Downloaded:
-                return "downloaded";
-              case cortex::db::ModelStatus::Downloadable:
-                return "downloadable";
-            }
-            return "unknown";
-          };
-          obj["modelSource"] = model_entry.model_source;
-          obj["status"] = status_to_string(model_entry.status);
-          obj["engine"] = model_entry.engine;
-          obj["metadata"] = model_entry.metadata;
-          data.append(std::move(obj));
-          continue;
-        }
-        yaml_handler.ModelConfigFromFile(
-            fmu::ToAbsoluteCortexDataPath(
-                fs::path(model_entry.path_to_model_yaml))
-                .string());
-        auto model_config = yaml_handler.GetModelConfig();
-
-        if (!engine_service_->IsRemoteEngine(model_config.engine)) {
-          Json::Value obj = model_config.ToJson();
-          obj["id"] = model_entry.model;
-          obj["model"] = model_entry.model;
-          obj["status"] = "downloaded";
-          auto es = model_service_->GetEstimation(model_entry.model);
-          if (es.has_value() && !!es.value()) {
-            obj["recommendation"] = hardware::ToJson(*(es.value()));
-          }
-          data.append(std::move(obj));
-          yaml_handler.Reset();
-        } else if (model_config.engine == kPythonEngine) {
-          config::PythonModelConfig python_model_config;
-          python_model_config.ReadFromYaml(
-              fmu::ToAbsoluteCortexDataPath(
-                  fs::path(model_entry.path_to_model_yaml))
-                  .string());
-          Json::Value obj = python_model_config.ToJson();
-          obj["id"] = model_entry.model;
-          obj["model"] = model_entry.model;
-          data.append(std::move(obj));
-        } else {
-          config::RemoteModelConfig remote_model_config;
-          remote_model_config.LoadFromYamlFile(
-              fmu::ToAbsoluteCortexDataPath(
-                  fs::path(model_entry.path_to_model_yaml))
-                  .string());
-          Json::Value obj = remote_model_config.ToJson();
-          obj["id"] = model_entry.model;
-          obj["model"] = model_entry.model;
-          data.append(std::move(obj));
-        }
-      } catch (const std::exception& e) {
-        LOG_ERROR << "Failed to load yaml file for model: "
-                  << model_entry.path_to_model_yaml << ", error: " << e.what();
+  ModelCatalog::Query query;
+  try {
+    auto param = [&req](const std::string& key) -> std::optional<std::string> {
+      auto value = req->getParameter(key);
+      if (value.empty()) {
+        return std::nullopt;
       }
+      return value;
+    };
+    query.engine = param("engine");
+    query.status = param("status");
+    query.source = param("source");
+    if (auto v = param("min_size")) {
+      query.min_size = std::stoull(*v);
+    }
+    if (auto v = param("max_size")) {
+      query.max_size = std::stoull(*v);
     }
+    query.after = param("after").value_or("");
+    if (auto v = param("limit")) {
+      query.limit = std::stoul(*v);
+    }
+  } catch (const std::exception& e) {
+    Json::Value ret;
+    ret["object"] = "list";
+    ret["data"] = Json::Value(Json::arrayValue);
+    ret["result"] = "Fail to get list model information";
+    ret["message"] = "Invalid query parameter: " + std::string(e.what());
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k400BadRequest);
+    callback(resp);
+    return;
+  }
 
-    ret["data"] = data;
-    ret["result"] = "OK";
-    auto ret_str = ToJsonStringWithPrecision(ret);
-    auto resp = cortex_utils::CreateCortexHttpTextAsJsonResponse(ret_str);
+  auto list = model_service_->ListModels(query);
+  if (list.has_value()) {
+    if (req->getHeader("If-None-Match") == list->etag) {
+      auto resp = HttpResponse::newHttpResponse();
+      resp->setStatusCode(k304NotModified);
+      resp->addHeader("ETag", list->etag);
+      callback(resp);
+      return;
+    }
+    auto resp = cortex_utils::CreateCortexHttpTextAsJsonResponse(list->body);
+    resp->addHeader("ETag", list->etag);
     resp->setStatusCode(k200OK);
     callback(resp);
   } else {
-    std::string message = "Fail to get list model information: " +
-                          std::string(list_entry.error());
+    std::string message =
+        "Fail to get list model information: " + std::string(list.error());
     LOG_ERROR << message;
-    ret["data"] = data;
+    Json::Value ret;
+    ret["object"] = "list";
+    ret["data"] = Json::Value(Json::arrayValue);
     ret["result"] = "Fail to get list model information";
     ret["message"] = message;
     auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
@@ -398,6 +353,7 @@ void Models::UpdateModel(const HttpRequestPtr& req,
       message = "Successfully update model ID '" + model_id +
                 "': " + json_body.toStyledString();
     }
+    model_service_->InvalidateModelCatalog(model_id);
     LOG_INFO << message;
     Json::Value ret;
     ret["result"] = "Updated successfully!";
@@ -426,8 +382,6 @@ void Models::UpdateModel(const HttpRequestPtr& req,
 void Models::ImportModel(
     const HttpRequestPtr& req,
     std::function<void(const HttpResponsePtr&)>&& callback) const {
-  namespace fs = std::filesystem;
-  namespace fmu = file_manager_utils;
   if (!http_util::HasFieldInReq(req, callback, "model") ||
       !http_util::HasFieldInReq(req, callback, "modelPath")) {
     return;
@@ -436,89 +390,75 @@ void Models::ImportModel(
   auto modelPath = (*(req->getJsonObject())).get("modelPath", "").asString();
   auto modelName = (*(req->getJsonObject())).get("name", "").asString();
   auto option = (*(req->getJsonObject())).get("option", "symlink").asString();
-  config::GGUFHandler gguf_handler;
-  config::YamlHandler yaml_handler;
-  std::string model_yaml_path = (file_manager_utils::GetModelsContainerPath() /
-                                 std::filesystem::path("imported") /
-                                 std::filesystem::path(modelHandle + ".yml"))
-                                    .string();
-
-  try {
-    // Use relative path for model_yaml_path. In case of import, we use absolute path for model
-    auto yaml_rel_path =
-        fmu::ToRelativeCortexDataPath(fs::path(model_yaml_path));
-    cortex::db::ModelEntry model_entry{
-        modelHandle, "",      "",         yaml_rel_path.string(),
-        modelHandle, "local", "imported", cortex::db::ModelStatus::Downloaded,
-        ""};
-
-    std::filesystem::create_directories(
-        std::filesystem::path(model_yaml_path).parent_path());
-    gguf_handler.Parse(modelPath);
-    config::ModelConfig model_config = gguf_handler.GetModelConfig();
-    // There are 2 options: symlink and copy
-    if (option == "copy") {
-      // Copy GGUF file to the destination path
-      std::filesystem::path file_path =
-          std::filesystem::path(model_yaml_path).parent_path() /
-          std::filesystem::path(modelPath).filename();
-      std::filesystem::copy_file(
-          modelPath, file_path, std::filesystem::copy_options::update_existing);
-      model_config.files.push_back(file_path.string());
-      auto size = std::filesystem::file_size(file_path);
-      model_config.size = size;
-    } else {
-      model_config.files.push_back(modelPath);
-      auto size = std::filesystem::file_size(modelPath);
-      model_config.size = size;
-
-      // set this so that it doesn't nuke the original file on model deletion
-      model_entry.branch_name = "imported";
-    }
-    model_config.model = modelHandle;
-    model_config.name = modelName.empty() ? model_config.name : modelName;
-    yaml_handler.UpdateModelConfig(model_config);
-
-    if (db_service_->AddModelEntry(model_entry).value()) {
-      yaml_handler.WriteYamlFile(model_yaml_path);
-      std::string success_message = "Model is imported successfully!";
-      LOG_INFO << success_message;
-      Json::Value ret;
-      ret["result"] = "OK";
-      ret["modelHandle"] = modelHandle;
-      ret["message"] = success_message;
-      auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
-      resp->setStatusCode(k200OK);
-      callback(resp);
 
-    } else {
-      std::string error_message = "Fail to import model, model_id '" +
-                                  modelHandle + "' already exists!";
-      LOG_ERROR << error_message;
-      Json::Value ret;
-      ret["result"] = "Import failed!";
-      ret["modelHandle"] = modelHandle;
-      ret["message"] = error_message;
-
-      auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
-      resp->setStatusCode(k400BadRequest);
-      callback(resp);
-    }
-
-  } catch (const std::exception& e) {
-    std::string error_message = "Error importing model path '" + modelPath +
-                                "' with model_id '" + modelHandle +
-                                "': " + e.what();
+  auto fail = [&](const std::string& error_message) {
     LOG_ERROR << error_message;
     Json::Value ret;
     ret["result"] = "Import failed!";
     ret["modelHandle"] = modelHandle;
     ret["message"] = error_message;
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k400BadRequest);
+    callback(resp);
+  };
 
+  // There are 2 options: symlink and copy. A copy can take minutes, it runs
+  // in the background and is followed on /events.
+  if (option == "copy") {
+    auto task = model_import_service_->StartCopyImport(modelHandle, modelPath,
+                                                       modelName);
+    if (task.has_error()) {
+      fail(task.error());
+      return;
+    }
+    Json::Value ret;
+    ret["result"] = "OK";
+    ret["modelHandle"] = modelHandle;
+    ret["message"] = "Model import started";
+    ret["task"] = task->ToJson();
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(k202Accepted);
+    callback(resp);
+    return;
+  }
+
+  auto res =
+      model_import_service_->ImportLinked(modelHandle, modelPath, modelName);
+  if (res.has_error()) {
+    fail(res.error());
+    return;
+  }
+  Json::Value ret;
+  ret["result"] = "OK";
+  ret["modelHandle"] = modelHandle;
+  ret["message"] = "Model is imported successfully!";
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void Models::AbortImportModel(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) const {
+  if (!http_util::HasFieldInReq(req, callback, "taskId")) {
+    return;
+  }
+  auto task_id = (*(req->getJsonObject())).get("taskId", "").asString();
+  auto result = model_import_service_->AbortImport(task_id);
+  if (result.has_error()) {
+    Json::Value ret;
+    ret["message"] = result.error();
     auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
     resp->setStatusCode(k400BadRequest);
     callback(resp);
+    return;
   }
+  Json::Value ret;
+  ret["message"] = "Import stopped successfully";
+  ret["task"] = result->ToJson();
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+  resp->setStatusCode(k200OK);
+  callback(resp);
 }
 
 void Models::StartModel(
@@ -579,6 +519,17 @@ void Models::StartModel(
     callback(resp);
     return;
   }
+  if (!engine_service_->IsRemoteEngine(engine_name) &&
+      cortex::StartupStatus::GetInstance().IsPending(
+          cortex::kHardwareStartupTask)) {
+    Json::Value ret;
+    ret["message"] = "Hardware detection is still running, retry once "
+                     "/healthz?ready reports ready";
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+    resp->setStatusCode(drogon::k503ServiceUnavailable);
+    callback(resp);
+    return;
+  }
 
   auto result = model_service_->StartModel(
       model_handle, *(req->getJsonObject()) /*params_override*/,
@@ -3,6 +3,7 @@
 #include <drogon/HttpController.h>
 #include <trantor/utils/Logger.h>
 #include "services/engine_service.h"
+#include "services/model_import_service.h"
 #include "services/model_service.h"
 #include "services/model_source_service.h"
 
@@ -18,6 +19,7 @@ class Models : public drogon::HttpController<Models, false> {
   METHOD_ADD(Models::GetModel, "/{1}", Get);
   METHOD_ADD(Models::UpdateModel, "/{1}", Options, Patch);
   METHOD_ADD(Models::ImportModel, "/import", Options, Post);
+  METHOD_ADD(Models::AbortImportModel, "/import", Options, Delete);
   METHOD_ADD(Models::DeleteModel, "/{1}", Options, Delete);
   METHOD_ADD(Models::StartModel, "/start", Options, Post);
   METHOD_ADD(Models::StopModel, "/stop", Options, Post);
@@ -34,6 +36,8 @@ class Models : public drogon::HttpController<Models, false> {
   ADD_METHOD_TO(Models::GetModel, "/v1/models/{1}", Get);
   ADD_METHOD_TO(Models::UpdateModel, "/v1/models/{1}", Options, Patch);
   ADD_METHOD_TO(Models::ImportModel, "/v1/models/import", Options, Post);
+  ADD_METHOD_TO(Models::AbortImportModel, "/v1/models/import", Options,
+                Delete);
   ADD_METHOD_TO(Models::DeleteModel, "/v1/models/{1}", Options, Delete);
   ADD_METHOD_TO(Models::StartModel, "/v1/models/start", Options, Post);
   ADD_METHOD_TO(Models::StopModel, "/v1/models/stop", Options, Post);
@@ -49,11 +53,13 @@ class Models : public drogon::HttpController<Models, false> {
   explicit Models(std::shared_ptr<DatabaseService> db_service,
                   std::shared_ptr<ModelService> model_service,
                   std::shared_ptr<EngineService> engine_service,
-                  std::shared_ptr<ModelSourceService> mss)
+                  std::shared_ptr<ModelSourceService> mss,
+                  std::shared_ptr<ModelImportService> model_import_service)
       : db_service_(db_service),
         model_service_{model_service},
         engine_service_{engine_service},
-        model_src_svc_(mss) {}
+        model_src_svc_(mss),
+        model_import_service_{model_import_service} {}
 
   void PullModel(const HttpRequestPtr& req,
                  std::function<void(const HttpResponsePtr&)>&& callback);
@@ -73,6 +79,9 @@ class Models : public drogon::HttpController<Models, false> {
   void ImportModel(
       const HttpRequestPtr& req,
       std::function<void(const HttpResponsePtr&)>&& callback) const;
+  void AbortImportModel(
+      const HttpRequestPtr& req,
+      std::function<void(const HttpResponsePtr&)>&& callback) const;
   void AddRemoteModel(
       const HttpRequestPtr& req,
       std::function<void(const HttpResponsePtr&)>&& callback) const;
@@ -116,4 +125,5 @@ class Models : public drogon::HttpController<Models, false> {
   std::shared_ptr<ModelService> model_service_;
   std::shared_ptr<EngineService> engine_service_;
   std::shared_ptr<ModelSourceService> model_src_svc_;
+  std::shared_ptr<ModelImportService> model_import_service_;
 };
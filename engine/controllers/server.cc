@@ -1,11 +1,122 @@
 #include "server.h"
 
+#include <iomanip>
+#include <sstream>
+#include "trantor/net/EventLoop.h"
 #include "trantor/utils/Logger.h"
 #include "utils/cortex_utils.h"
 #include "utils/function_calling/common.h"
+#include "utils/ulid_generator.h"
 
 using namespace inferences;
 
+namespace {
+constexpr const auto kPriorityHeader = "X-Cortex-Priority";
+constexpr const auto kClientIdHeader = "X-Cortex-Client-Id";
+constexpr const auto kDeadlineHeader = "X-Cortex-Deadline-Ms";
+constexpr const auto kSessionIdHeader = "X-Cortex-Session-Id";
+constexpr const auto kServerTimingHeader = "Server-Timing";
+// How often a pending non-stream request checks its client and deadline
+constexpr const auto kWatchInterval = std::chrono::milliseconds(100);
+// Not a standard status, the nginx convention for a client gone away
+constexpr const auto kClientClosedRequest = static_cast<HttpStatusCode>(499);
+
+// Stands in for an API key as the client id, which is kept by the scheduler
+// and written to its logs. FNV-1a is no secure hash but the keys are long
+// random strings, it's enough not to show them.
+std::string ApiKeyClientId(const std::string& key) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  std::ostringstream ss;
+  ss << "key_" << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return ss.str();
+}
+
+SchedulingOptions GetSchedulingOptions(const HttpRequestPtr& req) {
+  SchedulingOptions options;
+  options.priority = RequestPriorityFromString(req->getHeader(kPriorityHeader));
+
+  // Fairness is keyed on the caller: explicit client id, then a hash of the
+  // API key, then the peer address
+  options.client_id = req->getHeader(kClientIdHeader);
+  if (options.client_id.empty()) {
+    auto auth = req->getHeader("Authorization");
+    if (auto pos = auth.find("Bearer ");
+        pos != std::string::npos && pos + 7 < auth.size()) {
+      options.client_id = ApiKeyClientId(auth.substr(pos + 7));
+    }
+  }
+  if (options.client_id.empty()) {
+    options.client_id = req->getPeerAddr().toIp();
+  }
+
+  if (auto deadline = req->getHeader(kDeadlineHeader); !deadline.empty()) {
+    try {
+      auto ms = std::stoll(deadline);
+      if (ms > 0) {
+        options.deadline = std::chrono::steady_clock::now() +
+                           std::chrono::milliseconds(ms);
+      }
+    } catch (const std::exception& e) {
+      LOG_WARN << "Invalid " << kDeadlineHeader << " header: " << deadline;
+    }
+  }
+  // `timeout` in the body, in seconds, the earliest deadline wins
+  if (auto body = req->getJsonObject();
+      body && body->isMember("timeout") && (*body)["timeout"].isNumeric()) {
+    auto timeout_s = (*body)["timeout"].asDouble();
+    if (timeout_s > 0) {
+      auto deadline =
+          std::chrono::steady_clock::now() +
+          std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(timeout_s));
+      if (!options.deadline || deadline < *options.deadline) {
+        options.deadline = deadline;
+      }
+    }
+  }
+
+  options.cancellation = std::make_shared<RequestCancellation>(
+      "req_" + ulid::GenerateUlid(), options.deadline);
+
+  // Turns of a thread share a session unless the caller names one
+  options.session_id = req->getHeader(kSessionIdHeader);
+  if (auto body = req->getJsonObject();
+      options.session_id.empty() && body && body->isMember("thread_id")) {
+    options.session_id = (*body)["thread_id"].asString();
+  }
+  return options;
+}
+
+HttpResponsePtr CreateMessageResponse(HttpStatusCode status_code,
+                                      const std::string& message) {
+  Json::Value res;
+  res["message"] = message;
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(res);
+  resp->setStatusCode(status_code);
+  return resp;
+}
+
+// Retry-After of a request the scheduler rejected
+void AddRetryAfter(const HttpResponsePtr& resp, const Json::Value& status) {
+  if (status.isMember("retry_after")) {
+    resp->addHeader("Retry-After",
+                    std::to_string(status["retry_after"].asInt()));
+  }
+}
+
+HttpResponsePtr CreateErrorResponse(const InferResult& err) {
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(std::get<1>(err));
+  resp->setStatusCode(
+      static_cast<HttpStatusCode>(std::get<0>(err)["status_code"].asInt()));
+  AddRetryAfter(resp, std::get<0>(err));
+  return resp;
+}
+}  // namespace
+
 namespace inferences {
 
 server::server(std::shared_ptr<InferenceService> inference_service,
@@ -25,15 +136,21 @@ void server::ChatCompletion(
     const HttpRequestPtr& req,
     std::function<void(const HttpResponsePtr&)>&& callback) {
   LOG_DEBUG << "Start chat completion";
+  auto trace = inference_svc_->StartTrace("chat_completion");
+  trace->Begin(RequestTrace::kParse);
   auto json_body = req->getJsonObject();
   if (json_body == nullptr) {
     Json::Value ret;
     ret["message"] = "Body can't be empty";
     auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
     resp->setStatusCode(k400BadRequest);
+    trace->End(RequestTrace::kParse);
+    resp->addHeader(kServerTimingHeader, trace->ServerTiming());
+    inference_svc_->FinishTrace(trace);
     callback(resp);
     return;
   }
+  trace->End(RequestTrace::kParse);
   bool is_stream = (*json_body).get("stream", false).asBool();
   auto model_id = (*json_body).get("model", "invalid_model").asString();
   auto engine_type = [this, &json_body]() -> std::string {
@@ -44,27 +161,32 @@ void server::ChatCompletion(
     }
   }();
 
+  trace->Begin(RequestTrace::kResolve);
   if (auto efm = inference_svc_->GetEngineByModelId(model_id); !efm.empty()) {
     engine_type = efm;
     (*json_body)["engine"] = efm;
   }
+  trace->End(RequestTrace::kResolve);
 
   LOG_DEBUG << "request body: " << json_body->toStyledString();
   auto q = std::make_shared<SyncQueue>();
-  auto ir = inference_svc_->HandleChatCompletion(q, json_body);
+  auto options = GetSchedulingOptions(req);
+  options.trace = trace;
+  auto ir = inference_svc_->HandleChatCompletion(q, json_body, options);
   if (ir.has_error()) {
-    auto err = ir.error();
-    auto resp = cortex_utils::CreateCortexHttpJsonResponse(std::get<1>(err));
-    resp->setStatusCode(
-        static_cast<HttpStatusCode>(std::get<0>(err)["status_code"].asInt()));
+    auto resp = CreateErrorResponse(ir.error());
+    resp->addHeader(kServerTimingHeader, trace->ServerTiming());
+    inference_svc_->FinishTrace(trace);
     callback(resp);
     return;
   }
   LOG_DEBUG << "Wait to chat completion responses";
   if (is_stream) {
-    ProcessStreamRes(std::move(callback), q, engine_type, model_id);
+    ProcessStreamRes(std::move(callback), q, engine_type, model_id,
+                     options.cancellation, trace);
   } else {
-    ProcessNonStreamRes(std::move(callback), *q);
+    ProcessNonStreamRes(std::move(callback), q, req, options.cancellation,
+                        trace);
   }
   LOG_DEBUG << "Done chat completion";
 }
@@ -73,17 +195,14 @@ void server::Embedding(const HttpRequestPtr& req,
                        std::function<void(const HttpResponsePtr&)>&& callback) {
   LOG_TRACE << "Start embedding";
   auto q = std::make_shared<SyncQueue>();
-  auto ir = inference_svc_->HandleEmbedding(q, req->getJsonObject());
+  auto ir = inference_svc_->HandleEmbedding(q, req->getJsonObject(),
+                                            GetSchedulingOptions(req));
   if (ir.has_error()) {
-    auto err = ir.error();
-    auto resp = cortex_utils::CreateCortexHttpJsonResponse(std::get<1>(err));
-    resp->setStatusCode(
-        static_cast<HttpStatusCode>(std::get<0>(err)["status_code"].asInt()));
-    callback(resp);
+    callback(CreateErrorResponse(ir.error()));
     return;
   }
   LOG_TRACE << "Wait to embedding";
-  ProcessNonStreamRes(std::move(callback), *q);
+  ProcessNonStreamRes(std::move(callback), q);
   LOG_TRACE << "Done embedding";
 }
 
@@ -132,6 +251,35 @@ void server::FineTuning(
   LOG_TRACE << "Done fine-tuning";
 }
 
+void server::Tokenize(const HttpRequestPtr& req,
+                      std::function<void(const HttpResponsePtr&)>&& callback) {
+  auto ir = inference_svc_->Tokenize(req->getJsonObject());
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(std::get<1>(ir));
+  resp->setStatusCode(
+      static_cast<HttpStatusCode>(std::get<0>(ir)["status_code"].asInt()));
+  callback(resp);
+}
+
+void server::Detokenize(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  auto ir = inference_svc_->Detokenize(req->getJsonObject());
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(std::get<1>(ir));
+  resp->setStatusCode(
+      static_cast<HttpStatusCode>(std::get<0>(ir)["status_code"].asInt()));
+  callback(resp);
+}
+
+void server::CountTokens(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  auto ir = inference_svc_->CountTokens(req->getJsonObject());
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(std::get<1>(ir));
+  resp->setStatusCode(
+      static_cast<HttpStatusCode>(std::get<0>(ir)["status_code"].asInt()));
+  callback(resp);
+}
+
 void server::Inference(const HttpRequestPtr& req,
                        std::function<void(const HttpResponsePtr&)>&& callback) {
 
@@ -139,14 +287,12 @@ void server::Inference(const HttpRequestPtr& req,
 
   LOG_TRACE << "Start inference";
   auto q = std::make_shared<SyncQueue>();
-  auto ir = inference_svc_->HandleInference(q, req->getJsonObject());
+  auto options = GetSchedulingOptions(req);
+  auto ir =
+      inference_svc_->HandleInference(q, req->getJsonObject(), options);
   LOG_DEBUG << "request: " << req->getJsonObject()->toStyledString();
   if (ir.has_error()) {
-    auto err = ir.error();
-    auto resp = cortex_utils::CreateCortexHttpJsonResponse(std::get<1>(err));
-    resp->setStatusCode(
-        static_cast<HttpStatusCode>(std::get<0>(err)["status_code"].asInt()));
-    callback(resp);
+    callback(CreateErrorResponse(ir.error()));
     return;
   }
 
@@ -155,18 +301,18 @@ void server::Inference(const HttpRequestPtr& req,
       (*json_body).get("body", Json::Value()).get("stream", false).asBool();
 
   LOG_TRACE << "Wait to inference";
+  auto model_id = (*json_body).get("model", "invalid_model").asString();
+  auto engine_type = [this, &json_body]() -> std::string {
+    if (!inference_svc_->HasFieldInReq(json_body, "engine")) {
+      return kLlamaRepo;
+    } else {
+      return (*(json_body)).get("engine", kLlamaRepo).asString();
+    }
+  }();
   if (is_stream) {
-    auto model_id = (*json_body).get("model", "invalid_model").asString();
-    auto engine_type = [this, &json_body]() -> std::string {
-      if (!inference_svc_->HasFieldInReq(json_body, "engine")) {
-        return kLlamaRepo;
-      } else {
-        return (*(json_body)).get("engine", kLlamaRepo).asString();
-      }
-    }();
-    ProcessStreamRes(callback, q, engine_type, model_id);
+    ProcessStreamRes(callback, q, engine_type, model_id, options.cancellation);
   } else {
-    ProcessNonStreamRes(callback, *q);
+    ProcessNonStreamRes(callback, q, req, options.cancellation);
     LOG_TRACE << "Done  inference";
   }
 }
@@ -205,7 +351,7 @@ void server::RouteRequest(
     }();
     ProcessStreamRes(callback, q, engine_type, model_id);
   } else {
-    ProcessNonStreamRes(callback, *q);
+    ProcessNonStreamRes(callback, q);
     LOG_TRACE << "Done route request";
   }
 }
@@ -223,16 +369,27 @@ void server::LoadModel(const HttpRequestPtr& req,
 void server::ProcessStreamRes(std::function<void(const HttpResponsePtr&)> cb,
                               std::shared_ptr<SyncQueue> q,
                               const std::string& engine_type,
-                              const std::string& model_id) {
+                              const std::string& model_id,
+                              std::shared_ptr<RequestCancellation> cancellation,
+                              std::shared_ptr<RequestTrace> trace) {
   auto err_or_done = std::make_shared<std::atomic_bool>(false);
-  auto chunked_content_provider = [this, q, err_or_done, engine_type, model_id](
+  auto deadline = cancellation ? cancellation->deadline() : std::nullopt;
+  auto chunked_content_provider = [this, q, err_or_done, engine_type, model_id,
+                                   cancellation, deadline, trace](
                                       char* buf,
                                        std::size_t buf_size) -> std::size_t {
     if (buf == nullptr) {
       LOG_TRACE << "Buf is null";
       if (!(*err_or_done)) {
-        inference_svc_->StopInferencing(engine_type, model_id);
+        // the client went away, stop this request only when it can be
+        // told apart from the other requests of the model
+        if (cancellation) {
+          cancellation->Cancel(RequestCancellation::Reason::kClientClosed);
+        } else {
+          inference_svc_->StopInferencing(engine_type, model_id);
+        }
       }
+      inference_svc_->FinishTrace(trace);
       return 0;
     }
 
@@ -241,7 +398,21 @@ void server::ProcessStreamRes(std::function<void(const HttpResponsePtr&)> cb,
       return 0;
     }
 
-    auto [status, res] = q->wait_and_pop();
+    auto next = deadline ? q->wait_and_pop_until(*deadline)
+                         : std::optional<InferResult>(q->wait_and_pop());
+    if (!next) {
+      LOG_INFO << "Request deadline exceeded, stop generating "
+               << cancellation->request_id() << " of " << model_id;
+      cancellation->Cancel(RequestCancellation::Reason::kDeadlineExceeded);
+      Json::Value status;
+      status["status_code"] = k408RequestTimeout;
+      status["has_error"] = true;
+      status["is_done"] = true;
+      Json::Value res;
+      res["message"] = "Request deadline exceeded";
+      next = std::make_pair(status, res);
+    }
+    auto& [status, res] = *next;
 
     if (status["has_error"].asBool() || status["is_done"].asBool()) {
       *err_or_done = true;
@@ -256,6 +427,13 @@ void server::ProcessStreamRes(std::function<void(const HttpResponsePtr&)> cb,
     LOG_DEBUG << "data: " << str;
     std::size_t n = std::min(str.size(), buf_size);
     memcpy(buf, str.data(), n);
+    if (trace) {
+      trace->Begin(RequestTrace::kStream);
+      if (*err_or_done) {
+        trace->End(RequestTrace::kStream);
+        inference_svc_->FinishTrace(trace);
+      }
+    }
 
     return n;
   };
@@ -265,15 +443,84 @@ void server::ProcessStreamRes(std::function<void(const HttpResponsePtr&)> cb,
   cb(resp);
 }
 
-void server::ProcessNonStreamRes(std::function<void(const HttpResponsePtr&)> cb,
-                                 SyncQueue& q) {
-  auto [status, res] = q.wait_and_pop();
-  function_calling_utils::PostProcessResponse(res);
-  LOG_DEBUG << "response: " << res.toStyledString();
-  auto resp = cortex_utils::CreateCortexHttpJsonResponse(res);
-  resp->setStatusCode(
-      static_cast<drogon::HttpStatusCode>(status["status_code"].asInt()));
-  cb(resp);
+void server::ProcessNonStreamRes(
+    std::function<void(const HttpResponsePtr&)> cb,
+    std::shared_ptr<SyncQueue> q, const HttpRequestPtr& req,
+    std::shared_ptr<RequestCancellation> cancellation,
+    std::shared_ptr<RequestTrace> trace) {
+  auto to_response = [](InferResult result) {
+    auto& [status, res] = result;
+    function_calling_utils::PostProcessResponse(res);
+    LOG_DEBUG << "response: " << res.toStyledString();
+    auto resp = cortex_utils::CreateCortexHttpJsonResponse(res);
+    resp->setStatusCode(
+        static_cast<drogon::HttpStatusCode>(status["status_code"].asInt()));
+    // batched embeddings are rejected after the request was queued
+    AddRetryAfter(resp, status);
+    return resp;
+  };
+  // the timings are taken when the response leaves, whichever way it does
+  if (trace) {
+    cb = [this, cb = std::move(cb), trace](const HttpResponsePtr& resp) {
+      resp->addHeader(kServerTimingHeader, trace->ServerTiming());
+      inference_svc_->FinishTrace(trace);
+      cb(resp);
+    };
+  }
+
+  auto loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+  if (loop == nullptr) {
+    cb(to_response(q->wait_and_pop()));
+    return;
+  }
+
+  // The result is awaited on the event loop of the request rather than by
+  // blocking it, which is also what lets the loop notice a closed connection.
+  // Everything below runs on that loop.
+  struct PendingResponse {
+    std::function<void(const HttpResponsePtr&)> cb;
+    std::optional<trantor::TimerId> watch;
+    bool done = false;
+  };
+  auto pending = std::make_shared<PendingResponse>();
+  pending->cb = std::move(cb);
+  auto finish = [loop, q, pending](const HttpResponsePtr& resp) {
+    if (pending->done) {
+      return;
+    }
+    pending->done = true;
+    q->set_on_push(nullptr);
+    if (pending->watch) {
+      loop->invalidateTimer(*pending->watch);
+    }
+    pending->cb(resp);
+  };
+  auto deliver = [q, finish, to_response] {
+    if (auto result = q->try_pop(); result.has_value()) {
+      finish(to_response(std::move(result.value())));
+    }
+  };
+
+  if (req != nullptr && cancellation != nullptr) {
+    pending->watch =
+        loop->runEvery(kWatchInterval, [req, cancellation, finish]() {
+          auto reason = cancellation->Check(req->connected());
+          if (reason == RequestCancellation::Reason::kNone) {
+            return;
+          }
+          // a queued request is dropped, a running one stopped
+          auto gone = reason == RequestCancellation::Reason::kClientClosed;
+          LOG_INFO << (gone ? "Client disconnected" : "Deadline exceeded")
+                   << ", cancelled " << cancellation->request_id();
+          finish(gone ? CreateMessageResponse(kClientClosedRequest,
+                                              "Client closed request")
+                      : CreateMessageResponse(k408RequestTimeout,
+                                              "Request deadline exceeded"));
+        });
+  }
+  q->set_on_push([loop, deliver] { loop->queueInLoop(deliver); });
+  // the result may have been pushed before anyone listened
+  deliver();
 }
 
 }  // namespace inferences
@@ -48,6 +48,9 @@ class server : public drogon::HttpController<server, false>,
   ADD_METHOD_TO(server::Embedding, "/v1/embeddings", Options, Post);
   ADD_METHOD_TO(server::Inference, "/v1/inference", Options, Post);
   ADD_METHOD_TO(server::RouteRequest, "/v1/route/request", Options, Post);
+  ADD_METHOD_TO(server::Tokenize, "/v1/tokenize", Options, Post);
+  ADD_METHOD_TO(server::Detokenize, "/v1/detokenize", Options, Post);
+  ADD_METHOD_TO(server::CountTokens, "/v1/tokenize/count", Options, Post);
 
   METHOD_LIST_END
 
@@ -76,14 +79,32 @@ class server : public drogon::HttpController<server, false>,
                  std::function<void(const HttpResponsePtr&)>&& callback);
   void RouteRequest(const HttpRequestPtr& req,
                     std::function<void(const HttpResponsePtr&)>&& callback);
+  void Tokenize(const HttpRequestPtr& req,
+                std::function<void(const HttpResponsePtr&)>&& callback);
+  void Detokenize(const HttpRequestPtr& req,
+                  std::function<void(const HttpResponsePtr&)>&& callback);
+  void CountTokens(const HttpRequestPtr& req,
+                   std::function<void(const HttpResponsePtr&)>&& callback);
 
  private:
-  void ProcessStreamRes(std::function<void(const HttpResponsePtr&)> cb,
-                        std::shared_ptr<SyncQueue> q,
-                        const std::string& engine_type,
-                        const std::string& model_id);
-  void ProcessNonStreamRes(std::function<void(const HttpResponsePtr&)> cb,
-                           SyncQueue& q);
+  // The request is cancelled through [cancellation] if the client goes away
+  // or its deadline passes before it completes, without one the whole model
+  // is stopped when the client goes away. [trace] is finished with the last
+  // chunk
+  void ProcessStreamRes(
+      std::function<void(const HttpResponsePtr&)> cb,
+      std::shared_ptr<SyncQueue> q, const std::string& engine_type,
+      const std::string& model_id,
+      std::shared_ptr<RequestCancellation> cancellation = nullptr,
+      std::shared_ptr<RequestTrace> trace = nullptr);
+  // With [req] and [cancellation], the request is cancelled when the client
+  // disconnects or its deadline passes before it completes. The timings of
+  // [trace] are sent as a Server-Timing header
+  void ProcessNonStreamRes(
+      std::function<void(const HttpResponsePtr&)> cb,
+      std::shared_ptr<SyncQueue> q, const HttpRequestPtr& req = nullptr,
+      std::shared_ptr<RequestCancellation> cancellation = nullptr,
+      std::shared_ptr<RequestTrace> trace = nullptr);
 
  private:
   std::shared_ptr<InferenceService> inference_svc_;
@@ -0,0 +1,230 @@
+#include "vector_stores.h"
+#include "common/api-dto/delete_success_response.h"
+#include "utils/cortex_utils.h"
+#include "utils/logging_utils.h"
+
+namespace {
+// Default and upper bound of max_num_results, as for the file_search tool
+constexpr const int kDefaultMaxNumResults = 20;
+constexpr const int kMaxMaxNumResults = 50;
+
+HttpResponsePtr CreateErrorResponse(const std::string& message,
+                                    HttpStatusCode code = k400BadRequest) {
+  Json::Value ret;
+  ret["message"] = message;
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(ret);
+  resp->setStatusCode(code);
+  return resp;
+}
+}  // namespace
+
+void VectorStores::CreateVectorStore(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback) {
+  auto json_body = req->getJsonObject();
+  if (json_body == nullptr) {
+    callback(CreateErrorResponse("Request body can't be empty"));
+    return;
+  }
+
+  OpenAi::VectorStore store;
+  store.name = json_body->get("name", "").asString();
+  // OpenAI picks the embedding model itself, here it has to be named
+  store.embedding_model = json_body->get("model", "").asString();
+  if (store.embedding_model.empty()) {
+    callback(CreateErrorResponse("model is required to embed the files"));
+    return;
+  }
+  auto const& chunking = (*json_body)["chunking_strategy"];
+  if (chunking.get("type", "auto").asString() == "static") {
+    store.max_chunk_size_chars = chunking["static"]
+                                     .get("max_chunk_size_chars",
+                                          store.max_chunk_size_chars)
+                                     .asUInt();
+    store.chunk_overlap_chars = chunking["static"]
+                                    .get("chunk_overlap_chars",
+                                         store.chunk_overlap_chars)
+                                    .asUInt();
+  }
+  if ((*json_body)["metadata"].isObject()) {
+    store.metadata = (*json_body)["metadata"];
+  }
+
+  std::vector<std::string> file_ids;
+  for (auto const& id : (*json_body)["file_ids"]) {
+    file_ids.push_back(id.asString());
+  }
+
+  vector_store_service_->CreateVectorStore(
+      std::move(store), std::move(file_ids),
+      [callback = std::move(callback)](auto res) {
+        if (res.has_error()) {
+          callback(CreateErrorResponse(res.error()));
+          return;
+        }
+        auto resp =
+            cortex_utils::CreateCortexHttpJsonResponse(res->ToJson().value());
+        resp->setStatusCode(k200OK);
+        callback(resp);
+      });
+}
+
+void VectorStores::ListVectorStores(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    std::optional<std::string> limit, std::optional<std::string> order,
+    std::optional<std::string> after) const {
+  auto res = vector_store_service_->ListVectorStores(
+      std::stoi(limit.value_or("20")), order.value_or("desc"),
+      after.value_or(""));
+  if (res.has_error()) {
+    callback(CreateErrorResponse(res.error()));
+    return;
+  }
+
+  Json::Value data(Json::arrayValue);
+  for (auto& store : res.value()) {
+    data.append(store.ToJson().value());
+  }
+  Json::Value root;
+  root["object"] = "list";
+  root["data"] = data;
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(root);
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void VectorStores::RetrieveVectorStore(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& vector_store_id) const {
+  auto res = vector_store_service_->RetrieveVectorStore(vector_store_id);
+  if (res.has_error()) {
+    callback(CreateErrorResponse(res.error(), k404NotFound));
+    return;
+  }
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(res->ToJson().value());
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void VectorStores::DeleteVectorStore(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& vector_store_id) {
+  auto res = vector_store_service_->DeleteVectorStore(vector_store_id);
+  if (res.has_error()) {
+    callback(CreateErrorResponse(res.error()));
+    return;
+  }
+
+  api_response::DeleteSuccessResponse response;
+  response.id = vector_store_id;
+  response.object = "vector_store.deleted";
+  response.deleted = true;
+  auto resp =
+      cortex_utils::CreateCortexHttpJsonResponse(response.ToJson().value());
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void VectorStores::CreateVectorStoreFile(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& vector_store_id) {
+  auto json_body = req->getJsonObject();
+  if (json_body == nullptr || !(*json_body)["file_id"].isString()) {
+    callback(CreateErrorResponse("file_id is required"));
+    return;
+  }
+
+  auto res = vector_store_service_->AddFile(
+      vector_store_id, (*json_body)["file_id"].asString());
+  if (res.has_error()) {
+    callback(CreateErrorResponse(res.error()));
+    return;
+  }
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(res->ToJson().value());
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void VectorStores::ListVectorStoreFiles(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& vector_store_id) const {
+  auto res = vector_store_service_->ListFiles(vector_store_id);
+  if (res.has_error()) {
+    callback(CreateErrorResponse(res.error(), k404NotFound));
+    return;
+  }
+
+  Json::Value data(Json::arrayValue);
+  for (auto& file : res.value()) {
+    data.append(file.ToJson().value());
+  }
+  Json::Value root;
+  root["object"] = "list";
+  root["data"] = data;
+  auto resp = cortex_utils::CreateCortexHttpJsonResponse(root);
+  resp->setStatusCode(k200OK);
+  callback(resp);
+}
+
+void VectorStores::SearchVectorStore(
+    const HttpRequestPtr& req,
+    std::function<void(const HttpResponsePtr&)>&& callback,
+    const std::string& vector_store_id) {
+  auto json_body = req->getJsonObject();
+  if (json_body == nullptr || !(*json_body)["query"].isString()) {
+    callback(CreateErrorResponse("query is required"));
+    return;
+  }
+
+  auto query = (*json_body)["query"].asString();
+  auto max_num_results =
+      json_body->get("max_num_results", kDefaultMaxNumResults).asInt();
+  if (max_num_results < 1 || max_num_results > kMaxMaxNumResults) {
+    callback(CreateErrorResponse("max_num_results must be between 1 and " +
+                                 std::to_string(kMaxMaxNumResults)));
+    return;
+  }
+  auto score_threshold =
+      (*json_body)["ranking_options"].get("score_threshold", 0.0f).asFloat();
+  if (score_threshold < 0.0f || score_threshold > 1.0f) {
+    callback(CreateErrorResponse("score_threshold must be between 0 and 1"));
+    return;
+  }
+
+  vector_store_service_->Search(
+      vector_store_id, query, max_num_results, score_threshold,
+      [query, callback = std::move(callback)](auto res) {
+        if (res.has_error()) {
+          callback(CreateErrorResponse(res.error()));
+          return;
+        }
+
+        Json::Value data(Json::arrayValue);
+        for (auto const& r : res.value()) {
+          Json::Value item;
+          item["file_id"] = r.file_id;
+          item["filename"] = r.filename;
+          item["score"] = r.score;
+          item["attributes"] = Json::Value(Json::objectValue);
+          Json::Value content;
+          content["type"] = "text";
+          content["text"] = r.text;
+          item["content"].append(content);
+          data.append(item);
+        }
+        Json::Value root;
+        root["object"] = "vector_store.search_results.page";
+        root["search_query"] = query;
+        root["data"] = data;
+        root["has_more"] = false;
+        root["next_page"] = Json::Value();
+        auto resp = cortex_utils::CreateCortexHttpJsonResponse(root);
+        resp->setStatusCode(k200OK);
+        callback(resp);
+      });
+}
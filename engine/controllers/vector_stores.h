@@ -0,0 +1,74 @@
+#pragma once
+
+#include <drogon/HttpController.h>
+#include <trantor/utils/Logger.h>
+#include <optional>
+#include "services/vector_store_service.h"
+
+using namespace drogon;
+
+class VectorStores : public drogon::HttpController<VectorStores, false> {
+ public:
+  METHOD_LIST_BEGIN
+  ADD_METHOD_TO(VectorStores::CreateVectorStore, "/v1/vector_stores", Options,
+                Post);
+
+  ADD_METHOD_TO(VectorStores::ListVectorStores,
+                "/v1/vector_stores?limit={limit}&order={order}&after={after}",
+                Get);
+
+  ADD_METHOD_TO(VectorStores::RetrieveVectorStore,
+                "/v1/vector_stores/{vector_store_id}", Get);
+
+  ADD_METHOD_TO(VectorStores::DeleteVectorStore,
+                "/v1/vector_stores/{vector_store_id}", Options, Delete);
+
+  ADD_METHOD_TO(VectorStores::CreateVectorStoreFile,
+                "/v1/vector_stores/{vector_store_id}/files", Options, Post);
+
+  ADD_METHOD_TO(VectorStores::ListVectorStoreFiles,
+                "/v1/vector_stores/{vector_store_id}/files", Get);
+
+  ADD_METHOD_TO(VectorStores::SearchVectorStore,
+                "/v1/vector_stores/{vector_store_id}/search", Options, Post);
+  METHOD_LIST_END
+
+  explicit VectorStores(std::shared_ptr<VectorStoreService> vector_store_srv)
+      : vector_store_service_{vector_store_srv} {}
+
+  void CreateVectorStore(
+      const HttpRequestPtr& req,
+      std::function<void(const HttpResponsePtr&)>&& callback);
+
+  void ListVectorStores(const HttpRequestPtr& req,
+                        std::function<void(const HttpResponsePtr&)>&& callback,
+                        std::optional<std::string> limit,
+                        std::optional<std::string> order,
+                        std::optional<std::string> after) const;
+
+  void RetrieveVectorStore(
+      const HttpRequestPtr& req,
+      std::function<void(const HttpResponsePtr&)>&& callback,
+      const std::string& vector_store_id) const;
+
+  void DeleteVectorStore(const HttpRequestPtr& req,
+                         std::function<void(const HttpResponsePtr&)>&& callback,
+                         const std::string& vector_store_id);
+
+  void CreateVectorStoreFile(
+      const HttpRequestPtr& req,
+      std::function<void(const HttpResponsePtr&)>&& callback,
+      const std::string& vector_store_id);
+
+  void ListVectorStoreFiles(
+      const HttpRequestPtr& req,
+      std::function<void(const HttpResponsePtr&)>&& callback,
+      const std::string& vector_store_id) const;
+
+  void SearchVectorStore(const HttpRequestPtr& req,
+                         std::function<void(const HttpResponsePtr&)>&& callback,
+                         const std::string& vector_store_id);
+
+ private:
+  std::shared_ptr<VectorStoreService> vector_store_service_;
+};
@@ -69,4 +69,11 @@ class EngineI {
 
   // Stop inflight chat completion in stream mode
   virtual void StopInferencing(const std::string& model_id) = 0;
+
+  // Stop the inflight request whose body carried [request_id] as its
+  // "request_id", leaving the other requests of the model running. Only
+  // called when IsSupported("StopRequest"), engines built before it don't
+  // have it.
+  virtual void StopRequest(const std::string& model_id,
+                           const std::string& request_id) {}
 };
@@ -36,4 +36,9 @@ class RemoteEngineI {
   virtual Json::Value GetRemoteModels(const std::string& url,
                                       const std::string& api_key,
                                       const std::string& header_template) = 0;
+
+  // Stop the inflight request whose body carried [request_id] as its
+  // "request_id", leaving the other requests of the model running
+  virtual void StopRequest(const std::string& model_id,
+                           const std::string& request_id) = 0;
 };
@@ -0,0 +1,135 @@
+#include "batches.h"
+#include "utils/json_helper.h"
+#include "utils/logging_utils.h"
+
+namespace cortex::db {
+namespace {
+constexpr const auto kSelectColumns =
+    "SELECT id, endpoint, input_file_id, completion_window, status, "
+    "output_file_id, error_file_id, created_at, in_progress_at, completed_at, "
+    "failed_at, cancelled_at, total, completed, failed, input_offset, error, "
+    "metadata FROM batches";
+
+OpenAi::Batch ReadBatch(SQLite::Statement& query) {
+  OpenAi::Batch entry;
+  entry.id = query.getColumn(0).getString();
+  entry.endpoint = query.getColumn(1).getString();
+  entry.input_file_id = query.getColumn(2).getString();
+  entry.completion_window = query.getColumn(3).getString();
+  entry.status = query.getColumn(4).getString();
+  entry.output_file_id = query.getColumn(5).getString();
+  entry.error_file_id = query.getColumn(6).getString();
+  entry.created_at = query.getColumn(7).getInt64();
+  entry.in_progress_at = query.getColumn(8).getInt64();
+  entry.completed_at = query.getColumn(9).getInt64();
+  entry.failed_at = query.getColumn(10).getInt64();
+  entry.cancelled_at = query.getColumn(11).getInt64();
+  entry.total = query.getColumn(12).getInt64();
+  entry.completed = query.getColumn(13).getInt64();
+  entry.failed = query.getColumn(14).getInt64();
+  entry.input_offset = query.getColumn(15).getInt64();
+  entry.error = query.getColumn(16).getString();
+  auto metadata = json_helper::ParseJsonString(query.getColumn(17).getString());
+  if (metadata.isObject()) {
+    entry.metadata = metadata;
+  }
+  return entry;
+}
+
+// Binds every column but id, in the order of the UPDATE statement
+void BindBatch(SQLite::Statement& stmt, const OpenAi::Batch& batch,
+               int first) {
+  stmt.bind(first++, batch.endpoint);
+  stmt.bind(first++, batch.input_file_id);
+  stmt.bind(first++, batch.completion_window);
+  stmt.bind(first++, batch.status);
+  stmt.bind(first++, batch.output_file_id);
+  stmt.bind(first++, batch.error_file_id);
+  stmt.bind(first++, static_cast<int64_t>(batch.created_at));
+  stmt.bind(first++, static_cast<int64_t>(batch.in_progress_at));
+  stmt.bind(first++, static_cast<int64_t>(batch.completed_at));
+  stmt.bind(first++, static_cast<int64_t>(batch.failed_at));
+  stmt.bind(first++, static_cast<int64_t>(batch.cancelled_at));
+  stmt.bind(first++, static_cast<int64_t>(batch.total));
+  stmt.bind(first++, static_cast<int64_t>(batch.completed));
+  stmt.bind(first++, static_cast<int64_t>(batch.failed));
+  stmt.bind(first++, static_cast<int64_t>(batch.input_offset));
+  stmt.bind(first++, batch.error);
+  stmt.bind(first++, json_helper::DumpJsonString(batch.metadata));
+}
+}  // namespace
+
+cpp::result<std::vector<OpenAi::Batch>, std::string> Batches::GetBatchList()
+    const {
+  try {
+    std::vector<OpenAi::Batch> entries;
+    SQLite::Statement query(db_, std::string(kSelectColumns) +
+                                     " ORDER BY created_at DESC, id DESC");
+    while (query.executeStep()) {
+      entries.push_back(ReadBatch(query));
+    }
+    return entries;
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<OpenAi::Batch, std::string> Batches::GetBatchById(
+    const std::string& batch_id) const {
+  try {
+    SQLite::Statement query(db_, std::string(kSelectColumns) + " WHERE id = ?");
+    query.bind(1, batch_id);
+    if (query.executeStep()) {
+      return ReadBatch(query);
+    }
+    return cpp::fail("Batch not found: " + batch_id);
+  } catch (const std::exception& e) {
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<void, std::string> Batches::AddBatchEntry(
+    const OpenAi::Batch& batch) {
+  try {
+    SQLite::Statement insert(
+        db_,
+        "INSERT INTO batches (endpoint, input_file_id, completion_window, "
+        "status, output_file_id, error_file_id, created_at, in_progress_at, "
+        "completed_at, failed_at, cancelled_at, total, completed, failed, "
+        "input_offset, error, metadata, id) VALUES (?, ?, ?, ?, ?, ?, ?, ?, "
+        "?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+    BindBatch(insert, batch, 1);
+    insert.bind(18, batch.id);
+    insert.exec();
+    CTL_INF("Inserted batch: " << batch.id);
+    return {};
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+
+cpp::result<void, std::string> Batches::UpdateBatchEntry(
+    const OpenAi::Batch& batch) {
+  try {
+    SQLite::Statement upd(
+        db_,
+        "UPDATE batches SET endpoint = ?, input_file_id = ?, "
+        "completion_window = ?, status = ?, output_file_id = ?, "
+        "error_file_id = ?, created_at = ?, in_progress_at = ?, "
+        "completed_at = ?, failed_at = ?, cancelled_at = ?, total = ?, "
+        "completed = ?, failed = ?, input_offset = ?, error = ?, metadata = ? "
+        "WHERE id = ?");
+    BindBatch(upd, batch, 1);
+    upd.bind(18, batch.id);
+    if (upd.exec() != 1) {
+      return cpp::fail("Batch not found: " + batch.id);
+    }
+    return {};
+  } catch (const std::exception& e) {
+    CTL_WRN(e.what());
+    return cpp::fail(e.what());
+  }
+}
+}  // namespace cortex::db
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <SQLiteCpp/Database.h>
+#include <trantor/utils/Logger.h>
+#include <string>
+#include <vector>
+#include "common/batch.h"
+#include "database.h"
+#include "utils/result.hpp"
+
+namespace cortex::db {
+class Batches {
+  SQLite::Database& db_;
+
+ public:
+  Batches(SQLite::Database& db) : db_{db} {};
+
+  Batches() : db_(cortex::db::Database::GetInstance().db()) {}
+
+  ~Batches() {}
+
+  cpp::result<std::vector<OpenAi::Batch>, std::string> GetBatchList() const;
+
+  cpp::result<OpenAi::Batch, std::string> GetBatchById(
+      const std::string& batch_id) const;
+
+  cpp::result<void, std::string> AddBatchEntry(const OpenAi::Batch& batch);
+
+  cpp::result<void, std::string> UpdateBatchEntry(const OpenAi::Batch& batch);
+};
+}  // namespace cortex::db
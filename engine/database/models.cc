@@ -1,4 +1,5 @@
 #include "models.h"
+#include <SQLiteCpp/Transaction.h>
 #include <algorithm>
 #include <sstream>
 #include "database.h"
@@ -133,6 +134,8 @@ void Models::PrintModelInfo(const ModelEntry& entry) const {
 }
 
 cpp::result<bool, std::string> Models::AddModelEntry(ModelEntry new_entry) {
+  // declared first so it runs after the commit
+  cortex::utils::ScopeExit bump([] { version_++; });
   try {
     db_.exec("BEGIN TRANSACTION;");
     cortex::utils::ScopeExit se([this] { db_.exec("COMMIT;"); });
@@ -171,6 +174,7 @@ cpp::result<bool, std::string> Models::AddModelEntry(ModelEntry new_entry) {
 
 cpp::result<bool, std::string> Models::UpdateModelEntry(
     const std::string& identifier, const ModelEntry& updated_entry) {
+  cortex::utils::ScopeExit bump([] { version_++; });
   if (!HasModel(identifier)) {
     return cpp::fail("Model not found: " + identifier);
   }
@@ -197,6 +201,7 @@ cpp::result<bool, std::string> Models::UpdateModelEntry(
 
 cpp::result<bool, std::string> Models::DeleteModelEntry(
     const std::string& identifier) {
+  cortex::utils::ScopeExit bump([] { version_++; });
   try {
     // delete only if its there
     if (!HasModel(identifier)) {
@@ -211,8 +216,28 @@ cpp::result<bool, std::string> Models::DeleteModelEntry(
   }
 }
 
+cpp::result<int, std::string> Models::DeleteModelEntries(
+    const std::vector<std::string>& identifiers) {
+  cortex::utils::ScopeExit bump([] { version_++; });
+  try {
+    SQLite::Transaction transaction(db_);
+    SQLite::Statement del(db_, "DELETE from models WHERE model_id = ?");
+    int deleted = 0;
+    for (auto const& identifier : identifiers) {
+      del.bind(1, identifier);
+      deleted += del.exec();
+      del.reset();
+    }
+    transaction.commit();
+    return deleted;
+  } catch (const std::exception& e) {
+    return cpp::fail(e.what());
+  }
+}
+
 cpp::result<bool, std::string> Models::DeleteModelEntryWithOrg(
     const std::string& src) {
+  cortex::utils::ScopeExit bump([] { version_++; });
   try {
     SQLite::Statement del(db_,
                           "DELETE from models WHERE model_source LIKE ? AND "
@@ -226,6 +251,7 @@ cpp::result<bool, std::string> Models::DeleteModelEntryWithOrg(
 
 cpp::result<bool, std::string> Models::DeleteModelEntryWithRepo(
     const std::string& src) {
+  cortex::utils::ScopeExit bump([] { version_++; });
   try {
     SQLite::Statement del(db_,
                           "DELETE from models WHERE model_source = ? AND "
@@ -2,6 +2,7 @@
 
 #include <SQLiteCpp/Database.h>
 #include <trantor/utils/Logger.h>
+#include <atomic>
 #include <string>
 #include <vector>
 #include "utils/result.hpp"
@@ -36,7 +37,16 @@ class Models {
   std::string StatusToString(ModelStatus status) const;
   ModelStatus StringToStatus(const std::string& status_str) const;
 
+  inline static std::atomic<uint64_t> version_{0};
+
  public:
+  /**
+   * Incremented after every write to the models table, by any instance, so
+   * caches of the model list can tell whether they are stale.
+   */
+  static uint64_t Version() { return version_; }
+
+
   cpp::result<std::vector<ModelEntry>, std::string> LoadModelList() const;
   Models();
   Models(SQLite::Database& db);
@@ -49,6 +59,12 @@ class Models {
       const std::string& identifier, const ModelEntry& updated_entry);
   cpp::result<bool, std::string> DeleteModelEntry(
       const std::string& identifier);
+  /**
+   * Delete several models in one transaction. Returns the number of rows
+   * removed.
+   */
+  cpp::result<int, std::string> DeleteModelEntries(
+      const std::vector<std::string>& identifiers);
   cpp::result<bool, std::string> DeleteModelEntryWithOrg(
       const std::string& src);
   cpp::result<bool, std::string> DeleteModelEntryWithRepo(
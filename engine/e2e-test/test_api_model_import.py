@@ -1,3 +1,5 @@
+import time
+
 import pytest
 import requests
 from test_runner import start_server, stop_server
@@ -36,9 +38,15 @@ class TestApiModelImport:
                      'name': 'test_model',
                      'option': 'copy'}
         response = requests.post("http://localhost:3928/v1/models/import", json=body_json)
-        assert response.status_code == 200
+        # The copy runs in the background
+        assert response.status_code == 202
+        assert response.json()['task']['model'] == 'testing-model'
         # Test imported path
-        response = requests.get("http://localhost:3928/v1/models/testing-model")
+        for _ in range(600):
+            response = requests.get("http://localhost:3928/v1/models/testing-model")
+            if response.status_code == 200:
+                break
+            time.sleep(1)
         assert response.status_code == 200
         # Since this is a dynamic test - require actual file path
         # it's not safe to assert with the gguf file name
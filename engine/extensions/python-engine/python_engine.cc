@@ -1,8 +1,14 @@
 #include "python_engine.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
 #include <filesystem>
 #include <iostream>
 #include <sstream>
 #include <string>
+#if !defined(_WIN32)
+#include <sys/un.h>
+#endif
 
 namespace python_engine {
 namespace {
@@ -11,62 +17,164 @@ constexpr const int k400BadRequest = 400;
 constexpr const int k409Conflict = 409;
 constexpr const int k500InternalServerError = 500;
 constexpr const int kFileLoggerOption = 0;
+// how long a model being loaded may take to pass its health check
+constexpr const auto kReadinessTimeout = std::chrono::seconds(120);
+constexpr const auto kProbeInterval = std::chrono::milliseconds(250);
+constexpr const long kProbeTimeoutMs = 2000;
+constexpr const auto kSupervisorInterval = std::chrono::seconds(1);
+constexpr const auto kTerminateTimeout = std::chrono::seconds(5);
+
+#if !defined(_WIN32)
+constexpr const char* kUnixTransport = "unix";
+
+// Socket of the [index]th replica of [model] under the data folder, empty if
+// the path does not fit in sockaddr_un so the caller can fall back to TCP
+std::string MakeSocketPath(const std::string& model, size_t index) {
+  std::string name;
+  for (auto c : model) {
+    name += std::isalnum(static_cast<unsigned char>(c)) || c == '-' ||
+                    c == '.'
+                ? c
+                : '_';
+  }
+  if (index > 0) {
+    name += "." + std::to_string(index);
+  }
+  auto path = (file_manager_utils::GetCortexDataPath() / "sockets" /
+               (name + ".sock"))
+                  .string();
+  if (path.size() >= sizeof(sockaddr_un::sun_path)) {
+    return "";
+  }
+  return path;
+}
+#endif
+
+// Forwards one event of the model server stream, false once it is over
+bool ForwardStreamEvent(StreamContext* context, const sse::Event& event) {
+  Json::Value status;
+  status["is_stream"] = true;
+  status["has_error"] = false;
+  status["status_code"] = 200;
+  if (event.data == "[DONE]") {
+    status["is_done"] = true;
+    (*context->callback)(std::move(status), Json::Value());
+    return false;
+  }
+
+  // the model server already speaks the OpenAI format
+  Json::Value chunk_json;
+  chunk_json["data"] = sse::Serialize(event);
+  status["is_done"] = false;
+  (*context->callback)(std::move(status), std::move(chunk_json));
+  return true;
+}
 
 size_t StreamWriteCallback(char* ptr, size_t size, size_t nmemb,
                            void* userdata) {
   auto* context = static_cast<StreamContext*>(userdata);
-  std::string chunk(ptr, size * nmemb);
-
-  context->buffer += chunk;
+  context->parser.Feed(std::string_view(ptr, size * nmemb),
+                       [context](const sse::Event& event) {
+                         return ForwardStreamEvent(context, event);
+                       });
+  return size * nmemb;
+}
 
-  // Process complete lines
-  size_t pos;
-  while ((pos = context->buffer.find('\n')) != std::string::npos) {
-    std::string line = context->buffer.substr(0, pos);
-    context->buffer = context->buffer.substr(pos + 1);
-    LOG_DEBUG << "line: " << line;
+static size_t WriteCallback(char* ptr, size_t size, size_t nmemb,
+                            std::string* data) {
+  data->append(ptr, size * nmemb);
+  return size * nmemb;
+}
 
-    // Skip empty lines
-    if (line.empty() || line == "\r")
-      continue;
+std::string GetBaseUrl(const Replica& replica) {
+  if (!replica.socket_path.empty()) {
+    // the host is ignored by curl when connecting through a socket
+    return "http://localhost";
+  }
+  return "http://localhost:" + replica.port;
+}
 
-    if (line == "data: [DONE]") {
-      Json::Value status;
-      status["is_done"] = true;
-      status["has_error"] = false;
-      status["is_stream"] = true;
-      status["status_code"] = 200;
-      (*context->callback)(std::move(status), Json::Value());
-      break;
-    }
+// Releases the request counted against a replica by AcquireReplica
+struct OutstandingGuard {
+  std::shared_ptr<Replica> replica;
+  ~OutstandingGuard() { replica->outstanding--; }
+};
 
-    // Parse the JSON
-    Json::Value chunk_json;
-    chunk_json["data"] = line + "\n\n";
-    Json::Reader reader;
+CurlResponse NoReadyReplica(const std::string& model) {
+  CurlResponse response;
+  response.error = true;
+  response.error_message = "No ready process for model: " + model;
+  return response;
+}
 
-    Json::Value status;
-    status["is_done"] = false;
-    status["has_error"] = false;
-    status["is_stream"] = true;
-    status["status_code"] = 200;
-    (*context->callback)(std::move(status), std::move(chunk_json));
+bool HasExited(pid_t pid) {
+  if (pid <= 0) {
+    return true;
   }
-
-  return size * nmemb;
+#if defined(_WIN32)
+  return !process_status_utils::IsProcessRunning(pid);
+#else
+  // reap the child, an exited replica would otherwise linger as a zombie
+  int status;
+  auto res = waitpid(pid, &status, WNOHANG);
+  if (res == pid) {
+    return true;
+  }
+  if (res == -1 && errno == ECHILD) {
+    return !process_status_utils::IsProcessRunning(pid);
+  }
+  return false;
+#endif
 }
 
-static size_t WriteCallback(char* ptr, size_t size, size_t nmemb,
-                            std::string* data) {
-  data->append(ptr, size * nmemb);
-  return size * nmemb;
+bool TerminateReplica(Replica& replica) {
+  replica.ready = false;
+  bool terminated = true;
+  if (replica.pid > 0) {
+#if defined(_WIN32)
+    HANDLE hProcess = OpenProcess(PROCESS_TERMINATE, FALSE, replica.pid);
+    if (hProcess == NULL) {
+      LOG_ERROR << "Failed to open process";
+      return false;
+    }
+    terminated = TerminateProcess(hProcess, 0) == TRUE;
+    CloseHandle(hProcess);
+#elif defined(__APPLE__) || defined(__linux__)
+    terminated = kill(replica.pid, SIGTERM) == 0 || errno == ESRCH;
+    auto deadline = std::chrono::steady_clock::now() + kTerminateTimeout;
+    while (terminated && !HasExited(replica.pid)) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        LOG_WARN << "Process " << replica.pid << " ignored SIGTERM, killing it";
+        kill(replica.pid, SIGKILL);
+        waitpid(replica.pid, nullptr, 0);
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+#endif
+  }
+  if (!replica.socket_path.empty()) {
+    std::error_code ec;
+    std::filesystem::remove(replica.socket_path, ec);
+  }
+  return terminated;
 }
 
 }  // namespace
 
-PythonEngine::PythonEngine() : q_(4 /*n_parallel*/, "python_engine") {}
+PythonEngine::PythonEngine()
+    : q_(4 /*n_parallel*/, "python_engine"),
+      loader_(1, "python_engine_loader") {
+  supervisor_ = std::thread([this] { Supervise(); });
+}
 
 PythonEngine::~PythonEngine() {
+  {
+    std::lock_guard lock(replicas_mutex_);
+    stop_supervisor_ = true;
+  }
+  supervisor_cv_.notify_all();
+  supervisor_.join();
   curl_global_cleanup();
 }
 
@@ -81,83 +189,390 @@ config::PythonModelConfig* PythonEngine::GetModelConfig(
 }
 
 bool PythonEngine::TerminateModelProcess(const std::string& model) {
-  auto it = process_map_.find(model);
-  if (it == process_map_.end()) {
-    LOG_ERROR << "No process found for model: " << model
-              << ", removing from list running models.";
-    models_.erase(model);
-    return false;
+  std::vector<std::shared_ptr<Replica>> replicas;
+  {
+    std::lock_guard lock(replicas_mutex_);
+    auto it = replicas_.find(model);
+    if (it == replicas_.end()) {
+      LOG_ERROR << "No process found for model: " << model
+                << ", removing from list running models.";
+      std::unique_lock models_lock(models_mutex_);
+      models_.erase(model);
+      return false;
+    }
+    replicas = std::move(it->second);
+    replicas_.erase(it);
+  }
+
+  bool terminated = true;
+  for (auto& replica : replicas) {
+    terminated = TerminateReplica(*replica) && terminated;
   }
+  return terminated;
+}
 
+bool PythonEngine::SpawnReplica(const std::string& model,
+                                const config::PythonModelConfig& config,
+                                Replica& replica) {
+  auto model_folder_path = config.files[0];
+  auto data_folder_path =
+      std::filesystem::path(model_folder_path) / std::filesystem::path("venv");
 #if defined(_WIN32)
-  HANDLE hProcess = OpenProcess(PROCESS_TERMINATE, FALSE, it->second);
-  if (hProcess == NULL) {
-    LOG_ERROR << "Failed to open process";
-    return false;
+  auto executable = std::filesystem::path(data_folder_path) /
+                    std::filesystem::path("Scripts");
+#else
+  auto executable =
+      std::filesystem::path(data_folder_path) / std::filesystem::path("bin");
+#endif
+
+  auto executable_str =
+      (executable / std::filesystem::path(config.command[0])).string();
+  auto command = config.command;
+  command[0] = executable_str;
+  command.push_back((std::filesystem::path(model_folder_path) /
+                     std::filesystem::path(config.script))
+                        .string());
+  std::list<std::string> args{"--log_path",
+                              (file_manager_utils::GetCortexLogPath() /
+                               std::filesystem::path(config.log_path))
+                                  .string(),
+                              "--log_level",
+                              config.log_level};
+  if (replica.socket_path.empty()) {
+    args.insert(args.begin(), {"--port", replica.port});
+  } else {
+    // a socket left behind by a crashed process would fail the bind
+    std::filesystem::remove(replica.socket_path);
+    args.insert(args.begin(), {"--unix_socket", replica.socket_path});
+  }
+  if (!config.extra_params.isNull() && config.extra_params.isObject()) {
+    for (const auto& key : config.extra_params.getMemberNames()) {
+      const Json::Value& value = config.extra_params[key];
+
+      // Convert key to string with -- prefix
+      std::string param_key = "--" + key;
+
+      // Handle different JSON value types
+      if (value.isString()) {
+        args.emplace_back(param_key);
+        args.emplace_back(value.asString());
+      } else if (value.isInt()) {
+        args.emplace_back(param_key);
+        args.emplace_back(std::to_string(value.asInt()));
+      } else if (value.isDouble()) {
+        args.emplace_back(param_key);
+        args.emplace_back(std::to_string(value.asDouble()));
+      } else if (value.isBool()) {
+        // For boolean, only add the flag if true
+        if (value.asBool()) {
+          args.emplace_back(param_key);
+        }
+      }
+    }
   }
 
-  bool terminated = TerminateProcess(hProcess, 0) == TRUE;
-  CloseHandle(hProcess);
+  // Add the parsed arguments to the command
+  command.insert(command.end(), args.begin(), args.end());
+  replica.ready = false;
+  replica.pid = cortex::process::SpawnProcess(command);
+  if (replica.pid == -1) {
+    LOG_ERROR << "Failed to spawn replica " << replica.index << " of model "
+              << model;
+    return false;
+  }
+  LOG_INFO << "Spawned replica " << replica.index << " of model " << model
+           << " with pid " << replica.pid;
+  return true;
+}
 
-  if (terminated) {
-    process_map_.erase(it);
+bool PythonEngine::ProbeReplica(const config::PythonModelConfig& config,
+                                const Replica& replica) {
+  if (config.heath_check.path.empty()) {
+    // nothing to probe, the process is trusted once it runs
     return true;
   }
+  CURL* curl = curl_easy_init();
+  if (!curl) {
+    return false;
+  }
+  // not curl_utils::SimpleRequest, a replica still starting up refuses
+  // connections and that is not worth an error log every probe
+  auto url = GetBaseUrl(replica) + config.heath_check.path;
+  std::string body;
+  if (!replica.socket_path.empty()) {
+    curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH,
+                     replica.socket_path.c_str());
+  }
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, kProbeTimeoutMs);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+  auto res = curl_easy_perform(curl);
+  long http_code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  curl_easy_cleanup(curl);
+  return res == CURLE_OK && http_code >= 200 && http_code < 300;
+}
 
-#elif defined(__APPLE__) || defined(__linux__)
-  int result = kill(it->second, SIGTERM);
-  if (result == 0) {
-    process_map_.erase(it);
-    return true;
+std::optional<size_t> PythonEngine::WaitForReplicas(
+    const std::string& model) {
+  auto deadline = std::chrono::steady_clock::now() + kReadinessTimeout;
+  while (true) {
+    size_t ready = 0;
+    size_t pending = 0;
+    {
+      std::lock_guard lock(replicas_mutex_);
+      auto it = replicas_.find(model);
+      if (it == replicas_.end() || stop_supervisor_) {
+        return std::nullopt;
+      }
+      for (auto const& replica : it->second) {
+        if (replica->health.ready()) {
+          ready++;
+        } else if (replica->health.state() ==
+                   ReplicaHealth::State::kStarting) {
+          pending++;
+        }
+        // an exited one is left to the supervisor, which restarts it with a
+        // backoff
+      }
+    }
+    if (pending == 0 || std::chrono::steady_clock::now() >= deadline) {
+      return ready;
+    }
+    std::this_thread::sleep_for(kProbeInterval);
   }
-#endif
+}
 
-  return false;
+void PythonEngine::FinishLoad(const std::string& model) {
+  auto ready = WaitForReplicas(model);
+  if (!ready.has_value()) {
+    // unloaded meanwhile
+    return;
+  }
+  if (*ready == 0) {
+    LOG_ERROR << "Model " << model << " did not pass its health check";
+    AbortLoad(model);
+    std::lock_guard lock(replicas_mutex_);
+    load_errors_[model] = "did not pass its health check";
+    return;
+  }
+  std::lock_guard lock(replicas_mutex_);
+  if (auto it = replicas_.find(model);
+      it != replicas_.end() && *ready < it->second.size()) {
+    LOG_WARN << *ready << "/" << it->second.size() << " replicas of model "
+             << model << " are ready, the rest join once healthy";
+  } else {
+    LOG_INFO << "Model " << model << " is ready";
+  }
 }
 
-CurlResponse PythonEngine::MakeGetRequest(const std::string& model,
-                                          const std::string& path) {
-  auto const& config = models_[model];
-  std::string full_url = "http://localhost:" + config.port + path;
-  CurlResponse response;
+void PythonEngine::AbortLoad(const std::string& model) {
+  std::vector<std::shared_ptr<Replica>> replicas;
+  {
+    std::lock_guard lock(replicas_mutex_);
+    if (auto it = replicas_.find(model); it != replicas_.end()) {
+      replicas = std::move(it->second);
+      replicas_.erase(it);
+    }
+  }
+  for (auto& replica : replicas) {
+    TerminateReplica(*replica);
+  }
+  std::unique_lock lock(models_mutex_);
+  models_.erase(model);
+}
 
-  auto result = curl_utils::SimpleRequest(full_url, RequestType::GET);
-  if (result.has_error()) {
-    response.error = true;
-    response.error_message = result.error();
-  } else {
-    response.body = result.value();
+bool PythonEngine::IsRegistered(const std::string& model,
+                                const std::shared_ptr<Replica>& replica) const {
+  auto it = replicas_.find(model);
+  return it != replicas_.end() &&
+         std::find(it->second.begin(), it->second.end(), replica) !=
+             it->second.end();
+}
+
+void PythonEngine::Supervise() {
+  std::unique_lock lock(replicas_mutex_);
+  while (!stop_supervisor_) {
+    // replicas starting up are probed often so that a model being loaded
+    // serves as soon as they are ready, LoadModel wakes the supervisor up
+    // for them
+    auto starting = std::any_of(
+        replicas_.begin(), replicas_.end(), [](auto const& entry) {
+          return std::any_of(
+              entry.second.begin(), entry.second.end(),
+              [](auto const& replica) {
+                return replica->health.state() ==
+                       ReplicaHealth::State::kStarting;
+              });
+        });
+    supervisor_cv_.wait_for(
+        lock, starting ? kProbeInterval
+                       : std::chrono::milliseconds(kSupervisorInterval));
+    if (stop_supervisor_) {
+      break;
+    }
+    auto snapshot = replicas_;
+    lock.unlock();
+
+    for (auto& [model, replicas] : snapshot) {
+      config::PythonModelConfig config;
+      {
+        std::shared_lock models_lock(models_mutex_);
+        auto it = models_.find(model);
+        if (it == models_.end()) {
+          continue;
+        }
+        config = it->second;
+      }
+      for (auto& replica : replicas) {
+        SuperviseReplica(model, config, replica);
+      }
+    }
+    lock.lock();
   }
-  return response;
 }
 
-CurlResponse PythonEngine::MakeDeleteRequest(const std::string& model,
-                                             const std::string& path) {
-  auto const& config = models_[model];
-  std::string full_url = "http://localhost:" + config.port + path;
-  CurlResponse response;
+void PythonEngine::SuperviseReplica(const std::string& model,
+                                    const config::PythonModelConfig& config,
+                                    const std::shared_ptr<Replica>& replica) {
+  bool restart = false;
+  {
+    // the model may have been unloaded since the snapshot
+    std::lock_guard lock(replicas_mutex_);
+    if (!IsRegistered(model, replica)) {
+      return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (HasExited(replica->pid)) {
+      if (replica->pid > 0) {
+        LOG_WARN << "Replica " << replica->index << " of model " << model
+                 << " exited, restarting it";
+        replica->ready = false;
+        replica->pid = -1;
+        replica->health.OnExit(now);
+      }
+      if (!replica->health.ShouldRestart(now)) {
+        return;
+      }
+      restart = true;
+    }
+  }
+  if (restart) {
+    RestartReplica(model, config, replica);
+    return;
+  }
 
-  auto result = curl_utils::SimpleRequest(full_url, RequestType::DEL);
+  // ready replicas are probed too, a hung process stops getting requests
+  auto healthy = ProbeReplica(config, *replica);
+  bool terminate = false;
+  {
+    std::lock_guard lock(replicas_mutex_);
+    if (!IsRegistered(model, replica)) {
+      return;
+    }
+    auto was = replica->health.state();
+    replica->health.OnProbe(healthy);
+    auto state = replica->health.state();
+    if (state != was && state == ReplicaHealth::State::kReady) {
+      LOG_INFO << "Replica " << replica->index << " of model " << model
+               << " is ready";
+    } else if (state != was && state == ReplicaHealth::State::kUnhealthy) {
+      LOG_WARN << "Replica " << replica->index << " of model " << model
+               << " stopped answering its health check";
+    }
+    replica->ready = replica->health.ready();
+    terminate = replica->health.ShouldTerminate();
+  }
+  if (terminate) {
+    LOG_WARN << "Replica " << replica->index << " of model " << model
+             << " is hung, terminating it";
+    // restarted on the next pass once it exited
+    TerminateReplica(*replica);
+  }
+}
 
-  if (result.has_error()) {
-    response.error = true;
-    response.error_message = result.error();
-  } else {
-    response.body = result.value();
+void PythonEngine::RestartReplica(const std::string& model,
+                                  const config::PythonModelConfig& config,
+                                  const std::shared_ptr<Replica>& replica) {
+  auto fresh = std::make_shared<Replica>();
+  fresh->index = replica->index;
+  fresh->port = replica->port;
+  fresh->socket_path = replica->socket_path;
+  {
+    std::lock_guard lock(replicas_mutex_);
+    fresh->health = replica->health;
   }
 
-  return response;
+  // spawned without the lock, requests and the other models go on meanwhile
+  bool spawned = false;
+  try {
+    spawned = SpawnReplica(model, config, *fresh);
+  } catch (const std::exception& e) {
+    LOG_ERROR << "Failed to restart replica " << replica->index << " of model "
+              << model << ": " << e.what();
+  }
+  if (!spawned) {
+    std::lock_guard lock(replicas_mutex_);
+    replica->health.OnExit(std::chrono::steady_clock::now());
+    return;
+  }
+
+  fresh->health.OnRestart();
+  bool swapped = false;
+  {
+    std::lock_guard lock(replicas_mutex_);
+    if (auto it = replicas_.find(model); it != replicas_.end()) {
+      if (auto r = std::find(it->second.begin(), it->second.end(), replica);
+          r != it->second.end()) {
+        *r = fresh;
+        swapped = true;
+      }
+    }
+  }
+  if (!swapped) {
+    // the model was unloaded while the process was spawned
+    TerminateReplica(*fresh);
+  }
 }
 
-CurlResponse PythonEngine::MakePostRequest(const std::string& model,
-                                           const std::string& path,
-                                           const std::string& body) {
-  auto const& config = models_[model];
-  std::string full_url = "http://localhost:" + config.port + path;
+std::shared_ptr<Replica> PythonEngine::AcquireReplica(
+    const std::string& model, int slot) {
+  std::lock_guard lock(replicas_mutex_);
+  auto it = replicas_.find(model);
+  if (it == replicas_.end() || it->second.empty()) {
+    return nullptr;
+  }
+  if (slot >= 0) {
+    auto const& pinned = it->second[slot % it->second.size()];
+    if (pinned->ready) {
+      pinned->outstanding++;
+      return pinned;
+    }
+  }
+  std::shared_ptr<Replica> best;
+  for (auto const& replica : it->second) {
+    if (replica->ready &&
+        (!best || replica->outstanding < best->outstanding)) {
+      best = replica;
+    }
+  }
+  if (best) {
+    best->outstanding++;
+  }
+  return best;
+}
 
+CurlResponse PythonEngine::MakeRequest(const Replica& replica,
+                                       const std::string& path,
+                                       RequestType type,
+                                       const std::string& body,
+                                       const std::atomic<bool>* stop) {
+  std::string full_url = GetBaseUrl(replica) + path;
   CurlResponse response;
-  auto result = curl_utils::SimpleRequest(full_url, RequestType::POST, body);
 
+  auto result = curl_utils::SimpleRequest(full_url, type, body,
+                                          replica.socket_path, stop);
   if (result.has_error()) {
     response.error = true;
     response.error_message = result.error();
@@ -167,6 +582,38 @@ CurlResponse PythonEngine::MakePostRequest(const std::string& model,
   return response;
 }
 
+CurlResponse PythonEngine::MakeGetRequest(const std::string& model,
+                                          const std::string& path) {
+  auto replica = AcquireReplica(model);
+  if (!replica) {
+    return NoReadyReplica(model);
+  }
+  OutstandingGuard guard{replica};
+  return MakeRequest(*replica, path, RequestType::GET);
+}
+
+CurlResponse PythonEngine::MakeDeleteRequest(const std::string& model,
+                                             const std::string& path) {
+  auto replica = AcquireReplica(model);
+  if (!replica) {
+    return NoReadyReplica(model);
+  }
+  OutstandingGuard guard{replica};
+  return MakeRequest(*replica, path, RequestType::DEL);
+}
+
+CurlResponse PythonEngine::MakePostRequest(const std::string& model,
+                                           const std::string& path,
+                                           const std::string& body, int slot,
+                                           const std::atomic<bool>* stop) {
+  auto replica = AcquireReplica(model, slot);
+  if (!replica) {
+    return NoReadyReplica(model);
+  }
+  OutstandingGuard guard{replica};
+  return MakeRequest(*replica, path, RequestType::POST, body, stop);
+}
+
 bool PythonEngine::LoadModelConfig(const std::string& model,
                                    const std::string& yaml_path) {
   try {
@@ -209,8 +656,6 @@ void PythonEngine::GetModels(
 void PythonEngine::LoadModel(
     std::shared_ptr<Json::Value> json_body,
     std::function<void(Json::Value&&, Json::Value&&)>&& callback) {
-  // TODO: handle a case that can spawn process but the process spawn fail.
-  pid_t pid;
   if (!json_body->isMember("model") || !json_body->isMember("model_path")) {
     Json::Value error;
     error["error"] = "Missing required fields: model or model_path";
@@ -249,100 +694,92 @@ void PythonEngine::LoadModel(
     return;
   }
   auto model_config = models_[model];
-  auto model_folder_path = model_config.files[0];
-  auto data_folder_path =
-      std::filesystem::path(model_folder_path) / std::filesystem::path("venv");
+  auto reply_error = [&callback](int status_code, const std::string& message) {
+    Json::Value error;
+    error["error"] = message;
+    Json::Value status;
+    status["is_done"] = true;
+    status["has_error"] = true;
+    status["is_stream"] = false;
+    status["status_code"] = status_code;
+    callback(std::move(status), std::move(error));
+  };
+  auto fail = [&](int status_code, const std::string& message) {
+    AbortLoad(model);
+    reply_error(status_code, message);
+  };
+  auto unloaded = [&]() {
+    reply_error(k409Conflict,
+                "Model '" + model + "' was unloaded while loading");
+  };
+
+  // registered before anything is spawned, the model shows as loading and
+  // an unload meanwhile terminates what was spawned so far
+  {
+    std::lock_guard lock(replicas_mutex_);
+    replicas_[model].clear();
+    load_errors_.erase(model);
+  }
   try {
-#if defined(_WIN32)
-    auto executable = std::filesystem::path(data_folder_path) /
-                      std::filesystem::path("Scripts");
-#else
-    auto executable =
-        std::filesystem::path(data_folder_path) / std::filesystem::path("bin");
+    auto replica_count = std::max(1, model_config.replicas);
+    for (int i = 0; i < replica_count; i++) {
+      auto replica = std::make_shared<Replica>();
+      replica->index = i;
+      if (!model_config.port.empty()) {
+        replica->port = std::to_string(std::stoi(model_config.port) + i);
+      }
+#if !defined(_WIN32)
+      if (model_config.transport == kUnixTransport) {
+        replica->socket_path = MakeSocketPath(model, i);
+        if (replica->socket_path.empty()) {
+          LOG_WARN << "Socket path of model " << model
+                   << " is too long, falling back to port " << replica->port;
+        } else {
+          std::filesystem::create_directories(
+              std::filesystem::path(replica->socket_path).parent_path());
+        }
+      }
 #endif
-
-    auto executable_str =
-        (executable / std::filesystem::path(model_config.command[0])).string();
-    auto command = model_config.command;
-    command[0] = executable_str;
-    command.push_back((std::filesystem::path(model_folder_path) /
-                       std::filesystem::path(model_config.script))
-                          .string());
-    std::list<std::string> args{"--port",
-                                model_config.port,
-                                "--log_path",
-                                (file_manager_utils::GetCortexLogPath() /
-                                 std::filesystem::path(model_config.log_path))
-                                    .string(),
-                                "--log_level",
-                                model_config.log_level};
-    if (!model_config.extra_params.isNull() &&
-        model_config.extra_params.isObject()) {
-      for (const auto& key : model_config.extra_params.getMemberNames()) {
-        const Json::Value& value = model_config.extra_params[key];
-
-        // Convert key to string with -- prefix
-        std::string param_key = "--" + key;
-
-        // Handle different JSON value types
-        if (value.isString()) {
-          args.emplace_back(param_key);
-          args.emplace_back(value.asString());
-        } else if (value.isInt()) {
-          args.emplace_back(param_key);
-          args.emplace_back(std::to_string(value.asInt()));
-        } else if (value.isDouble()) {
-          args.emplace_back(param_key);
-          args.emplace_back(std::to_string(value.asDouble()));
-        } else if (value.isBool()) {
-          // For boolean, only add the flag if true
-          if (value.asBool()) {
-            args.emplace_back(param_key);
-          }
+      if (!SpawnReplica(model, model_config, *replica)) {
+        fail(k500InternalServerError, "Fail to spawn process with pid -1");
+        return;
+      }
+      bool registered = false;
+      {
+        std::lock_guard lock(replicas_mutex_);
+        if (auto it = replicas_.find(model); it != replicas_.end()) {
+          it->second.push_back(replica);
+          registered = true;
         }
       }
-    }
-
-    // Add the parsed arguments to the command
-    command.insert(command.end(), args.begin(), args.end());
-    pid = cortex::process::SpawnProcess(command);
-    process_map_[model] = pid;
-    if (pid == -1) {
-      std::unique_lock lock(models_mutex_);
-      if (models_.find(model) != models_.end()) {
-        models_.erase(model);
+      if (!registered) {
+        TerminateReplica(*replica);
+        unloaded();
+        return;
       }
-
-      Json::Value error;
-      error["error"] = "Fail to spawn process with pid -1";
-      Json::Value status;
-      status["is_done"] = true;
-      status["has_error"] = true;
-      status["is_stream"] = false;
-      status["status_code"] = k500InternalServerError;
-      callback(std::move(status), std::move(error));
-      return;
     }
   } catch (const std::exception& e) {
-    std::unique_lock lock(models_mutex_);
-    if (models_.find(model) != models_.end()) {
-      models_.erase(model);
-    }
-
-    Json::Value error;
-    error["error"] = e.what();
-    Json::Value status;
-    status["is_done"] = true;
-    status["has_error"] = true;
-    status["is_stream"] = false;
-    status["status_code"] = k500InternalServerError;
-    callback(std::move(status), std::move(error));
+    fail(k500InternalServerError, e.what());
     return;
   }
+  // probed by the supervisor from now on
+  supervisor_cv_.notify_all();
+
+  // The replicas can take minutes to come up, which is not waited for on the
+  // calling server thread. The status of the model reports it as loading
+  // until a replica is ready, or why the load failed.
+  loader_.runTaskInQueue([this, model] { FinishLoad(model); });
+
+  std::string pids;
+  {
+    std::lock_guard lock(replicas_mutex_);
+    for (auto const& replica : replicas_[model]) {
+      pids += (pids.empty() ? "" : ", ") + std::to_string(replica->pid);
+    }
+  }
 
   Json::Value response;
-  response["status"] =
-      "Model loaded successfully with pid: " + std::to_string(pid);
+  response["status"] = "Model is loading with pid: " + pids;
   Json::Value status;
   status["is_done"] = true;
   status["has_error"] = false;
@@ -374,8 +811,7 @@ void PythonEngine::UnloadModel(
       models_.erase(model);
     } else {
       Json::Value error;
-      error["error"] = "Fail to terminate process with id: " +
-                       std::to_string(process_map_[model]);
+      error["error"] = "Fail to terminate processes of model: " + model;
       Json::Value status;
       status["is_done"] = true;
       status["has_error"] = true;
@@ -404,8 +840,24 @@ void PythonEngine::HandleChatCompletion(
 
 CurlResponse PythonEngine::MakeStreamPostRequest(
     const std::string& model, const std::string& path, const std::string& body,
-    const std::function<void(Json::Value&&, Json::Value&&)>& callback) {
-  auto const& config = models_[model];
+    const std::function<void(Json::Value&&, Json::Value&&)>& callback,
+    int slot, const std::atomic<bool>* stop) {
+  auto replica = AcquireReplica(model, slot);
+  if (!replica) {
+    auto response = NoReadyReplica(model);
+    Json::Value status;
+    status["is_done"] = true;
+    status["has_error"] = true;
+    status["is_stream"] = true;
+    status["status_code"] = 503;
+
+    Json::Value error;
+    error["error"] = response.error_message;
+    callback(std::move(status), std::move(error));
+    return response;
+  }
+  OutstandingGuard guard{replica};
+
   CURL* curl = curl_easy_init();
   CurlResponse response;
 
@@ -415,7 +867,8 @@ CurlResponse PythonEngine::MakeStreamPostRequest(
     return response;
   }
 
-  std::string full_url = "http://localhost:" + config.port + path;
+  std::string full_url = GetBaseUrl(*replica) + path;
+  auto const& socket_path = replica->socket_path;
 
   struct curl_slist* headers = nullptr;
   headers = curl_slist_append(headers, "Content-Type: application/json");
@@ -425,9 +878,11 @@ CurlResponse PythonEngine::MakeStreamPostRequest(
 
   StreamContext context{
       std::make_shared<std::function<void(Json::Value&&, Json::Value&&)>>(
-          callback),
-      ""};
+          callback)};
 
+  if (!socket_path.empty()) {
+    curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, socket_path.c_str());
+  }
   curl_easy_setopt(curl, CURLOPT_URL, full_url.c_str());
   curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
   curl_easy_setopt(curl, CURLOPT_POST, 1L);
@@ -435,8 +890,12 @@ CurlResponse PythonEngine::MakeStreamPostRequest(
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamWriteCallback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &context);
   curl_easy_setopt(curl, CURLOPT_TRANSFER_ENCODING, 1L);
+  AbortTransferOnStop(curl, stop);
 
   CURLcode res = curl_easy_perform(curl);
+  context.parser.Finish([&context](const sse::Event& event) {
+    return ForwardStreamEvent(&context, event);
+  });
 
   if (res != CURLE_OK) {
     response.error = true;
@@ -480,6 +939,9 @@ void PythonEngine::HandleInference(
       (*json_body).get("transform_response", "").asString();
   auto model = (*json_body)["model"].asString();
   auto& body = (*json_body)["body"];
+  auto slot = json_body->get("id_slot", -1).asInt();
+  // tracked until the request is over
+  auto stop = inflight_.Add(json_body->get("request_id", "").asString());
 
   if (models_.find(model) == models_.end()) {
     Json::Value error;
@@ -526,14 +988,16 @@ void PythonEngine::HandleInference(
   CurlResponse response;
   if (method == "post") {
     if (body.isMember("stream") && body["stream"].asBool()) {
-      q_.runTaskInQueue(
-          [this, model, path, transformed_request, cb = std::move(callback)] {
-            MakeStreamPostRequest(model, path, transformed_request, cb);
-          });
+      q_.runTaskInQueue([this, model, path, transformed_request, slot, stop,
+                         cb = std::move(callback)] {
+        MakeStreamPostRequest(model, path, transformed_request, cb, slot,
+                              stop.get());
+      });
 
       return;
     } else {
-      response = MakePostRequest(model, path, transformed_request);
+      response =
+          MakePostRequest(model, path, transformed_request, slot, stop.get());
     }
 
   } else if (method == "get") {
@@ -639,6 +1103,14 @@ Json::Value PythonEngine::GetRemoteModels() {
 
 void PythonEngine::StopInferencing(const std::string& model_id) {}
 
+void PythonEngine::StopRequest(const std::string& model_id,
+                               const std::string& request_id) {
+  if (!inflight_.Stop(request_id)) {
+    LOG_DEBUG << "Request " << request_id << " of " << model_id
+              << " is not running";
+  }
+}
+
 void PythonEngine::HandleRouteRequest(
     std::shared_ptr<Json::Value> json_body,
     std::function<void(Json::Value&&, Json::Value&&)>&& callback) {
@@ -820,13 +1292,46 @@ void PythonEngine::GetModelStatus(
   }
 
   auto model = json_body->get("model", "").asString();
-  auto model_config = models_[model];
-  auto health_endpoint = model_config.heath_check;
-  auto pid = process_map_[model];
-  auto is_process_live = process_status_utils::IsProcessRunning(pid);
-  auto response_health = MakeGetRequest(model, health_endpoint.path);
+  // polled while the model loads, which must not register it
+  config::PythonModelConfig model_config;
+  {
+    std::shared_lock lock(models_mutex_);
+    if (auto it = models_.find(model); it != models_.end()) {
+      model_config = it->second;
+    }
+  }
+  bool is_process_live = false;
+  bool is_ready = false;
+  bool is_starting = false;
+  std::string load_error;
+  Json::Value replicas_json(Json::arrayValue);
+  {
+    std::lock_guard lock(replicas_mutex_);
+    if (auto it = load_errors_.find(model); it != load_errors_.end()) {
+      load_error = it->second;
+    }
+    if (auto it = replicas_.find(model); it != replicas_.end()) {
+      // none spawned yet
+      is_starting = it->second.empty();
+      for (auto const& replica : it->second) {
+        is_process_live = is_process_live ||
+                          process_status_utils::IsProcessRunning(replica->pid);
+        is_ready = is_ready || replica->ready;
+        auto state = replica->health.state();
+        is_starting =
+            is_starting || state == ReplicaHealth::State::kStarting;
+        Json::Value r;
+        r["pid"] = replica->pid;
+        r["state"] = ReplicaHealth::ToString(state);
+        r["ready"] = replica->ready.load();
+        r["outstanding_requests"] = replica->outstanding.load();
+        r["restarts"] = replica->health.restarts();
+        replicas_json.append(r);
+      }
+    }
+  }
 
-  if (response_health.error && is_process_live) {
+  if (!is_ready && (is_process_live || is_starting)) {
     Json::Value status;
     status["is_done"] = true;
     status["has_error"] = false;
@@ -837,14 +1342,17 @@ void PythonEngine::GetModelStatus(
     callback(std::move(status), std::move(message));
     return;
   }
-  else if(response_health.error && !is_process_live){
+  else if(!is_ready && !is_process_live){
     Json::Value status;
     status["is_done"] = true;
     status["has_error"] = true;
     status["is_stream"] = false;
     status["status_code"] = k400BadRequest;
     Json::Value message;
-    message["message"] = response_health.error_message;
+    message["message"] =
+        load_error.empty() ? "model '" + model + "' is not running"
+                           : "model '" + model + "' failed to load: " +
+                                 load_error;
     callback(std::move(status), std::move(message));
     return;
   }
@@ -853,6 +1361,7 @@ void PythonEngine::GetModelStatus(
   response["model"] = model;
   response["model_loaded"] = true;
   response["model_data"] = model_config.ToJson();
+  response["replicas"] = replicas_json;
 
   Json::Value status;
   status["is_done"] = true;
@@ -872,7 +1381,7 @@ void PythonEngine::HandleEmbedding(
 bool PythonEngine::IsSupported(const std::string& f) {
   if (f == "HandleChatCompletion" || f == "LoadModel" || f == "UnloadModel" ||
       f == "GetModelStatus" || f == "GetModels" || f == "SetFileLogger" ||
-      f == "SetLogLevel") {
+      f == "SetLogLevel" || f == "StopRequest") {
     return true;
   }
   return false;
@@ -910,8 +1419,15 @@ void PythonEngine::Load(EngineLoadOption opts) {
 };
 
 void PythonEngine::Unload(EngineUnloadOption opts) {
-  for (const auto& pair : models_) {
-    TerminateModelProcess(pair.first);
+  std::vector<std::string> models;
+  {
+    std::shared_lock lock(models_mutex_);
+    for (const auto& pair : models_) {
+      models.push_back(pair.first);
+    }
+  }
+  for (const auto& model : models) {
+    TerminateModelProcess(model);
   }
 };
 
@@ -3,26 +3,50 @@
 #include <curl/curl.h>
 #include <json/json.h>
 #include <yaml-cpp/yaml.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <shared_mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
+#include "common/inflight_requests.h"
 #include "config/model_config.h"
 #include "trantor/utils/ConcurrentTaskQueue.h"
 
 #include "cortex-common/EngineI.h"
+#include "extensions/python-engine/replica_health.h"
 #include "extensions/template_renderer.h"
 #include "utils/file_logger.h"
 #include "utils/file_manager_utils.h"
 #include "utils/process_status_utils.h"
 #include "utils/curl_utils.h"
 #include "utils/process/utils.h"
+#include "utils/sse_parser.h"
 
 // Helper for CURL response
 namespace python_engine {
 struct StreamContext {
   std::shared_ptr<std::function<void(Json::Value&&, Json::Value&&)>> callback;
-  std::string buffer;
+  sse::Parser parser{};
+};
+
+// One process serving a model
+struct Replica {
+  size_t index = 0;
+  pid_t pid = -1;
+  // TCP port, unused when the replica listens on [socket_path]
+  std::string port;
+  std::string socket_path;
+  // mirrors health.ready(), read without the lock by the request paths
+  std::atomic<bool> ready{false};
+  std::atomic<int> outstanding{0};
+  // guarded by the replicas mutex of the engine
+  ReplicaHealth health;
 };
 
 struct CurlResponse {
@@ -40,13 +64,41 @@ class PythonEngine : public EngineI {
   std::unordered_map<std::string, config::PythonModelConfig> models_;
   extensions::TemplateRenderer renderer_;
   std::unique_ptr<trantor::FileLogger> async_file_logger_;
-  std::unordered_map<std::string, pid_t> process_map_;
+  // Processes of the loaded models, registered as soon as they are spawned.
+  // The supervisor probes them, restarts them on exit and swaps the new
+  // process in, so a model being loaded or unloaded never leaves one behind.
+  std::mutex replicas_mutex_;
+  std::unordered_map<std::string, std::vector<std::shared_ptr<Replica>>>
+      replicas_;
+  std::condition_variable supervisor_cv_;
+  std::atomic<bool> stop_supervisor_{false};
+  std::thread supervisor_;
   trantor::ConcurrentTaskQueue q_;
+  // Inference requests being served, which StopRequest aborts
+  InflightRequests inflight_;
+  // Why the last load of a model failed, by model, reported by its status.
+  // Guarded by replicas_mutex_
+  std::unordered_map<std::string, std::string> load_errors_;
+  // Waits for the replicas of the models being loaded, off the thread which
+  // called LoadModel
+  trantor::ConcurrentTaskQueue loader_;
 
   // Helper functions
+  /**
+   * Pick the ready replica of [model] with the fewest requests in flight and
+   * count the caller's request against it, nullptr if none is ready. A
+   * request pinned to [slot] goes to the replica of that slot while it is
+   * ready, so a session keeps hitting the same process.
+   */
+  std::shared_ptr<Replica> AcquireReplica(const std::string& model,
+                                          int slot = -1);
+  CurlResponse MakeRequest(const Replica& replica, const std::string& path,
+                           RequestType type, const std::string& body = "",
+                           const std::atomic<bool>* stop = nullptr);
   CurlResponse MakePostRequest(const std::string& model,
-                               const std::string& path,
-                               const std::string& body);
+                               const std::string& path, const std::string& body,
+                               int slot = -1,
+                               const std::atomic<bool>* stop = nullptr);
   CurlResponse MakeGetRequest(const std::string& model,
                               const std::string& path);
   CurlResponse MakeDeleteRequest(const std::string& model,
@@ -54,10 +106,36 @@ class PythonEngine : public EngineI {
   CurlResponse MakeStreamPostRequest(
       const std::string& model, const std::string& path,
       const std::string& body,
-      const std::function<void(Json::Value&&, Json::Value&&)>& callback);
+      const std::function<void(Json::Value&&, Json::Value&&)>& callback,
+      int slot = -1, const std::atomic<bool>* stop = nullptr);
 
   // Process manager functions
   bool TerminateModelProcess(const std::string& model);
+  bool SpawnReplica(const std::string& model,
+                    const config::PythonModelConfig& config, Replica& replica);
+  bool ProbeReplica(const config::PythonModelConfig& config,
+                    const Replica& replica);
+  /**
+   * Wait until the replicas of [model] being loaded pass the health check of
+   * the supervisor, returns the number of ready replicas, nullopt if the
+   * model was unloaded or the engine stopped meanwhile.
+   */
+  std::optional<size_t> WaitForReplicas(const std::string& model);
+  // Unloads [model] if none of its replicas passes the health check
+  void FinishLoad(const std::string& model);
+  // Terminates the replicas of [model] and forgets its config
+  void AbortLoad(const std::string& model);
+  // Requires replicas_mutex_ held
+  bool IsRegistered(const std::string& model,
+                    const std::shared_ptr<Replica>& replica) const;
+  void Supervise();
+  void SuperviseReplica(const std::string& model,
+                        const config::PythonModelConfig& config,
+                        const std::shared_ptr<Replica>& replica);
+  // Spawns a new process for an exited [replica] and swaps it in
+  void RestartReplica(const std::string& model,
+                      const config::PythonModelConfig& config,
+                      const std::shared_ptr<Replica>& replica);
 
   // Internal model management
   bool LoadModelConfig(const std::string& model, const std::string& yaml_path);
@@ -107,5 +185,7 @@ class PythonEngine : public EngineI {
       std::function<void(Json::Value&&, Json::Value&&)>&& callback) override;
   Json::Value GetRemoteModels() override;
   void StopInferencing(const std::string& model_id) override;
+  void StopRequest(const std::string& model_id,
+                   const std::string& request_id) override;
 };
 }  // namespace python_engine
\ No newline at end of file
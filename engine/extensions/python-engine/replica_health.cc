@@ -0,0 +1,55 @@
+#include "replica_health.h"
+#include <algorithm>
+
+namespace python_engine {
+
+void ReplicaHealth::OnProbe(bool healthy) {
+  if (state_ == State::kExited) {
+    return;
+  }
+  if (healthy) {
+    state_ = State::kReady;
+    failed_probes_ = 0;
+    failures_ = 0;
+    return;
+  }
+  // a replica still starting up refuses connections, that's no failure
+  if (state_ == State::kStarting) {
+    return;
+  }
+  failed_probes_++;
+  if (failed_probes_ >= kMaxFailedProbes) {
+    state_ = State::kUnhealthy;
+  }
+}
+
+void ReplicaHealth::OnExit(Clock::time_point now) {
+  auto backoff = std::min<Clock::duration>(
+      kMaxRestartBackoff, std::chrono::seconds(1 << std::min(failures_, 5)));
+  failures_++;
+  state_ = State::kExited;
+  failed_probes_ = 0;
+  next_restart_ = now + backoff;
+}
+
+void ReplicaHealth::OnRestart() {
+  state_ = State::kStarting;
+  failed_probes_ = 0;
+  restarts_++;
+}
+
+const char* ReplicaHealth::ToString(State state) {
+  switch (state) {
+    case State::kStarting:
+      return "starting";
+    case State::kReady:
+      return "ready";
+    case State::kUnhealthy:
+      return "unhealthy";
+    case State::kExited:
+      return "exited";
+  }
+  return "unknown";
+}
+
+}  // namespace python_engine
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+
+namespace python_engine {
+
+/**
+ * Health of one replica of a python model, as seen by the supervisor.
+ *
+ * A spawned replica is starting until its health check answers, then ready.
+ * A ready replica keeps being probed: after a few failed probes in a row it
+ * is unhealthy and gets no traffic, and if it doesn't recover it is
+ * terminated. An exited replica is restarted after a backoff which grows
+ * with the exits since it was last ready.
+ */
+class ReplicaHealth {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  enum class State { kStarting, kReady, kUnhealthy, kExited };
+
+  // Failed probes in a row taking a ready replica out of rotation
+  static constexpr int kMaxFailedProbes = 3;
+  // Failed probes in a row after which an unhealthy replica is terminated
+  static constexpr int kMaxUnhealthyProbes = 2 * kMaxFailedProbes;
+  static constexpr auto kMaxRestartBackoff = std::chrono::seconds(30);
+
+  State state() const { return state_; }
+
+  // Only ready replicas get requests
+  bool ready() const { return state_ == State::kReady; }
+
+  int restarts() const { return restarts_; }
+
+  // Result of a health check of the running process
+  void OnProbe(bool healthy);
+
+  void OnExit(Clock::time_point now);
+
+  bool ShouldRestart(Clock::time_point now) const {
+    return state_ == State::kExited && now >= next_restart_;
+  }
+
+  void OnRestart();
+
+  // The process stopped answering for good, the supervisor kills it
+  bool ShouldTerminate() const {
+    return state_ == State::kUnhealthy &&
+           failed_probes_ >= kMaxUnhealthyProbes;
+  }
+
+  static const char* ToString(State state);
+
+ private:
+  State state_ = State::kStarting;
+  int failed_probes_ = 0;
+  int restarts_ = 0;
+  // exits since the replica was last ready
+  int failures_ = 0;
+  Clock::time_point next_restart_;
+};
+
+}  // namespace python_engine
@@ -0,0 +1,259 @@
+#include "rate_limiter.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace remote_engine {
+namespace {
+using Clock = RateLimiter::Clock;
+
+// How long a 429 pauses requests when the provider doesn't say
+constexpr const auto kDefaultPause = std::chrono::seconds(1);
+
+int ToRetryAfterSeconds(Clock::duration wait) {
+  auto s = std::chrono::duration<double>(wait).count();
+  return std::max(1, static_cast<int>(std::ceil(s)));
+}
+
+std::optional<double> GetNumber(const RateLimiter::Headers& headers,
+                                std::initializer_list<const char*> names) {
+  for (auto const* name : names) {
+    if (auto it = headers.find(name); it != headers.end()) {
+      try {
+        return std::stod(it->second);
+      } catch (const std::exception&) {
+        // a date or something else we don't understand
+      }
+    }
+  }
+  return std::nullopt;
+}
+}  // namespace
+
+RateLimiter::RateLimiter(Config config, TimerFn timer)
+    : config_{std::move(config)},
+      timer_{std::move(timer)},
+      last_refill_{Clock::now()} {
+  auto init = [this](Bucket& bucket, double per_minute) {
+    if (per_minute <= 0) {
+      return;
+    }
+    bucket.rate_per_s = per_minute / 60.0;
+    bucket.capacity =
+        std::max(bucket.rate_per_s * config_.burst_seconds, 1.0);
+    bucket.level = bucket.capacity;
+  };
+  init(requests_, config_.requests_per_minute);
+  init(tokens_, config_.tokens_per_minute);
+}
+
+bool RateLimiter::TryAcquire(int64_t tokens) {
+  std::lock_guard<std::mutex> l(mtx_);
+  auto now = Clock::now();
+  Refill(now);
+  if (!queue_.empty() || TimeToFit(tokens, now) > Clock::duration::zero()) {
+    return false;
+  }
+  Charge(tokens);
+  return true;
+}
+
+void RateLimiter::Acquire(int64_t tokens, AdmitFn on_admit) {
+  Rejection rejection;
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    auto now = Clock::now();
+    Refill(now);
+    auto wait = TimeToFit(tokens, now);
+    if (queue_.size() >= config_.max_queue) {
+      rejection = Rejection{
+          .retry_after_s = ToRetryAfterSeconds(wait),
+          .message = "Too many requests waiting for the provider rate limit"};
+    } else if (queue_.empty() && wait > config_.max_wait) {
+      rejection = Rejection{
+          .retry_after_s = ToRetryAfterSeconds(wait),
+          .message = "Request would wait too long for the provider rate limit"};
+    } else {
+      queue_.push_back(Waiter{.tokens = tokens,
+                              .deadline = now + config_.max_wait,
+                              .on_admit = std::move(on_admit)});
+      // the others wait for the head, which drains them once it goes
+      if (queue_.size() == 1) {
+        ScheduleDrain(wait);
+      }
+      return;
+    }
+  }
+  on_admit(std::move(rejection));
+}
+
+void RateLimiter::Drain() {
+  std::vector<std::pair<AdmitFn, std::optional<Rejection>>> answers;
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    drain_at_.reset();
+    auto now = Clock::now();
+    Refill(now);
+    while (!queue_.empty()) {
+      auto& head = queue_.front();
+      auto wait = TimeToFit(head.tokens, now);
+      if (wait <= Clock::duration::zero()) {
+        Charge(head.tokens);
+        answers.emplace_back(std::move(head.on_admit), std::nullopt);
+      } else if (now + wait > head.deadline) {
+        Rejection rejection{
+            .retry_after_s = ToRetryAfterSeconds(wait),
+            .message = "Timed out waiting for the provider rate limit"};
+        answers.emplace_back(std::move(head.on_admit), std::move(rejection));
+      } else {
+        ScheduleDrain(wait);
+        break;
+      }
+      queue_.pop_front();
+    }
+  }
+  for (auto& [on_admit, rejection] : answers) {
+    on_admit(std::move(rejection));
+  }
+}
+
+void RateLimiter::ScheduleDrain(Clock::duration delay) {
+  auto at = Clock::now() + delay;
+  if (drain_at_ && *drain_at_ <= at) {
+    return;
+  }
+  drain_at_ = at;
+  timer_(delay, [this] { Drain(); });
+}
+
+void RateLimiter::Charge(int64_t tokens) {
+  if (requests_.limited()) {
+    requests_.level -= 1;
+  }
+  if (tokens_.limited()) {
+    tokens_.level -= tokens;
+  }
+}
+
+void RateLimiter::Update(long status_code, const Headers& headers) {
+  std::lock_guard<std::mutex> l(mtx_);
+  auto now = Clock::now();
+  Refill(now);
+
+  // OpenAI and Anthropic report what is left of the provider budget
+  if (auto remaining =
+          GetNumber(headers, {"x-ratelimit-remaining-requests",
+                              "anthropic-ratelimit-requests-remaining"});
+      remaining && requests_.limited()) {
+    requests_.level = std::min(requests_.level, *remaining);
+  }
+  if (auto remaining =
+          GetNumber(headers, {"x-ratelimit-remaining-tokens",
+                              "anthropic-ratelimit-tokens-remaining"});
+      remaining && tokens_.limited()) {
+    tokens_.level = std::min(tokens_.level, *remaining);
+  }
+
+  if (status_code == 429) {
+    Clock::duration pause = kDefaultPause;
+    if (auto ms = GetNumber(headers, {"retry-after-ms"}); ms) {
+      pause = std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double, std::milli>(*ms));
+    } else if (auto s = GetNumber(headers, {"retry-after"}); s) {
+      pause = std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(*s));
+    }
+    paused_until_ = std::max(paused_until_, now + pause);
+    for (auto* bucket : {&requests_, &tokens_}) {
+      bucket->level = std::min(bucket->level, 0.0);
+    }
+  }
+  // the head may fit sooner or later than planned
+  if (!queue_.empty()) {
+    ScheduleDrain(Clock::duration::zero());
+  }
+}
+
+void RateLimiter::Adjust(int64_t tokens) {
+  std::lock_guard<std::mutex> l(mtx_);
+  if (tokens_.limited()) {
+    tokens_.level = std::min(tokens_.capacity, tokens_.level - tokens);
+  }
+  if (!queue_.empty()) {
+    ScheduleDrain(Clock::duration::zero());
+  }
+}
+
+size_t RateLimiter::GetQueueSize() const {
+  std::lock_guard<std::mutex> l(mtx_);
+  return queue_.size();
+}
+
+void RateLimiter::Refill(Clock::time_point now) {
+  auto elapsed = std::chrono::duration<double>(now - last_refill_).count();
+  if (elapsed <= 0) {
+    return;
+  }
+  last_refill_ = now;
+  for (auto* bucket : {&requests_, &tokens_}) {
+    if (bucket->limited()) {
+      bucket->level = std::min(bucket->capacity,
+                               bucket->level + elapsed * bucket->rate_per_s);
+    }
+  }
+}
+
+Clock::duration RateLimiter::TimeToFit(int64_t tokens,
+                                       Clock::time_point now) const {
+  double wait_s = 0;
+  auto need = [&wait_s](const Bucket& bucket, double cost) {
+    if (!bucket.limited()) {
+      return;
+    }
+    // a request larger than the bucket goes once the bucket is full
+    auto required = std::min(cost, bucket.capacity);
+    if (bucket.level < required) {
+      wait_s = std::max(wait_s, (required - bucket.level) / bucket.rate_per_s);
+    }
+  };
+  need(requests_, 1);
+  need(tokens_, static_cast<double>(tokens));
+
+  auto wait = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(wait_s));
+  if (paused_until_ > now) {
+    wait = std::max(wait, paused_until_ - now);
+  }
+  return wait;
+}
+
+size_t CollectHeader(char* buffer, size_t size, size_t nitems,
+                     void* userdata) {
+  auto* headers = static_cast<RateLimiter::Headers*>(userdata);
+  auto n = size * nitems;
+  std::string_view line(buffer, n);
+  // a new status line, after a redirect or a 100 Continue
+  if (line.rfind("HTTP/", 0) == 0) {
+    headers->clear();
+    return n;
+  }
+  auto colon = line.find(':');
+  if (colon == std::string_view::npos) {
+    return n;
+  }
+  std::string name(line.substr(0, colon));
+  std::transform(name.begin(), name.end(), name.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  auto value = line.substr(colon + 1);
+  auto begin = value.find_first_not_of(" \t");
+  auto end = value.find_last_not_of(" \t\r\n");
+  (*headers)[name] = begin == std::string_view::npos
+                         ? ""
+                         : std::string(value.substr(begin, end - begin + 1));
+  return n;
+}
+
+}  // namespace remote_engine
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace remote_engine {
+
+/**
+ * Client-side rate limit of a remote provider account.
+ *
+ * Two token buckets, one for requests and one for estimated tokens, refill
+ * continuously at their per-minute rate and hold a few seconds worth of
+ * budget, so a burst is spread out locally instead of hitting the provider
+ * limit. Requests which don't fit wait in a bounded FIFO queue, which holds
+ * no thread: the head of the queue is woken up by a timer once it fits. The
+ * provider's answers adapt the buckets: a 429 pauses every request for its
+ * Retry-After, and the remaining budget reported in rate-limit headers caps
+ * the local one.
+ */
+class RateLimiter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Config {
+    // 0 means unlimited
+    double requests_per_minute = 0;
+    double tokens_per_minute = 0;
+    // Budget which can be spent at once, as seconds of refill
+    double burst_seconds = 6;
+    size_t max_queue = 64;
+    std::chrono::milliseconds max_wait{std::chrono::seconds(60)};
+  };
+
+  struct Rejection {
+    int retry_after_s;
+    std::string message;
+  };
+
+  using Headers = std::unordered_map<std::string, std::string>;
+
+  // Answer to a queued request, a rejection if it won't be sent
+  using AdmitFn = std::function<void(std::optional<Rejection>)>;
+
+  // Runs [task] after [delay] on another thread, never inline
+  using TimerFn =
+      std::function<void(Clock::duration delay, std::function<void()> task)>;
+
+  RateLimiter(Config config, TimerFn timer);
+
+  /**
+   * Admit a request of [tokens] estimated tokens if it fits now and no other
+   * request is queued.
+   */
+  bool TryAcquire(int64_t tokens);
+
+  /**
+   * Queue a request of [tokens] estimated tokens. [on_admit] runs from the
+   * timer once it fits, or with a rejection if it would wait for longer than
+   * the maximum wait. A full queue rejects it at once.
+   */
+  void Acquire(int64_t tokens, AdmitFn on_admit);
+
+  /**
+   * Adapt to the answer of the provider, [headers] having lowercase names.
+   */
+  void Update(long status_code, const Headers& headers);
+
+  // Charge the difference once the actual usage of a request is known
+  void Adjust(int64_t tokens);
+
+  size_t GetQueueSize() const;
+
+ private:
+  struct Bucket {
+    double rate_per_s = 0;
+    double capacity = 0;
+    double level = 0;
+
+    bool limited() const { return rate_per_s > 0; }
+  };
+
+  struct Waiter {
+    int64_t tokens;
+    Clock::time_point deadline;
+    AdmitFn on_admit;
+  };
+
+  // Answer the requests at the head of the queue which fit or expired
+  void Drain();
+
+  // Drain after [delay] unless a drain comes sooner, [mtx_] held
+  void ScheduleDrain(Clock::duration delay);
+
+  void Charge(int64_t tokens);
+
+  void Refill(Clock::time_point now);
+
+  // Time until a request of [tokens] fits, zero if it does now
+  Clock::duration TimeToFit(int64_t tokens, Clock::time_point now) const;
+
+  Config config_;
+  TimerFn timer_;
+
+  mutable std::mutex mtx_;
+  Bucket requests_;
+  Bucket tokens_;
+  Clock::time_point last_refill_;
+  Clock::time_point paused_until_;
+  std::deque<Waiter> queue_;
+  std::optional<Clock::time_point> drain_at_;
+};
+
+/**
+ * CURLOPT_HEADERFUNCTION collecting the headers of a response into the
+ * RateLimiter::Headers at [userdata], names lowercased.
+ */
+size_t CollectHeader(char* buffer, size_t size, size_t nitems, void* userdata);
+
+}  // namespace remote_engine
@@ -12,6 +12,8 @@ namespace {
 constexpr const int k200OK = 200;
 constexpr const int k400BadRequest = 400;
 constexpr const int k409Conflict = 409;
+constexpr const int k429TooManyRequests = 429;
+constexpr const int k499ClientClosedRequest = 499;
 constexpr const int k500InternalServerError = 500;
 constexpr const int kFileLoggerOption = 0;
 
@@ -20,61 +22,73 @@ constexpr const std::array<std::string_view, 5> kAnthropicModels = {
     "claude-3-opus-20240229", "claude-3-sonnet-20240229",
     "claude-3-haiku-20240307"};
 
-}  // namespace
+// Attempts of a non-stream request the provider throttles
+constexpr const int kMaxThrottledAttempts = 3;
 
-size_t StreamWriteCallback(char* ptr, size_t size, size_t nmemb,
-                           void* userdata) {
-  auto* context = static_cast<StreamContext*>(userdata);
-  std::string chunk(ptr, size * nmemb);
-  CTL_DBG(chunk);
-  Json::Value check_error;
-  Json::Reader reader;
-  if (reader.parse(chunk, check_error)) {
-    CTL_WRN(chunk);
+// Providers count the prompt and the completion budget against token limits
+int64_t EstimateTokens(const Json::Value& body, const std::string& request) {
+  // about 4 characters per token
+  int64_t tokens = request.size() / 4;
+  for (auto const* key : {"max_completion_tokens", "max_tokens"}) {
+    if (body.isMember(key) && body[key].isIntegral()) {
+      return tokens + body[key].asInt64();
+    }
+  }
+  return tokens;
+}
+
+int64_t GetUsedTokens(const Json::Value& response) {
+  auto const& usage = response["usage"];
+  if (usage.isMember("total_tokens")) {
+    return usage["total_tokens"].asInt64();
+  }
+  return usage.get("input_tokens", 0).asInt64() +
+         usage.get("output_tokens", 0).asInt64();
+}
+
+Json::Value RateLimitedStatus(bool is_stream) {
+  Json::Value status;
+  status["is_done"] = true;
+  status["has_error"] = true;
+  status["is_stream"] = is_stream;
+  status["status_code"] = k429TooManyRequests;
+  return status;
+}
+
+// Answer to a request stopped before it was sent
+Json::Value StoppedStatus(bool is_stream) {
+  Json::Value status;
+  status["is_done"] = true;
+  status["has_error"] = true;
+  status["is_stream"] = is_stream;
+  status["status_code"] = k499ClientClosedRequest;
+  return status;
+}
+
+// Forwards one event of the provider stream, false once it is over
+bool ForwardStreamEvent(StreamContext* context, const sse::Event& event) {
+  context->has_events = true;
+  CTL_DBG(std::string(event.data));
+  if (event.data == "[DONE]" || event.type == "message_stop") {
     Json::Value status;
     status["is_done"] = true;
-    status["has_error"] = true;
+    status["has_error"] = false;
     status["is_stream"] = true;
-    status["status_code"] = k400BadRequest;
+    status["status_code"] = k200OK;
     context->need_stop = false;
-    (*context->callback)(std::move(status), std::move(check_error));
-    return size * nmemb;
+    (*context->callback)(std::move(status), Json::Value());
+    return false;
   }
 
-  context->buffer += chunk;
-  // Process complete lines
-  size_t pos;
-  while ((pos = context->buffer.find('\n')) != std::string::npos) {
-    std::string line = context->buffer.substr(0, pos);
-    context->buffer = context->buffer.substr(pos + 1);
-
-    // Skip empty lines
-    if (line.empty() || line == "\r" ||
-        line.find("event:") != std::string::npos)
-      continue;
-
-    CTL_DBG(line);
-    if (line == "data: [DONE]" ||
-        line.find("message_stop") != std::string::npos) {
-      Json::Value status;
-      status["is_done"] = true;
-      status["has_error"] = false;
-      status["is_stream"] = true;
-      status["status_code"] = k200OK;
-      context->need_stop = false;
-      (*context->callback)(std::move(status), Json::Value());
-      break;
-    }
-
-    // Parse the JSON
-    Json::Value chunk_json;
-    std::string s = line;
-    if (line.size() > 6)
-      s = line.substr(6);
+  Json::Value chunk_json;
+  if (context->stream_template.empty()) {
+    // already in the OpenAI format, nothing to parse
+    chunk_json["data"] = sse::Serialize(event);
+  } else {
     try {
-      auto root = json_helper::ParseJsonString(s);
+      auto root = json_helper::ParseJsonString(std::string(event.data));
       if (root.getMemberNames().empty())
-        continue;
+        return true;
       root["model"] = context->model;
       root["id"] = context->id;
       root["stream"] = true;
@@ -83,23 +97,66 @@ size_t StreamWriteCallback(char* ptr, size_t size, size_t nmemb,
       chunk_json["data"] = "data: " + result + "\n\n";
     } catch (const std::exception& e) {
       CTL_WRN("JSON parse error: " << e.what());
-      continue;
+      return true;
     }
+  }
 
-    Json::Value status;
-    status["is_done"] = false;
-    status["has_error"] = false;
-    status["is_stream"] = true;
-    status["status_code"] = 200;
-    (*context->callback)(std::move(status), std::move(chunk_json));
+  Json::Value status;
+  status["is_done"] = false;
+  status["has_error"] = false;
+  status["is_stream"] = true;
+  status["status_code"] = 200;
+  (*context->callback)(std::move(status), std::move(chunk_json));
+  return true;
+}
+}  // namespace
+
+size_t StreamWriteCallback(char* ptr, size_t size, size_t nmemb,
+                           void* userdata) {
+  auto* context = static_cast<StreamContext*>(userdata);
+  std::string_view chunk(ptr, size * nmemb);
+  CTL_DBG(std::string(chunk));
+  // A provider error is a plain JSON body instead of events
+  auto first = chunk.find_first_not_of(" \t\r\n");
+  if (!context->has_events && first != std::string_view::npos &&
+      chunk[first] == '{') {
+    Json::Value check_error;
+    Json::Reader reader;
+    if (reader.parse(chunk.data(), chunk.data() + chunk.size(),
+                     check_error)) {
+      CTL_WRN(std::string(chunk));
+      long status_code = 0;
+      if (context->curl) {
+        curl_easy_getinfo(context->curl, CURLINFO_RESPONSE_CODE,
+                          &status_code);
+      }
+      Json::Value status;
+      status["is_done"] = true;
+      status["has_error"] = true;
+      status["is_stream"] = true;
+      status["status_code"] = status_code == k429TooManyRequests
+                                  ? k429TooManyRequests
+                                  : k400BadRequest;
+      context->need_stop = false;
+      (*context->callback)(std::move(status), std::move(check_error));
+      return size * nmemb;
+    }
   }
 
+  context->parser.Feed(chunk, [context](const sse::Event& event) {
+    return ForwardStreamEvent(context, event);
+  });
   return size * nmemb;
 }
 
 CurlResponse RemoteEngine::MakeStreamingChatCompletionRequest(
     const ModelConfig& config, const std::string& body,
-    const std::function<void(Json::Value&&, Json::Value&&)>& callback) {
+    const std::function<void(Json::Value&&, Json::Value&&)>& callback,
+    const Admission& admission, const std::atomic<bool>* stop) {
+  if (config.router) {
+    return MakeRoutedStreamingChatCompletionRequest(config, body, callback,
+                                                    admission, stop);
+  }
 
   CURL* curl = curl_easy_init();
   CurlResponse response;
@@ -139,7 +196,7 @@ CurlResponse RemoteEngine::MakeStreamingChatCompletionRequest(
   StreamContext context{
       std::make_shared<std::function<void(Json::Value&&, Json::Value&&)>>(
           callback),
-      "",
+      {},
       "",
       config.model,
       renderer_,
@@ -152,8 +209,17 @@ CurlResponse RemoteEngine::MakeStreamingChatCompletionRequest(
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamWriteCallback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &context);
   curl_easy_setopt(curl, CURLOPT_TRANSFER_ENCODING, 1L);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, CollectHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response.headers);
+  AbortTransferOnStop(curl, stop);
+  context.curl = curl;
 
   CURLcode res = curl_easy_perform(curl);
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status_code);
+  context.curl = nullptr;
+  context.parser.Finish([&context](const sse::Event& event) {
+    return ForwardStreamEvent(&context, event);
+  });
 
   if (res != CURLE_OK) {
     response.error = true;
@@ -184,6 +250,80 @@ CurlResponse RemoteEngine::MakeStreamingChatCompletionRequest(
   return response;
 }
 
+CurlResponse RemoteEngine::MakeRoutedStreamingChatCompletionRequest(
+    const ModelConfig& config, const std::string& body,
+    const std::function<void(Json::Value&&, Json::Value&&)>& callback,
+    const Admission& admission, const std::atomic<bool>* stop) {
+  std::string stream_template = chat_res_template_;
+  if (config.transform_resp["chat_completions"] &&
+      config.transform_resp["chat_completions"]["template"]) {
+    // Model level overrides engine level
+    stream_template =
+        config.transform_resp["chat_completions"]["template"].as<std::string>();
+  }
+
+  StreamContext context{
+      std::make_shared<std::function<void(Json::Value&&, Json::Value&&)>>(
+          callback),
+      {},
+      "",
+      config.model,
+      renderer_,
+      stream_template};
+
+  // Only the upstream which wins the race feeds the stream
+  auto res = config.router->Post(
+      body,
+      {"Content-Type: application/json", "Accept: text/event-stream",
+       "Cache-Control: no-cache"},
+      [&context](const char* data, size_t size) {
+        StreamWriteCallback(const_cast<char*>(data), 1, size, &context);
+        return true;
+      },
+      admission.upstream, admission.tokens, stop);
+  context.parser.Finish([&context](const sse::Event& event) {
+    return ForwardStreamEvent(&context, event);
+  });
+
+  CurlResponse response;
+  response.status_code = res.status_code;
+  response.headers = std::move(res.headers);
+  response.limiter = std::move(res.limiter);
+  if (res.error) {
+    response.error = true;
+    response.error_message = res.error_message;
+
+    Json::Value status;
+    status["is_done"] = true;
+    status["has_error"] = true;
+    status["is_stream"] = true;
+    status["status_code"] = res.status_code == k429TooManyRequests
+                                ? k429TooManyRequests
+                                : k500InternalServerError;
+
+    // the error of the last upstream, when it sent one
+    Json::Value error;
+    Json::Reader reader;
+    if (res.body.empty() || !reader.parse(res.body, error)) {
+      error = Json::Value();
+      error["error"] = response.error_message;
+    }
+    context.need_stop = false;
+    callback(std::move(status), std::move(error));
+  }
+
+  if (context.need_stop) {
+    CTL_DBG("No stop message received, need to stop");
+    Json::Value status;
+    status["is_done"] = true;
+    status["has_error"] = false;
+    status["is_stream"] = true;
+    status["status_code"] = k200OK;
+    (*context.callback)(std::move(status), Json::Value());
+  }
+  return response;
+}
+
 std::string ReplaceApiKeyPlaceholder(const std::string& templateStr,
                                      const std::string& apiKey) {
   const std::string placeholder = "{{api_key}}";
@@ -219,8 +359,11 @@ static size_t WriteCallback(char* ptr, size_t size, size_t nmemb,
 }
 
 RemoteEngine::RemoteEngine(const std::string& engine_name)
-    : engine_name_(engine_name), q_(1 /*n_parallel*/, engine_name) {
+    : engine_name_(engine_name),
+      q_(1 /*n_parallel*/, engine_name),
+      timer_loop_(engine_name + "_rate_limit") {
   curl_global_init(CURL_GLOBAL_ALL);
+  timer_loop_.run();
 }
 
 RemoteEngine::~RemoteEngine() {
@@ -278,7 +421,23 @@ CurlResponse RemoteEngine::MakeGetModelsRequest(
 
 CurlResponse RemoteEngine::MakeChatCompletionRequest(
     const ModelConfig& config, const std::string& body,
+    const Admission& admission, const std::atomic<bool>* stop,
     const std::string& method) {
+  if (config.router && method == "POST") {
+    auto res = config.router->Post(body, {"Content-Type: application/json"},
+                                   nullptr, admission.upstream,
+                                   admission.tokens, stop);
+    CurlResponse response;
+    // with a body, the error of the last upstream is passed on as is
+    response.body = std::move(res.body);
+    response.error = res.error && response.body.empty();
+    response.error_message = res.error_message;
+    response.status_code = res.status_code;
+    response.headers = std::move(res.headers);
+    response.limiter = std::move(res.limiter);
+    return response;
+  }
+
   CURL* curl = curl_easy_init();
   CurlResponse response;
 
@@ -312,6 +471,9 @@ CurlResponse RemoteEngine::MakeChatCompletionRequest(
   std::string response_string;
   curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
   curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_string);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, CollectHeader);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response.headers);
+  AbortTransferOnStop(curl, stop);
 
   CURLcode res = curl_easy_perform(curl);
   if (res != CURLE_OK) {
@@ -319,6 +481,7 @@ CurlResponse RemoteEngine::MakeChatCompletionRequest(
     response.error_message = curl_easy_strerror(res);
   } else {
     response.body = response_string;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status_code);
   }
 
   curl_slist_free_all(headers);
@@ -354,6 +517,16 @@ bool RemoteEngine::LoadModelConfig(const std::string& model,
       LOG_WARN << "Missing transform_resp in config for model " << model;
     }
 
+    if (auto upstreams = config["upstreams"];
+        upstreams && upstreams.IsSequence() && upstreams.size() > 0) {
+      auto default_url = chat_url_;
+      if (model_config.transform_req["chat_completions"]["url"]) {
+        default_url = model_config.transform_req["chat_completions"]["url"]
+                          .as<std::string>();
+      }
+      model_config.router = LoadUpstreams(config, body, default_url);
+    }
+
     model_config.is_loaded = true;
 
     // Thread-safe update of models map
@@ -371,6 +544,85 @@ bool RemoteEngine::LoadModelConfig(const std::string& model,
   }
 }
 
+std::shared_ptr<RateLimiter> RemoteEngine::GetRateLimiter(
+    const std::string& api_key) {
+  std::lock_guard<std::mutex> l(limiters_mtx_);
+  if (auto it = limiters_.find(api_key); it != limiters_.end()) {
+    return it->second;
+  }
+  // Without limits in the metadata, the limiter still honours Retry-After
+  RateLimiter::Config config;
+  if (auto const& limits = metadata_["rate_limit"]; limits.isObject()) {
+    config.requests_per_minute =
+        limits.get("requests_per_minute", 0).asDouble();
+    config.tokens_per_minute = limits.get("tokens_per_minute", 0).asDouble();
+    config.burst_seconds =
+        limits.get("burst_seconds", config.burst_seconds).asDouble();
+    config.max_queue = limits
+                           .get("max_queue",
+                                static_cast<Json::UInt64>(config.max_queue))
+                           .asUInt64();
+    config.max_wait = std::chrono::milliseconds(
+        limits
+            .get("max_wait_ms",
+                 static_cast<Json::Int64>(config.max_wait.count()))
+            .asInt64());
+  }
+  auto limiter = std::make_shared<RateLimiter>(
+      config,
+      [this](RateLimiter::Clock::duration delay, std::function<void()> task) {
+        timer_loop_.getLoop()->runAfter(
+            std::chrono::duration<double>(delay), std::move(task));
+      });
+  limiters_.emplace(api_key, limiter);
+  return limiter;
+}
+
+std::shared_ptr<UpstreamRouter> RemoteEngine::LoadUpstreams(
+    const YAML::Node& config, const Json::Value& body,
+    const std::string& default_url) {
+  std::string header_template;
+  if (auto s = config["header_template"]; s) {
+    header_template = s.as<std::string>();
+  } else if (!metadata_["header_template"].isNull()) {
+    header_template = metadata_["header_template"].asString();
+  }
+
+  std::vector<UpstreamRouter::Upstream> upstreams;
+  for (auto const& u : config["upstreams"]) {
+    UpstreamRouter::Upstream upstream;
+    upstream.url = u["url"].as<std::string>(default_url);
+    upstream.weight = u["weight"].as<double>(1.0);
+    // An upstream can bring its own key, the engine key otherwise
+    auto key_body = body;
+    if (u["api_key"]) {
+      key_body["api_key"] = u["api_key"].as<std::string>();
+    } else if (u["api_key_env"]) {
+      auto env = std::getenv(u["api_key_env"].as<std::string>().c_str());
+      key_body["api_key"] = env ? env : "";
+    }
+    upstream.headers = header_template.empty()
+                           ? header_
+                           : ReplaceHeaderPlaceholders(header_template,
+                                                       key_body);
+    upstream.limiter = GetRateLimiter(key_body["api_key"].asString());
+    CTL_INF("Upstream " << upstreams.size() << ": " << upstream.url
+                        << ", weight " << upstream.weight);
+    upstreams.push_back(std::move(upstream));
+  }
+
+  UpstreamRouter::Config router_config;
+  if (auto routing = config["routing"]; routing) {
+    router_config.hedge_percentile =
+        routing["hedge_percentile"].as<double>(router_config.hedge_percentile);
+    router_config.hedge_min_samples = routing["hedge_min_samples"].as<size_t>(
+        router_config.hedge_min_samples);
+    router_config.cooldown = std::chrono::milliseconds(
+        routing["cooldown_ms"].as<int64_t>(router_config.cooldown.count()));
+  }
+  return std::make_shared<UpstreamRouter>(std::move(upstreams), router_config);
+}
+
 void RemoteEngine::GetModels(
     std::shared_ptr<Json::Value> json_body,
     std::function<void(Json::Value&&, Json::Value&&)>&& callback) {
@@ -547,6 +799,9 @@ void RemoteEngine::HandleChatCompletion(
   }
   bool is_stream =
       json_body->isMember("stream") && (*json_body)["stream"].asBool();
+  // tracked until the request is over, the provider doesn't know the field
+  auto stop = inflight_.Add(json_body->get("request_id", "").asString());
+  json_body->removeMember("request_id");
   Json::FastWriter writer;
   // Transform request
   std::string result;
@@ -584,100 +839,209 @@ void RemoteEngine::HandleChatCompletion(
     result = (*json_body).toStyledString();
   }
 
+  auto tokens = EstimateTokens(*json_body, result);
   if (is_stream) {
-    q_.runTaskInQueue([this, model_config, result, cb = std::move(callback)] {
-      MakeStreamingChatCompletionRequest(*model_config, result, cb);
+    // the stream is read in the task queue, whether it waits or not
+    q_.runTaskInQueue([this, model_config, result, tokens, stop,
+                       cb = std::move(callback)] {
+      Admit(*model_config, tokens,
+            [this, model_config, result, stop, cb](
+                std::optional<RateLimiter::Rejection> rejection,
+                const Admission& admission) {
+              if (rejection) {
+                Json::Value error;
+                error["error"] = rejection->message;
+                cb(RateLimitedStatus(true), std::move(error));
+                return;
+              }
+              if (*stop) {
+                Json::Value error;
+                error["error"] = "Request stopped";
+                cb(StoppedStatus(true), std::move(error));
+                return;
+              }
+              auto response = MakeStreamingChatCompletionRequest(
+                  *model_config, result, cb, admission, stop.get());
+              // the router updates the limits of the upstreams it tried
+              if (!model_config->router) {
+                GetRateLimiter(model_config->api_key)
+                    ->Update(response.status_code, response.headers);
+              }
+            });
     });
   } else {
+    SendChatCompletion(model, model_config, std::move(result), tokens, 1,
+                       std::move(stop), std::move(callback));
+  }
+}
 
-    auto response = MakeChatCompletionRequest(*model_config, result);
-
-    if (response.error) {
-      Json::Value status;
-      status["is_done"] = true;
-      status["has_error"] = true;
-      status["is_stream"] = false;
-      status["status_code"] = k400BadRequest;
-      Json::Value error;
-      error["error"] = response.error_message;
-      callback(std::move(status), std::move(error));
-      return;
+void RemoteEngine::Admit(const ModelConfig& config, int64_t tokens,
+                         SendFn&& send) {
+  Admission admission{.tokens = tokens};
+  std::shared_ptr<RateLimiter> limiter;
+  if (config.router) {
+    // each upstream is limited by its own key
+    admission.upstream = config.router->Pick({});
+    if (admission.upstream) {
+      limiter = config.router->GetLimiter(*admission.upstream);
     }
+  } else {
+    limiter = GetRateLimiter(config.api_key);
+  }
+  if (!limiter || limiter->TryAcquire(tokens)) {
+    send(std::nullopt, admission);
+    return;
+  }
+  limiter->Acquire(
+      tokens, [this, admission, send = std::move(send)](
+                  std::optional<RateLimiter::Rejection> rejection) {
+        q_.runTaskInQueue(
+            [admission, send, rejection] { send(rejection, admission); });
+      });
+}
 
-    Json::Value response_json;
-    Json::Reader reader;
-    if (!reader.parse(response.body, response_json)) {
-      Json::Value status;
-      status["is_done"] = true;
-      status["has_error"] = true;
-      status["is_stream"] = false;
-      status["status_code"] = k500InternalServerError;
-      Json::Value error;
-      error["error"] = "Failed to parse response";
-      LOG_WARN << "Failed to parse response: " << response.body;
-      callback(std::move(status), std::move(error));
-      return;
+void RemoteEngine::SendChatCompletion(
+    const std::string& model, ModelConfig* model_config, std::string body,
+    int64_t tokens, int attempt, InflightRequests::StopFlag stop,
+    std::function<void(Json::Value&&, Json::Value&&)>&& callback) {
+  Admit(*model_config, tokens,
+        [this, model, model_config, body = std::move(body), attempt, stop,
+         cb = std::move(callback)](
+            std::optional<RateLimiter::Rejection> rejection,
+            const Admission& admission) mutable {
+          if (rejection) {
+            Json::Value error;
+            error["error"] = rejection->message;
+            cb(RateLimitedStatus(false), std::move(error));
+            return;
+          }
+          // it may have waited for the rate limit, or a throttled attempt
+          if (*stop) {
+            Json::Value error;
+            error["error"] = "Request stopped";
+            cb(StoppedStatus(false), std::move(error));
+            return;
+          }
+          auto response = MakeChatCompletionRequest(*model_config, body,
+                                                    admission, stop.get());
+          if (!model_config->router) {
+            GetRateLimiter(model_config->api_key)
+                ->Update(response.status_code, response.headers);
+          }
+          // the limiter holds the next attempt back for the Retry-After
+          if (response.status_code == k429TooManyRequests &&
+              attempt < kMaxThrottledAttempts) {
+            CTL_WRN("Provider throttled the request, attempt " << attempt);
+            SendChatCompletion(model, model_config, std::move(body),
+                               admission.tokens, attempt + 1, std::move(stop),
+                               std::move(cb));
+            return;
+          }
+          FinishChatCompletion(model, *model_config, std::move(response),
+                               admission.tokens, cb);
+        });
+}
+
+void RemoteEngine::FinishChatCompletion(
+    const std::string& model, const ModelConfig& model_config,
+    CurlResponse&& response, int64_t tokens,
+    const std::function<void(Json::Value&&, Json::Value&&)>& callback) {
+  if (response.error) {
+    Json::Value status;
+    status["is_done"] = true;
+    status["has_error"] = true;
+    status["is_stream"] = false;
+    status["status_code"] = k400BadRequest;
+    Json::Value error;
+    error["error"] = response.error_message;
+    callback(std::move(status), std::move(error));
+    return;
+  }
+
+  Json::Value response_json;
+  Json::Reader reader;
+  if (!reader.parse(response.body, response_json)) {
+    Json::Value status;
+    status["is_done"] = true;
+    status["has_error"] = true;
+    status["is_stream"] = false;
+    status["status_code"] = k500InternalServerError;
+    Json::Value error;
+    error["error"] = "Failed to parse response";
+    LOG_WARN << "Failed to parse response: " << response.body;
+    callback(std::move(status), std::move(error));
+    return;
+  }
+
+  if (response.status_code == k429TooManyRequests) {
+    callback(RateLimitedStatus(false), std::move(response_json));
+    return;
+  }
+  if (auto limiter = model_config.router
+                         ? response.limiter
+                         : GetRateLimiter(model_config.api_key);
+      limiter && response_json.isMember("usage")) {
+    limiter->Adjust(GetUsedTokens(response_json) - tokens);
+  }
+
+  // Transform Response
+  std::string response_str;
+  try {
+    std::string template_str;
+    if (!chat_res_template_.empty()) {
+      CTL_DBG(
+          "Use engine transform response template: " << chat_res_template_);
+      template_str = chat_res_template_;
+    }
+    if (model_config.transform_resp["chat_completions"] &&
+        model_config.transform_resp["chat_completions"]["template"]) {
+      // Model level overrides engine level
+      template_str =
+          model_config.transform_resp["chat_completions"]["template"]
+              .as<std::string>();
+      CTL_DBG("Use model transform request template: " << template_str);
     }
 
-    // Transform Response
-    std::string response_str;
     try {
-      std::string template_str;
-      if (!chat_res_template_.empty()) {
-        CTL_DBG(
-            "Use engine transform response template: " << chat_res_template_);
-        template_str = chat_res_template_;
-      }
-      if (model_config->transform_resp["chat_completions"] &&
-          model_config->transform_resp["chat_completions"]["template"]) {
-        // Model level overrides engine level
-        template_str =
-            model_config->transform_resp["chat_completions"]["template"]
-                .as<std::string>();
-        CTL_DBG("Use model transform request template: " << template_str);
-      }
-
-      try {
-        response_json["stream"] = false;
-        if (!response_json.isMember("model")) {
-          response_json["model"] = model;
-        }
-        response_str = renderer_.Render(template_str, response_json);
-      } catch (const std::exception& e) {
-        throw std::runtime_error("Template rendering error: " +
-                                 std::string(e.what()));
+      response_json["stream"] = false;
+      if (!response_json.isMember("model")) {
+        response_json["model"] = model;
       }
+      response_str = renderer_.Render(template_str, response_json);
     } catch (const std::exception& e) {
-      // Log error and potentially rethrow or handle accordingly
-      LOG_WARN << "Error: " << e.what();
-      LOG_WARN << "Response: " << response.body;
-      LOG_WARN << "Using original body";
-      response_str = response_json.toStyledString();
-    }
-
-    Json::Reader reader_final;
-    Json::Value response_json_final;
-    if (!reader_final.parse(response_str, response_json_final)) {
-      Json::Value status;
-      status["is_done"] = true;
-      status["has_error"] = true;
-      status["is_stream"] = false;
-      status["status_code"] = k500InternalServerError;
-      Json::Value error;
-      error["error"] = "Failed to parse response";
-      callback(std::move(status), std::move(error));
-      LOG_WARN << "Failed to parse response: " << response_str;
-      return;
+      throw std::runtime_error("Template rendering error: " +
+                               std::string(e.what()));
     }
+  } catch (const std::exception& e) {
+    // Log error and potentially rethrow or handle accordingly
+    LOG_WARN << "Error: " << e.what();
+    LOG_WARN << "Response: " << response.body;
+    LOG_WARN << "Using original body";
+    response_str = response_json.toStyledString();
+  }
 
+  Json::Reader reader_final;
+  Json::Value response_json_final;
+  if (!reader_final.parse(response_str, response_json_final)) {
     Json::Value status;
     status["is_done"] = true;
-    status["has_error"] = false;
+    status["has_error"] = true;
     status["is_stream"] = false;
-    status["status_code"] = k200OK;
-
-    callback(std::move(status), std::move(response_json_final));
+    status["status_code"] = k500InternalServerError;
+    Json::Value error;
+    error["error"] = "Failed to parse response";
+    callback(std::move(status), std::move(error));
+    LOG_WARN << "Failed to parse response: " << response_str;
+    return;
   }
+
+  Json::Value status;
+  status["is_done"] = true;
+  status["has_error"] = false;
+  status["is_stream"] = false;
+  status["status_code"] = k200OK;
+
+  callback(std::move(status), std::move(response_json_final));
 }
 
 void RemoteEngine::GetModelStatus(
@@ -713,6 +1077,14 @@ void RemoteEngine::GetModelStatus(
   callback(std::move(status), std::move(response));
 }
 
+void RemoteEngine::StopRequest(const std::string& model_id,
+                               const std::string& request_id) {
+  if (!inflight_.Stop(request_id)) {
+    CTL_DBG("Request " << request_id << " of " << model_id
+                       << " is not running");
+  }
+}
+
 // Implement remaining virtual functions
 void RemoteEngine::HandleEmbedding(
     std::shared_ptr<Json::Value>,
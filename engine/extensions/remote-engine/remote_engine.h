@@ -3,33 +3,49 @@
 #include <curl/curl.h>
 #include <json/json.h>
 #include <yaml-cpp/yaml.h>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <shared_mutex>
 #include <string>
 #include <unordered_map>
+#include "common/inflight_requests.h"
 #include "cortex-common/remote_enginei.h"
+#include "extensions/remote-engine/rate_limiter.h"
+#include "extensions/remote-engine/upstream_router.h"
 #include "extensions/template_renderer.h"
+#include "trantor/net/EventLoopThread.h"
 #include "trantor/utils/ConcurrentTaskQueue.h"
 #include "utils/engine_constants.h"
 #include "utils/file_logger.h"
+#include "utils/sse_parser.h"
 // Helper for CURL response
 
 namespace remote_engine {
 
 struct StreamContext {
   std::shared_ptr<std::function<void(Json::Value&&, Json::Value&&)>> callback;
-  std::string buffer;
+  sse::Parser parser;
   // Cache value for Anthropic
   std::string id;
   std::string model;
   extensions::TemplateRenderer& renderer;
   std::string stream_template;
   bool need_stop = true;
+  CURL* curl = nullptr;
+  // set by the first event, an error body can only come before
+  bool has_events = false;
 };
 struct CurlResponse {
   std::string body;
   bool error{false};
   std::string error_message;
+  long status_code{0};
+  RateLimiter::Headers headers;
+  // Rate limit of the upstream which answered a routed request
+  std::shared_ptr<RateLimiter> limiter;
 };
 
 class RemoteEngine : public RemoteEngineI {
@@ -43,8 +59,20 @@ class RemoteEngine : public RemoteEngineI {
     YAML::Node transform_req;
     YAML::Node transform_resp;
     bool is_loaded{false};
+    // Set when the model declares several upstreams
+    std::shared_ptr<UpstreamRouter> router;
   };
 
+  // A request let through by the rate limit
+  struct Admission {
+    // Upstream the request was admitted for, when the model is routed
+    std::optional<size_t> upstream{};
+    // Estimated tokens it was charged
+    int64_t tokens = 0;
+  };
+  using SendFn = std::function<void(std::optional<RateLimiter::Rejection>,
+                                    const Admission&)>;
+
   // Thread-safe model config storage
   mutable std::shared_mutex models_mtx_;
   std::unordered_map<std::string, ModelConfig> models_;
@@ -56,13 +84,46 @@ class RemoteEngine : public RemoteEngineI {
   std::string engine_name_;
   std::string chat_url_;
   trantor::ConcurrentTaskQueue q_;
-
-  // Helper functions
-  CurlResponse MakeChatCompletionRequest(const ModelConfig& config,
-                                         const std::string& body,
-                                         const std::string& method = "POST");
+  // Rate limits of the provider, by api key
+  std::mutex limiters_mtx_;
+  std::unordered_map<std::string, std::shared_ptr<RateLimiter>> limiters_;
+  // Wakes up the requests waiting for a rate limit, stopped before the
+  // limiters go away
+  trantor::EventLoopThread timer_loop_;
+  // Chat completions being sent, which StopRequest aborts
+  InflightRequests inflight_;
+
+  // Helper functions, the transfer is aborted once [stop] is set
+  CurlResponse MakeChatCompletionRequest(
+      const ModelConfig& config, const std::string& body,
+      const Admission& admission, const std::atomic<bool>* stop = nullptr,
+      const std::string& method = "POST");
   CurlResponse MakeStreamingChatCompletionRequest(
       const ModelConfig& config, const std::string& body,
+      const std::function<void(Json::Value&&, Json::Value&&)>& callback,
+      const Admission& admission, const std::atomic<bool>* stop);
+  CurlResponse MakeRoutedStreamingChatCompletionRequest(
+      const ModelConfig& config, const std::string& body,
+      const std::function<void(Json::Value&&, Json::Value&&)>& callback,
+      const Admission& admission, const std::atomic<bool>* stop);
+
+  /**
+   * Call [send] once the rate limit of the key the request goes out with
+   * lets [tokens] through. A request which fits is sent from the calling
+   * thread. One which has to wait holds no thread, it is sent from the task
+   * queue once it fits.
+   */
+  void Admit(const ModelConfig& config, int64_t tokens, SendFn&& send);
+
+  // Send a non-stream request, again while the provider throttles it
+  void SendChatCompletion(
+      const std::string& model, ModelConfig* model_config, std::string body,
+      int64_t tokens, int attempt, InflightRequests::StopFlag stop,
+      std::function<void(Json::Value&&, Json::Value&&)>&& callback);
+
+  void FinishChatCompletion(
+      const std::string& model, const ModelConfig& model_config,
+      CurlResponse&& response, int64_t tokens,
       const std::function<void(Json::Value&&, Json::Value&&)>& callback);
   CurlResponse MakeGetModelsRequest(const std::string& url,
                                     const std::string& api_key,
@@ -72,6 +133,10 @@ class RemoteEngine : public RemoteEngineI {
   bool LoadModelConfig(const std::string& model, const std::string& yaml_path,
                        const Json::Value& body);
   ModelConfig* GetModelConfig(const std::string& model);
+  std::shared_ptr<RateLimiter> GetRateLimiter(const std::string& api_key);
+  std::shared_ptr<UpstreamRouter> LoadUpstreams(const YAML::Node& config,
+                                                const Json::Value& body,
+                                                const std::string& default_url);
 
  public:
   explicit RemoteEngine(const std::string& engine_name);
@@ -106,6 +171,9 @@ class RemoteEngine : public RemoteEngineI {
   Json::Value GetRemoteModels(const std::string& url,
                               const std::string& api_key,
                               const std::string& header_template) override;
+
+  void StopRequest(const std::string& model_id,
+                   const std::string& request_id) override;
 };
 
 }  // namespace remote_engine
\ No newline at end of file
@@ -0,0 +1,404 @@
+#include "upstream_router.h"
+#include <curl/curl.h>
+#include <algorithm>
+#include <memory>
+#include "rate_limiter.h"
+#include "utils/logging_utils.h"
+
+namespace remote_engine {
+namespace {
+using Clock = UpstreamRouter::Clock;
+
+// Weight of the latest outcome in the health and latency averages
+constexpr const double kDecay = 0.2;
+// Unhealthy upstreams keep a chance to be picked, and to recover
+constexpr const double kMinHealth = 0.01;
+constexpr const size_t kMaxSamples = 256;
+constexpr const size_t kMaxErrorBody = 4096;
+constexpr const auto kPollInterval = std::chrono::milliseconds(1000);
+// How soon a request which can be stopped notices it
+constexpr const auto kStopPollInterval = std::chrono::milliseconds(100);
+
+struct Transfer;
+
+struct Attempt {
+  size_t upstream;
+  Transfer* transfer;
+  CURL* curl = nullptr;
+  curl_slist* headers = nullptr;
+  Clock::time_point started{};
+  std::optional<Clock::time_point> first_byte{};
+  RateLimiter::Headers response_headers{};
+  // Body of a response which will be failed over
+  std::string error_body{};
+};
+
+struct Transfer {
+  const UpstreamRouter::DataFn& on_data;
+  Attempt* winner = nullptr;
+  std::string body{};
+  bool aborted = false;
+};
+
+size_t WriteCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+  auto* attempt = static_cast<Attempt*>(userdata);
+  auto* transfer = attempt->transfer;
+  auto n = size * nmemb;
+  if (transfer->winner == nullptr) {
+    long status = 0;
+    curl_easy_getinfo(attempt->curl, CURLINFO_RESPONSE_CODE, &status);
+    if (UpstreamRouter::ShouldFailover(status)) {
+      auto& error_body = attempt->error_body;
+      if (error_body.size() < kMaxErrorBody) {
+        error_body.append(ptr,
+                          std::min(n, kMaxErrorBody - error_body.size()));
+      }
+      return n;
+    }
+    // the first upstream to send a usable byte wins the race
+    transfer->winner = attempt;
+    attempt->first_byte = Clock::now();
+  } else if (transfer->winner != attempt) {
+    return 0;
+  }
+
+  if (transfer->on_data) {
+    if (!transfer->on_data(ptr, n)) {
+      transfer->aborted = true;
+      return 0;
+    }
+    return n;
+  }
+  transfer->body.append(ptr, n);
+  return n;
+}
+
+std::chrono::milliseconds ElapsedMs(Clock::time_point from,
+                                    Clock::time_point to) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(to - from);
+}
+}  // namespace
+
+UpstreamRouter::UpstreamRouter(std::vector<Upstream> upstreams, Config config)
+    : upstreams_{std::move(upstreams)},
+      config_{std::move(config)},
+      states_(upstreams_.size()),
+      rng_{config_.seed} {}
+
+std::optional<size_t> UpstreamRouter::Pick(const std::vector<size_t>& tried,
+                                           Clock::time_point now) {
+  std::lock_guard<std::mutex> l(mtx_);
+  std::vector<double> scores(upstreams_.size(), 0);
+  bool any_ready = false;
+  for (size_t i = 0; i < upstreams_.size(); i++) {
+    if (std::find(tried.begin(), tried.end(), i) != tried.end() ||
+        upstreams_[i].weight <= 0) {
+      continue;
+    }
+    auto const& s = states_[i];
+    // a second of first-byte latency halves the share of an upstream
+    scores[i] = upstreams_[i].weight * std::max(s.health, kMinHealth) /
+                (1.0 + s.latency_ms / 1000.0);
+    any_ready = any_ready || s.cooldown_until <= now;
+  }
+  if (any_ready) {
+    for (size_t i = 0; i < upstreams_.size(); i++) {
+      if (states_[i].cooldown_until > now) {
+        scores[i] = 0;
+      }
+    }
+  }
+
+  double total = 0;
+  for (auto score : scores) {
+    total += score;
+  }
+  if (total <= 0) {
+    return std::nullopt;
+  }
+  auto r = std::uniform_real_distribution<double>(0, total)(rng_);
+  for (size_t i = 0; i < scores.size(); i++) {
+    if (scores[i] <= 0) {
+      continue;
+    }
+    if (r < scores[i]) {
+      return i;
+    }
+    r -= scores[i];
+  }
+  // rounding, the last candidate
+  for (size_t i = scores.size(); i > 0; i--) {
+    if (scores[i - 1] > 0) {
+      return i - 1;
+    }
+  }
+  return std::nullopt;
+}
+
+void UpstreamRouter::ReportSuccess(size_t upstream,
+                                   std::chrono::milliseconds first_byte) {
+  std::lock_guard<std::mutex> l(mtx_);
+  auto& s = states_[upstream];
+  s.health = s.health * (1 - kDecay) + kDecay;
+  auto ms = static_cast<double>(first_byte.count());
+  s.latency_ms =
+      s.samples.empty() ? ms : s.latency_ms * (1 - kDecay) + ms * kDecay;
+  s.samples.push_back(first_byte.count());
+  if (s.samples.size() > kMaxSamples) {
+    s.samples.pop_front();
+  }
+}
+
+void UpstreamRouter::ReportFailure(size_t upstream, bool throttled,
+                                   std::chrono::milliseconds retry_after,
+                                   Clock::time_point now) {
+  std::lock_guard<std::mutex> l(mtx_);
+  auto& s = states_[upstream];
+  s.health = s.health * (1 - kDecay);
+  if (throttled) {
+    s.cooldown_until = now + std::max(retry_after, config_.cooldown);
+  }
+}
+
+std::optional<std::chrono::milliseconds> UpstreamRouter::GetHedgeDelay(
+    size_t upstream) const {
+  if (config_.hedge_percentile <= 0) {
+    return std::nullopt;
+  }
+  std::lock_guard<std::mutex> l(mtx_);
+  auto const& s = states_[upstream];
+  if (s.samples.empty() ||
+      s.samples.size() < std::max<size_t>(config_.hedge_min_samples, 1)) {
+    return std::nullopt;
+  }
+  std::vector<int64_t> sorted(s.samples.begin(), s.samples.end());
+  auto rank = static_cast<size_t>(std::min(config_.hedge_percentile, 100.0) /
+                                  100.0 * (sorted.size() - 1));
+  std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+  return std::chrono::milliseconds(sorted[rank]);
+}
+
+double UpstreamRouter::GetHealth(size_t upstream) const {
+  std::lock_guard<std::mutex> l(mtx_);
+  return states_[upstream].health;
+}
+
+UpstreamRouter::Response UpstreamRouter::Post(
+    const std::string& body, const std::vector<std::string>& headers,
+    const DataFn& on_data, std::optional<size_t> first, int64_t tokens,
+    const std::atomic<bool>* stopped) {
+  Response response;
+  CURLM* multi = curl_multi_init();
+  if (!multi) {
+    response.error = true;
+    response.error_message = "Failed to initialize CURL";
+    return response;
+  }
+
+  Transfer transfer{.on_data = on_data};
+  std::vector<std::unique_ptr<Attempt>> attempts;
+  std::vector<size_t> tried;
+  std::optional<Clock::time_point> hedge_at;
+  bool hedged = false;
+  long last_status = 0;
+  std::string last_error = "no upstream available";
+  std::string last_body;
+  RateLimiter::Headers last_headers;
+
+  auto start = [&](size_t upstream) {
+    tried.push_back(upstream);
+    auto attempt = std::make_unique<Attempt>(
+        Attempt{.upstream = upstream, .transfer = &transfer});
+    attempt->curl = curl_easy_init();
+    if (!attempt->curl) {
+      last_error = "Failed to initialize CURL";
+      return false;
+    }
+    for (auto const& h : upstreams_[upstream].headers) {
+      attempt->headers = curl_slist_append(attempt->headers, h.c_str());
+    }
+    for (auto const& h : headers) {
+      attempt->headers = curl_slist_append(attempt->headers, h.c_str());
+    }
+    auto* curl = attempt->curl;
+    curl_easy_setopt(curl, CURLOPT_URL, upstreams_[upstream].url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, attempt->headers);
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                     static_cast<curl_off_t>(body.size()));
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, attempt.get());
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, CollectHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &attempt->response_headers);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, attempt.get());
+    attempt->started = Clock::now();
+    curl_multi_add_handle(multi, curl);
+    if (auto delay = GetHedgeDelay(upstream); delay && !hedged) {
+      hedge_at = attempt->started + *delay;
+    }
+    attempts.push_back(std::move(attempt));
+    return true;
+  };
+  auto stop = [&](Attempt& attempt) {
+    if (attempt.curl) {
+      curl_multi_remove_handle(multi, attempt.curl);
+      curl_easy_cleanup(attempt.curl);
+      attempt.curl = nullptr;
+    }
+    curl_slist_free_all(attempt.headers);
+    attempt.headers = nullptr;
+  };
+  auto running = [&] {
+    return std::any_of(attempts.begin(), attempts.end(),
+                       [](auto const& a) { return a->curl != nullptr; });
+  };
+  auto admit = [&](size_t upstream) {
+    auto const& limiter = upstreams_[upstream].limiter;
+    if (!limiter || limiter->TryAcquire(tokens)) {
+      return true;
+    }
+    CTL_DBG("Upstream " << upstreams_[upstream].url << " is rate limited");
+    last_status = 429;
+    last_error = "rate limit reached";
+    return false;
+  };
+  auto start_next = [&] {
+    while (auto next = Pick(tried)) {
+      if (!admit(*next)) {
+        tried.push_back(*next);
+        continue;
+      }
+      if (start(*next)) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  if (!(first && *first < upstreams_.size() && start(*first))) {
+    start_next();
+  }
+  bool done = false;
+  while (!done) {
+    int still_running = 0;
+    curl_multi_perform(multi, &still_running);
+    if (stopped && *stopped) {
+      response.error = true;
+      response.error_message = "Request stopped";
+      break;
+    }
+
+    // the race is over as soon as one upstream answered
+    if (transfer.winner != nullptr) {
+      for (auto& a : attempts) {
+        if (a.get() != transfer.winner && a->curl != nullptr) {
+          CTL_DBG("Cancel the request to " << upstreams_[a->upstream].url);
+          stop(*a);
+        }
+      }
+    }
+
+    int left = 0;
+    while (auto* msg = curl_multi_info_read(multi, &left)) {
+      if (msg->msg != CURLMSG_DONE) {
+        continue;
+      }
+      Attempt* attempt = nullptr;
+      curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &attempt);
+      auto result = msg->data.result;
+      long status = 0;
+      curl_easy_getinfo(attempt->curl, CURLINFO_RESPONSE_CODE, &status);
+      curl_off_t retry_after_s = 0;
+      curl_easy_getinfo(attempt->curl, CURLINFO_RETRY_AFTER, &retry_after_s);
+      auto const& url = upstreams_[attempt->upstream].url;
+      auto now = Clock::now();
+      if (auto const& limiter = upstreams_[attempt->upstream].limiter;
+          limiter && result == CURLE_OK) {
+        limiter->Update(status, attempt->response_headers);
+      }
+
+      if (transfer.winner == nullptr && result == CURLE_OK &&
+          !ShouldFailover(status)) {
+        // an answer without a body
+        transfer.winner = attempt;
+        attempt->first_byte = now;
+      }
+
+      if (transfer.winner == attempt) {
+        response.status_code = status;
+        response.url = url;
+        response.limiter = upstreams_[attempt->upstream].limiter;
+        response.headers = std::move(attempt->response_headers);
+        if (result == CURLE_OK) {
+          ReportSuccess(attempt->upstream,
+                        ElapsedMs(attempt->started, *attempt->first_byte));
+        } else {
+          if (!transfer.aborted) {
+            ReportFailure(attempt->upstream, false, {}, now);
+          }
+          response.error = true;
+          response.error_message = curl_easy_strerror(result);
+        }
+        done = true;
+      } else if (transfer.winner == nullptr) {
+        auto throttled = status == 429;
+        ReportFailure(attempt->upstream, throttled,
+                      std::chrono::seconds(retry_after_s), now);
+        last_status = status;
+        last_body = attempt->error_body;
+        last_headers = std::move(attempt->response_headers);
+        last_error = result != CURLE_OK
+                         ? std::string(curl_easy_strerror(result))
+                         : "HTTP " + std::to_string(status);
+        CTL_WRN("Upstream " << url << " failed: " << last_error);
+      }
+      stop(*attempt);
+    }
+    if (done) {
+      break;
+    }
+
+    if (transfer.winner == nullptr && !running()) {
+      hedge_at.reset();
+      if (!start_next()) {
+        response.error = true;
+        response.status_code = last_status;
+        response.body = last_body;
+        response.headers = std::move(last_headers);
+        response.error_message =
+            "All upstreams failed, last error: " + last_error;
+        break;
+      }
+      continue;
+    }
+
+    auto timeout = stopped ? kStopPollInterval : kPollInterval;
+    if (transfer.winner == nullptr && hedge_at) {
+      auto now = Clock::now();
+      if (now >= *hedge_at) {
+        hedge_at.reset();
+        hedged = true;
+        if (auto next = Pick(tried); next && admit(*next) && start(*next)) {
+          CTL_INF("Hedge the request to " << upstreams_[*next].url);
+        }
+        continue;
+      }
+      timeout = std::min(timeout, ElapsedMs(now, *hedge_at) +
+                                      std::chrono::milliseconds(1));
+    }
+    curl_multi_poll(multi, nullptr, 0, static_cast<int>(timeout.count()),
+                    nullptr);
+  }
+
+  for (auto& a : attempts) {
+    stop(*a);
+  }
+  curl_multi_cleanup(multi);
+  if (!response.error) {
+    response.body = std::move(transfer.body);
+  }
+  return response;
+}
+
+}  // namespace remote_engine
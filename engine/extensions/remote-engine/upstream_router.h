@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "extensions/remote-engine/rate_limiter.h"
+
+namespace remote_engine {
+
+/**
+ * Spreads the requests of a remote model over several upstreams (providers,
+ * regions or keys serving the same model).
+ *
+ * Each request goes to a weighted random upstream, the weight being scaled
+ * by the health of the upstream and its recent first-byte latency. A 429 or
+ * 5xx, or a failed connection, moves the request to the next upstream
+ * before anything reached the client; a 429 also takes the upstream out of
+ * rotation for a cooldown. With hedging on, a second upstream is raced
+ * against the first when it hasn't sent its first byte within a percentile
+ * of its usual latency, and whichever answers first wins, the other one is
+ * cancelled. An upstream with a rate limit is only tried again or hedged to
+ * while its limit has budget left.
+ */
+class UpstreamRouter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Upstream {
+    std::string url;
+    std::vector<std::string> headers{};
+    double weight = 1.0;
+    // Rate limit of the key of the upstream, shared with the other users of
+    // the key
+    std::shared_ptr<RateLimiter> limiter{};
+  };
+
+  struct Config {
+    // Percentile of the first-byte latency after which the request is
+    // hedged, 0 disables hedging
+    double hedge_percentile = 0;
+    // Samples an upstream needs before its latency is trusted for hedging
+    size_t hedge_min_samples = 20;
+    // How long a throttled upstream is skipped when it gives no Retry-After
+    std::chrono::milliseconds cooldown{std::chrono::seconds(10)};
+    uint32_t seed = std::random_device{}();
+  };
+
+  struct Response {
+    long status_code = 0;
+    std::string body;
+    bool error = false;
+    std::string error_message;
+    // Url of the upstream which answered
+    std::string url;
+    // Rate limit of the upstream which answered
+    std::shared_ptr<RateLimiter> limiter;
+    // Lowercase names
+    std::unordered_map<std::string, std::string> headers;
+  };
+
+  // Receives the body of the winning response, returns false to abort it
+  using DataFn = std::function<bool(const char* data, size_t size)>;
+
+  UpstreamRouter(std::vector<Upstream> upstreams, Config config);
+
+  /**
+   * POST [body] with [headers] added to those of the upstream. The body of
+   * the response is passed to [on_data] as it arrives, or returned in the
+   * response without it.
+   *
+   * The request goes to [first] if given, the caller having admitted it to
+   * the rate limit of that upstream. Any other upstream is charged [tokens]
+   * before it is tried, and skipped if its limit has no budget left. The
+   * limits learn from the answers of the upstreams.
+   *
+   * Every attempt is cancelled once [stopped] is set, without counting
+   * against the health of its upstream.
+   */
+  Response Post(const std::string& body,
+                const std::vector<std::string>& headers,
+                const DataFn& on_data = nullptr,
+                std::optional<size_t> first = std::nullopt,
+                int64_t tokens = 0,
+                const std::atomic<bool>* stopped = nullptr);
+
+  /**
+   * A weighted choice among the upstreams not in [tried], nullopt when none
+   * is left. Upstreams in cooldown are only chosen if all the others are.
+   */
+  std::optional<size_t> Pick(const std::vector<size_t>& tried,
+                             Clock::time_point now = Clock::now());
+
+  void ReportSuccess(size_t upstream, std::chrono::milliseconds first_byte);
+
+  /**
+   * [throttled] upstreams are skipped for [retry_after], or for the
+   * configured cooldown if it is shorter.
+   */
+  void ReportFailure(size_t upstream, bool throttled,
+                     std::chrono::milliseconds retry_after = {},
+                     Clock::time_point now = Clock::now());
+
+  // Time to wait for the first byte of [upstream] before hedging
+  std::optional<std::chrono::milliseconds> GetHedgeDelay(
+      size_t upstream) const;
+
+  double GetHealth(size_t upstream) const;
+
+  std::shared_ptr<RateLimiter> GetLimiter(size_t upstream) const {
+    return upstreams_[upstream].limiter;
+  }
+
+  size_t size() const { return upstreams_.size(); }
+
+  static bool ShouldFailover(long status_code) {
+    return status_code == 429 || status_code >= 500;
+  }
+
+ private:
+  struct State {
+    double health = 1.0;
+    // Moving average of the first-byte latency, in ms
+    double latency_ms = 0;
+    std::deque<int64_t> samples;
+    Clock::time_point cooldown_until;
+  };
+
+  std::vector<Upstream> upstreams_;
+  Config config_;
+
+  mutable std::mutex mtx_;
+  std::vector<State> states_;
+  std::mt19937 rng_;
+};
+
+}  // namespace remote_engine
@@ -3,7 +3,9 @@
 #include <trantor/utils/Logger.h>
 #include <memory>
 #include <mutex>
+#include "common/startup_status.h"
 #include "controllers/assistants.h"
+#include "controllers/batches.h"
 #include "controllers/configs.h"
 #include "controllers/engines.h"
 #include "controllers/events.h"
@@ -15,20 +17,26 @@
 #include "controllers/server.h"
 #include "controllers/swagger.h"
 #include "controllers/threads.h"
+#include "controllers/vector_stores.h"
 #include "database/database.h"
 #include "migrations/migration_manager.h"
 #include "repositories/assistant_fs_repository.h"
 #include "repositories/file_fs_repository.h"
 #include "repositories/message_fs_repository.h"
 #include "repositories/thread_fs_repository.h"
+#include "repositories/vector_store_fs_repository.h"
 #include "services/assistant_service.h"
+#include "services/batch_service.h"
 #include "services/config_service.h"
 #include "services/database_service.h"
 #include "services/file_watcher_service.h"
+#include "services/inference_scheduler.h"
 #include "services/message_service.h"
+#include "services/model_import_service.h"
 #include "services/model_service.h"
 #include "services/model_source_service.h"
 #include "services/thread_service.h"
+#include "services/vector_store_service.h"
 #include "utils/archive_utils.h"
 #include "utils/cortex_utils.h"
 #include "utils/dylib_path_manager.h"
@@ -36,6 +44,7 @@
 #include "utils/file_logger.h"
 #include "utils/file_manager_utils.h"
 #include "utils/logging_utils.h"
+#include "utils/string_utils.h"
 #include "utils/system_info_utils.h"
 
 #if defined(__APPLE__) && defined(__MACH__)
@@ -137,12 +146,6 @@ void RunServer(std::optional<std::string> host, std::optional<int> port,
 
   auto db_service = std::make_shared<DatabaseService>();
   auto hw_service = std::make_shared<HardwareService>(db_service);
-  hw_service->UpdateHardwareInfos();
-  if (hw_service->ShouldRestart()) {
-    CTL_INF("Restart to update hardware configuration");
-    hw_service->Restart(config.apiServerHost, std::stoi(config.apiServerPort));
-    return;
-  }
 
   using Event = cortex::event::Event;
   using EventQueue =
@@ -162,6 +165,8 @@ void RunServer(std::optional<std::string> host, std::optional<int> port,
   auto thread_repo = std::make_shared<ThreadFsRepository>(data_folder_path);
   auto assistant_repo =
       std::make_shared<AssistantFsRepository>(data_folder_path);
+  auto vector_store_repo =
+      std::make_shared<VectorStoreFsRepository>(data_folder_path);
 
   auto file_srv = std::make_shared<FileService>(file_repo);
   auto assistant_srv =
@@ -175,16 +180,91 @@ void RunServer(std::optional<std::string> host, std::optional<int> port,
       std::make_shared<DownloadService>(event_queue_ptr, config_service);
   auto engine_service = std::make_shared<EngineService>(
       download_service, dylib_path_manager, db_service);
-  auto inference_svc = std::make_shared<InferenceService>(engine_service);
+  InferenceScheduler::Config scheduler_config{
+      .max_concurrency = config.maxConcurrentRequestsPerModel,
+      .max_queue_size = config.maxQueuedRequestsPerModel,
+      .queue_timeout_ms = config.requestQueueTimeoutMs,
+      .client_weights = {}};
+  for (auto const& entry : config.clientWeights) {
+    auto parts = string_utils::SplitBy(entry, "=");
+    if (parts.size() != 2) {
+      CTL_WRN("Invalid client weight: " << entry);
+      continue;
+    }
+    try {
+      scheduler_config.client_weights[parts[0]] = std::stoi(parts[1]);
+    } catch (const std::exception& e) {
+      CTL_WRN("Invalid client weight: " << entry);
+    }
+  }
+  auto inference_scheduler =
+      std::make_shared<InferenceScheduler>(std::move(scheduler_config));
+  auto inference_svc =
+      std::make_shared<InferenceService>(engine_service, inference_scheduler);
+  if (config.embeddingBatchWindowMs > 0) {
+    inference_svc->EnableEmbeddingBatching(
+        {.window_ms = config.embeddingBatchWindowMs,
+         .max_batch_size = config.embeddingMaxBatchSize});
+  }
+  if (config.responseCacheEnabled) {
+    inference_svc->EnableResponseCache(
+        {.max_bytes = config.responseCacheMaxBytes,
+         .disk_max_bytes = config.responseCacheDiskMaxBytes,
+         .disk_path = file_manager_utils::GetCortexDataPath() / "cache" /
+                      "responses"});
+  }
+  if (config.sessionIdleTimeoutSec > 0) {
+    inference_svc->EnableSessionAffinity(
+        {.idle_timeout = std::chrono::seconds(config.sessionIdleTimeoutSec)});
+  }
+  if (auto policy = ContextFitter::ParsePolicy(config.contextOverflowPolicy)) {
+    inference_svc->EnableContextFitting({.default_policy = *policy});
+  } else {
+    CTL_WRN("Invalid context overflow policy: "
+            << config.contextOverflowPolicy);
+    inference_svc->EnableContextFitting({});
+  }
+  inference_svc->EnableTracing(
+      {.path = std::filesystem::path(config.logFolderPath) /
+               std::filesystem::path(cortex_utils::logs_folder) /
+               "cortex-trace.json",
+       .sample_rate = config.traceSampleRate,
+       .max_bytes = config.traceMaxBytes});
   auto model_src_svc = std::make_shared<ModelSourceService>(db_service);
   auto model_service = std::make_shared<ModelService>(
       db_service, hw_service, download_service, inference_svc, engine_service);
   inference_svc->SetModelService(model_service);
+  auto vector_store_srv = std::make_shared<VectorStoreService>(
+      vector_store_repo, file_srv, inference_svc);
+  auto batch_srv = std::make_shared<BatchService>(
+      db_service, file_srv, inference_svc, event_queue_ptr,
+      BatchService::Config{.max_concurrency =
+                               config.batchMaxConcurrentRequests});
 
   auto file_watcher_srv = std::make_shared<FileWatcherService>(
       model_dir_path.string(), model_service);
   file_watcher_srv->start();
 
+  // Slow startup work runs in the background so the listener comes up right
+  // away. Clients wait on /healthz?ready for it to finish.
+  auto& startup_status = cortex::StartupStatus::GetInstance();
+  startup_status.AddTask(cortex::kHardwareStartupTask);
+  startup_status.AddTask(cortex::kModelsStartupTask);
+  std::thread([hw_service, &startup_status] {
+    hw_service->UpdateHardwareInfos();
+    if (hw_service->ShouldRestart()) {
+      // stay not ready, the restarted server takes over
+      CTL_INF("Hardware configuration changed, restarting");
+      shutdown_signal = true;
+      return;
+    }
+    startup_status.FinishTask(cortex::kHardwareStartupTask);
+  }).detach();
+  std::thread([model_service, &startup_status] {
+    model_service->ForceIndexingModelList();
+    startup_status.FinishTask(cortex::kModelsStartupTask);
+  }).detach();
+
   // initialize custom controllers
   auto swagger_ctl = std::make_shared<SwaggerController>(config.apiServerHost,
                                                          config.apiServerPort);
@@ -193,14 +273,19 @@ void RunServer(std::optional<std::string> host, std::optional<int> port,
   auto thread_ctl = std::make_shared<Threads>(thread_srv, message_srv);
   auto message_ctl = std::make_shared<Messages>(message_srv);
   auto engine_ctl = std::make_shared<Engines>(engine_service);
-  auto model_ctl = std::make_shared<Models>(db_service, model_service,
-                                            engine_service, model_src_svc);
+  auto model_import_svc =
+      std::make_shared<ModelImportService>(db_service, event_queue_ptr);
+  auto model_ctl =
+      std::make_shared<Models>(db_service, model_service, engine_service,
+                               model_src_svc, model_import_svc);
   auto event_ctl = std::make_shared<Events>(event_queue_ptr);
   auto pm_ctl = std::make_shared<ProcessManager>(engine_service);
   auto hw_ctl = std::make_shared<Hardware>(engine_service, hw_service);
   auto server_ctl =
       std::make_shared<inferences::server>(inference_svc, engine_service);
   auto config_ctl = std::make_shared<Configs>(config_service);
+  auto vector_store_ctl = std::make_shared<VectorStores>(vector_store_srv);
+  auto batch_ctl = std::make_shared<Batches>(batch_srv);
 
   drogon::app().registerController(swagger_ctl);
   drogon::app().registerController(file_ctl);
@@ -214,6 +299,8 @@ void RunServer(std::optional<std::string> host, std::optional<int> port,
   drogon::app().registerController(server_ctl);
   drogon::app().registerController(hw_ctl);
   drogon::app().registerController(config_ctl);
+  drogon::app().registerController(vector_store_ctl);
+  drogon::app().registerController(batch_ctl);
 
   auto upload_path = std::filesystem::temp_directory_path() / "cortex-uploads";
   drogon::app().setUploadPath(upload_path.string());
@@ -308,11 +395,11 @@ void RunServer(std::optional<std::string> host, std::optional<int> port,
     std::this_thread::sleep_for(std::chrono::seconds(1));
   }
 
+  drogon::app().quit();
   if (hw_service->ShouldRestart()) {
     CTL_INF("Restart to update hardware configuration");
     hw_service->Restart(config.apiServerHost, std::stoi(config.apiServerPort));
   }
-  drogon::app().quit();
 }
 
 void print_help() {
@@ -9,6 +9,7 @@
 #include "v1/migration.h"
 #include "v2/migration.h"
 #include "v3/migration.h"
+#include "v4/migration.h"
 
 namespace cortex::migr {
 
@@ -149,6 +150,8 @@ cpp::result<bool, std::string> MigrationManager::DoUpFolderStructure(
       return v2::MigrateFolderStructureUp();
     case 3:
       return v3::MigrateFolderStructureUp();
+    case 4:
+      return v4::MigrateFolderStructureUp();
 
     default:
       return true;
@@ -165,6 +168,8 @@ cpp::result<bool, std::string> MigrationManager::DoDownFolderStructure(
       return v2::MigrateFolderStructureDown();
     case 3:
       return v3::MigrateFolderStructureDown();
+    case 4:
+      return v4::MigrateFolderStructureDown();
 
     default:
       return true;
@@ -203,6 +208,8 @@ cpp::result<bool, std::string> MigrationManager::DoUpDB(int version) {
       return v2::MigrateDBUp(db_);
     case 3:
       return v3::MigrateDBUp(db_);
+    case 4:
+      return v4::MigrateDBUp(db_);
 
     default:
       return true;
@@ -219,6 +226,8 @@ cpp::result<bool, std::string> MigrationManager::DoDownDB(int version) {
       return v2::MigrateDBDown(db_);
     case 3:
       return v3::MigrateDBDown(db_);
+    case 4:
+      return v4::MigrateDBDown(db_);
 
     default:
       return true;
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <SQLiteCpp/Database.h>
+#include <string>
+#include "utils/logging_utils.h"
+#include "utils/result.hpp"
+
+namespace cortex::migr::v4 {
+inline cpp::result<bool, std::string> MigrateFolderStructureUp() {
+  return true;
+}
+
+inline cpp::result<bool, std::string> MigrateFolderStructureDown() {
+  return true;
+}
+
+// Database
+inline cpp::result<bool, std::string> MigrateDBUp(SQLite::Database& db) {
+  try {
+    db.exec(
+        "CREATE TABLE IF NOT EXISTS schema_version ( version INTEGER PRIMARY "
+        "KEY);");
+
+    // batches
+    {
+      SQLite::Statement query(db,
+                              "SELECT name FROM sqlite_master WHERE "
+                              "type='table' AND name='batches'");
+      auto table_exists = query.executeStep();
+
+      if (!table_exists) {
+        db.exec(
+            "CREATE TABLE batches ("
+            "id TEXT PRIMARY KEY,"
+            "endpoint TEXT,"
+            "input_file_id TEXT,"
+            "completion_window TEXT,"
+            "status TEXT,"
+            "output_file_id TEXT,"
+            "error_file_id TEXT,"
+            "created_at INTEGER,"
+            "in_progress_at INTEGER,"
+            "completed_at INTEGER,"
+            "failed_at INTEGER,"
+            "cancelled_at INTEGER,"
+            "total INTEGER,"
+            "completed INTEGER,"
+            "failed INTEGER,"
+            "input_offset INTEGER,"
+            "error TEXT,"
+            "metadata TEXT"
+            ")");
+      }
+    }
+
+    return true;
+  } catch (const std::exception& e) {
+    CTL_WRN("Migration up failed: " << e.what());
+    return cpp::fail(e.what());
+  }
+};
+
+inline cpp::result<bool, std::string> MigrateDBDown(SQLite::Database& db) {
+  try {
+    SQLite::Statement query(db,
+                            "SELECT name FROM sqlite_master WHERE "
+                            "type='table' AND name='batches'");
+    auto table_exists = query.executeStep();
+    if (table_exists) {
+      db.exec("DROP TABLE batches");
+    }
+
+    return true;
+  } catch (const std::exception& e) {
+    CTL_WRN("Migration down failed: " << e.what());
+    return cpp::fail(e.what());
+  }
+}
+};  // namespace cortex::migr::v4
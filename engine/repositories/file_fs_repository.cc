@@ -10,8 +10,8 @@ std::filesystem::path FileFsRepository::GetFilePath() const {
   return data_folder_path_ / kFileContainerFolderName;
 }
 
-cpp::result<void, std::string> FileFsRepository::StoreFile(
-    OpenAi::File& file_metadata, const char* content, uint64_t length) {
+std::filesystem::path FileFsRepository::GetUniqueFilePath(
+    OpenAi::File& file_metadata) const {
   auto file_container_path = GetFilePath();
   if (!std::filesystem::exists(file_container_path)) {
     std::filesystem::create_directories(file_container_path);
@@ -40,6 +40,12 @@ cpp::result<void, std::string> FileFsRepository::StoreFile(
     file_metadata.filename = new_filename;
     counter++;
   }
+  return file_full_path;
+}
+
+cpp::result<void, std::string> FileFsRepository::StoreFile(
+    OpenAi::File& file_metadata, const char* content, uint64_t length) {
+  auto file_full_path = GetUniqueFilePath(file_metadata);
 
   try {
     std::ofstream file(file_full_path, std::ios::binary);
@@ -66,6 +72,28 @@ cpp::result<void, std::string> FileFsRepository::StoreFile(
   }
 }
 
+cpp::result<void, std::string> FileFsRepository::StoreFileFromPath(
+    OpenAi::File& file_metadata, const std::filesystem::path& src) {
+  auto file_full_path = GetUniqueFilePath(file_metadata);
+
+  try {
+    file_metadata.bytes = std::filesystem::file_size(src);
+    std::filesystem::rename(src, file_full_path);
+
+    auto result = db_service_->AddFileEntry(file_metadata);
+    if (result.has_error()) {
+      std::filesystem::rename(file_full_path, src);
+      return cpp::fail(result.error());
+    }
+
+    return {};
+  } catch (const std::exception& e) {
+    CTL_ERR("Failed to store file: " << e.what());
+    return cpp::fail("Failed to move file: " + src.string() +
+                     ", error: " + e.what());
+  }
+}
+
 cpp::result<std::vector<OpenAi::File>, std::string> FileFsRepository::ListFiles(
     const std::string& purpose, uint8_t limit, const std::string& order,
     const std::string& after) const {
@@ -151,6 +179,19 @@ FileFsRepository::RetrieveFileContentByPath(const std::string& path) const {
   }
 }
 
+cpp::result<std::filesystem::path, std::string>
+FileFsRepository::GetFileLocalPath(const std::string& file_id) const {
+  auto file_metadata = RetrieveFile(file_id);
+  if (file_metadata.has_error()) {
+    return cpp::fail(file_metadata.error());
+  }
+  auto file_path = GetFilePath() / file_metadata->filename;
+  if (!std::filesystem::exists(file_path)) {
+    return cpp::fail("File content not found: " + file_path.string());
+  }
+  return file_path;
+}
+
 cpp::result<void, std::string> FileFsRepository::DeleteFileLocal(
     const std::string& file_id) {
   CTL_INF("Deleting file: " + file_id);
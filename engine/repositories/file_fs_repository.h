@@ -13,6 +13,9 @@ class FileFsRepository : public FileRepository {
                                            const char* content,
                                            uint64_t length) override;
 
+  cpp::result<void, std::string> StoreFileFromPath(
+      OpenAi::File& file_metadata, const std::filesystem::path& src) override;
+
   cpp::result<std::vector<OpenAi::File>, std::string> ListFiles(
       const std::string& purpose, uint8_t limit, const std::string& order,
       const std::string& after) const override;
@@ -26,6 +29,9 @@ class FileFsRepository : public FileRepository {
   cpp::result<std::pair<std::unique_ptr<char[]>, size_t>, std::string>
   RetrieveFileContentByPath(const std::string& path) const override;
 
+  cpp::result<std::filesystem::path, std::string> GetFileLocalPath(
+      const std::string& file_id) const override;
+
   cpp::result<void, std::string> DeleteFileLocal(
       const std::string& file_id) override;
 
@@ -45,6 +51,12 @@ class FileFsRepository : public FileRepository {
  private:
   std::filesystem::path GetFilePath() const;
 
+  /**
+   * Path for storing [file_metadata], renaming the file when a file with the
+   * same name already exists.
+   */
+  std::filesystem::path GetUniqueFilePath(OpenAi::File& file_metadata) const;
+
   /**
    * The path to the data folder.
    */
@@ -0,0 +1,287 @@
+#include "vector_store_fs_repository.h"
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include "utils/json_helper.h"
+
+namespace {
+cpp::result<Json::Value, std::string> ReadJsonFile(
+    const std::filesystem::path& path) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    return cpp::fail("Failed to open file: " + path.string());
+  }
+  Json::Value root;
+  Json::CharReaderBuilder builder;
+  JSONCPP_STRING errs;
+  if (!parseFromStream(builder, file, &root, &errs)) {
+    return cpp::fail("Failed to parse JSON: " + errs);
+  }
+  return root;
+}
+
+cpp::result<void, std::string> WriteJsonFile(const std::filesystem::path& path,
+                                             const Json::Value& root) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    return cpp::fail("Failed to open file: " + path.string());
+  }
+  file << root.toStyledString();
+  file.close();
+  if (!file) {
+    return cpp::fail("Failed to write file: " + path.string());
+  }
+  return {};
+}
+}  // namespace
+
+std::filesystem::path VectorStoreFsRepository::GetVectorStorePath(
+    const std::string& store_id) const {
+  return data_folder_path_ / kVectorStoreContainerFolderName / store_id;
+}
+
+std::filesystem::path VectorStoreFsRepository::GetIndexPath(
+    const std::string& store_id) const {
+  return GetVectorStorePath(store_id) / kIndexFolderName;
+}
+
+cpp::result<OpenAi::VectorStore, std::string>
+VectorStoreFsRepository::LoadVectorStore(const std::string& store_id) const {
+  auto path = GetVectorStorePath(store_id) / kVectorStoreFileName;
+  if (!std::filesystem::exists(path)) {
+    return cpp::fail("Vector store not found: " + store_id);
+  }
+  auto root = ReadJsonFile(path);
+  if (root.has_error()) {
+    return cpp::fail(root.error());
+  }
+  return OpenAi::VectorStore::FromJson(root.value());
+}
+
+cpp::result<void, std::string> VectorStoreFsRepository::SaveVectorStore(
+    OpenAi::VectorStore& store) {
+  auto json = store.ToJson();
+  if (json.has_error()) {
+    return cpp::fail(json.error());
+  }
+  return WriteJsonFile(GetVectorStorePath(store.id) / kVectorStoreFileName,
+                       json.value());
+}
+
+cpp::result<void, std::string> VectorStoreFsRepository::CreateVectorStore(
+    OpenAi::VectorStore& store) {
+  CTL_INF("CreateVectorStore: " + store.id);
+  std::unique_lock lock(mutex_);
+  auto path = GetVectorStorePath(store.id);
+  if (std::filesystem::exists(path)) {
+    return cpp::fail("Vector store exists: " + store.id);
+  }
+  std::error_code ec;
+  std::filesystem::create_directories(path / kFilesFolderName, ec);
+  if (ec) {
+    return cpp::fail("Failed to create " + path.string() + ": " +
+                     ec.message());
+  }
+  return SaveVectorStore(store);
+}
+
+cpp::result<std::vector<OpenAi::VectorStore>, std::string>
+VectorStoreFsRepository::ListVectorStores(uint8_t limit,
+                                          const std::string& order,
+                                          const std::string& after) const {
+  std::shared_lock lock(mutex_);
+  std::vector<OpenAi::VectorStore> stores;
+  try {
+    for (auto const& entry : std::filesystem::directory_iterator(
+             data_folder_path_ / kVectorStoreContainerFolderName)) {
+      if (!entry.is_directory()) {
+        continue;
+      }
+      auto res = LoadVectorStore(entry.path().filename().string());
+      if (res.has_value()) {
+        stores.push_back(std::move(res.value()));
+      }
+    }
+  } catch (const std::exception& e) {
+    return cpp::fail(std::string("Failed to list vector stores: ") + e.what());
+  }
+
+  // ids are ULIDs, so sorting by id sorts by creation time
+  std::sort(stores.begin(), stores.end(),
+            [&order](const OpenAi::VectorStore& a,
+                     const OpenAi::VectorStore& b) {
+              return order == "desc" ? a.id > b.id : a.id < b.id;
+            });
+  if (!after.empty()) {
+    auto it = std::find_if(
+        stores.begin(), stores.end(),
+        [&after](const OpenAi::VectorStore& s) { return s.id == after; });
+    if (it != stores.end()) {
+      stores.erase(stores.begin(), std::next(it));
+    }
+  }
+  if (limit > 0 && stores.size() > limit) {
+    stores.resize(limit);
+  }
+  return stores;
+}
+
+cpp::result<OpenAi::VectorStore, std::string>
+VectorStoreFsRepository::RetrieveVectorStore(
+    const std::string& store_id) const {
+  std::shared_lock lock(mutex_);
+  return LoadVectorStore(store_id);
+}
+
+cpp::result<void, std::string> VectorStoreFsRepository::ModifyVectorStore(
+    OpenAi::VectorStore& store) {
+  std::unique_lock lock(mutex_);
+  if (!std::filesystem::exists(GetVectorStorePath(store.id))) {
+    return cpp::fail("Vector store not found: " + store.id);
+  }
+  return SaveVectorStore(store);
+}
+
+cpp::result<void, std::string> VectorStoreFsRepository::DeleteVectorStore(
+    const std::string& store_id) {
+  CTL_INF("DeleteVectorStore: " + store_id);
+  std::unique_lock lock(mutex_);
+  auto path = GetVectorStorePath(store_id);
+  if (!std::filesystem::exists(path)) {
+    return cpp::fail("Vector store not found: " + store_id);
+  }
+  try {
+    std::filesystem::remove_all(path);
+    return {};
+  } catch (const std::exception& e) {
+    return cpp::fail("Failed to delete vector store: " + std::string(e.what()));
+  }
+}
+
+cpp::result<std::vector<OpenAi::VectorStoreFile>, std::string>
+VectorStoreFsRepository::ListVectorStoreFiles(
+    const std::string& store_id) const {
+  std::shared_lock lock(mutex_);
+  auto path = GetVectorStorePath(store_id) / kFilesFolderName;
+  if (!std::filesystem::exists(path)) {
+    return cpp::fail("Vector store not found: " + store_id);
+  }
+  std::vector<OpenAi::VectorStoreFile> files;
+  for (auto const& entry : std::filesystem::directory_iterator(path)) {
+    if (entry.path().extension() != ".json") {
+      continue;
+    }
+    auto root = ReadJsonFile(entry.path());
+    if (root.has_error()) {
+      CTL_WRN(root.error());
+      continue;
+    }
+    auto file = OpenAi::VectorStoreFile::FromJson(root.value());
+    if (file.has_value()) {
+      files.push_back(std::move(file.value()));
+    }
+  }
+  std::sort(files.begin(), files.end(),
+            [](const OpenAi::VectorStoreFile& a,
+               const OpenAi::VectorStoreFile& b) {
+              return a.created_at < b.created_at;
+            });
+  return files;
+}
+
+cpp::result<void, std::string> VectorStoreFsRepository::SaveVectorStoreFile(
+    OpenAi::VectorStoreFile& file) {
+  std::unique_lock lock(mutex_);
+  auto path = GetVectorStorePath(file.vector_store_id) / kFilesFolderName;
+  if (!std::filesystem::exists(path)) {
+    return cpp::fail("Vector store not found: " + file.vector_store_id);
+  }
+  auto json = file.ToJson();
+  if (json.has_error()) {
+    return cpp::fail(json.error());
+  }
+  return WriteJsonFile(path / (file.id + ".json"), json.value());
+}
+
+cpp::result<std::vector<OpenAi::VectorStoreChunk>, std::string>
+VectorStoreFsRepository::LoadChunks(const std::string& store_id) const {
+  std::shared_lock lock(mutex_);
+  std::vector<OpenAi::VectorStoreChunk> chunks;
+  auto path = GetVectorStorePath(store_id) / kChunksFileName;
+  if (!std::filesystem::exists(path)) {
+    return chunks;
+  }
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    auto root = json_helper::ParseJsonString(line);
+    chunks.push_back(OpenAi::VectorStoreChunk{
+        .file_id = root["file_id"].asString(),
+        .text = root["text"].asString(),
+    });
+  }
+  return chunks;
+}
+
+cpp::result<void, std::string> VectorStoreFsRepository::AppendChunks(
+    const std::string& store_id,
+    const std::vector<OpenAi::VectorStoreChunk>& chunks) {
+  std::unique_lock lock(mutex_);
+  auto path = GetVectorStorePath(store_id) / kChunksFileName;
+  std::ofstream file(path, std::ios::app);
+  if (!file) {
+    return cpp::fail("Failed to open file: " + path.string());
+  }
+  for (auto const& chunk : chunks) {
+    Json::Value root;
+    root["file_id"] = chunk.file_id;
+    root["text"] = chunk.text;
+    // the compact dump escapes newlines, one chunk stays on one line
+    file << json_helper::DumpJsonString(root) << '\n';
+  }
+  file.close();
+  if (!file) {
+    return cpp::fail("Failed to write file: " + path.string());
+  }
+  return {};
+}
+
+cpp::result<void, std::string> VectorStoreFsRepository::TruncateChunks(
+    const std::string& store_id, size_t count) {
+  auto chunks = LoadChunks(store_id);
+  if (chunks.has_error()) {
+    return cpp::fail(chunks.error());
+  }
+  if (chunks->size() <= count) {
+    return {};
+  }
+  chunks->resize(count);
+
+  std::unique_lock lock(mutex_);
+  auto path = GetVectorStorePath(store_id) / kChunksFileName;
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::trunc);
+    for (auto const& chunk : chunks.value()) {
+      Json::Value root;
+      root["file_id"] = chunk.file_id;
+      root["text"] = chunk.text;
+      file << json_helper::DumpJsonString(root) << '\n';
+    }
+    if (!file) {
+      return cpp::fail("Failed to write file: " + tmp_path.string());
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    return cpp::fail("Failed to replace " + path.string() + ": " +
+                     ec.message());
+  }
+  return {};
+}
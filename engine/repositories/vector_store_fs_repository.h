@@ -0,0 +1,85 @@
+#pragma once
+
+#include <filesystem>
+#include <shared_mutex>
+#include "common/repository/vector_store_repository.h"
+#include "utils/logging_utils.h"
+
+/**
+ * Stores each vector store in its own folder:
+ *   vector_stores/<id>/vector_store.json   the store object
+ *   vector_stores/<id>/files/<file_id>.json attached files
+ *   vector_stores/<id>/chunks.jsonl        chunk text, one line per vector
+ *   vector_stores/<id>/index/              vectors and ANN index
+ */
+class VectorStoreFsRepository : public VectorStoreRepository {
+ private:
+  constexpr static auto kVectorStoreFileName = "vector_store.json";
+  constexpr static auto kChunksFileName = "chunks.jsonl";
+  constexpr static auto kFilesFolderName = "files";
+  constexpr static auto kIndexFolderName = "index";
+  constexpr static auto kVectorStoreContainerFolderName = "vector_stores";
+
+  mutable std::shared_mutex mutex_;
+
+  /**
+   * The path to the data folder.
+   */
+  std::filesystem::path data_folder_path_;
+
+  std::filesystem::path GetVectorStorePath(const std::string& store_id) const;
+
+  cpp::result<OpenAi::VectorStore, std::string> LoadVectorStore(
+      const std::string& store_id) const;
+
+  cpp::result<void, std::string> SaveVectorStore(OpenAi::VectorStore& store);
+
+ public:
+  explicit VectorStoreFsRepository(
+      const std::filesystem::path& data_folder_path)
+      : data_folder_path_{data_folder_path} {
+    CTL_INF("Constructing VectorStoreFsRepository..");
+    auto container_path = data_folder_path_ / kVectorStoreContainerFolderName;
+
+    if (!std::filesystem::exists(container_path)) {
+      std::filesystem::create_directories(container_path);
+    }
+  }
+
+  cpp::result<void, std::string> CreateVectorStore(
+      OpenAi::VectorStore& store) override;
+
+  cpp::result<std::vector<OpenAi::VectorStore>, std::string> ListVectorStores(
+      uint8_t limit, const std::string& order,
+      const std::string& after) const override;
+
+  cpp::result<OpenAi::VectorStore, std::string> RetrieveVectorStore(
+      const std::string& store_id) const override;
+
+  cpp::result<void, std::string> ModifyVectorStore(
+      OpenAi::VectorStore& store) override;
+
+  cpp::result<void, std::string> DeleteVectorStore(
+      const std::string& store_id) override;
+
+  cpp::result<std::vector<OpenAi::VectorStoreFile>, std::string>
+  ListVectorStoreFiles(const std::string& store_id) const override;
+
+  cpp::result<void, std::string> SaveVectorStoreFile(
+      OpenAi::VectorStoreFile& file) override;
+
+  cpp::result<std::vector<OpenAi::VectorStoreChunk>, std::string> LoadChunks(
+      const std::string& store_id) const override;
+
+  cpp::result<void, std::string> AppendChunks(
+      const std::string& store_id,
+      const std::vector<OpenAi::VectorStoreChunk>& chunks) override;
+
+  cpp::result<void, std::string> TruncateChunks(const std::string& store_id,
+                                                size_t count) override;
+
+  std::filesystem::path GetIndexPath(
+      const std::string& store_id) const override;
+
+  ~VectorStoreFsRepository() = default;
+};
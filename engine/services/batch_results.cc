@@ -0,0 +1,71 @@
+#include "batch_results.h"
+#include <fstream>
+#include "utils/json_helper.h"
+#include "utils/ulid_generator.h"
+
+namespace {
+constexpr const auto kOutputFileName = "output.jsonl";
+constexpr const auto kErrorsFileName = "errors.jsonl";
+
+uint64_t LoadAnsweredIds(const std::filesystem::path& path,
+                         std::unordered_set<std::string>& ids) {
+  std::error_code ec;
+  if (!std::filesystem::exists(path, ec)) {
+    return 0;
+  }
+  uint64_t answered = 0;
+  uint64_t complete_bytes = 0;
+  {
+    std::ifstream file(path, std::ios::binary);
+    std::string line;
+    while (std::getline(file, line)) {
+      if (file.eof()) {
+        // no newline, the write was interrupted
+        break;
+      }
+      complete_bytes += line.size() + 1;
+      auto root = json_helper::ParseJsonString(line);
+      if (root.isMember("custom_id") &&
+          ids.insert(root["custom_id"].asString()).second) {
+        answered++;
+      }
+    }
+  }
+  if (std::filesystem::file_size(path, ec) > complete_bytes) {
+    std::filesystem::resize_file(path, complete_bytes, ec);
+  }
+  return answered;
+}
+
+bool HasContent(const std::filesystem::path& path) {
+  std::error_code ec;
+  return std::filesystem::exists(path, ec) &&
+         std::filesystem::file_size(path, ec) > 0;
+}
+}  // namespace
+
+std::filesystem::path BatchResults::output_path() const {
+  return dir_ / kOutputFileName;
+}
+
+std::filesystem::path BatchResults::errors_path() const {
+  return dir_ / kErrorsFileName;
+}
+
+BatchResults::Counts BatchResults::Load(
+    std::unordered_set<std::string>& done_ids) const {
+  Counts counts;
+  counts.completed = LoadAnsweredIds(output_path(), done_ids);
+  counts.failed = LoadAnsweredIds(errors_path(), done_ids);
+  return counts;
+}
+
+void BatchResults::ReserveFileIds(OpenAi::Batch& batch) const {
+  auto reserve = [](const std::filesystem::path& path, std::string& file_id) {
+    if (file_id.empty() && HasContent(path)) {
+      file_id = "file-" + ulid::GenerateUlid();
+    }
+  };
+  reserve(output_path(), batch.output_file_id);
+  reserve(errors_path(), batch.error_file_id);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_set>
+#include "common/batch.h"
+
+/**
+ * Result files of a batch being processed: output.jsonl for the requests
+ * which succeeded and errors.jsonl for the others, one record per line.
+ *
+ * The files are what a resumed batch trusts. The progress persisted in the
+ * database may lag behind them by up to a report interval, so the answered
+ * requests and their counts are read back from the files after a restart.
+ */
+class BatchResults {
+ public:
+  struct Counts {
+    uint64_t completed = 0;
+    uint64_t failed = 0;
+  };
+
+  explicit BatchResults(std::filesystem::path dir) : dir_{std::move(dir)} {}
+
+  std::filesystem::path output_path() const;
+
+  std::filesystem::path errors_path() const;
+
+  /**
+   * Collect the custom_ids answered so far into [done_ids] and count them,
+   * cutting off a trailing line only partly written when the server went
+   * down.
+   */
+  Counts Load(std::unordered_set<std::string>& done_ids) const;
+
+  /**
+   * Pick the ids the non-empty result files are stored under, keeping the
+   * ones an interrupted finalize already picked. Saved before the files are
+   * moved, they let a finalize run again without storing a file twice.
+   */
+  void ReserveFileIds(OpenAi::Batch& batch) const;
+
+ private:
+  std::filesystem::path dir_;
+};
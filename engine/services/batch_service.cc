@@ -0,0 +1,540 @@
+#include "batch_service.h"
+#include <algorithm>
+#include <chrono>
+#include "services/batch_results.h"
+#include "services/inference_scheduler.h"
+#include "utils/file_manager_utils.h"
+#include "utils/function_calling/common.h"
+#include "utils/json_helper.h"
+#include "utils/logging_utils.h"
+#include "utils/ulid_generator.h"
+
+namespace {
+constexpr const int k200OK = 200;
+constexpr const int k429TooManyRequests = 429;
+// progress is persisted and broadcast at most this often
+constexpr const auto kReportInterval = std::chrono::seconds(1);
+
+uint64_t NowSeconds() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+void TrimLineEnd(std::string& line) {
+  if (!line.empty() && line.back() == '\r') {
+    line.pop_back();
+  }
+}
+
+bool IsBlank(const std::string& line) {
+  return line.find_first_not_of(" \t\r") == std::string::npos;
+}
+}  // namespace
+
+BatchService::BatchService(std::shared_ptr<DatabaseService> db_service,
+                           std::shared_ptr<FileService> file_service,
+                           std::shared_ptr<InferenceService> inference_service,
+                           std::shared_ptr<EventQueue> event_queue,
+                           Config config)
+    : db_service_{db_service},
+      file_service_{file_service},
+      inference_service_{inference_service},
+      event_queue_{event_queue},
+      config_{config} {
+  config_.max_concurrency = std::max(config_.max_concurrency, 1);
+
+  // pick up the batches interrupted by the last shutdown
+  if (auto batches = db_service_->GetBatchList(); batches.has_value()) {
+    // the list is newest first, resume in creation order
+    for (auto it = batches->rbegin(); it != batches->rend(); ++it) {
+      if (it->IsFinished()) {
+        continue;
+      }
+      CTL_INF("Resuming batch " << it->id << " (" << it->status << ")");
+      if (it->status == "cancelling") {
+        cancelled_.insert(it->id);
+      }
+      queue_.push_back(it->id);
+    }
+  } else {
+    CTL_WRN("Failed to load batches: " << batches.error());
+  }
+  runner_ = std::thread([this] { RunLoop(); });
+}
+
+BatchService::~BatchService() {
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (runner_.joinable()) {
+    runner_.join();
+  }
+}
+
+uint64_t BatchService::ParseCompletionWindow(const std::string& window) {
+  if (window.size() < 2 || window.back() != 'h') {
+    return 0;
+  }
+  try {
+    size_t pos = 0;
+    auto hours = std::stoul(window.substr(0, window.size() - 1), &pos);
+    if (pos != window.size() - 1) {
+      return 0;
+    }
+    return hours * 3600;
+  } catch (const std::exception&) {
+    return 0;
+  }
+}
+
+cpp::result<OpenAi::Batch, std::string> BatchService::CreateBatch(
+    const std::string& input_file_id, const std::string& endpoint,
+    const std::string& completion_window, const Json::Value& metadata) {
+  if (std::find(kSupportedEndpoints.begin(), kSupportedEndpoints.end(),
+                endpoint) == kSupportedEndpoints.end()) {
+    return cpp::fail("Unsupported endpoint: " + endpoint +
+                     ". Supported endpoints are /v1/chat/completions and "
+                     "/v1/embeddings");
+  }
+  if (ParseCompletionWindow(completion_window) == 0) {
+    return cpp::fail("Invalid completion_window: " + completion_window);
+  }
+  auto file = file_service_->RetrieveFile(input_file_id);
+  if (file.has_error()) {
+    return cpp::fail("File not found: " + input_file_id);
+  }
+  if (file->purpose != "batch") {
+    return cpp::fail("The input file must be uploaded with purpose batch");
+  }
+
+  OpenAi::Batch batch;
+  batch.id = "batch_" + ulid::GenerateUlid();
+  batch.endpoint = endpoint;
+  batch.input_file_id = input_file_id;
+  batch.completion_window = completion_window;
+  batch.status = "validating";
+  batch.created_at = NowSeconds();
+  if (metadata.isObject()) {
+    batch.metadata = metadata;
+  }
+  if (auto res = db_service_->AddBatchEntry(batch); res.has_error()) {
+    return cpp::fail(res.error());
+  }
+
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    queue_.push_back(batch.id);
+  }
+  cv_.notify_one();
+  return batch;
+}
+
+cpp::result<OpenAi::Batch, std::string> BatchService::RetrieveBatch(
+    const std::string& batch_id) const {
+  return db_service_->GetBatchById(batch_id);
+}
+
+cpp::result<std::vector<OpenAi::Batch>, std::string> BatchService::ListBatches(
+    uint8_t limit, const std::string& after) const {
+  auto batches = db_service_->GetBatchList();
+  if (batches.has_error()) {
+    return cpp::fail(batches.error());
+  }
+  if (!after.empty()) {
+    auto it = std::find_if(
+        batches->begin(), batches->end(),
+        [&after](const OpenAi::Batch& b) { return b.id == after; });
+    if (it != batches->end()) {
+      batches->erase(batches->begin(), std::next(it));
+    }
+  }
+  if (limit > 0 && batches->size() > limit) {
+    batches->resize(limit);
+  }
+  return batches;
+}
+
+cpp::result<OpenAi::Batch, std::string> BatchService::CancelBatch(
+    const std::string& batch_id) {
+  auto batch = db_service_->GetBatchById(batch_id);
+  if (batch.has_error()) {
+    return cpp::fail(batch.error());
+  }
+  if (batch->IsFinished()) {
+    return cpp::fail("Cannot cancel a batch with status " + batch->status);
+  }
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    cancelled_.insert(batch_id);
+  }
+  // the runner finishes the cancellation once in-flight requests are done
+  batch->status = "cancelling";
+  Save(batch.value());
+  return batch;
+}
+
+void BatchService::RunLoop() {
+  while (true) {
+    std::string batch_id;
+    {
+      std::unique_lock<std::mutex> l(mtx_);
+      cv_.wait(l, [this] { return stop_ || !queue_.empty(); });
+      if (stop_) {
+        return;
+      }
+      batch_id = std::move(queue_.front());
+      queue_.pop_front();
+    }
+
+    auto batch = db_service_->GetBatchById(batch_id);
+    if (batch.has_error()) {
+      CTL_WRN("Failed to load batch " << batch_id << ": " << batch.error());
+      continue;
+    }
+    ProcessBatch(std::move(batch.value()));
+  }
+}
+
+void BatchService::ProcessBatch(OpenAi::Batch batch) {
+  if (batch.status == "validating" && !IsCancelled(batch.id)) {
+    if (auto res = Validate(batch); res.has_error()) {
+      CTL_WRN("Batch " << batch.id << " failed validation: " << res.error());
+      batch.status = "failed";
+      batch.failed_at = NowSeconds();
+      batch.error = res.error();
+      Save(batch);
+      Emit(BatchEventType::BatchFailed, batch);
+      return;
+    }
+    batch.status = "in_progress";
+    batch.in_progress_at = NowSeconds();
+    Save(batch);
+    Emit(BatchEventType::BatchInProgress, batch);
+  }
+
+  if (batch.status == "in_progress" && !IsCancelled(batch.id)) {
+    auto dir = GetBatchPath(batch.id);
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    RunState state;
+    // the counts persisted last may miss the requests answered since
+    BatchResults results(dir);
+    auto counts = results.Load(state.done_ids);
+    batch.completed = counts.completed;
+    batch.failed = counts.failed;
+    auto input_path = file_service_->GetFileLocalPath(batch.input_file_id);
+    if (input_path.has_error()) {
+      batch.status = "failed";
+      batch.failed_at = NowSeconds();
+      batch.error = input_path.error();
+      Save(batch);
+      Emit(BatchEventType::BatchFailed, batch);
+      return;
+    }
+    state.input.open(input_path.value(), std::ios::binary);
+    state.input.seekg(batch.input_offset);
+    state.read_offset = batch.input_offset;
+    state.output.open(results.output_path(),
+                      std::ios::binary | std::ios::app);
+    state.errors.open(results.errors_path(),
+                      std::ios::binary | std::ios::app);
+    state.last_report = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < config_.max_concurrency; i++) {
+      workers.emplace_back([this, &batch, &state] { Work(batch, state); });
+    }
+    for (auto& w : workers) {
+      w.join();
+    }
+    state.output.close();
+    state.errors.close();
+
+    if (stop_) {
+      // resumed from input_offset on the next start
+      Save(batch);
+      return;
+    }
+    if (state.expired) {
+      batch.status = "expired";
+    }
+  }
+
+  Finalize(batch);
+}
+
+cpp::result<void, std::string> BatchService::Validate(OpenAi::Batch& batch) {
+  auto input_path = file_service_->GetFileLocalPath(batch.input_file_id);
+  if (input_path.has_error()) {
+    return cpp::fail(input_path.error());
+  }
+  std::ifstream input(input_path.value(), std::ios::binary);
+  if (!input) {
+    return cpp::fail("Failed to open input file " + batch.input_file_id);
+  }
+
+  std::unordered_set<std::string> custom_ids;
+  std::string line;
+  uint64_t line_number = 0;
+  uint64_t total = 0;
+  while (std::getline(input, line)) {
+    line_number++;
+    TrimLineEnd(line);
+    if (IsBlank(line)) {
+      continue;
+    }
+    auto prefix = "Line " + std::to_string(line_number) + ": ";
+    Json::Value req;
+    Json::Reader reader;
+    if (!reader.parse(line, req) || !req.isObject()) {
+      return cpp::fail(prefix + "invalid JSON");
+    }
+    auto custom_id = req.get("custom_id", "").asString();
+    if (custom_id.empty()) {
+      return cpp::fail(prefix + "custom_id is required");
+    }
+    if (!custom_ids.insert(custom_id).second) {
+      return cpp::fail(prefix + "duplicate custom_id " + custom_id);
+    }
+    if (req.get("method", "").asString() != "POST") {
+      return cpp::fail(prefix + "method must be POST");
+    }
+    if (req.get("url", "").asString() != batch.endpoint) {
+      return cpp::fail(prefix + "url must match the batch endpoint " +
+                       batch.endpoint);
+    }
+    if (!req["body"].isObject() || !req["body"]["model"].isString()) {
+      return cpp::fail(prefix + "body with a model is required");
+    }
+    total++;
+  }
+  if (total == 0) {
+    return cpp::fail("The input file has no requests");
+  }
+  batch.total = total;
+  return {};
+}
+
+void BatchService::Work(OpenAi::Batch& batch, RunState& state) {
+  auto deadline =
+      batch.created_at + ParseCompletionWindow(batch.completion_window);
+  while (true) {
+    std::string line;
+    uint64_t start = 0;
+    Json::Value req;
+    {
+      std::lock_guard<std::mutex> l(state.mtx);
+      if (stop_ || state.expired || IsCancelled(batch.id)) {
+        return;
+      }
+      if (NowSeconds() > deadline) {
+        state.expired = true;
+        return;
+      }
+      // skip blank lines and the requests answered before a restart
+      while (true) {
+        start = state.read_offset;
+        if (!std::getline(state.input, line)) {
+          return;
+        }
+        state.read_offset = start + line.size() + 1;
+        TrimLineEnd(line);
+        if (IsBlank(line)) {
+          continue;
+        }
+        req = json_helper::ParseJsonString(line);
+        if (state.done_ids.count(req["custom_id"].asString()) > 0) {
+          continue;
+        }
+        break;
+      }
+      state.in_flight.insert(start);
+    }
+
+    auto [status, res] = Execute(batch, req["body"]);
+    auto status_code = status.get("status_code", k200OK).asInt();
+    if (status.get("has_error", false).asBool() && status_code == k200OK) {
+      status_code = 500;
+    }
+
+    Json::Value record;
+    record["id"] = "batch_req_" + ulid::GenerateUlid();
+    record["custom_id"] = req["custom_id"];
+    record["response"]["status_code"] = status_code;
+    record["response"]["body"] = res;
+    auto succeeded = status_code == k200OK;
+    if (succeeded) {
+      record["error"] = Json::Value();
+    } else {
+      record["error"]["code"] = "request_failed";
+      record["error"]["message"] =
+          res.get("message", "Request failed").asString();
+    }
+
+    std::lock_guard<std::mutex> l(state.mtx);
+    auto& out = succeeded ? state.output : state.errors;
+    out << json_helper::DumpJsonString(record) << '\n';
+    out.flush();
+    (succeeded ? batch.completed : batch.failed)++;
+
+    // every line before the oldest one in flight is done
+    state.in_flight.erase(start);
+    batch.input_offset =
+        state.in_flight.empty() ? state.read_offset : *state.in_flight.begin();
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - state.last_report >= kReportInterval) {
+      state.last_report = now;
+      if (IsCancelled(batch.id)) {
+        batch.status = "cancelling";
+      }
+      Save(batch);
+      Emit(BatchEventType::BatchUpdated, batch);
+    }
+  }
+}
+
+InferResult BatchService::Execute(const OpenAi::Batch& batch,
+                                  Json::Value body) {
+  auto is_chat = batch.endpoint == "/v1/chat/completions";
+  if (is_chat) {
+    body["stream"] = false;
+  }
+  auto model_id = body.get("model", "").asString();
+  if (auto efm = inference_service_->GetEngineByModelId(model_id);
+      !efm.empty()) {
+    body["engine"] = efm;
+  }
+  SchedulingOptions options{.priority = RequestPriority::kLow,
+                            .client_id = "batch:" + batch.id};
+
+  while (true) {
+    auto q = std::make_shared<SyncQueue>();
+    auto json_body = std::make_shared<Json::Value>(body);
+    auto ir = is_chat
+                  ? inference_service_->HandleChatCompletion(q, json_body,
+                                                             options)
+                  : inference_service_->HandleEmbedding(q, json_body, options);
+    auto result = ir.has_error() ? ir.error() : q->wait_and_pop();
+
+    // the scheduler sheds low priority work first; wait for capacity rather
+    // than failing the request
+    if (result.first.get("status_code", k200OK).asInt() ==
+            k429TooManyRequests &&
+        !stop_ && !IsCancelled(batch.id)) {
+      auto retry_after =
+          std::max(result.first.get("retry_after", 1).asInt(), 1);
+      for (int i = 0; i < retry_after * 10 && !stop_; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+      continue;
+    }
+    if (is_chat && result.first.get("status_code", k200OK).asInt() == k200OK) {
+      function_calling_utils::PostProcessResponse(result.second);
+    }
+    return result;
+  }
+}
+
+void BatchService::Finalize(OpenAi::Batch& batch) {
+  auto cancelled = IsCancelled(batch.id) || batch.status == "cancelling" ||
+                   batch.cancelled_at != 0;
+  // a batch resumed while finalizing stopped early if requests are left
+  auto expired =
+      !cancelled &&
+      (batch.status == "expired" ||
+       (batch.status == "finalizing" &&
+        batch.completed + batch.failed < batch.total));
+
+  // partial results are kept for cancelled and expired batches as well
+  BatchResults results(GetBatchPath(batch.id));
+  if (batch.status != "finalizing") {
+    if (cancelled && batch.cancelled_at == 0) {
+      batch.cancelled_at = NowSeconds();
+    }
+    // the file ids are saved before the files move, so a finalize
+    // interrupted by a restart stores each of them once, under the same id
+    results.ReserveFileIds(batch);
+    batch.status = "finalizing";
+    Save(batch);
+  }
+
+  auto store_file = [this, &batch](const std::filesystem::path& path,
+                                   std::string& file_id) {
+    if (file_id.empty() || file_service_->RetrieveFile(file_id).has_value()) {
+      // nothing to store, or stored before the restart
+      return;
+    }
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec)) {
+      CTL_WRN("Lost " << path.filename().string() << " of " << batch.id);
+      file_id.clear();
+      return;
+    }
+    auto file = file_service_->AddFileFromPath(
+        batch.id + "_" + path.filename().string(), "batch_output", path,
+        file_id);
+    if (file.has_error()) {
+      CTL_WRN("Failed to store " << path.filename().string() << " of "
+                                 << batch.id << ": " << file.error());
+      file_id.clear();
+    }
+  };
+  store_file(results.output_path(), batch.output_file_id);
+  store_file(results.errors_path(), batch.error_file_id);
+  std::error_code ec;
+  std::filesystem::remove_all(GetBatchPath(batch.id), ec);
+
+  auto now = NowSeconds();
+  if (cancelled) {
+    batch.status = "cancelled";
+  } else if (expired) {
+    batch.status = "expired";
+  } else {
+    batch.status = "completed";
+    batch.completed_at = now;
+  }
+  Save(batch);
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    cancelled_.erase(batch.id);
+  }
+  Emit(cancelled ? BatchEventType::BatchCancelled
+       : expired ? BatchEventType::BatchFailed
+                 : BatchEventType::BatchCompleted,
+       batch);
+  CTL_INF("Batch " << batch.id << " " << batch.status << ": "
+                   << batch.completed << " completed, " << batch.failed
+                   << " failed");
+}
+
+bool BatchService::IsCancelled(const std::string& batch_id) const {
+  std::lock_guard<std::mutex> l(mtx_);
+  return cancelled_.find(batch_id) != cancelled_.end();
+}
+
+void BatchService::Save(const OpenAi::Batch& batch) {
+  if (auto res = db_service_->UpdateBatchEntry(batch); res.has_error()) {
+    CTL_WRN("Failed to save batch " << batch.id << ": " << res.error());
+  }
+}
+
+void BatchService::Emit(BatchEventType type, const OpenAi::Batch& batch) {
+  if (event_queue_ == nullptr) {
+    return;
+  }
+  auto copy = batch;
+  BatchEvent event;
+  event.type_ = type;
+  event.batch_ = copy.ToJson().value();
+  event_queue_->enqueue(EventType::BatchEvent, std::move(event));
+}
+
+std::filesystem::path BatchService::GetBatchPath(
+    const std::string& batch_id) const {
+  return file_manager_utils::GetCortexDataPath() / "batches" / batch_id;
+}
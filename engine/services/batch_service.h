@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_set>
+#include "common/batch.h"
+#include "common/event.h"
+#include "services/database_service.h"
+#include "services/file_service.h"
+#include "services/inference_service.h"
+#include "utils/result.hpp"
+
+/**
+ * Offline processing of /v1/batches jobs.
+ *
+ * The input file is a JSONL file uploaded through /v1/files, one request per
+ * line. Batches run one at a time; the lines of a batch are streamed to the
+ * InferenceService by a bounded number of workers at the lowest scheduling
+ * priority, so batch traffic only uses capacity interactive requests leave
+ * idle. Results are appended to the output files as they come in and the
+ * progress is persisted in the database, so an interrupted batch resumes
+ * where it stopped after a restart.
+ */
+class BatchService {
+ public:
+  using BatchEventType = cortex::event::BatchEventType;
+  using BatchEvent = cortex::event::BatchEvent;
+  using EventType = cortex::event::EventType;
+  using EventQueue =
+      eventpp::EventQueue<EventType,
+                          void(const eventpp::AnyData<eventMaxSize>&)>;
+
+  struct Config {
+    // requests of the running batch in flight at once
+    int max_concurrency = 2;
+  };
+
+  inline static const std::vector<std::string> kSupportedEndpoints{
+      "/v1/chat/completions", "/v1/embeddings"};
+
+  explicit BatchService(std::shared_ptr<DatabaseService> db_service,
+                        std::shared_ptr<FileService> file_service,
+                        std::shared_ptr<InferenceService> inference_service,
+                        std::shared_ptr<EventQueue> event_queue,
+                        Config config);
+
+  ~BatchService();
+
+  cpp::result<OpenAi::Batch, std::string> CreateBatch(
+      const std::string& input_file_id, const std::string& endpoint,
+      const std::string& completion_window, const Json::Value& metadata);
+
+  cpp::result<OpenAi::Batch, std::string> RetrieveBatch(
+      const std::string& batch_id) const;
+
+  cpp::result<std::vector<OpenAi::Batch>, std::string> ListBatches(
+      uint8_t limit, const std::string& after) const;
+
+  cpp::result<OpenAi::Batch, std::string> CancelBatch(
+      const std::string& batch_id);
+
+  /**
+   * Parse a completion window such as "24h" into seconds, 0 if invalid.
+   */
+  static uint64_t ParseCompletionWindow(const std::string& window);
+
+ private:
+  // State shared by the workers of the running batch
+  struct RunState {
+    std::mutex mtx;
+    std::ifstream input;
+    uint64_t read_offset = 0;
+    // start offsets of the lines being processed
+    std::set<uint64_t> in_flight;
+    // custom_ids already answered in a previous run
+    std::unordered_set<std::string> done_ids;
+    std::ofstream output;
+    std::ofstream errors;
+    std::chrono::steady_clock::time_point last_report;
+    bool expired = false;
+  };
+
+  void RunLoop();
+
+  void ProcessBatch(OpenAi::Batch batch);
+
+  cpp::result<void, std::string> Validate(OpenAi::Batch& batch);
+
+  void Work(OpenAi::Batch& batch, RunState& state);
+
+  /**
+   * Run one request through the InferenceService, retrying while the
+   * scheduler sheds load. Returns the status and body of the response.
+   */
+  InferResult Execute(const OpenAi::Batch& batch, Json::Value body);
+
+  void Finalize(OpenAi::Batch& batch);
+
+  bool IsCancelled(const std::string& batch_id) const;
+
+  void Save(const OpenAi::Batch& batch);
+
+  void Emit(BatchEventType type, const OpenAi::Batch& batch);
+
+  std::filesystem::path GetBatchPath(const std::string& batch_id) const;
+
+  std::shared_ptr<DatabaseService> db_service_;
+  std::shared_ptr<FileService> file_service_;
+  std::shared_ptr<InferenceService> inference_service_;
+  std::shared_ptr<EventQueue> event_queue_;
+  Config config_;
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<std::string> queue_;
+  std::unordered_set<std::string> cancelled_;
+  std::atomic<bool> stop_{false};
+  std::thread runner_;
+};
@@ -0,0 +1,169 @@
+#include "context_fitter.h"
+#include <numeric>
+#include <vector>
+
+namespace {
+// Upper bounds of the tokens a chat template adds around each message and
+// around the whole prompt, for the estimate which skips the exact count
+constexpr const size_t kMessageOverhead = 16;
+constexpr const size_t kPromptOverhead = 64;
+
+uint64_t Fnv1a(std::string_view data, uint64_t hash) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Text the count of a message is taken from
+std::string MessageText(const nlohmann::ordered_json& message) {
+  auto it = message.find("content");
+  if (it != message.end() && it->is_string() &&
+      !message.contains("tool_calls")) {
+    return it->get<std::string>();
+  }
+  // structured content or tool calls, their serialization is an upper bound
+  return message.dump();
+}
+
+bool IsRole(const nlohmann::ordered_json& message, std::string_view role) {
+  auto it = message.find("role");
+  return it != message.end() && it->is_string() &&
+         it->get_ref<const std::string&>() == role;
+}
+
+std::string TooLongMessage(size_t ctx_len, size_t prompt_tokens,
+                           size_t reserved) {
+  return "This model's maximum context length is " + std::to_string(ctx_len) +
+         " tokens. However, you requested " +
+         std::to_string(prompt_tokens + reserved) + " tokens (" +
+         std::to_string(prompt_tokens) + " in the messages, " +
+         std::to_string(reserved) +
+         " in the completion). Please reduce the length of the messages or "
+         "completion.";
+}
+}  // namespace
+
+ContextFitter::ContextFitter(Config config) : config_{std::move(config)} {}
+
+std::optional<ContextFitter::Policy> ContextFitter::ParsePolicy(
+    std::string_view policy) {
+  if (policy == "none") {
+    return Policy::kNone;
+  }
+  if (policy == "error") {
+    return Policy::kError;
+  }
+  if (policy == "truncate") {
+    return Policy::kTruncate;
+  }
+  return std::nullopt;
+}
+
+cpp::result<ContextFitter::Result, std::string> ContextFitter::Fit(
+    Policy policy, const std::string& model, nlohmann::ordered_json& messages,
+    Budget budget, const CountFn& count, const RenderFn& render) {
+  Result result;
+  if (policy == Policy::kNone || !messages.is_array()) {
+    return result;
+  }
+
+  std::vector<size_t> counts;
+  counts.reserve(messages.size());
+  for (auto const& message : messages) {
+    counts.push_back(CountMessage(model, message, count));
+  }
+  auto estimate = std::accumulate(counts.begin(), counts.end(), size_t{0}) +
+                  counts.size() * kMessageOverhead + kPromptOverhead;
+  if (estimate + budget.reserved <= budget.ctx_len) {
+    return result;
+  }
+
+  // the leading system messages and the last user turn are kept
+  size_t first = 0;
+  while (first < messages.size() && IsRole(messages[first], "system")) {
+    first++;
+  }
+  size_t last_user = messages.size();
+  while (last_user > first && !IsRole(messages[last_user - 1], "user")) {
+    last_user--;
+  }
+  last_user = last_user > first ? last_user - 1 : first;
+
+  while (true) {
+    auto prompt = render(messages);
+    if (prompt.has_error()) {
+      // can't be measured, the caller reports the error when rendering
+      return result;
+    }
+    result.prompt_tokens = count(prompt.value());
+    result.prompt = std::move(prompt.value());
+    if (result.prompt_tokens + budget.reserved <= budget.ctx_len) {
+      return result;
+    }
+    if (policy == Policy::kError || first >= last_user) {
+      return cpp::fail(TooLongMessage(budget.ctx_len, result.prompt_tokens,
+                                      budget.reserved));
+    }
+
+    // Spread what the template adds evenly over the messages to guess how
+    // many turns to drop, the next render tells whether it was enough
+    auto content = std::accumulate(counts.begin(), counts.end(), size_t{0});
+    auto overhead = result.prompt_tokens > content
+                        ? (result.prompt_tokens - content) / counts.size()
+                        : 0;
+    auto excess = result.prompt_tokens + budget.reserved - budget.ctx_len;
+    size_t end = first;
+    size_t freed = 0;
+    while (end < last_user && freed < excess) {
+      freed += counts[end++] + overhead;
+    }
+    // whole turns: the history resumes with a user message
+    while (end < last_user && !IsRole(messages[end], "user")) {
+      end++;
+    }
+
+    messages.erase(messages.begin() + first, messages.begin() + end);
+    counts.erase(counts.begin() + first, counts.begin() + end);
+    result.dropped_messages += end - first;
+    last_user -= end - first;
+  }
+}
+
+size_t ContextFitter::GetCachedCounts() const {
+  std::lock_guard<std::mutex> l(mtx_);
+  return lru_.size();
+}
+
+size_t ContextFitter::CountMessage(const std::string& model,
+                                   const nlohmann::ordered_json& message,
+                                   const CountFn& count) {
+  auto text = MessageText(message);
+  auto role = message.value("role", "");
+  auto key = Fnv1a(model, 0xcbf29ce484222325ULL);
+  key = Fnv1a(std::string_view("\0", 1), key);
+  key = Fnv1a(role, key);
+  key = Fnv1a(std::string_view("\0", 1), key);
+  key = Fnv1a(text, key);
+
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    if (auto it = index_.find(key); it != index_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return it->second->second;
+    }
+  }
+
+  auto n = count(text);
+  std::lock_guard<std::mutex> l(mtx_);
+  if (index_.find(key) == index_.end()) {
+    lru_.emplace_front(key, n);
+    index_[key] = lru_.begin();
+    while (lru_.size() > config_.max_cached_counts) {
+      index_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+  }
+  return n;
+}
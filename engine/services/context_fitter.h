@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "utils/result.hpp"
+
+/**
+ * Makes chat histories fit the context window of the model before they are
+ * sent to the engine, instead of letting a long prefill fail there.
+ *
+ * The token count of each message is cached, so that most requests are let
+ * through on an estimate: the cached counts plus a generous allowance for
+ * the template. Only when the estimate gets close to the window is the
+ * prompt rendered and counted exactly. Depending on the policy, a prompt
+ * which doesn't fit is then rejected, or its oldest turns are dropped: the
+ * leading system messages, which carry the tool definitions, and the last
+ * user turn are always kept.
+ */
+class ContextFitter {
+ public:
+  enum class Policy {
+    kNone,
+    // reject requests which don't fit
+    kError,
+    // drop the oldest turns
+    kTruncate,
+  };
+
+  struct Config {
+    Policy default_policy = Policy::kNone;
+    size_t max_cached_counts = 65536;
+  };
+
+  static std::optional<Policy> ParsePolicy(std::string_view policy);
+
+  using CountFn = std::function<size_t(std::string_view text)>;
+  using RenderFn = std::function<cpp::result<std::string, std::string>(
+      const nlohmann::ordered_json& messages)>;
+
+  struct Budget {
+    size_t ctx_len;
+    // kept for the completion
+    size_t reserved = 0;
+  };
+
+  struct Result {
+    // set when the prompt had to be rendered to be counted
+    std::optional<std::string> prompt;
+    size_t prompt_tokens = 0;
+    size_t dropped_messages = 0;
+  };
+
+  explicit ContextFitter(Config config);
+
+  const Config& config() const { return config_; }
+
+  /**
+   * Fit [messages] in [budget] following [policy]. [model] scopes the cached
+   * counts, [count] and [render] tokenize and render for that model. The
+   * error is meant for the client.
+   */
+  cpp::result<Result, std::string> Fit(Policy policy, const std::string& model,
+                                       nlohmann::ordered_json& messages,
+                                       Budget budget, const CountFn& count,
+                                       const RenderFn& render);
+
+  size_t GetCachedCounts() const;
+
+ private:
+  size_t CountMessage(const std::string& model,
+                      const nlohmann::ordered_json& message,
+                      const CountFn& count);
+
+  // hash of the message and its token count
+  using Count = std::pair<uint64_t, size_t>;
+
+  Config config_;
+
+  mutable std::mutex mtx_;
+  // most recently used first
+  std::list<Count> lru_;
+  std::unordered_map<uint64_t, std::list<Count>::iterator> index_;
+};
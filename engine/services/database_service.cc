@@ -51,6 +51,28 @@ cpp::result<void, std::string> DatabaseService::DeleteFileEntry(
 }
 // end file
 
+// begin batches
+cpp::result<std::vector<OpenAi::Batch>, std::string>
+DatabaseService::GetBatchList() const {
+  return cortex::db::Batches().GetBatchList();
+}
+
+cpp::result<OpenAi::Batch, std::string> DatabaseService::GetBatchById(
+    const std::string& batch_id) const {
+  return cortex::db::Batches().GetBatchById(batch_id);
+}
+
+cpp::result<void, std::string> DatabaseService::AddBatchEntry(
+    const OpenAi::Batch& batch) {
+  return cortex::db::Batches().AddBatchEntry(batch);
+}
+
+cpp::result<void, std::string> DatabaseService::UpdateBatchEntry(
+    const OpenAi::Batch& batch) {
+  return cortex::db::Batches().UpdateBatchEntry(batch);
+}
+// end batches
+
 // begin hardware
 cpp::result<std::vector<HardwareEntry>, std::string>
 DatabaseService::LoadHardwareList() const {
@@ -79,6 +101,10 @@ DatabaseService::LoadModelList() const {
   return cortex::db::Models().LoadModelList();
 }
 
+uint64_t DatabaseService::GetModelsVersion() const {
+  return cortex::db::Models::Version();
+}
+
 cpp::result<ModelEntry, std::string> DatabaseService::GetModelInfo(
     const std::string& identifier) const {
   return cortex::db::Models().GetModelInfo(identifier);
@@ -99,6 +125,11 @@ cpp::result<bool, std::string> DatabaseService::DeleteModelEntry(
   return cortex::db::Models().DeleteModelEntry(identifier);
 }
 
+cpp::result<int, std::string> DatabaseService::DeleteModelEntries(
+    const std::vector<std::string>& identifiers) {
+  return cortex::db::Models().DeleteModelEntries(identifiers);
+}
+
 cpp::result<bool, std::string> DatabaseService::DeleteModelEntryWithOrg(
     const std::string& src) {
   return cortex::db::Models().DeleteModelEntryWithOrg(src);
@@ -1,4 +1,5 @@
 #pragma once
+#include "database/batches.h"
 #include "database/engines.h"
 #include "database/file.h"
 #include "database/hardware.h"
@@ -35,6 +36,16 @@ class DatabaseService {
 
   cpp::result<void, std::string> DeleteFileEntry(const std::string& file_id);
 
+  // batches
+  cpp::result<std::vector<OpenAi::Batch>, std::string> GetBatchList() const;
+
+  cpp::result<OpenAi::Batch, std::string> GetBatchById(
+      const std::string& batch_id) const;
+
+  cpp::result<void, std::string> AddBatchEntry(const OpenAi::Batch& batch);
+
+  cpp::result<void, std::string> UpdateBatchEntry(const OpenAi::Batch& batch);
+
   // hardware
   cpp::result<std::vector<HardwareEntry>, std::string> LoadHardwareList() const;
   cpp::result<bool, std::string> AddHardwareEntry(
@@ -45,6 +56,7 @@ class DatabaseService {
 
   // models
   cpp::result<std::vector<ModelEntry>, std::string> LoadModelList() const;
+  uint64_t GetModelsVersion() const;
   cpp::result<ModelEntry, std::string> GetModelInfo(
       const std::string& identifier) const;
   void PrintModelInfo(const ModelEntry& entry) const;
@@ -53,6 +65,8 @@ class DatabaseService {
       const std::string& identifier, const ModelEntry& updated_entry);
   cpp::result<bool, std::string> DeleteModelEntry(
       const std::string& identifier);
+  cpp::result<int, std::string> DeleteModelEntries(
+      const std::vector<std::string>& identifiers);
   cpp::result<bool, std::string> DeleteModelEntryWithOrg(
       const std::string& src);
   cpp::result<bool, std::string> DeleteModelEntryWithRepo(
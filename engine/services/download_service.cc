@@ -18,6 +18,12 @@ size_t WriteCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
   return written;
 }
 
+size_t SinkWriteCallback(char* ptr, size_t size, size_t nmemb,
+                         void* userdata) {
+  auto* sink = static_cast<DownloadSink*>(userdata);
+  return sink->Write(ptr, size * nmemb) ? size * nmemb : 0;
+}
+
 cpp::result<void, std::string> ProcessCompletedTransfers(CURLM* multi_handle) {
   CURLMsg* msg;
   int msgs_left;
@@ -376,11 +382,14 @@ void DownloadService::ProcessTask(DownloadTask& task, int worker_id) {
       CTL_ERR("Failed to init curl!");
       return;
     }
-    auto file = fopen(item.localPath.string().c_str(), "wb");
-    if (!file) {
-      CTL_ERR("Failed to open output file " + item.localPath.string());
-      curl_easy_cleanup(handle);
-      return;
+    FILE* file = nullptr;
+    if (!item.sink) {
+      file = fopen(item.localPath.string().c_str(), "wb");
+      if (!file) {
+        CTL_ERR("Failed to open output file " + item.localPath.string());
+        curl_easy_cleanup(handle);
+        return;
+      }
     }
     auto dl_data_ptr = std::make_shared<DownloadingData>(DownloadingData{
         .task_id = task.id,
@@ -403,7 +412,24 @@ void DownloadService::ProcessTask(DownloadTask& task, int worker_id) {
   for (auto& [handle, file] : task_handles) {
     curl_multi_remove_handle(worker_data->multi_handle, handle);
     curl_easy_cleanup(handle);
-    fclose(file);
+    if (file) {
+      fclose(file);
+    }
+  }
+
+  for (const auto& item : task.items) {
+    if (!item.sink) {
+      continue;
+    }
+    if (auto close_res = item.sink->Close(!result.has_error());
+        close_res.has_error() && !result.has_error()) {
+      CTL_ERR("Failed to finish " << item.id << ": " << close_res.error());
+      result = cpp::fail(ProcessDownloadFailed{
+          .message = close_res.error(),
+          .task_id = task.id,
+          .type = DownloadEventType::DownloadError,
+      });
+    }
   }
 
   if (result.has_error()) {
@@ -461,8 +487,15 @@ void DownloadService::SetUpCurlHandle(CURL* handle, const DownloadItem& item,
                                       FILE* file, DownloadingData* dl_data) {
   SetUpProxy(handle, config_service_);
   curl_easy_setopt(handle, CURLOPT_URL, item.downloadUrl.c_str());
-  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteCallback);
-  curl_easy_setopt(handle, CURLOPT_WRITEDATA, file);
+  if (item.sink) {
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, SinkWriteCallback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, item.sink.get());
+    // an error page must not reach the sink
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+  } else {
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, file);
+  }
   curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
   curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
   curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
@@ -0,0 +1,273 @@
+#include "embedding_batcher.h"
+#include <algorithm>
+#include <optional>
+#include <unordered_set>
+#include "utils/logging_utils.h"
+
+namespace {
+constexpr const int k200OK = 200;
+constexpr const int k500InternalServerError = 500;
+
+// Fields that are the same for every caller in a batch. Requests with any
+// other field are sent to the engine as is.
+const std::unordered_set<std::string> kBatchableFields{
+    "model", "engine", "input", "encoding_format", "dimensions"};
+
+size_t CountInputChars(const Json::Value& input) {
+  if (input.isString()) {
+    return input.asString().size();
+  }
+  size_t n = 0;
+  for (auto const& i : input) {
+    n += i.asString().size();
+  }
+  return n;
+}
+}  // namespace
+
+EmbeddingBatcher::EmbeddingBatcher(Config config, FlushFn flush)
+    : config_{std::move(config)}, flush_{std::move(flush)} {
+  thread_ = std::thread(&EmbeddingBatcher::FlushThread, this);
+}
+
+EmbeddingBatcher::~EmbeddingBatcher() {
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+bool EmbeddingBatcher::CanBatch(const Json::Value& body) {
+  if (!body.isObject()) {
+    return false;
+  }
+  for (auto const& name : body.getMemberNames()) {
+    if (kBatchableFields.find(name) == kBatchableFields.end()) {
+      return false;
+    }
+  }
+  auto const& input = body["input"];
+  if (input.isString()) {
+    return true;
+  }
+  if (!input.isArray() || input.empty()) {
+    return false;
+  }
+  // token id inputs are left alone
+  return std::all_of(input.begin(), input.end(),
+                     [](const Json::Value& v) { return v.isString(); });
+}
+
+std::string EmbeddingBatcher::BatchKey(const Json::Value& body,
+                                       const SchedulingOptions& options) {
+  return body.get("model", "").asString() + "|" +
+         body.get("engine", "").asString() + "|" +
+         body.get("encoding_format", "").asString() + "|" +
+         body.get("dimensions", 0).asString() + "|" +
+         RequestPriorityToString(options.priority);
+}
+
+void EmbeddingBatcher::Submit(std::shared_ptr<Json::Value> body,
+                              const SchedulingOptions& options, Callback cb) {
+  auto const& input = (*body)["input"];
+  Item item{.body = body,
+            .cb = std::move(cb),
+            .num_inputs = input.isArray() ? input.size() : 1,
+            .input_chars = CountInputChars(input)};
+
+  std::optional<Batch> full;
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    auto key = BatchKey(*body, options);
+    auto [it, inserted] = batches_.try_emplace(key);
+    auto& batch = it->second;
+    if (inserted) {
+      batch.options = options;
+      batch.deadline = std::chrono::steady_clock::now() +
+                       std::chrono::milliseconds(config_.window_ms);
+    }
+    batch.num_inputs += item.num_inputs;
+    batch.items.push_back(std::move(item));
+    if (batch.num_inputs >= static_cast<size_t>(config_.max_batch_size)) {
+      full = std::move(batch);
+      batches_.erase(it);
+    }
+  }
+
+  if (full) {
+    Flush(std::move(*full));
+  } else {
+    cv_.notify_one();
+  }
+}
+
+std::vector<Json::Value> EmbeddingBatcher::Scatter(
+    const Json::Value& res, const std::vector<size_t>& sizes,
+    const std::vector<size_t>& weights) {
+  auto const& data = res["data"];
+  size_t total = 0;
+  for (auto s : sizes) {
+    total += s;
+  }
+  if (!data.isArray() || data.size() != total) {
+    return {};
+  }
+
+  // engines are not required to return the embeddings in input order
+  std::vector<const Json::Value*> ordered(total, nullptr);
+  for (Json::ArrayIndex i = 0; i < data.size(); i++) {
+    auto index = data[i].get("index", i).asUInt();
+    if (index >= total || ordered[index] != nullptr) {
+      return {};
+    }
+    ordered[index] = &data[i];
+  }
+
+  size_t total_weight = 0;
+  for (auto w : weights) {
+    total_weight += w;
+  }
+  auto prompt_tokens = res["usage"].get("prompt_tokens", 0).asUInt64();
+  auto total_tokens = res["usage"].get("total_tokens", 0).asUInt64();
+
+  std::vector<Json::Value> results;
+  results.reserve(sizes.size());
+  size_t offset = 0;
+  uint64_t prompt_left = prompt_tokens;
+  uint64_t total_left = total_tokens;
+  for (size_t i = 0; i < sizes.size(); i++) {
+    Json::Value r = res;
+    r["data"] = Json::Value(Json::arrayValue);
+    for (size_t j = 0; j < sizes[i]; j++) {
+      Json::Value e = *ordered[offset + j];
+      e["index"] = static_cast<Json::UInt>(j);
+      r["data"].append(std::move(e));
+    }
+    offset += sizes[i];
+
+    if (res.isMember("usage")) {
+      // the last caller gets the rounding remainder so the parts add up
+      uint64_t prompt = prompt_left;
+      uint64_t total = total_left;
+      if (i + 1 < sizes.size()) {
+        auto share = total_weight == 0
+                         ? 1.0 / sizes.size()
+                         : static_cast<double>(weights[i]) / total_weight;
+        prompt = std::min<uint64_t>(prompt_left, prompt_tokens * share);
+        total = std::min<uint64_t>(total_left, total_tokens * share);
+      }
+      prompt_left -= prompt;
+      total_left -= total;
+      r["usage"]["prompt_tokens"] = static_cast<Json::UInt64>(prompt);
+      r["usage"]["total_tokens"] = static_cast<Json::UInt64>(total);
+    }
+    results.push_back(std::move(r));
+  }
+  return results;
+}
+
+void EmbeddingBatcher::Flush(Batch batch) {
+  if (batch.items.size() == 1) {
+    auto& item = batch.items.front();
+    flush_(item.body, batch.options, std::move(item.cb));
+    return;
+  }
+
+  CTL_DBG("Flushing embedding batch with " << batch.items.size()
+                                           << " requests, "
+                                           << batch.num_inputs << " inputs");
+  auto body = std::make_shared<Json::Value>(*batch.items.front().body);
+  Json::Value input(Json::arrayValue);
+  std::vector<size_t> sizes;
+  std::vector<size_t> weights;
+  std::vector<Callback> callbacks;
+  for (auto& item : batch.items) {
+    auto const& in = (*item.body)["input"];
+    if (in.isArray()) {
+      for (auto const& i : in) {
+        input.append(i);
+      }
+    } else {
+      input.append(in);
+    }
+    sizes.push_back(item.num_inputs);
+    weights.push_back(item.input_chars);
+    callbacks.push_back(std::move(item.cb));
+  }
+  (*body)["input"] = std::move(input);
+
+  auto cb = [sizes = std::move(sizes), weights = std::move(weights),
+             callbacks = std::move(callbacks)](Json::Value status,
+                                               Json::Value res) {
+    if (status.get("has_error", false).asBool() ||
+        status.get("status_code", k200OK).asInt() != k200OK) {
+      for (auto const& c : callbacks) {
+        c(Json::Value(status), Json::Value(res));
+      }
+      return;
+    }
+
+    auto parts = Scatter(res, sizes, weights);
+    if (parts.empty()) {
+      CTL_ERR("Unexpected embedding response for batched request");
+      Json::Value err;
+      err["message"] = "Engine returned an unexpected number of embeddings";
+      Json::Value stt;
+      stt["status_code"] = k500InternalServerError;
+      stt["is_done"] = true;
+      stt["has_error"] = true;
+      for (auto const& c : callbacks) {
+        c(Json::Value(stt), Json::Value(err));
+      }
+      return;
+    }
+    for (size_t i = 0; i < callbacks.size(); i++) {
+      callbacks[i](Json::Value(status), std::move(parts[i]));
+    }
+  };
+  flush_(body, batch.options, std::move(cb));
+}
+
+void EmbeddingBatcher::FlushThread() {
+  while (true) {
+    std::vector<Batch> ready;
+    bool stop = false;
+    {
+      std::unique_lock<std::mutex> l(mtx_);
+      stop = stop_;
+      auto now = std::chrono::steady_clock::now();
+      std::optional<std::chrono::steady_clock::time_point> next_deadline;
+      for (auto it = batches_.begin(); it != batches_.end();) {
+        if (stop || it->second.deadline <= now) {
+          ready.push_back(std::move(it->second));
+          it = batches_.erase(it);
+        } else {
+          if (!next_deadline || it->second.deadline < *next_deadline) {
+            next_deadline = it->second.deadline;
+          }
+          ++it;
+        }
+      }
+
+      if (ready.empty() && !stop) {
+        if (next_deadline) {
+          cv_.wait_until(l, *next_deadline);
+        } else {
+          cv_.wait(l);
+        }
+        continue;
+      }
+    }
+
+    for (auto& batch : ready) {
+      Flush(std::move(batch));
+    }
+    if (stop) {
+      break;
+    }
+  }
+}
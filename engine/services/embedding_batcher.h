@@ -0,0 +1,91 @@
+#pragma once
+
+#include <json/json.h>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "services/inference_scheduler.h"
+
+/**
+ * Coalesces concurrent embedding requests for the same model into a single
+ * engine call.
+ *
+ * The first request for a batch key opens a window; requests arriving before
+ * it closes (or until the batch holds max_batch_size inputs) are merged into
+ * one `input` array. The engine response is split back per caller with the
+ * `index` fields renumbered and usage apportioned to each caller.
+ */
+class EmbeddingBatcher {
+ public:
+  using Callback = std::function<void(Json::Value&&, Json::Value&&)>;
+  using FlushFn =
+      std::function<void(std::shared_ptr<Json::Value> body,
+                         const SchedulingOptions& options, Callback cb)>;
+
+  struct Config {
+    int window_ms = 5;
+    int max_batch_size = 32;
+  };
+
+  EmbeddingBatcher(Config config, FlushFn flush);
+
+  ~EmbeddingBatcher();
+
+  EmbeddingBatcher(const EmbeddingBatcher&) = delete;
+  EmbeddingBatcher& operator=(const EmbeddingBatcher&) = delete;
+
+  /**
+   * Only plain string inputs without extra per-request parameters are merged,
+   * anything else should go to the engine directly.
+   */
+  static bool CanBatch(const Json::Value& body);
+
+  void Submit(std::shared_ptr<Json::Value> body,
+              const SchedulingOptions& options, Callback cb);
+
+  /**
+   * Split a batched engine response into one response per caller. [sizes]
+   * holds the number of inputs of each caller and [weights] the share of the
+   * usage each caller is charged.
+   */
+  static std::vector<Json::Value> Scatter(const Json::Value& res,
+                                          const std::vector<size_t>& sizes,
+                                          const std::vector<size_t>& weights);
+
+ private:
+  struct Item {
+    std::shared_ptr<Json::Value> body;
+    Callback cb;
+    size_t num_inputs;
+    size_t input_chars;
+  };
+
+  struct Batch {
+    std::vector<Item> items;
+    SchedulingOptions options;
+    size_t num_inputs = 0;
+    std::chrono::steady_clock::time_point deadline;
+  };
+
+  static std::string BatchKey(const Json::Value& body,
+                              const SchedulingOptions& options);
+
+  void Flush(Batch batch);
+
+  void FlushThread();
+
+  Config config_;
+  FlushFn flush_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::unordered_map<std::string, Batch> batches_;
+  bool stop_{false};
+  std::thread thread_;
+};
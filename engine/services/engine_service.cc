@@ -11,6 +11,7 @@
 #include "database/models.h"
 #include "extensions/python-engine/python_engine.h"
 #include "extensions/remote-engine/remote_engine.h"
+#include "services/extracting_sink.h"
 
 #include "utils/archive_utils.h"
 #include "utils/engine_constants.h"
@@ -290,18 +291,28 @@ cpp::result<void, std::string> EngineService::DownloadEngine(
                              normalize_version;
   auto variant_path = variant_folder_path / selected_variant->name;
 
-  std::filesystem::create_directories(variant_folder_path);
+  // A tarball is extracted while it downloads and the version folder only
+  // shows up once complete; a zip has to be on disk first
+  std::shared_ptr<DownloadSink> sink;
+  if (string_utils::EndsWith(selected_variant->name, ".tar.gz")) {
+    std::filesystem::create_directories(variant_folder_path.parent_path());
+    sink = std::make_shared<ExtractingSink>(variant_folder_path, true);
+  } else {
+    std::filesystem::create_directories(variant_folder_path);
+  }
 
   CTL_INF("variant_folder_path: " + variant_folder_path.string());
   auto on_finished = [this, engine, selected_variant, variant_folder_path,
-                      normalize_version](const DownloadTask& finishedTask) {
-    // try to unzip the downloaded file
-    CTL_INF("Engine zip path: " << finishedTask.items[0].localPath.string());
+                      normalize_version, streamed = sink != nullptr](
+                         const DownloadTask& finishedTask) {
     CTL_INF("Version: " + normalize_version);
-
-    auto extract_path = finishedTask.items[0].localPath.parent_path();
-    archive_utils::ExtractArchive(finishedTask.items[0].localPath.string(),
-                                  extract_path.string(), true);
+    if (!streamed) {
+      // try to unzip the downloaded file
+      CTL_INF("Engine zip path: " << finishedTask.items[0].localPath.string());
+      auto extract_path = finishedTask.items[0].localPath.parent_path();
+      archive_utils::ExtractArchive(finishedTask.items[0].localPath.string(),
+                                    extract_path.string(), true);
+    }
 
     auto variant = engine_matcher_utils::GetVariantFromNameAndVersion(
         selected_variant->name, engine, normalize_version);
@@ -338,10 +349,12 @@ cpp::result<void, std::string> EngineService::DownloadEngine(
       }
     }
 
-    try {
-      std::filesystem::remove(finishedTask.items[0].localPath);
-    } catch (const std::exception& e) {
-      CTL_WRN("Could not delete file: " << e.what());
+    if (!streamed) {
+      try {
+        std::filesystem::remove(finishedTask.items[0].localPath);
+      } catch (const std::exception& e) {
+        CTL_WRN("Could not delete file: " << e.what());
+      }
     }
     CTL_INF("Finished!");
   };
@@ -353,6 +366,7 @@ cpp::result<void, std::string> EngineService::DownloadEngine(
                        .id = selected_variant->name,
                        .downloadUrl = selected_variant->browser_download_url,
                        .localPath = variant_path,
+                       .sink = sink,
                    }}};
 
   auto add_task_result = download_service_->AddTask(downloadTask, on_finished);
@@ -405,6 +419,10 @@ cpp::result<bool, std::string> EngineService::DownloadCuda(
   }};
 
   auto on_finished = [engine](const DownloadTask& finishedTask) {
+    if (finishedTask.items[0].sink) {
+      // already extracted while downloading
+      return;
+    }
     auto engine_path = file_manager_utils::GetCudaToolkitPath(engine, true);
 
     archive_utils::ExtractArchive(finishedTask.items[0].localPath.string(),
@@ -416,6 +434,9 @@ cpp::result<bool, std::string> EngineService::DownloadCuda(
     }
   };
   if (async) {
+    // queued tasks stream the archive straight into the deps folder
+    downloadCudaToolkitTask.items[0].sink = std::make_shared<ExtractingSink>(
+        file_manager_utils::GetCudaToolkitPath(engine, false), false);
     auto res = download_service_->AddTask(downloadCudaToolkitTask, on_finished);
     if (res.has_error()) {
       return cpp::fail(res.error());
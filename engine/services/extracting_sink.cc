@@ -0,0 +1,118 @@
+#include "extracting_sink.h"
+#include <set>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+void SyncPath(const std::filesystem::path& path) {
+#if !defined(_WIN32)
+  if (auto fd = open(path.c_str(), O_RDONLY); fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+#endif
+}
+
+bool IsDirectory(const std::filesystem::path& path) {
+  std::error_code ec;
+  return std::filesystem::is_directory(
+      std::filesystem::symlink_status(path, ec));
+}
+
+cpp::result<void, std::string> MergeDirectory(
+    const std::filesystem::path& staging, const std::filesystem::path& target) {
+  // listed first, the entries are moved out of the tree being walked
+  std::vector<std::filesystem::path> entries;
+  std::error_code ec;
+  for (auto it = std::filesystem::recursive_directory_iterator(staging, ec);
+       !ec && it != std::filesystem::recursive_directory_iterator();
+       it.increment(ec)) {
+    entries.push_back(it->path());
+  }
+  if (ec) {
+    return cpp::fail("Failed to read " + staging.string() + ": " +
+                     ec.message());
+  }
+
+  std::set<std::filesystem::path> touched{target};
+  for (auto const& entry : entries) {
+    auto dest = target / entry.lexically_relative(staging);
+    if (IsDirectory(entry)) {
+      if (!IsDirectory(dest)) {
+        std::filesystem::remove(dest, ec);
+        std::filesystem::create_directories(dest, ec);
+      }
+    } else {
+      if (IsDirectory(dest)) {
+        std::filesystem::remove_all(dest, ec);
+      }
+      // replaces a file of the same name atomically, symlinks included
+      std::filesystem::rename(entry, dest, ec);
+      touched.insert(dest.parent_path());
+    }
+    if (ec) {
+      return cpp::fail("Failed to publish " + dest.string() + ": " +
+                       ec.message());
+    }
+  }
+  for (auto const& dir : touched) {
+    SyncPath(dir);
+  }
+  std::filesystem::remove_all(staging, ec);
+  return {};
+}
+}  // namespace
+
+cpp::result<void, std::string> PublishDirectory(
+    const std::filesystem::path& staging, const std::filesystem::path& target) {
+  std::error_code ec;
+  for (auto it = std::filesystem::recursive_directory_iterator(staging, ec);
+       !ec && it != std::filesystem::recursive_directory_iterator();
+       it.increment(ec)) {
+    SyncPath(it->path());
+  }
+  SyncPath(staging);
+
+  if (std::filesystem::exists(target, ec)) {
+    return MergeDirectory(staging, target);
+  }
+  std::filesystem::rename(staging, target, ec);
+  if (ec) {
+    return cpp::fail("Failed to publish " + target.string() + ": " +
+                     ec.message());
+  }
+  SyncPath(target.parent_path());
+  return {};
+}
+
+ExtractingSink::ExtractingSink(const std::filesystem::path& target,
+                               bool ignore_parent_dir)
+    : target_{target}, staging_{target} {
+  staging_ += ".staging";
+  // left over by an interrupted install
+  std::error_code ec;
+  std::filesystem::remove_all(staging_, ec);
+  extractor_ = std::make_unique<archive_utils::StreamExtractor>(
+      staging_.string(), ignore_parent_dir);
+}
+
+bool ExtractingSink::Write(const char* data, size_t size) {
+  return extractor_->Write(data, size);
+}
+
+cpp::result<void, std::string> ExtractingSink::Close(bool success) {
+  if (success && extractor_->Finish()) {
+    return PublishDirectory(staging_, target_);
+  }
+  extractor_->Abort();
+  std::error_code ec;
+  std::filesystem::remove_all(staging_, ec);
+  if (success) {
+    return cpp::fail("Failed to extract archive to " + target_.string());
+  }
+  return {};
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include "common/download_task.h"
+#include "utils/archive_utils.h"
+#include "utils/result.hpp"
+
+/**
+ * Move what was extracted to [staging] into [target] once everything in it
+ * is on disk, so that an interrupted install never leaves a half written
+ * engine behind. A missing target is replaced at once. An existing one may
+ * be shared, like the CUDA dependencies folder of an engine, so the files
+ * are merged into it instead: each replaces the file of the same name and
+ * the files the archive doesn't have are kept.
+ */
+cpp::result<void, std::string> PublishDirectory(
+    const std::filesystem::path& staging, const std::filesystem::path& target);
+
+/**
+ * Extracts a .tar.gz download as it arrives into a staging directory next
+ * to [target], which is published once the archive is complete.
+ */
+class ExtractingSink : public DownloadSink {
+ public:
+  ExtractingSink(const std::filesystem::path& target, bool ignore_parent_dir);
+
+  bool Write(const char* data, size_t size) override;
+
+  cpp::result<void, std::string> Close(bool success) override;
+
+ private:
+  std::filesystem::path target_;
+  std::filesystem::path staging_;
+  std::unique_ptr<archive_utils::StreamExtractor> extractor_;
+};
@@ -28,6 +28,29 @@ cpp::result<OpenAi::File, std::string> FileService::UploadFile(
   return file;
 }
 
+cpp::result<OpenAi::File, std::string> FileService::AddFileFromPath(
+    const std::string& filename, const std::string& purpose,
+    const std::filesystem::path& path, const std::string& file_id) {
+  auto seconds_since_epoch =
+      std::chrono::duration_cast<std::chrono::seconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+
+  OpenAi::File file;
+  file.id = file_id.empty() ? "file-" + ulid::GenerateUlid() : file_id;
+  file.object = "file";
+  file.created_at = seconds_since_epoch;
+  file.filename = filename;
+  file.purpose = purpose;
+
+  auto res = file_repository_->StoreFileFromPath(file, path);
+  if (res.has_error()) {
+    return cpp::fail(res.error());
+  }
+
+  return file;
+}
+
 cpp::result<std::vector<OpenAi::File>, std::string> FileService::ListFiles(
     const std::string& purpose, uint8_t limit, const std::string& order,
     const std::string& after) const {
@@ -44,6 +67,11 @@ cpp::result<void, std::string> FileService::DeleteFileLocal(
   return file_repository_->DeleteFileLocal(file_id);
 }
 
+cpp::result<std::filesystem::path, std::string> FileService::GetFileLocalPath(
+    const std::string& file_id) const {
+  return file_repository_->GetFileLocalPath(file_id);
+}
+
 cpp::result<std::pair<std::unique_ptr<char[]>, size_t>, std::string>
 FileService::RetrieveFileContent(const std::string& file_id) const {
   return file_repository_->RetrieveFileContent(file_id);
@@ -14,6 +14,15 @@ class FileService {
                                                     const char* content,
                                                     uint64_t content_length);
 
+  /**
+   * Register the file at [path] under [filename], moving it into the file
+   * store. Used for files produced by the server, like batch outputs. The
+   * file gets [file_id] if given, a new id otherwise.
+   */
+  cpp::result<OpenAi::File, std::string> AddFileFromPath(
+      const std::string& filename, const std::string& purpose,
+      const std::filesystem::path& path, const std::string& file_id = "");
+
   cpp::result<std::vector<OpenAi::File>, std::string> ListFiles(
       const std::string& purpose, uint8_t limit, const std::string& order,
       const std::string& after) const;
@@ -23,6 +32,9 @@ class FileService {
 
   cpp::result<void, std::string> DeleteFileLocal(const std::string& file_id);
 
+  cpp::result<std::filesystem::path, std::string> GetFileLocalPath(
+      const std::string& file_id) const;
+
   cpp::result<std::pair<std::unique_ptr<char[]>, size_t>, std::string>
   RetrieveFileContent(const std::string& file_id) const;
 
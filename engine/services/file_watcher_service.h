@@ -1,5 +1,8 @@
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <memory>
+#include <set>
 #include <string>
 #include <thread>
 #include "services/model_service.h"
@@ -27,9 +30,12 @@ class FileWatcherService {
 #elif defined(__APPLE__)
   FSEventStreamRef event_stream;
 #else  // Linux
+  static constexpr const int kDebounceMs = 200;
   int fd;
   int wd;
   std::unordered_map<int, std::string> watch_descriptors;
+  std::set<std::filesystem::path> pending_paths_;
+  std::chrono::steady_clock::time_point last_event_at_;
 #endif
 
  public:
@@ -238,7 +244,8 @@ class FileWatcherService {
 #else  // Linux
 
   void AddWatch(const std::string& dirPath) {
-    const int watch_flags = IN_DELETE | IN_DELETE_SELF | IN_CREATE;
+    const int watch_flags = IN_DELETE | IN_DELETE_SELF | IN_CREATE |
+                            IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE;
     wd = inotify_add_watch(fd, dirPath.c_str(), watch_flags);
     if (wd < 0) {
       throw std::runtime_error("Failed to add watch on " + dirPath + ": " +
@@ -299,11 +306,17 @@ class FileWatcherService {
     struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
 
     while (running_) {
+      if (!pending_paths_.empty() && DebounceRemainingMs() == 0) {
+        FlushPendingPaths();
+      }
+
       // Poll will sleep until either:
       // 1. Events are available (POLLIN)
-      // 2. POLL_TIMEOUT_MS milliseconds have elapsed
+      // 2. The timeout has elapsed, shorter while events are being debounced
       // 3. An error occurs
-      int poll_result = poll(&pfd, 1, POLL_TIMEOUT_MS);
+      int timeout_ms =
+          pending_paths_.empty() ? POLL_TIMEOUT_MS : DebounceRemainingMs();
+      int poll_result = poll(&pfd, 1, timeout_ms);
 
       if (poll_result < 0) {
         if (errno == EINTR) {
@@ -345,20 +358,69 @@ class FileWatcherService {
         while (i < static_cast<size_t>(length)) {
           struct inotify_event* event =
               reinterpret_cast<struct inotify_event*>(&buffer[i]);
-
-          if (event->mask & (IN_DELETE | IN_DELETE_SELF)) {
-            try {
-              model_service_->ForceIndexingModelList();
-            } catch (const std::exception& e) {
-              CTL_ERR("Error processing delete event: " +
-                      std::string(e.what()));
-            }
-          }
-
+          HandleEvent(event);
           i += sizeof(struct inotify_event) + event->len;
         }
       }
     }
   }
+
+  // Collect the paths touched by an event. Reconciliation runs once the
+  // events stop for kDebounceMs, so removing a whole repo folder results in
+  // a single pass over the affected models.
+  void HandleEvent(const struct inotify_event* event) {
+    auto it = watch_descriptors.find(event->wd);
+    if (it == watch_descriptors.end()) {
+      return;
+    }
+    if (event->mask & IN_IGNORED) {
+      // watch removed, its directory is gone
+      watch_descriptors.erase(it);
+      return;
+    }
+
+    auto path = std::filesystem::path(it->second);
+    if (event->len > 0) {
+      path /= event->name;
+    }
+
+    if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+      // new folders need their own watch, e.g. a freshly downloaded repo
+      try {
+        AddWatch(path.string());
+      } catch (const std::exception& e) {
+        CTL_WRN("Failed to add watch: " + std::string(e.what()));
+      }
+    }
+
+    if (event->mask & (IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_MOVED_FROM |
+                       IN_MOVED_TO | IN_CLOSE_WRITE)) {
+      pending_paths_.insert(path.lexically_normal());
+      last_event_at_ = std::chrono::steady_clock::now();
+    }
+  }
+
+  void FlushPendingPaths() {
+    if (pending_paths_.empty()) {
+      return;
+    }
+    std::vector<std::filesystem::path> paths(pending_paths_.begin(),
+                                             pending_paths_.end());
+    pending_paths_.clear();
+    CTL_DBG("Reconciling models for " << paths.size() << " changed paths");
+    try {
+      model_service_->ReconcileModels(paths);
+    } catch (const std::exception& e) {
+      CTL_ERR("Error reconciling models: " + std::string(e.what()));
+    }
+  }
+
+  // Milliseconds left before pending paths should be flushed
+  int DebounceRemainingMs() const {
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       std::chrono::steady_clock::now() - last_event_at_)
+                       .count();
+    return std::max(0, static_cast<int>(kDebounceMs - elapsed));
+  }
 #endif
 };
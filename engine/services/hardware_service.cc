@@ -19,18 +19,9 @@
 
 namespace {
 bool TryConnectToServer(const std::string& host, int port) {
-  constexpr const auto kMaxRetry = 4u;
-  auto count = 0u;
-  // Check if server is started
-  while (true) {
-    if (commands::IsServerAlive(host, port))
-      break;
-    // Wait for server up
-    std::this_thread::sleep_for(std::chrono::seconds(1));
-    if (count++ == kMaxRetry) {
-      std::cerr << "Could not start server" << std::endl;
-      return false;
-    }
+  if (!commands::WaitForServerReady(host, port)) {
+    std::cerr << "Could not start server" << std::endl;
+    return false;
   }
   return true;
 }
@@ -63,6 +54,11 @@ bool HardwareService::Restart(const std::string& host, int port) {
   namespace luh = logging_utils_helper;
   if (!ahc_)
     return true;
+  // the new server binds the same port, the old listener must be gone first
+  if (!commands::WaitForPortReleased(host, port)) {
+    CTL_ERR("Port " << port << " is still in use, can't restart the server");
+    return false;
+  }
   auto exe = commands::GetCortexServerBinary();
   auto get_config_file_path = []() -> std::string {
     if (file_manager_utils::cortex_config_file_path.empty()) {
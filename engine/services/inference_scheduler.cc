@@ -0,0 +1,303 @@
+#include "inference_scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "utils/logging_utils.h"
+
+namespace {
+constexpr const int k408RequestTimeout = 408;
+constexpr const int k429TooManyRequests = 429;
+constexpr const double kServiceTimeAlpha = 0.2;
+constexpr const int kMaxRetryAfterSeconds = 60;
+
+InferenceScheduler::Rejection Cancelled(const RequestCancellation& c) {
+  return {.status_code = c.status_code(),
+          .retry_after_s = 0,
+          .message = c.message()};
+}
+}  // namespace
+
+InferenceScheduler::InferenceScheduler(Config config)
+    : config_{std::move(config)} {
+  thread_ = std::thread(&InferenceScheduler::SchedulerThread, this);
+}
+
+InferenceScheduler::~InferenceScheduler() {
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+}
+
+std::optional<InferenceScheduler::Rejection> InferenceScheduler::Submit(
+    const std::string& model, const SchedulingOptions& options,
+    DispatchFn dispatch, RejectFn on_expired) {
+  if (options.cancellation && options.cancellation->IsCancelled()) {
+    return Cancelled(*options.cancellation);
+  }
+  {
+    std::unique_lock<std::mutex> l(mtx_);
+    auto& state = models_[model];
+    state.removed = false;
+    auto limit = EffectiveLimit(state);
+    if (state.queued == 0 && (limit == 0 || state.in_flight < limit)) {
+      state.in_flight++;
+      l.unlock();
+      dispatch(std::make_shared<Ticket>(weak_from_this(), model));
+      return std::nullopt;
+    }
+
+    if (state.queued >= static_cast<size_t>(config_.max_queue_size)) {
+      CTL_WRN("Queue is full for model " << model << ", rejecting request");
+      return Rejection{
+          .status_code = k429TooManyRequests,
+          .retry_after_s = EstimateRetryAfter(state),
+          .message = "Too many requests for model '" + model +
+                     "', please retry later"};
+    }
+
+    auto deadline = options.deadline;
+    if (!deadline && config_.queue_timeout_ms > 0) {
+      deadline = std::chrono::steady_clock::now() +
+                 std::chrono::milliseconds(config_.queue_timeout_ms);
+    }
+
+    auto& pc = state.classes[static_cast<size_t>(options.priority)];
+    auto [it, inserted] = pc.clients.try_emplace(options.client_id);
+    if (inserted) {
+      // A newly active client starts at the current virtual time so it
+      // can't claim slots for the time it was idle
+      it->second.pass = pc.virtual_time;
+    }
+    it->second.items.push_back(
+        Pending{.dispatch = std::move(dispatch),
+                .on_expired = std::move(on_expired),
+                .deadline = deadline,
+                .cancellation = options.cancellation});
+    state.queued++;
+    CTL_DBG("Queued request for model " << model << ", client '"
+                                        << options.client_id << "', priority "
+                                        << RequestPriorityToString(
+                                               options.priority)
+                                        << ", queued: " << state.queued);
+  }
+  cv_.notify_one();
+  if (options.cancellation) {
+    // wake the scheduler thread to drop the request and free its place
+    options.cancellation->OnCancel([weak = weak_from_this()] {
+      if (auto s = weak.lock()) {
+        std::lock_guard<std::mutex> l(s->mtx_);
+        s->cv_.notify_one();
+      }
+    });
+  }
+  return std::nullopt;
+}
+
+void InferenceScheduler::SetModelConcurrency(const std::string& model,
+                                             int limit) {
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    auto& state = models_[model];
+    state.limit = std::max(0, limit);
+    state.removed = false;
+  }
+  // a larger limit may unblock queued requests
+  cv_.notify_one();
+}
+
+void InferenceScheduler::RemoveModel(const std::string& model) {
+  std::lock_guard<std::mutex> l(mtx_);
+  auto it = models_.find(model);
+  if (it == models_.end()) {
+    return;
+  }
+  if (IsIdle(it->second)) {
+    models_.erase(it);
+    return;
+  }
+  it->second.limit = 0;
+  it->second.removed = true;
+}
+
+int InferenceScheduler::GetInFlight(const std::string& model) const {
+  std::lock_guard<std::mutex> l(mtx_);
+  if (auto it = models_.find(model); it != models_.end()) {
+    return it->second.in_flight;
+  }
+  return 0;
+}
+
+size_t InferenceScheduler::GetQueued(const std::string& model) const {
+  std::lock_guard<std::mutex> l(mtx_);
+  if (auto it = models_.find(model); it != models_.end()) {
+    return it->second.queued;
+  }
+  return 0;
+}
+
+size_t InferenceScheduler::GetModelCount() const {
+  std::lock_guard<std::mutex> l(mtx_);
+  return models_.size();
+}
+
+void InferenceScheduler::OnRelease(const std::string& model,
+                                   std::chrono::steady_clock::duration held) {
+  bool has_waiting = false;
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    auto it = models_.find(model);
+    if (it == models_.end()) {
+      return;
+    }
+    auto& state = it->second;
+    state.in_flight = std::max(0, state.in_flight - 1);
+    auto held_ms =
+        std::chrono::duration<double, std::milli>(held).count();
+    state.avg_service_ms =
+        state.avg_service_ms == 0
+            ? held_ms
+            : (1 - kServiceTimeAlpha) * state.avg_service_ms +
+                  kServiceTimeAlpha * held_ms;
+    has_waiting = state.queued > 0;
+    if (state.removed && IsIdle(state)) {
+      models_.erase(it);
+    }
+  }
+  if (has_waiting) {
+    cv_.notify_one();
+  }
+}
+
+int InferenceScheduler::EffectiveLimit(const ModelState& state) const {
+  return state.limit > 0 ? state.limit : config_.max_concurrency;
+}
+
+int InferenceScheduler::ClientWeight(const std::string& client_id) const {
+  if (auto it = config_.client_weights.find(client_id);
+      it != config_.client_weights.end() && it->second > 0) {
+    return it->second;
+  }
+  return 1;
+}
+
+std::optional<InferenceScheduler::Pending> InferenceScheduler::PopNext(
+    ModelState& state) {
+  for (auto& pc : state.classes) {
+    if (pc.clients.empty()) {
+      continue;
+    }
+    auto next = pc.clients.end();
+    for (auto it = pc.clients.begin(); it != pc.clients.end(); ++it) {
+      if (next == pc.clients.end() || it->second.pass < next->second.pass) {
+        next = it;
+      }
+    }
+    auto& cq = next->second;
+    auto pending = std::move(cq.items.front());
+    cq.items.pop_front();
+    pc.virtual_time = cq.pass;
+    cq.pass += 1.0 / ClientWeight(next->first);
+    if (cq.items.empty()) {
+      pc.clients.erase(next);
+    }
+    state.queued--;
+    return pending;
+  }
+  return std::nullopt;
+}
+
+int InferenceScheduler::EstimateRetryAfter(const ModelState& state) const {
+  auto limit = std::max(1, EffectiveLimit(state));
+  auto avg_ms = state.avg_service_ms > 0 ? state.avg_service_ms : 1000.0;
+  auto seconds = static_cast<int>(
+      std::ceil((state.queued + 1) * avg_ms / limit / 1000.0));
+  return std::clamp(seconds, 1, kMaxRetryAfterSeconds);
+}
+
+void InferenceScheduler::SchedulerThread() {
+  while (true) {
+    std::vector<std::pair<DispatchFn, TicketPtr>> to_dispatch;
+    std::vector<std::pair<RejectFn, Rejection>> to_expire;
+    {
+      std::unique_lock<std::mutex> l(mtx_);
+      if (stop_) {
+        break;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      std::optional<std::chrono::steady_clock::time_point> next_deadline;
+      for (auto m = models_.begin(); m != models_.end();) {
+        auto& [model, state] = *m;
+        // drop requests which were cancelled or waited past their deadline
+        for (auto& pc : state.classes) {
+          for (auto it = pc.clients.begin(); it != pc.clients.end();) {
+            auto& items = it->second.items;
+            for (auto p = items.begin(); p != items.end();) {
+              if (p->cancellation && p->cancellation->IsCancelled()) {
+                CTL_DBG("Dropped cancelled request "
+                        << p->cancellation->request_id() << " of model "
+                        << model);
+                to_expire.emplace_back(std::move(p->on_expired),
+                                       Cancelled(*p->cancellation));
+                p = items.erase(p);
+                state.queued--;
+              } else if (p->deadline && *p->deadline <= now) {
+                to_expire.emplace_back(
+                    std::move(p->on_expired),
+                    Rejection{.status_code = k408RequestTimeout,
+                              .retry_after_s = 0,
+                              .message = "Request deadline exceeded while "
+                                         "waiting in queue"});
+                p = items.erase(p);
+                state.queued--;
+              } else {
+                if (p->deadline &&
+                    (!next_deadline || *p->deadline < *next_deadline)) {
+                  next_deadline = p->deadline;
+                }
+                ++p;
+              }
+            }
+            it = items.empty() ? pc.clients.erase(it) : std::next(it);
+          }
+        }
+
+        auto limit = EffectiveLimit(state);
+        while (state.queued > 0 && (limit == 0 || state.in_flight < limit)) {
+          auto pending = PopNext(state);
+          if (!pending) {
+            break;
+          }
+          state.in_flight++;
+          to_dispatch.emplace_back(
+              std::move(pending->dispatch),
+              std::make_shared<Ticket>(weak_from_this(), model));
+        }
+        m = state.removed && IsIdle(state) ? models_.erase(m) : std::next(m);
+      }
+
+      if (to_dispatch.empty() && to_expire.empty()) {
+        if (next_deadline) {
+          cv_.wait_until(l, *next_deadline);
+        } else {
+          cv_.wait(l);
+        }
+        continue;
+      }
+    }
+
+    for (auto& [on_expired, rejection] : to_expire) {
+      if (on_expired) {
+        on_expired(rejection);
+      }
+    }
+    for (auto& [dispatch, ticket] : to_dispatch) {
+      dispatch(std::move(ticket));
+    }
+  }
+}
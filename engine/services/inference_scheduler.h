@@ -0,0 +1,217 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "common/request_cancellation.h"
+#include "utils/request_trace.h"
+
+enum class RequestPriority { kHigh = 0, kNormal = 1, kLow = 2 };
+
+inline RequestPriority RequestPriorityFromString(const std::string& str) {
+  if (str == "high") {
+    return RequestPriority::kHigh;
+  } else if (str == "low") {
+    return RequestPriority::kLow;
+  }
+  return RequestPriority::kNormal;
+}
+
+inline std::string RequestPriorityToString(RequestPriority priority) {
+  switch (priority) {
+    case RequestPriority::kHigh:
+      return "high";
+    case RequestPriority::kLow:
+      return "low";
+    default:
+      return "normal";
+  }
+}
+
+struct SchedulingOptions {
+  RequestPriority priority = RequestPriority::kNormal;
+
+  // API key / client identifier used for weighted fairness. Requests without
+  // a client id share one anonymous bucket.
+  std::string client_id{};
+
+  // Absolute point in time after which a queued request is dropped.
+  std::optional<std::chrono::steady_clock::time_point> deadline{};
+
+  // Conversation the request belongs to, pinned to one engine slot.
+  std::string session_id{};
+
+  // Stage timings of the request, null when it is not traced.
+  std::shared_ptr<RequestTrace> trace{};
+
+  // Set when the request can be cancelled; a cancelled request still queued
+  // is answered with the status of its cancellation instead of dispatched.
+  std::shared_ptr<RequestCancellation> cancellation{};
+};
+
+/**
+ * Admission control in front of the engines.
+ *
+ * Each model has a concurrency limit and a bounded wait queue. Requests over
+ * the limit wait in one of three strict priority classes; inside a class,
+ * clients are served by stride scheduling so a client with weight 2 gets
+ * twice the slots of a client with weight 1 regardless of how many requests
+ * it has queued. Requests are rejected up front (429) when the queue is full
+ * and dropped (408) if their deadline passes while queued. Requests cancelled
+ * while queued are dropped too, with 499 when their client went away.
+ */
+class InferenceScheduler
+    : public std::enable_shared_from_this<InferenceScheduler> {
+ public:
+  struct Config {
+    // Default number of in-flight requests per model, 0 means unlimited.
+    int max_concurrency = 0;
+    // Maximum number of requests waiting per model.
+    int max_queue_size = 64;
+    // Applied when the request doesn't carry its own deadline, 0 means none.
+    int queue_timeout_ms = 0;
+    std::unordered_map<std::string, int> client_weights{};
+  };
+
+  struct Rejection {
+    int status_code;
+    int retry_after_s;
+    std::string message;
+  };
+
+  /**
+   * A granted slot. The slot is returned to the scheduler on Release() or when
+   * the last reference goes away, whichever comes first.
+   */
+  class Ticket {
+   public:
+    Ticket(std::weak_ptr<InferenceScheduler> scheduler, std::string model)
+        : scheduler_{std::move(scheduler)},
+          model_{std::move(model)},
+          started_at_{std::chrono::steady_clock::now()} {}
+
+    ~Ticket() { Release(); }
+
+    Ticket(const Ticket&) = delete;
+    Ticket& operator=(const Ticket&) = delete;
+
+    void Release() {
+      if (released_.exchange(true)) {
+        return;
+      }
+      if (auto s = scheduler_.lock()) {
+        s->OnRelease(model_, std::chrono::steady_clock::now() - started_at_);
+      }
+    }
+
+   private:
+    std::weak_ptr<InferenceScheduler> scheduler_;
+    std::string model_;
+    std::chrono::steady_clock::time_point started_at_;
+    std::atomic<bool> released_{false};
+  };
+
+  using TicketPtr = std::shared_ptr<Ticket>;
+  using DispatchFn = std::function<void(TicketPtr)>;
+  using RejectFn = std::function<void(const Rejection&)>;
+
+  explicit InferenceScheduler(Config config);
+
+  ~InferenceScheduler();
+
+  InferenceScheduler(const InferenceScheduler&) = delete;
+  InferenceScheduler& operator=(const InferenceScheduler&) = delete;
+
+  /**
+   * Submit a request for [model]. If a slot is free, [dispatch] runs on the
+   * calling thread before returning. Otherwise the request is queued and
+   * [dispatch] runs later on the scheduler thread, or [on_expired] runs if the
+   * deadline passes or the request is cancelled first. Returns a rejection if
+   * the queue is full or the request was cancelled already.
+   */
+  std::optional<Rejection> Submit(const std::string& model,
+                                  const SchedulingOptions& options,
+                                  DispatchFn dispatch, RejectFn on_expired);
+
+  /**
+   * Override the concurrency limit of a model, 0 restores the default.
+   */
+  void SetModelConcurrency(const std::string& model, int limit);
+
+  /**
+   * Forget [model] once it is unloaded, its limit included. The state of a
+   * model with requests still queued or running goes when they are done.
+   */
+  void RemoveModel(const std::string& model);
+
+  int GetInFlight(const std::string& model) const;
+
+  size_t GetQueued(const std::string& model) const;
+
+  // Number of models the scheduler keeps a state for
+  size_t GetModelCount() const;
+
+ private:
+  struct Pending {
+    DispatchFn dispatch;
+    RejectFn on_expired;
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    std::shared_ptr<RequestCancellation> cancellation;
+  };
+
+  struct ClientQueue {
+    std::deque<Pending> items;
+    double pass = 0;
+  };
+
+  struct PriorityClass {
+    std::unordered_map<std::string, ClientQueue> clients;
+    double virtual_time = 0;
+  };
+
+  struct ModelState {
+    int limit = 0;
+    int in_flight = 0;
+    size_t queued = 0;
+    std::array<PriorityClass, 3> classes;
+    // EWMA of slot hold time, used to estimate Retry-After
+    double avg_service_ms = 0;
+    // unloaded, erased when idle
+    bool removed = false;
+  };
+
+  void OnRelease(const std::string& model,
+                 std::chrono::steady_clock::duration held);
+
+  static bool IsIdle(const ModelState& state) {
+    return state.in_flight == 0 && state.queued == 0;
+  }
+
+  int EffectiveLimit(const ModelState& state) const;
+
+  int ClientWeight(const std::string& client_id) const;
+
+  // Pops the next request by priority then stride order. Requires mtx_ held.
+  std::optional<Pending> PopNext(ModelState& state);
+
+  int EstimateRetryAfter(const ModelState& state) const;
+
+  void SchedulerThread();
+
+  Config config_;
+
+  mutable std::mutex mtx_;
+  std::condition_variable cv_;
+  std::unordered_map<std::string, ModelState> models_;
+  bool stop_{false};
+  std::thread thread_;
+};
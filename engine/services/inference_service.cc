@@ -1,19 +1,82 @@
 #include "inference_service.h"
 #include <drogon/HttpTypes.h>
+#include <algorithm>
+#include "common/startup_status.h"
 #include "utils/engine_constants.h"
 #include "utils/function_calling/common.h"
-#include "utils/jinja_utils.h"
+
+namespace {
+// The engine is done with a request once it reports the last chunk, an error,
+// or any non-stream result.
+bool IsFinalResult(const Json::Value& status) {
+  return status.get("is_done", false).asBool() ||
+         status.get("has_error", false).asBool() ||
+         !status.get("is_stream", false).asBool();
+}
+
+void ReleaseIfFinal(const InferenceScheduler::TicketPtr& ticket,
+                    const Json::Value& status) {
+  if (ticket && IsFinalResult(status)) {
+    ticket->Release();
+  }
+}
+
+std::function<void(Json::Value&&, Json::Value&&)> PushTo(
+    std::shared_ptr<SyncQueue> q) {
+  return [q](Json::Value status, Json::Value res) {
+    q->push(std::make_pair(status, res));
+  };
+}
+
+InferResult BadRequestResult(const std::string& message) {
+  Json::Value res;
+  Json::Value stt;
+  res["message"] = message;
+  stt["status_code"] = drogon::k400BadRequest;
+  return std::make_pair(stt, res);
+}
+
+InferResult CancelledResult(const RequestCancellation& cancellation) {
+  Json::Value res;
+  Json::Value stt;
+  res["message"] = cancellation.message();
+  stt["status_code"] = cancellation.status_code();
+  stt["is_done"] = true;
+  stt["has_error"] = true;
+  return std::make_pair(stt, res);
+}
+
+InferResult EngineNotLoadedResult() {
+  Json::Value res;
+  Json::Value stt;
+  res["message"] = "Engine is not loaded yet";
+  stt["status_code"] = drogon::k400BadRequest;
+  stt["is_done"] = true;
+  stt["has_error"] = true;
+  return std::make_pair(stt, res);
+}
+}  // namespace
 
 cpp::result<void, InferResult> InferenceService::HandleChatCompletion(
-    std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body) {
+    std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body,
+    const SchedulingOptions& options) {
   std::string engine_type;
   if (!HasFieldInReq(json_body, "engine")) {
     engine_type = kLlamaRepo;
   } else {
     engine_type = (*(json_body)).get("engine", kLlamaRepo).asString();
   }
-  function_calling_utils::PreprocessRequest(json_body);
+  // function calling rewrites the messages of requests with tools
+  auto messages_rewritten = function_calling_utils::HasTools(json_body);
+  {
+    RequestTrace::Span span(options.trace.get(), RequestTrace::kPreprocess);
+    function_calling_utils::PreprocessRequest(json_body);
+  }
   auto tool_choice = json_body->get("tool_choice", Json::Value::null);
+  // streamed function calls are moved to tool_calls deltas on the fly
+  auto stream_tool_calls =
+      messages_rewritten && json_body->get("stream", false).asBool() &&
+      !(tool_choice.isString() && tool_choice.asString() == "none");
   auto model_id = json_body->get("model", "").asString();
   if (saved_models_.find(model_id) != saved_models_.end()) {
     // check if model is started, if not start it first
@@ -44,24 +107,31 @@ cpp::result<void, InferResult> InferenceService::HandleChatCompletion(
       auto metadata_ptr = model_service->GetCachedModelMetadata(model_id);
       if (metadata_ptr != nullptr &&
           !metadata_ptr->tokenizer->chat_template.empty()) {
-        auto tokenizer = metadata_ptr->tokenizer;
-        auto messages = (*json_body)["messages"];
-        Json::Value messages_jsoncpp(Json::arrayValue);
-        for (auto message : messages) {
-          messages_jsoncpp.append(message);
+        RequestTrace::Span span(options.trace.get(), RequestTrace::kRender);
+        auto const& tokenizer = metadata_ptr->tokenizer;
+        // Large prompts make copies of the messages costly, they are
+        // converted from the DOM once
+        nlohmann::ordered_json messages =
+            extensions::TemplateRenderer().ConvertJsonValue(
+                (*json_body)["messages"]);
+
+        auto render = [this, &tokenizer](const nlohmann::ordered_json& m) {
+          return prompt_builder_.Render(
+              tokenizer->chat_template, m, tokenizer->bos_token,
+              tokenizer->eos_token, tokenizer->add_bos_token,
+              tokenizer->add_eos_token, tokenizer->add_generation_prompt);
+        };
+        auto fitted = FitContext(model_id, *json_body, messages, render);
+        if (fitted.has_error()) {
+          return cpp::fail(fitted.error());
         }
-
-        Json::Value tools(Json::arrayValue);
-        Json::Value template_data_json;
-        template_data_json["messages"] = messages_jsoncpp;
-        // template_data_json["tools"] = tools;
-
-        auto prompt_result = jinja::RenderTemplate(
-            tokenizer->chat_template, template_data_json, tokenizer->bos_token,
-            tokenizer->eos_token, tokenizer->add_bos_token,
-            tokenizer->add_eos_token, tokenizer->add_generation_prompt);
+        auto prompt_result =
+            fitted.value()
+                ? cpp::result<std::string, std::string>(
+                      std::move(*fitted.value()))
+                : render(messages);
         if (prompt_result.has_value()) {
-          (*json_body)["prompt"] = prompt_result.value();
+          (*json_body)["prompt"] = std::move(prompt_result.value());
           Json::Value stops(Json::arrayValue);
           stops.append(tokenizer->eos_token);
           (*json_body)["stop"] = stops;
@@ -75,25 +145,76 @@ cpp::result<void, InferResult> InferenceService::HandleChatCompletion(
 
   CTL_DBG("Json body inference: " + json_body->toStyledString());
 
-  auto cb = [q, tool_choice](Json::Value status, Json::Value res) {
-    if (!tool_choice.isNull()) {
-      res["tool_choice"] = tool_choice;
+  auto push = PushTo(q);
+  if (response_cache_ && ResponseCache::IsCacheable(*json_body, false)) {
+    auto key = ResponseCache::MakeKey("chat", *json_body,
+                                      GetModelFileIdentity(model_id));
+    if (ReplayFromCache(key, q)) {
+      return {};
     }
-    q->push(std::make_pair(status, res));
-  };
-  if (std::holds_alternative<EngineI*>(engine_result.value())) {
-    std::get<EngineI*>(engine_result.value())
-        ->HandleChatCompletion(json_body, std::move(cb));
-  } else {
-    std::get<RemoteEngineI*>(engine_result.value())
-        ->HandleChatCompletion(json_body, std::move(cb));
+    push = response_cache_->Record(key, std::move(push), options.cancellation);
   }
 
-  return {};
+  auto dispatch = [this, push, json_body, engine_type, tool_choice, model_id,
+                   stream_tool_calls, session_id = options.session_id,
+                   trace = options.trace,
+                   cancellation = options.cancellation](
+                      InferenceScheduler::TicketPtr ticket) {
+    // the engine might have been unloaded while the request was queued
+    auto engine_result = engine_service_->GetLoadedEngine(engine_type);
+    if (engine_result.has_error()) {
+      auto [stt, res] = EngineNotLoadedResult();
+      push(std::move(stt), std::move(res));
+      return;
+    }
+    if (!StartCancellable(cancellation, engine_type, model_id, *json_body)) {
+      auto [stt, res] = CancelledResult(*cancellation);
+      push(std::move(stt), std::move(res));
+      return;
+    }
+    PinSession(model_id, session_id, *json_body);
+
+    auto parser =
+        stream_tool_calls
+            ? std::make_shared<function_calling_utils::ToolCallParser>()
+            : nullptr;
+    if (trace) {
+      trace->Begin(RequestTrace::kEngine);
+      trace->Begin(RequestTrace::kFirstToken);
+    }
+    auto cb = [push, tool_choice, ticket, parser, trace](Json::Value status,
+                                                         Json::Value res) {
+      if (!tool_choice.isNull()) {
+        res["tool_choice"] = tool_choice;
+      }
+      if (trace) {
+        trace->End(RequestTrace::kFirstToken);
+        if (IsFinalResult(status)) {
+          trace->End(RequestTrace::kEngine);
+        }
+      }
+      ReleaseIfFinal(ticket, status);
+      if (parser && !status.get("has_error", false).asBool() &&
+          !function_calling_utils::PostProcessStreamChunk(*parser, res)) {
+        return;
+      }
+      push(std::move(status), std::move(res));
+    };
+    if (std::holds_alternative<EngineI*>(engine_result.value())) {
+      std::get<EngineI*>(engine_result.value())
+          ->HandleChatCompletion(json_body, std::move(cb));
+    } else {
+      std::get<RemoteEngineI*>(engine_result.value())
+          ->HandleChatCompletion(json_body, std::move(cb));
+    }
+  };
+
+  return Schedule(model_id, options, push, std::move(dispatch));
 }
 
 cpp::result<void, InferResult> InferenceService::HandleEmbedding(
-    std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body) {
+    std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body,
+    const SchedulingOptions& options) {
   std::string engine_type;
   if (!HasFieldInReq(json_body, "engine")) {
     engine_type = kLlamaRepo;
@@ -111,21 +232,63 @@ cpp::result<void, InferResult> InferenceService::HandleEmbedding(
     return cpp::fail(std::make_pair(stt, res));
   }
 
-  auto cb = [q](Json::Value status, Json::Value res) {
-    q->push(std::make_pair(status, res));
-  };
-  if (std::holds_alternative<EngineI*>(engine_result.value())) {
-    std::get<EngineI*>(engine_result.value())
-        ->HandleEmbedding(json_body, std::move(cb));
+  auto push = PushTo(q);
+  if (response_cache_ && ResponseCache::IsCacheable(*json_body, true)) {
+    auto key = ResponseCache::MakeKey(
+        "embedding", *json_body,
+        GetModelFileIdentity(json_body->get("model", "").asString()));
+    if (ReplayFromCache(key, q)) {
+      return {};
+    }
+    push = response_cache_->Record(key, std::move(push), options.cancellation);
+  }
+
+  if (embedding_batcher_ && EmbeddingBatcher::CanBatch(*json_body)) {
+    embedding_batcher_->Submit(json_body, options, std::move(push));
+    return {};
+  }
+  return DispatchEmbedding(json_body, options, std::move(push));
+}
+
+cpp::result<void, InferResult> InferenceService::DispatchEmbedding(
+    std::shared_ptr<Json::Value> json_body, const SchedulingOptions& options,
+    EngineCallback cb) {
+  std::string engine_type;
+  if (!HasFieldInReq(json_body, "engine")) {
+    engine_type = kLlamaRepo;
   } else {
-    std::get<RemoteEngineI*>(engine_result.value())
-        ->HandleEmbedding(json_body, std::move(cb));
+    engine_type = (*(json_body)).get("engine", kLlamaRepo).asString();
   }
-  return {};
+
+  auto dispatch = [this, cb, json_body,
+                   engine_type](InferenceScheduler::TicketPtr ticket) {
+    auto engine_result = engine_service_->GetLoadedEngine(engine_type);
+    if (engine_result.has_error()) {
+      auto [stt, res] = EngineNotLoadedResult();
+      cb(std::move(stt), std::move(res));
+      return;
+    }
+
+    auto engine_cb = [cb, ticket](Json::Value status, Json::Value res) {
+      ReleaseIfFinal(ticket, status);
+      cb(std::move(status), std::move(res));
+    };
+    if (std::holds_alternative<EngineI*>(engine_result.value())) {
+      std::get<EngineI*>(engine_result.value())
+          ->HandleEmbedding(json_body, std::move(engine_cb));
+    } else {
+      std::get<RemoteEngineI*>(engine_result.value())
+          ->HandleEmbedding(json_body, std::move(engine_cb));
+    }
+  };
+
+  auto model_id = json_body->get("model", "").asString();
+  return Schedule(model_id, options, cb, std::move(dispatch));
 }
 
 cpp::result<void, InferResult> InferenceService::HandleInference(
-    std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body) {
+    std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body,
+    const SchedulingOptions& options) {
   std::string engine_type;
   if (!HasFieldInReq(json_body, "engine")) {
     engine_type = kLlamaRepo;
@@ -143,14 +306,33 @@ cpp::result<void, InferResult> InferenceService::HandleInference(
     return cpp::fail(std::make_pair(stt, res));
   }
 
-  auto cb = [q](Json::Value status, Json::Value res) {
-    q->push(std::make_pair(status, res));
+  auto model_id = json_body->get("model", "").asString();
+  auto dispatch = [this, q, json_body, engine_type, model_id,
+                   session_id = options.session_id,
+                   cancellation = options.cancellation](
+                      InferenceScheduler::TicketPtr ticket) {
+    auto engine_result = engine_service_->GetLoadedEngine(engine_type);
+    if (engine_result.has_error()) {
+      q->push(EngineNotLoadedResult());
+      return;
+    }
+    if (!StartCancellable(cancellation, engine_type, model_id, *json_body)) {
+      q->push(CancelledResult(*cancellation));
+      return;
+    }
+    PinSession(model_id, session_id, *json_body);
+
+    auto cb = [q, ticket](Json::Value status, Json::Value res) {
+      ReleaseIfFinal(ticket, status);
+      q->push(std::make_pair(status, res));
+    };
+    if (std::holds_alternative<EngineI*>(engine_result.value())) {
+      std::get<EngineI*>(engine_result.value())
+          ->HandleInference(json_body, std::move(cb));
+    }
   };
-  if (std::holds_alternative<EngineI*>(engine_result.value())) {
-    std::get<EngineI*>(engine_result.value())
-        ->HandleInference(json_body, std::move(cb));
-  }
-  return {};
+
+  return Schedule(model_id, options, PushTo(q), std::move(dispatch));
 }
 
 cpp::result<void, InferResult> InferenceService::HandleRouteRequest(
@@ -193,6 +375,15 @@ InferResult InferenceService::LoadModel(
 
   Json::Value r;
   Json::Value stt;
+  // local engines pick their devices from the probed hardware
+  if (!engine_service_->IsRemoteEngine(engine_type) &&
+      cortex::StartupStatus::GetInstance().IsPending(
+          cortex::kHardwareStartupTask)) {
+    r["message"] = "Hardware detection is still running, retry once "
+                   "/healthz?ready reports ready";
+    stt["status_code"] = drogon::k503ServiceUnavailable;
+    return std::make_pair(stt, r);
+  }
   auto load_engine_result = engine_service_->LoadEngine(engine_type);
   if (load_engine_result.has_error()) {
     LOG_ERROR << "Could not load engine: " << load_engine_result.error();
@@ -220,6 +411,19 @@ InferResult InferenceService::LoadModel(
   if (!engine_service_->IsRemoteEngine(engine_type)) {
     auto model_id = json_body->get("model", "").asString();
     saved_models_[model_id] = json_body;
+    auto loaded = stt.get("status_code", 0).asInt() == drogon::k200OK;
+    // The engine can't serve more than n_parallel requests at once, anything
+    // above that waits in our queue where it is ordered fairly
+    if (loaded && scheduler_ && json_body->isMember("n_parallel")) {
+      scheduler_->SetModelConcurrency(model_id,
+                                      (*json_body)["n_parallel"].asInt());
+    }
+    // one slot per parallel sequence, or per process of a python model
+    if (loaded && session_affinity_) {
+      session_affinity_->SetModelSlots(
+          model_id, std::max(json_body->get("n_parallel", 1).asInt(),
+                             json_body->get("replicas", 1).asInt()));
+    }
   }
   return std::make_pair(stt, r);
 }
@@ -241,6 +445,12 @@ InferResult InferenceService::UnloadModel(const std::string& engine_name,
   Json::Value json_body;
   json_body["engine"] = engine_name;
   json_body["model"] = model_id;
+  if (session_affinity_) {
+    session_affinity_->RemoveModel(model_id);
+  }
+  if (scheduler_) {
+    scheduler_->RemoveModel(model_id);
+  }
 
   LOG_TRACE << "Start unload model";
   auto cb = [&r, &stt](Json::Value status, Json::Value res) {
@@ -384,6 +594,134 @@ InferResult InferenceService::FineTuning(
   return std::make_pair(stt, r);
 }
 
+cpp::result<std::shared_ptr<VocabTokenizer>, InferResult>
+InferenceService::GetTokenizer(std::shared_ptr<Json::Value> json_body) {
+  if (!json_body) {
+    return cpp::fail(BadRequestResult("Body must be a JSON object"));
+  }
+  auto model_id = json_body->get("model", "").asString();
+  if (model_id.empty()) {
+    return cpp::fail(BadRequestResult("Field 'model' is required"));
+  }
+  auto model_service = model_service_.lock();
+  if (!model_service) {
+    return cpp::fail(BadRequestResult("Model service is not available"));
+  }
+  auto tokenizer = model_service->GetTokenizer(model_id);
+  if (tokenizer.has_error()) {
+    return cpp::fail(BadRequestResult(tokenizer.error()));
+  }
+  return tokenizer.value();
+}
+
+InferResult InferenceService::Tokenize(std::shared_ptr<Json::Value> json_body) {
+  auto tokenizer = GetTokenizer(json_body);
+  if (tokenizer.has_error()) {
+    return tokenizer.error();
+  }
+  if (!(*json_body)["content"].isString()) {
+    return BadRequestResult("Field 'content' must be a string");
+  }
+
+  // same defaults as the /tokenize endpoint of llama.cpp
+  auto ids = tokenizer.value()->Encode(
+      (*json_body)["content"].asString(),
+      json_body->get("add_special", false).asBool(),
+      json_body->get("parse_special", true).asBool());
+  Json::Value tokens(Json::arrayValue);
+  for (auto id : ids) {
+    tokens.append(id);
+  }
+  Json::Value res;
+  Json::Value stt;
+  res["model"] = (*json_body)["model"];
+  res["tokens"] = std::move(tokens);
+  res["count"] = static_cast<Json::UInt64>(ids.size());
+  stt["status_code"] = drogon::k200OK;
+  return std::make_pair(stt, res);
+}
+
+InferResult InferenceService::Detokenize(
+    std::shared_ptr<Json::Value> json_body) {
+  auto tokenizer = GetTokenizer(json_body);
+  if (tokenizer.has_error()) {
+    return tokenizer.error();
+  }
+  const auto& tokens = (*json_body)["tokens"];
+  if (!tokens.isArray()) {
+    return BadRequestResult("Field 'tokens' must be an array");
+  }
+
+  std::vector<int32_t> ids;
+  ids.reserve(tokens.size());
+  for (auto const& token : tokens) {
+    if (!token.isInt()) {
+      return BadRequestResult("Tokens must be integers");
+    }
+    ids.push_back(token.asInt());
+  }
+  auto content = tokenizer.value()->Decode(
+      ids, json_body->get("skip_special", false).asBool());
+  if (content.has_error()) {
+    return BadRequestResult(content.error());
+  }
+  Json::Value res;
+  Json::Value stt;
+  res["model"] = (*json_body)["model"];
+  res["content"] = std::move(content.value());
+  stt["status_code"] = drogon::k200OK;
+  return std::make_pair(stt, res);
+}
+
+InferResult InferenceService::CountTokens(
+    std::shared_ptr<Json::Value> json_body) {
+  auto tokenizer = GetTokenizer(json_body);
+  if (tokenizer.has_error()) {
+    return tokenizer.error();
+  }
+
+  size_t count = 0;
+  if ((*json_body)["content"].isString()) {
+    count = tokenizer.value()
+                ->Encode((*json_body)["content"].asString(),
+                         json_body->get("add_special", true).asBool(),
+                         json_body->get("parse_special", true).asBool())
+                .size();
+  } else if ((*json_body)["messages"].isArray()) {
+    // the prompt the engine would be given by HandleChatCompletion
+    auto model_id = (*json_body)["model"].asString();
+    auto model_service = model_service_.lock();
+    auto metadata = model_service
+                        ? model_service->GetCachedModelMetadata(model_id)
+                        : nullptr;
+    if (metadata == nullptr || metadata->tokenizer->chat_template.empty()) {
+      return BadRequestResult("Model " + model_id +
+                              " is not loaded or has no chat template");
+    }
+    auto const& t = metadata->tokenizer;
+    auto prompt = prompt_builder_.Render(
+        t->chat_template,
+        extensions::TemplateRenderer().ConvertJsonValue(
+            (*json_body)["messages"]),
+        t->bos_token, t->eos_token, t->add_bos_token, t->add_eos_token,
+        t->add_generation_prompt);
+    if (prompt.has_error()) {
+      return BadRequestResult("Failed to render prompt: " + prompt.error());
+    }
+    // the template writes the special tokens itself
+    count = tokenizer.value()->Encode(prompt.value(), false, true).size();
+  } else {
+    return BadRequestResult("Field 'content' or 'messages' is required");
+  }
+
+  Json::Value res;
+  Json::Value stt;
+  res["model"] = (*json_body)["model"];
+  res["count"] = static_cast<Json::UInt64>(count);
+  stt["status_code"] = drogon::k200OK;
+  return std::make_pair(stt, res);
+}
+
 bool InferenceService::StopInferencing(const std::string& engine_name,
                                        const std::string& model_id) {
   CTL_DBG("Stop inferencing");
@@ -403,6 +741,64 @@ bool InferenceService::StopInferencing(const std::string& engine_name,
   return true;
 }
 
+bool InferenceService::StopRequest(const std::string& engine_name,
+                                   const std::string& model_id,
+                                   const std::string& request_id) {
+  auto engine_result = engine_service_->GetLoadedEngine(engine_name);
+  if (engine_result.has_error()) {
+    LOG_WARN << "Engine is not loaded yet";
+    return false;
+  }
+  if (std::holds_alternative<RemoteEngineI*>(engine_result.value())) {
+    std::get<RemoteEngineI*>(engine_result.value())
+        ->StopRequest(model_id, request_id);
+    CTL_INF("Stopped request " << request_id << " of " << model_id);
+    return true;
+  }
+
+  auto engine = std::get<EngineI*>(engine_result.value());
+  if (engine->IsSupported("StopRequest")) {
+    engine->StopRequest(model_id, request_id);
+    CTL_INF("Stopped request " << request_id << " of " << model_id);
+    return true;
+  }
+  // the request holds one slot itself, nothing else runs with one left
+  if (scheduler_ && scheduler_->GetInFlight(model_id) <= 1 &&
+      engine->IsSupported("StopInferencing")) {
+    engine->StopInferencing(model_id);
+    CTL_INF("Stopped inferencing of " << model_id << " for " << request_id);
+    return true;
+  }
+  CTL_INF("Request " << request_id << " of " << model_id
+                     << " can't be stopped alone, its result is dropped");
+  return false;
+}
+
+bool InferenceService::StartCancellable(
+    const std::shared_ptr<RequestCancellation>& cancellation,
+    const std::string& engine_type, const std::string& model_id,
+    Json::Value& json_body) {
+  if (!cancellation) {
+    return true;
+  }
+  if (cancellation->IsCancelled()) {
+    CTL_DBG("Skipped cancelled request " << cancellation->request_id());
+    return false;
+  }
+  auto engine_result = engine_service_->GetLoadedEngine(engine_type);
+  if (engine_result.has_value() &&
+      (std::holds_alternative<RemoteEngineI*>(engine_result.value()) ||
+       std::get<EngineI*>(engine_result.value())
+           ->IsSupported("StopRequest"))) {
+    json_body["request_id"] = cancellation->request_id();
+  }
+  cancellation->OnCancel(
+      [this, engine_type, model_id, request_id = cancellation->request_id()] {
+        StopRequest(engine_type, model_id, request_id);
+      });
+  return true;
+}
+
 bool InferenceService::HasFieldInReq(std::shared_ptr<Json::Value> json_body,
                                      const std::string& field) {
   if (!json_body || (*json_body)[field].isNull()) {
@@ -411,6 +807,186 @@ bool InferenceService::HasFieldInReq(std::shared_ptr<Json::Value> json_body,
   return true;
 }
 
+cpp::result<void, InferResult> InferenceService::Schedule(
+    const std::string& model_id, const SchedulingOptions& options,
+    EngineCallback on_expired, InferenceScheduler::DispatchFn dispatch) {
+  if (auto trace = options.trace) {
+    trace->Begin(RequestTrace::kQueue);
+    dispatch = [trace, dispatch = std::move(dispatch)](
+                   InferenceScheduler::TicketPtr ticket) {
+      trace->End(RequestTrace::kQueue);
+      dispatch(std::move(ticket));
+    };
+  }
+  if (!scheduler_) {
+    dispatch(nullptr);
+    return {};
+  }
+
+  auto on_reject = [on_expired = std::move(on_expired)](
+                       const InferenceScheduler::Rejection& rejection) {
+    Json::Value res;
+    Json::Value stt;
+    res["message"] = rejection.message;
+    stt["status_code"] = rejection.status_code;
+    stt["is_done"] = true;
+    stt["has_error"] = true;
+    on_expired(std::move(stt), std::move(res));
+  };
+  auto rejection = scheduler_->Submit(model_id, options, std::move(dispatch),
+                                      std::move(on_reject));
+  if (rejection.has_value()) {
+    Json::Value res;
+    Json::Value stt;
+    res["message"] = rejection->message;
+    stt["status_code"] = rejection->status_code;
+    stt["retry_after"] = rejection->retry_after_s;
+    return cpp::fail(std::make_pair(stt, res));
+  }
+  return {};
+}
+
+void InferenceService::EnableEmbeddingBatching(
+    EmbeddingBatcher::Config config) {
+  embedding_batcher_ = std::make_unique<EmbeddingBatcher>(
+      std::move(config), [this](std::shared_ptr<Json::Value> body,
+                                const SchedulingOptions& options,
+                                EmbeddingBatcher::Callback cb) {
+        auto res = DispatchEmbedding(body, options, cb);
+        if (res.has_error()) {
+          auto [stt, r] = res.error();
+          stt["is_done"] = true;
+          stt["has_error"] = true;
+          cb(std::move(stt), std::move(r));
+        }
+      });
+}
+
+void InferenceService::EnableSessionAffinity(SessionAffinity::Config config) {
+  session_affinity_ = std::make_unique<SessionAffinity>(std::move(config));
+}
+
+void InferenceService::PinSession(const std::string& model_id,
+                                  const std::string& session_id,
+                                  Json::Value& json_body) {
+  if (!session_affinity_ || session_id.empty()) {
+    return;
+  }
+  if (auto slot = session_affinity_->Acquire(model_id, session_id); slot) {
+    // llama.cpp naming: the slot keeps the KV cache of its last prompt, which
+    // is reused up to the longest common prefix
+    json_body["session_id"] = session_id;
+    json_body["id_slot"] = *slot;
+    json_body["cache_prompt"] = true;
+  }
+}
+
+void InferenceService::EnableTracing(TraceSink::Config config) {
+  trace_sink_ = std::make_unique<TraceSink>(std::move(config));
+}
+
+std::shared_ptr<RequestTrace> InferenceService::StartTrace(std::string name) {
+  if (!trace_sink_) {
+    return std::make_shared<RequestTrace>(std::move(name), 0, false);
+  }
+  return trace_sink_->StartTrace(std::move(name));
+}
+
+void InferenceService::FinishTrace(const std::shared_ptr<RequestTrace>& trace) {
+  if (trace && trace->Finish() && trace->sampled() && trace_sink_) {
+    trace_sink_->Write(*trace);
+  }
+}
+
+void InferenceService::EnableContextFitting(ContextFitter::Config config) {
+  context_fitter_ = std::make_unique<ContextFitter>(std::move(config));
+}
+
+cpp::result<std::optional<std::string>, InferResult>
+InferenceService::FitContext(const std::string& model_id,
+                             const Json::Value& json_body,
+                             nlohmann::ordered_json& messages,
+                             const ContextFitter::RenderFn& render) {
+  if (!context_fitter_) {
+    return std::nullopt;
+  }
+  auto policy = context_fitter_->config().default_policy;
+  if (auto& o = json_body["context_overflow"]; !o.isNull()) {
+    auto parsed = ContextFitter::ParsePolicy(o.asString());
+    if (!parsed) {
+      return cpp::fail(BadRequestResult(
+          "Invalid context_overflow, expected none, error or truncate"));
+    }
+    policy = *parsed;
+  }
+  if (policy == ContextFitter::Policy::kNone) {
+    return std::nullopt;
+  }
+
+  auto model_service = model_service_.lock();
+  if (!model_service) {
+    return std::nullopt;
+  }
+  auto ctx_len = model_service->GetLoadedContextLength(model_id);
+  auto tokenizer = model_service->GetTokenizer(model_id);
+  if (!ctx_len || *ctx_len <= 0 || tokenizer.has_error()) {
+    return std::nullopt;
+  }
+
+  // room for the completion, when the request bounds it
+  size_t reserved = 0;
+  for (auto const& field : {"max_completion_tokens", "max_tokens"}) {
+    if (auto& v = json_body[field]; v.isIntegral() && v.asInt64() > 0) {
+      reserved = v.asUInt64();
+      break;
+    }
+  }
+  auto count = [&tokenizer](std::string_view text) {
+    // the chat template writes the special tokens itself
+    return tokenizer.value()->Encode(text, false, true).size();
+  };
+  auto result = context_fitter_->Fit(
+      policy, model_id, messages,
+      {.ctx_len = static_cast<size_t>(*ctx_len), .reserved = reserved}, count,
+      render);
+  if (result.has_error()) {
+    return cpp::fail(BadRequestResult(result.error()));
+  }
+  if (result->dropped_messages > 0) {
+    CTL_INF("Dropped " << result->dropped_messages << " messages to fit "
+                       << result->prompt_tokens << " tokens in the context of "
+                       << model_id);
+  }
+  return std::move(result->prompt);
+}
+
+void InferenceService::EnableResponseCache(ResponseCache::Config config) {
+  response_cache_ = std::make_unique<ResponseCache>(std::move(config));
+}
+
+bool InferenceService::ReplayFromCache(const std::string& key,
+                                       std::shared_ptr<SyncQueue> q) {
+  auto entry = response_cache_->Get(key);
+  if (!entry) {
+    return false;
+  }
+  CTL_DBG("Response cache hit: " << key);
+  for (auto& r : *entry) {
+    q->push(std::move(r));
+  }
+  return true;
+}
+
+std::string InferenceService::GetModelFileIdentity(
+    const std::string& model_id) const {
+  auto it = saved_models_.find(model_id);
+  if (it == saved_models_.end() || !it->second->isMember("model_path")) {
+    return "";
+  }
+  return ResponseCache::GetFileIdentity(
+      (*it->second)["model_path"].asString());
+}
+
 std::string InferenceService::GetEngineByModelId(
     const std::string& model_id) const {
   return model_service_.lock()->GetEngineByModelId(model_id);
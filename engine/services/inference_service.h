@@ -1,11 +1,20 @@
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
+#include <optional>
 #include <queue>
 #include "extensions/remote-engine/remote_engine.h"
+#include "services/context_fitter.h"
+#include "services/embedding_batcher.h"
 #include "services/engine_service.h"
+#include "services/inference_scheduler.h"
 #include "services/model_service.h"
+#include "services/prompt_builder.h"
+#include "services/response_cache.h"
+#include "services/session_affinity.h"
 #include "utils/result.hpp"
 
 // Status and result
@@ -13,9 +22,16 @@ using InferResult = std::pair<Json::Value, Json::Value>;
 
 struct SyncQueue {
   void push(InferResult&& p) {
-    std::unique_lock<std::mutex> l(mtx);
-    q.push(p);
-    cond.notify_one();
+    std::function<void()> notify;
+    {
+      std::unique_lock<std::mutex> l(mtx);
+      q.push(p);
+      cond.notify_one();
+      notify = on_push;
+    }
+    if (notify) {
+      notify();
+    }
   }
 
   InferResult wait_and_pop() {
@@ -26,24 +42,59 @@ struct SyncQueue {
     return res;
   }
 
+  // nullopt if nothing was pushed before [deadline]
+  std::optional<InferResult> wait_and_pop_until(
+      std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> l(mtx);
+    if (!cond.wait_until(l, deadline, [this] { return !q.empty(); })) {
+      return std::nullopt;
+    }
+    auto res = q.front();
+    q.pop();
+    return res;
+  }
+
+  std::optional<InferResult> try_pop() {
+    std::unique_lock<std::mutex> l(mtx);
+    if (q.empty()) {
+      return std::nullopt;
+    }
+    auto res = q.front();
+    q.pop();
+    return res;
+  }
+
+  // Called from the pushing thread after each push, so that a consumer can
+  // wait for results without blocking a thread
+  void set_on_push(std::function<void()> fn) {
+    std::unique_lock<std::mutex> l(mtx);
+    on_push = std::move(fn);
+  }
+
   std::mutex mtx;
   std::condition_variable cond;
   std::queue<InferResult> q;
+  std::function<void()> on_push;
 };
 
 class InferenceService {
  public:
-  explicit InferenceService(std::shared_ptr<EngineService> engine_service)
-      : engine_service_{engine_service} {}
+  explicit InferenceService(
+      std::shared_ptr<EngineService> engine_service,
+      std::shared_ptr<InferenceScheduler> scheduler = nullptr)
+      : engine_service_{engine_service}, scheduler_{scheduler} {}
 
   cpp::result<void, InferResult> HandleChatCompletion(
-      std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body);
+      std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body,
+      const SchedulingOptions& options = {});
 
   cpp::result<void, InferResult> HandleEmbedding(
-      std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body);
+      std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body,
+      const SchedulingOptions& options = {});
 
   cpp::result<void, InferResult> HandleInference(
-      std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body);
+      std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body,
+      const SchedulingOptions& options = {});
 
   cpp::result<void, InferResult> HandleRouteRequest(
       std::shared_ptr<SyncQueue> q, std::shared_ptr<Json::Value> json_body);
@@ -59,9 +110,28 @@ class InferenceService {
 
   InferResult FineTuning(std::shared_ptr<Json::Value> json_body);
 
+  /**
+   * Token ids of the "content" of a request, computed from the vocabulary
+   * of the model file without going through the engine.
+   */
+  InferResult Tokenize(std::shared_ptr<Json::Value> json_body);
+
+  InferResult Detokenize(std::shared_ptr<Json::Value> json_body);
+
+  // Token count of "content", or of "messages" rendered by the chat template
+  InferResult CountTokens(std::shared_ptr<Json::Value> json_body);
+
   bool StopInferencing(const std::string& engine_name,
                        const std::string& model_id);
 
+  /**
+   * Stop the request [request_id] of [model_id]. Engines which can't stop a
+   * single request are stopped as a whole only when it is the one request
+   * they run; otherwise it runs to completion and its result is dropped.
+   */
+  bool StopRequest(const std::string& engine_name, const std::string& model_id,
+                   const std::string& request_id);
+
   bool HasFieldInReq(std::shared_ptr<Json::Value> json_body,
                      const std::string& field);
 
@@ -71,9 +141,97 @@ class InferenceService {
 
   std::string GetEngineByModelId(const std::string& model_id) const;
 
+  /**
+   * Merge concurrent embedding requests for the same model into one engine
+   * call.
+   */
+  void EnableEmbeddingBatching(EmbeddingBatcher::Config config);
+
+  /**
+   * Serve repeated deterministic requests from an exact-match cache.
+   */
+  void EnableResponseCache(ResponseCache::Config config);
+
+  /**
+   * Keep the requests of a session on the same engine slot.
+   */
+  void EnableSessionAffinity(SessionAffinity::Config config);
+
+  /**
+   * Make chat histories fit the context window of the model before they are
+   * dispatched, following the "context_overflow" of the request or
+   * [config].default_policy.
+   */
+  void EnableContextFitting(ContextFitter::Config config);
+
+  /**
+   * Write a share of the request traces to a rotating Chrome trace file.
+   */
+  void EnableTracing(TraceSink::Config config);
+
+  // A trace for a new request, written by FinishTrace if it is sampled
+  std::shared_ptr<RequestTrace> StartTrace(std::string name);
+
+  void FinishTrace(const std::shared_ptr<RequestTrace>& trace);
+
  private:
+  using EngineCallback = std::function<void(Json::Value&&, Json::Value&&)>;
+
+  /**
+   * Run [dispatch] once the scheduler admits the request. Without a scheduler
+   * it runs immediately with a null ticket. [on_expired] receives the error
+   * if the request times out in the queue.
+   */
+  cpp::result<void, InferResult> Schedule(
+      const std::string& model_id, const SchedulingOptions& options,
+      EngineCallback on_expired, InferenceScheduler::DispatchFn dispatch);
+
+  /**
+   * Hook [cancellation] up to the engine about to run the request, which
+   * gets its "request_id". False if the request was cancelled already, it
+   * must not be dispatched then.
+   */
+  bool StartCancellable(
+      const std::shared_ptr<RequestCancellation>& cancellation,
+      const std::string& engine_type, const std::string& model_id,
+      Json::Value& json_body);
+
+  // Push a cached result to [q], returns false on a cache miss
+  bool ReplayFromCache(const std::string& key, std::shared_ptr<SyncQueue> q);
+
+  // Identity of the file [model_id] was loaded from, empty for remote models
+  std::string GetModelFileIdentity(const std::string& model_id) const;
+
+  // Tell the engine which slot serves the session of the request, if any
+  void PinSession(const std::string& model_id, const std::string& session_id,
+                  Json::Value& json_body);
+
+  cpp::result<std::shared_ptr<VocabTokenizer>, InferResult> GetTokenizer(
+      std::shared_ptr<Json::Value> json_body);
+
+  /**
+   * Drop the turns of [messages] which don't fit the context window of
+   * [model_id]. The prompt is returned when it had to be rendered.
+   */
+  cpp::result<std::optional<std::string>, InferResult> FitContext(
+      const std::string& model_id, const Json::Value& json_body,
+      nlohmann::ordered_json& messages, const ContextFitter::RenderFn& render);
+
+  cpp::result<void, InferResult> DispatchEmbedding(
+      std::shared_ptr<Json::Value> json_body, const SchedulingOptions& options,
+      EngineCallback cb);
+
   std::shared_ptr<EngineService> engine_service_;
+  std::shared_ptr<InferenceScheduler> scheduler_;
   std::weak_ptr<ModelService> model_service_;
   using SavedModel = std::shared_ptr<Json::Value>;
   std::unordered_map<std::string, SavedModel> saved_models_;
+  std::unique_ptr<ResponseCache> response_cache_;
+  std::unique_ptr<SessionAffinity> session_affinity_;
+  std::unique_ptr<ContextFitter> context_fitter_;
+  std::unique_ptr<TraceSink> trace_sink_;
+  // rendered history of multi-turn conversations
+  PromptBuilder prompt_builder_{PromptBuilder::Config{}};
+  // destroyed first, pending batches still call back into this service
+  std::unique_ptr<EmbeddingBatcher> embedding_batcher_;
 };
@@ -0,0 +1,148 @@
+#include "model_catalog.h"
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+
+namespace {
+std::string Serialize(const Json::Value& value) {
+  Json::StreamWriterBuilder wbuilder;
+  wbuilder.settings_["precision"] = 2;
+  wbuilder.settings_["indentation"] = "";
+  return Json::writeString(wbuilder, value);
+}
+
+std::string Quote(const std::string& s) {
+  return Serialize(Json::Value(s));
+}
+
+// FNV-1a, stable across restarts unlike std::hash
+std::string Hash(const std::string& s) {
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : s) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  std::ostringstream oss;
+  oss << std::hex << std::setw(16) << std::setfill('0') << h;
+  return oss.str();
+}
+}  // namespace
+
+ModelCatalog::ModelCatalog() {
+  full_response_ = R"({"data":[],"object":"list","result":"OK"})";
+  etag_ = "\"" + Hash(full_response_) + "\"";
+}
+
+bool ModelCatalog::Replace(std::vector<Entry> entries) {
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.id < b.id; });
+  entries.erase(std::unique(entries.begin(), entries.end(),
+                            [](const Entry& a, const Entry& b) {
+                              return a.id == b.id;
+                            }),
+                entries.end());
+
+  std::vector<std::string> ids, engines, statuses, sources, objects;
+  std::vector<uint64_t> sizes;
+  ids.reserve(entries.size());
+  engines.reserve(entries.size());
+  statuses.reserve(entries.size());
+  sources.reserve(entries.size());
+  sizes.reserve(entries.size());
+  objects.reserve(entries.size());
+  for (auto& e : entries) {
+    ids.push_back(std::move(e.id));
+    engines.push_back(std::move(e.engine));
+    statuses.push_back(std::move(e.status));
+    sources.push_back(std::move(e.source));
+    sizes.push_back(e.size);
+    objects.push_back(Serialize(e.object));
+  }
+
+  std::unique_lock lock(mtx_);
+  if (ids == ids_ && objects == objects_ && engines == engines_ &&
+      statuses == statuses_ && sources == sources_ && sizes == sizes_) {
+    return false;
+  }
+  ids_ = std::move(ids);
+  engines_ = std::move(engines);
+  statuses_ = std::move(statuses);
+  sources_ = std::move(sources);
+  sizes_ = std::move(sizes);
+  objects_ = std::move(objects);
+
+  std::string body = R"({"data":[)";
+  for (size_t i = 0; i < objects_.size(); i++) {
+    if (i > 0) {
+      body += ',';
+    }
+    body += objects_[i];
+  }
+  body += R"(],"object":"list","result":"OK"})";
+  full_response_ = std::move(body);
+  etag_ = "\"" + Hash(full_response_) + "\"";
+  return true;
+}
+
+ModelCatalog::Response ModelCatalog::List(const Query& query) const {
+  std::shared_lock lock(mtx_);
+  if (query.IsEmpty()) {
+    return {full_response_, etag_};
+  }
+
+  auto i = query.after.empty()
+               ? size_t{0}
+               : static_cast<size_t>(
+                     std::upper_bound(ids_.begin(), ids_.end(), query.after) -
+                     ids_.begin());
+  std::string body = R"({"data":[)";
+  size_t count = 0;
+  size_t first = ids_.size();
+  size_t last = ids_.size();
+  bool has_more = false;
+  for (; i < ids_.size(); i++) {
+    if ((query.engine && engines_[i] != *query.engine) ||
+        (query.status && statuses_[i] != *query.status) ||
+        (query.source && sources_[i] != *query.source) ||
+        (query.min_size && sizes_[i] < *query.min_size) ||
+        (query.max_size && sizes_[i] > *query.max_size)) {
+      continue;
+    }
+    if (query.limit > 0 && count == query.limit) {
+      has_more = true;
+      break;
+    }
+    if (count > 0) {
+      body += ',';
+    } else {
+      first = i;
+    }
+    body += objects_[i];
+    last = i;
+    count++;
+  }
+  body += "]";
+  if (count > 0) {
+    body += R"(,"first_id":)" + Quote(ids_[first]);
+  }
+  if (query.limit > 0) {
+    body += R"(,"has_more":)" + std::string(has_more ? "true" : "false");
+  }
+  if (count > 0) {
+    body += R"(,"last_id":)" + Quote(ids_[last]);
+  }
+  body += R"(,"object":"list","result":"OK"})";
+  auto etag = "\"" + Hash(body) + "\"";
+  return {std::move(body), std::move(etag)};
+}
+
+std::string ModelCatalog::ETag() const {
+  std::shared_lock lock(mtx_);
+  return etag_;
+}
+
+size_t ModelCatalog::Size() const {
+  std::shared_lock lock(mtx_);
+  return ids_.size();
+}
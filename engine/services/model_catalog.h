@@ -0,0 +1,80 @@
+#pragma once
+
+#include <json/json.h>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+/**
+ * In-memory catalog behind /v1/models.
+ *
+ * The filterable fields are kept column by column, sorted by model id, next
+ * to the serialized item of each model, so a query is a scan over a few
+ * small vectors plus string concatenation, and pagination is a binary
+ * search on the id column. The unfiltered response is serialized once per
+ * change along with its ETag. A filtered response is tagged with the hash of
+ * its own body, so its ETag changes exactly when that view does.
+ */
+class ModelCatalog {
+ public:
+  struct Entry {
+    std::string id;
+    std::string engine;
+    // downloaded, downloadable or remote
+    std::string status;
+    std::string source;
+    uint64_t size = 0;
+    // item of the /v1/models response
+    Json::Value object;
+  };
+
+  struct Query {
+    std::optional<std::string> engine{};
+    std::optional<std::string> status{};
+    std::optional<std::string> source{};
+    std::optional<uint64_t> min_size{};
+    std::optional<uint64_t> max_size{};
+    // return the models after this id
+    std::string after{};
+    // 0 returns every match
+    size_t limit = 0;
+
+    bool IsEmpty() const {
+      return !engine && !status && !source && !min_size && !max_size &&
+             after.empty() && limit == 0;
+    }
+  };
+
+  struct Response {
+    std::string body;
+    std::string etag;
+  };
+
+  ModelCatalog();
+
+  /**
+   * Replace the content of the catalog, returns false if [entries] are what
+   * the catalog already holds.
+   */
+  bool Replace(std::vector<Entry> entries);
+
+  Response List(const Query& query) const;
+
+  // ETag of the unfiltered response
+  std::string ETag() const;
+
+  size_t Size() const;
+
+ private:
+  mutable std::shared_mutex mtx_;
+  std::vector<std::string> ids_;
+  std::vector<std::string> engines_;
+  std::vector<std::string> statuses_;
+  std::vector<std::string> sources_;
+  std::vector<uint64_t> sizes_;
+  std::vector<std::string> objects_;
+
+  std::string full_response_;
+  std::string etag_;
+};
@@ -0,0 +1,311 @@
+#include "model_import_service.h"
+#include <algorithm>
+#include <chrono>
+#include "config/gguf_parser.h"
+#include "config/yaml_config.h"
+#include "utils/file_copy_utils.h"
+#include "utils/file_manager_utils.h"
+#include "utils/logging_utils.h"
+#include "utils/ulid_generator.h"
+
+namespace {
+// Imported models live in their own folder of the models container
+constexpr const auto kImportedFolder = "imported";
+// Linked imports keep this branch so deleting the model keeps the file
+constexpr const auto kLinkedBranch = "imported";
+constexpr const auto kProgressInterval = std::chrono::milliseconds(500);
+}  // namespace
+
+Json::Value ModelImportService::ImportTask::ToJson() const {
+  Json::Value root;
+  root["id"] = id;
+  root["model"] = model;
+  root["source"] = source;
+  root["destination"] = destination;
+  root["status"] = status;
+  root["totalBytes"] = Json::UInt64(total_bytes);
+  root["copiedBytes"] = Json::UInt64(copied_bytes);
+  if (!method.empty()) {
+    root["method"] = method;
+  }
+  if (!error.empty()) {
+    root["error"] = error;
+  }
+  return root;
+}
+
+ModelImportService::ModelImportService(
+    std::shared_ptr<DatabaseService> db_service,
+    std::shared_ptr<EventQueue> event_queue)
+    : db_service_{db_service}, event_queue_{event_queue} {
+  runner_ = std::thread([this] {
+    while (true) {
+      std::shared_ptr<Job> job;
+      {
+        std::unique_lock<std::mutex> l(mtx_);
+        cv_.wait(l, [this] { return stop_ || !queue_.empty(); });
+        if (stop_) {
+          return;
+        }
+        job = queue_.front();
+        queue_.pop_front();
+      }
+      Run(job);
+    }
+  });
+}
+
+ModelImportService::~ModelImportService() {
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    stop_ = true;
+    // stop the running copy, it cleans up after itself
+    for (auto& [id, job] : jobs_) {
+      job->cancelled = true;
+    }
+  }
+  cv_.notify_all();
+  if (runner_.joinable()) {
+    runner_.join();
+  }
+}
+
+cpp::result<void, std::string> ModelImportService::ImportLinked(
+    const std::string& model, const std::string& model_path,
+    const std::string& name) {
+  auto model_config = Prepare(model, model_path, name);
+  if (model_config.has_error()) {
+    return cpp::fail(model_config.error());
+  }
+  std::error_code ec;
+  model_config->files.push_back(model_path);
+  model_config->size = std::filesystem::file_size(model_path, ec);
+  return Register(model, std::move(model_config.value()), kLinkedBranch);
+}
+
+cpp::result<ModelImportService::ImportTask, std::string>
+ModelImportService::StartCopyImport(const std::string& model,
+                                    const std::string& model_path,
+                                    const std::string& name) {
+  auto model_config = Prepare(model, model_path, name);
+  if (model_config.has_error()) {
+    return cpp::fail(model_config.error());
+  }
+
+  auto job = std::make_shared<Job>();
+  job->model_config = std::move(model_config.value());
+  auto& task = job->task;
+  task.id = "import_" + ulid::GenerateUlid();
+  task.model = model;
+  task.source = model_path;
+  task.destination = (GetYamlPath(model).parent_path() /
+                      std::filesystem::path(model_path).filename())
+                         .string();
+  task.status = "queued";
+  std::error_code ec;
+  task.total_bytes = std::filesystem::file_size(model_path, ec);
+
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    for (auto const& [id, other] : jobs_) {
+      if (other->task.model == model) {
+        return cpp::fail("Model '" + model + "' is already being imported");
+      }
+      if (other->task.destination == task.destination) {
+        return cpp::fail("File '" + task.destination +
+                         "' is already being imported");
+      }
+    }
+    jobs_[task.id] = job;
+    queue_.push_back(job);
+  }
+  cv_.notify_one();
+  CTL_INF("Queued import of " << model_path << " as " << model);
+  return task;
+}
+
+cpp::result<ModelImportService::ImportTask, std::string>
+ModelImportService::AbortImport(const std::string& task_id) {
+  std::shared_ptr<Job> job;
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    auto it = jobs_.find(task_id);
+    if (it == jobs_.end()) {
+      return cpp::fail("Import task not found: " + task_id);
+    }
+    job = it->second;
+    job->cancelled = true;
+    // a job which didn't start yet never reaches the runner
+    if (auto q = std::find(queue_.begin(), queue_.end(), job);
+        q != queue_.end()) {
+      queue_.erase(q);
+      jobs_.erase(it);
+      job->task.status = "cancelled";
+      queued = true;
+    }
+  }
+  if (queued) {
+    Emit(ImportEventType::ImportStopped, job->task);
+  }
+  std::lock_guard<std::mutex> l(mtx_);
+  return job->task;
+}
+
+cpp::result<config::ModelConfig, std::string> ModelImportService::Prepare(
+    const std::string& model, const std::string& model_path,
+    const std::string& name) {
+  if (db_service_->HasModel(model)) {
+    return cpp::fail("Fail to import model, model_id '" + model +
+                     "' already exists!");
+  }
+  try {
+    config::GGUFHandler gguf_handler;
+    gguf_handler.Parse(model_path);
+    auto model_config = gguf_handler.GetModelConfig();
+    model_config.model = model;
+    model_config.name = name.empty() ? model_config.name : name;
+    return model_config;
+  } catch (const std::exception& e) {
+    return cpp::fail("Error importing model path '" + model_path +
+                     "' with model_id '" + model + "': " + e.what());
+  }
+}
+
+cpp::result<void, std::string> ModelImportService::Register(
+    const std::string& model, config::ModelConfig model_config,
+    const std::string& branch) {
+  namespace fmu = file_manager_utils;
+  auto yaml_path = GetYamlPath(model);
+  try {
+    std::filesystem::create_directories(yaml_path.parent_path());
+    // Use relative path for the yaml. In case of import, we use absolute path
+    // for the model
+    cortex::db::ModelEntry model_entry{
+        model,
+        "",
+        branch,
+        fmu::ToRelativeCortexDataPath(yaml_path).string(),
+        model,
+        "local",
+        "imported",
+        cortex::db::ModelStatus::Downloaded,
+        "",
+        ""};
+    auto added = db_service_->AddModelEntry(model_entry);
+    if (added.has_error() || !added.value()) {
+      return cpp::fail("Fail to import model, model_id '" + model +
+                       "' already exists!");
+    }
+
+    config::YamlHandler yaml_handler;
+    yaml_handler.UpdateModelConfig(model_config);
+    yaml_handler.WriteYamlFile(yaml_path.string());
+    CTL_INF("Model is imported successfully: " << model);
+    return {};
+  } catch (const std::exception& e) {
+    return cpp::fail("Error importing model_id '" + model + "': " + e.what());
+  }
+}
+
+void ModelImportService::Run(const std::shared_ptr<Job>& job) {
+  namespace fs = std::filesystem;
+  auto& task = job->task;
+  auto snapshot = [this, &task] {
+    std::lock_guard<std::mutex> l(mtx_);
+    return task;
+  };
+  auto finish = [this, &job](ImportEventType type, const std::string& status,
+                             const std::string& error) {
+    ImportTask done;
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      job->task.status = status;
+      job->task.error = error;
+      jobs_.erase(job->task.id);
+      done = job->task;
+    }
+    if (!error.empty()) {
+      CTL_WRN("Import of " << done.model << " " << status << ": " << error);
+    }
+    Emit(type, done);
+  };
+
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    task.status = "in_progress";
+  }
+  Emit(ImportEventType::ImportStarted, snapshot());
+
+  // the model only appears once its file is complete
+  fs::path destination(task.destination);
+  auto partial = fs::path(task.destination + ".part");
+  std::error_code ec;
+  fs::create_directories(destination.parent_path(), ec);
+
+  auto last_emit = std::chrono::steady_clock::now();
+  auto res = file_copy_utils::CopyFile(
+      task.source, partial, [&](uint64_t copied, uint64_t total) {
+        if (job->cancelled) {
+          return false;
+        }
+        {
+          std::lock_guard<std::mutex> l(mtx_);
+          task.copied_bytes = copied;
+          task.total_bytes = total;
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_emit >= kProgressInterval) {
+          last_emit = now;
+          Emit(ImportEventType::ImportUpdated, snapshot());
+        }
+        return true;
+      });
+  if (res.has_error()) {
+    fs::remove(partial, ec);
+    if (job->cancelled) {
+      finish(ImportEventType::ImportStopped, "cancelled", "");
+    } else {
+      finish(ImportEventType::ImportError, "failed", res.error());
+    }
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    task.method = file_copy_utils::CopyMethodToString(res.value());
+  }
+
+  fs::rename(partial, destination, ec);
+  if (ec) {
+    fs::remove(partial, ec);
+    finish(ImportEventType::ImportError, "failed",
+           "Failed to move the copy in place: " + ec.message());
+    return;
+  }
+
+  job->model_config.files.push_back(destination.string());
+  job->model_config.size = task.total_bytes;
+  auto registered = Register(task.model, job->model_config, "");
+  if (registered.has_error()) {
+    fs::remove(destination, ec);
+    finish(ImportEventType::ImportError, "failed", registered.error());
+    return;
+  }
+  finish(ImportEventType::ImportSuccess, "completed", "");
+}
+
+void ModelImportService::Emit(ImportEventType type, const ImportTask& task) {
+  if (event_queue_ == nullptr) {
+    return;
+  }
+  ImportEvent event;
+  event.type_ = type;
+  event.task_ = task.ToJson();
+  event_queue_->enqueue(EventType::ImportEvent, std::move(event));
+}
+
+std::filesystem::path ModelImportService::GetYamlPath(
+    const std::string& model) const {
+  return file_manager_utils::GetModelsContainerPath() / kImportedFolder /
+         (model + ".yml");
+}
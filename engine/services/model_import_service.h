@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include "common/event.h"
+#include "config/model_config.h"
+#include "services/database_service.h"
+#include "utils/result.hpp"
+
+/**
+ * Imports local GGUF files as models.
+ *
+ * Linked imports only read the GGUF metadata and complete right away. Copied
+ * imports are queued and run one at a time on a background thread, so a
+ * multi-GB copy never holds a request thread: the caller gets a task back
+ * immediately and follows it on /events. The model is registered once its
+ * file is fully in place, a cancelled or failed copy leaves nothing behind.
+ */
+class ModelImportService {
+ public:
+  using ImportEventType = cortex::event::ImportEventType;
+  using ImportEvent = cortex::event::ImportEvent;
+  using EventType = cortex::event::EventType;
+  using EventQueue =
+      eventpp::EventQueue<EventType,
+                          void(const eventpp::AnyData<eventMaxSize>&)>;
+
+  struct ImportTask {
+    std::string id;
+    std::string model;
+    std::string source;
+    std::string destination;
+    // queued, in_progress, completed, cancelled or failed
+    std::string status;
+    uint64_t total_bytes = 0;
+    uint64_t copied_bytes = 0;
+    std::string method;
+    std::string error;
+
+    Json::Value ToJson() const;
+  };
+
+  explicit ModelImportService(std::shared_ptr<DatabaseService> db_service,
+                              std::shared_ptr<EventQueue> event_queue);
+
+  ~ModelImportService();
+
+  ModelImportService(const ModelImportService&) = delete;
+  ModelImportService& operator=(const ModelImportService&) = delete;
+
+  /**
+   * Register [model_path] in place. The file is left untouched when the
+   * model is deleted.
+   */
+  cpp::result<void, std::string> ImportLinked(const std::string& model,
+                                              const std::string& model_path,
+                                              const std::string& name);
+
+  /**
+   * Queue a copy of [model_path] into the models folder, the model is
+   * registered when the copy completes.
+   */
+  cpp::result<ImportTask, std::string> StartCopyImport(
+      const std::string& model, const std::string& model_path,
+      const std::string& name);
+
+  cpp::result<ImportTask, std::string> AbortImport(const std::string& task_id);
+
+ private:
+  struct Job {
+    ImportTask task;
+    config::ModelConfig model_config;
+    std::atomic<bool> cancelled{false};
+  };
+
+  /**
+   * Read the GGUF metadata of [model_path] into a model config, fails if
+   * [model] is already taken.
+   */
+  cpp::result<config::ModelConfig, std::string> Prepare(
+      const std::string& model, const std::string& model_path,
+      const std::string& name);
+
+  cpp::result<void, std::string> Register(const std::string& model,
+                                          config::ModelConfig model_config,
+                                          const std::string& branch);
+
+  void Run(const std::shared_ptr<Job>& job);
+
+  void Emit(ImportEventType type, const ImportTask& task);
+
+  std::filesystem::path GetYamlPath(const std::string& model) const;
+
+  std::shared_ptr<DatabaseService> db_service_;
+  std::shared_ptr<EventQueue> event_queue_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<std::shared_ptr<Job>> queue_;
+  // queued and running jobs by task id
+  std::unordered_map<std::string, std::shared_ptr<Job>> jobs_;
+  bool stop_ = false;
+  std::thread runner_;
+};
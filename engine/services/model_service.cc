@@ -182,6 +182,65 @@ void ModelService::ForceIndexingModelList() {
   }
 }
 
+void ModelService::ReconcileModels(
+    const std::vector<std::filesystem::path>& changed_paths) {
+  namespace fs = std::filesystem;
+  namespace fmu = file_manager_utils;
+  if (changed_paths.empty()) {
+    return;
+  }
+
+  auto list_entry = db_service_->LoadModelList();
+  if (list_entry.has_error()) {
+    CTL_ERR("Failed to load model list: " << list_entry.error());
+    return;
+  }
+
+  // A model is affected when a changed path is its model.yml, one of the
+  // folders containing it, or a file next to it
+  auto is_affected = [&changed_paths](const fs::path& yaml_path) {
+    auto model_dir = yaml_path.parent_path();
+    for (auto const& changed : changed_paths) {
+      auto [c, y] = std::mismatch(changed.begin(), changed.end(),
+                                  yaml_path.begin(), yaml_path.end());
+      if (c == changed.end() || changed.parent_path() == model_dir) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  config::YamlHandler yaml_handler;
+  std::vector<std::string> broken;
+  for (const auto& model_entry : list_entry.value()) {
+    if (model_entry.status != cortex::db::ModelStatus::Downloaded) {
+      continue;
+    }
+    auto yaml_path = fmu::ToAbsoluteCortexDataPath(
+                         fs::path(model_entry.path_to_model_yaml))
+                         .lexically_normal();
+    if (!is_affected(yaml_path)) {
+      continue;
+    }
+    try {
+      yaml_handler.ModelConfigFromFile(yaml_path.string());
+      yaml_handler.Reset();
+    } catch (const std::exception& e) {
+      CTL_DBG(e.what());
+      broken.push_back(model_entry.model);
+    }
+  }
+
+  if (broken.empty()) {
+    return;
+  }
+  CTL_INF("Removing " << broken.size() << " broken model entries");
+  auto res = db_service_->DeleteModelEntries(broken);
+  if (res.has_error()) {
+    CTL_ERR("Failed to remove model entries: " << res.error());
+  }
+}
+
 cpp::result<std::string, std::string> ModelService::HandleCortexsoModel(
     const std::string& modelName) {
   auto branches =
@@ -835,6 +894,8 @@ cpp::result<StartModelResult, std::string> ModelService::StartModel(
                 fs::path(model_entry.value().path_to_model_yaml))
                 .string();
         json_data["engine"] = mc.engine;
+        // one session affinity slot per process
+        json_data["replicas"] = python_model_config.replicas;
         assert(!!inference_svc_);
         // Check if python engine
 
@@ -961,6 +1022,7 @@ cpp::result<StartModelResult, std::string> ModelService::StartModel(
     auto data = std::get<1>(ir);
 
     if (status == drogon::k200OK) {
+      loaded_context_lengths_[model_handle] = json_data["ctx_len"].asInt();
       // start model successfully, we store the metadata so we can use
       // for each inference
       auto metadata_res = GetModelMetadata(model_handle);
@@ -1042,6 +1104,11 @@ cpp::result<bool, std::string> ModelService::StopModel(
         bypass_stop_check_set_.erase(model_handle);
       }
       loaded_model_metadata_map_.erase(model_handle);
+      loaded_context_lengths_.erase(model_handle);
+      {
+        std::lock_guard<std::mutex> l(tokenizers_mtx_);
+        tokenizers_.erase(model_handle);
+      }
       CTL_INF("Removed metadata for model " << model_handle);
       return true;
     } else {
@@ -1327,6 +1394,21 @@ ModelService::GetModelMetadata(const std::string& model_id) const {
     return cpp::fail("Model ID can't be empty");
   }
 
+  auto file = GetModelFile(model_id);
+  if (file.has_error()) {
+    return cpp::fail(file.error());
+  }
+
+  auto model_metadata_res = cortex_utils::ReadGgufMetadata(file.value());
+  if (!model_metadata_res.has_value()) {
+    CTL_ERR("Failed to read metadata: " + model_metadata_res.error());
+    return cpp::fail("Failed to read metadata: " + model_metadata_res.error());
+  }
+  return std::move(*model_metadata_res);
+}
+
+cpp::result<std::filesystem::path, std::string> ModelService::GetModelFile(
+    const std::string& model_id) const {
   auto model_config = GetDownloadedModel(model_id);
   if (!model_config.has_value()) {
     return cpp::fail("Can't get model config for " + model_id);
@@ -1336,16 +1418,35 @@ ModelService::GetModelMetadata(const std::string& model_id) const {
     return cpp::fail("Model has no actual file. Might not be a local model!");
   }
   // TODO: handle the case we have multiple files
-  auto file = model_config->files[0];
+  return file_manager_utils::ToAbsoluteCortexDataPath(
+      std::filesystem::path(model_config->files[0]));
+}
 
-  auto model_metadata_res = cortex_utils::ReadGgufMetadata(
-      file_manager_utils::ToAbsoluteCortexDataPath(
-          std::filesystem::path(file)));
-  if (!model_metadata_res.has_value()) {
-    CTL_ERR("Failed to read metadata: " + model_metadata_res.error());
-    return cpp::fail("Failed to read metadata: " + model_metadata_res.error());
+cpp::result<std::shared_ptr<VocabTokenizer>, std::string>
+ModelService::GetTokenizer(const std::string& model_id) {
+  {
+    std::lock_guard<std::mutex> l(tokenizers_mtx_);
+    if (auto it = tokenizers_.find(model_id); it != tokenizers_.end()) {
+      return it->second;
+    }
   }
-  return std::move(*model_metadata_res);
+
+  auto file = GetModelFile(model_id);
+  if (file.has_error()) {
+    return cpp::fail(file.error());
+  }
+  auto tokenizer = VocabTokenizer::Load(file.value());
+  if (tokenizer.has_error()) {
+    CTL_WRN("Failed to load tokenizer of " << model_id << ": "
+                                           << tokenizer.error());
+    return cpp::fail(tokenizer.error());
+  }
+  // only loaded models are kept, StopModel drops them
+  if (GetCachedModelMetadata(model_id) != nullptr) {
+    std::lock_guard<std::mutex> l(tokenizers_mtx_);
+    tokenizers_.emplace(model_id, tokenizer.value());
+  }
+  return tokenizer.value();
 }
 
 std::shared_ptr<ModelMetadata> ModelService::GetCachedModelMetadata(
@@ -1356,6 +1457,15 @@ std::shared_ptr<ModelMetadata> ModelService::GetCachedModelMetadata(
   return loaded_model_metadata_map_.at(model_id);
 }
 
+std::optional<int> ModelService::GetLoadedContextLength(
+    const std::string& model_id) const {
+  auto it = loaded_context_lengths_.find(model_id);
+  if (it == loaded_context_lengths_.end()) {
+    return std::nullopt;
+  }
+  return it->second;
+}
+
 std::string ModelService::GetEngineByModelId(
     const std::string& model_id) const {
   namespace fs = std::filesystem;
@@ -1373,4 +1483,207 @@ std::string ModelService::GetEngineByModelId(
   auto mc = yaml_handler.GetModelConfig();
   CTL_DBG(mc.engine);
   return mc.engine;
-}
\ No newline at end of file
+}
+namespace {
+// recommendations depend on the free memory of the host
+constexpr const auto kCatalogRefreshInterval = std::chrono::seconds(30);
+
+std::string ToCatalogStatus(cortex::db::ModelStatus status) {
+  switch (status) {
+    case cortex::db::ModelStatus::Remote:
+      return "remote";
+    case cortex::db::ModelStatus::Downloaded:
+      return "downloaded";
+    case cortex::db::ModelStatus::Downloadable:
+      return "downloadable";
+  }
+  return "unknown";
+}
+
+// What a catalog item is built from: the database row and, for models with
+// a YAML file, the time it was last written
+std::string GetCatalogKey(const cortex::db::ModelEntry& model_entry) {
+  namespace fs = std::filesystem;
+  namespace fmu = file_manager_utils;
+  auto key = model_entry.path_to_model_yaml + '\n' + model_entry.model_source +
+             '\n' + model_entry.engine + '\n' +
+             ToCatalogStatus(model_entry.status) + '\n' + model_entry.metadata;
+  if (model_entry.status != cortex::db::ModelStatus::Downloadable) {
+    std::error_code ec;
+    auto mtime = fs::last_write_time(
+        fmu::ToAbsoluteCortexDataPath(fs::path(model_entry.path_to_model_yaml)),
+        ec);
+    key += '\n' + (ec ? std::string("missing")
+                      : std::to_string(mtime.time_since_epoch().count()));
+  }
+  return key;
+}
+}  // namespace
+
+ModelService::CatalogSource ModelService::BuildCatalogSource(
+    const cortex::db::ModelEntry& model_entry, std::string key) {
+  namespace fs = std::filesystem;
+  namespace fmu = file_manager_utils;
+  CatalogSource source{.key = std::move(key)};
+  auto& entry = source.entry;
+  entry.id = model_entry.model;
+  entry.engine = model_entry.engine;
+  entry.status = ToCatalogStatus(model_entry.status);
+  entry.source = model_entry.model_source;
+
+  if (model_entry.status == cortex::db::ModelStatus::Downloadable) {
+    Json::Value obj;
+    obj["id"] = model_entry.model;
+    obj["model"] = model_entry.model;
+    obj["modelSource"] = model_entry.model_source;
+    obj["status"] = entry.status;
+    obj["engine"] = model_entry.engine;
+    obj["metadata"] = model_entry.metadata;
+    entry.object = std::move(obj);
+    return source;
+  }
+
+  auto yaml_path =
+      fmu::ToAbsoluteCortexDataPath(fs::path(model_entry.path_to_model_yaml))
+          .string();
+  config::YamlHandler yaml_handler;
+  yaml_handler.ModelConfigFromFile(yaml_path);
+  auto model_config = yaml_handler.GetModelConfig();
+  entry.engine = model_config.engine;
+
+  if (!engine_svc_->IsRemoteEngine(model_config.engine)) {
+    Json::Value obj = model_config.ToJson();
+    obj["id"] = model_entry.model;
+    obj["model"] = model_entry.model;
+    obj["status"] = "downloaded";
+    entry.status = "downloaded";
+    entry.size = model_config.size;
+    entry.object = std::move(obj);
+    source.estimate = true;
+  } else if (model_config.engine == kPythonEngine) {
+    config::PythonModelConfig python_model_config;
+    python_model_config.ReadFromYaml(yaml_path);
+    Json::Value obj = python_model_config.ToJson();
+    obj["id"] = model_entry.model;
+    obj["model"] = model_entry.model;
+    entry.object = std::move(obj);
+  } else {
+    config::RemoteModelConfig remote_model_config;
+    remote_model_config.LoadFromYamlFile(yaml_path);
+    Json::Value obj = remote_model_config.ToJson();
+    obj["id"] = model_entry.model;
+    obj["model"] = model_entry.model;
+    entry.object = std::move(obj);
+  }
+  return source;
+}
+
+void ModelService::AddRecommendation(CatalogSource& source) {
+  if (!source.estimate) {
+    return;
+  }
+  auto es = GetEstimation(source.entry.id);
+  if (es.has_value() && !!es.value()) {
+    source.entry.object["recommendation"] = hardware::ToJson(*(es.value()));
+  } else {
+    source.entry.object.removeMember("recommendation");
+  }
+}
+
+cpp::result<void, std::string> ModelService::SyncModelCatalog() {
+  // The catalog is rebuilt from a copy of its sources without holding
+  // catalog_mtx_, so the estimations don't block the readers, and swapped in
+  // when nothing newer was installed meanwhile
+  std::unordered_map<std::string, CatalogSource> previous;
+  uint64_t db_version;
+  uint64_t generation;
+  bool refresh;
+  {
+    std::lock_guard lock(catalog_mtx_);
+    db_version = db_service_->GetModelsVersion();
+    generation = catalog_generation_;
+    auto now = std::chrono::steady_clock::now();
+    refresh = now - catalog_refreshed_at_ >= kCatalogRefreshInterval;
+    if (!refresh && catalog_db_version_ == db_version) {
+      return {};
+    }
+    // the other readers keep the current recommendations until this one
+    // refreshed them
+    if (refresh) {
+      catalog_refreshed_at_ = now;
+    }
+    previous = catalog_sources_;
+  }
+
+  auto list_entry = db_service_->LoadModelList();
+  if (list_entry.has_error()) {
+    return cpp::fail(list_entry.error());
+  }
+
+  std::unordered_map<std::string, CatalogSource> sources;
+  std::vector<std::string> broken;
+  for (const auto& model_entry : list_entry.value()) {
+    auto key = GetCatalogKey(model_entry);
+    if (auto it = previous.find(model_entry.model);
+        it != previous.end() && it->second.key == key) {
+      auto source = std::move(it->second);
+      if (refresh) {
+        AddRecommendation(source);
+      }
+      sources.emplace(model_entry.model, std::move(source));
+      continue;
+    }
+    try {
+      auto source = BuildCatalogSource(model_entry, std::move(key));
+      AddRecommendation(source);
+      sources.emplace(model_entry.model, std::move(source));
+    } catch (const std::exception& e) {
+      CTL_WRN("Failed to load yaml file for model: "
+              << model_entry.path_to_model_yaml << ", error: " << e.what());
+      if (model_entry.status == cortex::db::ModelStatus::Downloaded) {
+        broken.push_back(model_entry.model);
+      }
+    }
+  }
+  // same cleanup as ForceIndexingModelList
+  if (!broken.empty()) {
+    if (auto res = db_service_->DeleteModelEntries(broken); res.has_error()) {
+      CTL_WRN("Failed to remove broken models: " << res.error());
+    }
+  }
+
+  std::vector<ModelCatalog::Entry> entries;
+  entries.reserve(sources.size());
+  for (const auto& [_, source] : sources) {
+    entries.push_back(source.entry);
+  }
+
+  std::lock_guard lock(catalog_mtx_);
+  // invalidated or synced from a newer database meanwhile, the next
+  // ListModels syncs again if needed
+  if (generation != catalog_generation_ ||
+      (catalog_db_version_ && *catalog_db_version_ > db_version)) {
+    return {};
+  }
+  if (model_catalog_.Replace(std::move(entries))) {
+    CTL_DBG("Model catalog updated, " << sources.size() << " models");
+  }
+  catalog_sources_ = std::move(sources);
+  catalog_db_version_ = db_version;
+  return {};
+}
+
+cpp::result<ModelCatalog::Response, std::string> ModelService::ListModels(
+    const ModelCatalog::Query& query) {
+  if (auto res = SyncModelCatalog(); res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  return model_catalog_.List(query);
+}
+
+void ModelService::InvalidateModelCatalog(const std::string& model_id) {
+  std::lock_guard lock(catalog_mtx_);
+  catalog_sources_.erase(model_id);
+  catalog_db_version_.reset();
+  catalog_generation_++;
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
 #include "common/engine_servicei.h"
@@ -9,7 +11,9 @@
 #include "services/database_service.h"
 #include "services/download_service.h"
 #include "services/hardware_service.h"
+#include "services/model_catalog.h"
 #include "utils/hardware/gguf/gguf_file_estimate.h"
+#include "utils/vocab_tokenizer.h"
 
 class InferenceService;
 
@@ -31,6 +35,14 @@ class ModelService {
  public:
   void ForceIndexingModelList();
 
+  /**
+   * Re-validate only the downloaded models whose files live under one of
+   * [changed_paths], and drop the broken ones from the database in a single
+   * transaction.
+   */
+  void ReconcileModels(
+      const std::vector<std::filesystem::path>& changed_paths);
+
   explicit ModelService(std::shared_ptr<DatabaseService> db_service,
                         std::shared_ptr<HardwareService> hw_service,
                         std::shared_ptr<DownloadService> download_service,
@@ -91,9 +103,48 @@ class ModelService {
   std::shared_ptr<ModelMetadata> GetCachedModelMetadata(
       const std::string& model_id) const;
 
+  // ctx_len the model was started with, nullopt if it is not loaded
+  std::optional<int> GetLoadedContextLength(const std::string& model_id) const;
+
   std::string GetEngineByModelId(const std::string& model_id) const;
 
+  /**
+   * Tokenizer built from the GGUF vocabulary of [model_id]. It is kept while
+   * the model is loaded, models which are not loaded get a fresh one.
+   */
+  cpp::result<std::shared_ptr<VocabTokenizer>, std::string> GetTokenizer(
+      const std::string& model_id);
+
+  /**
+   * The /v1/models response for [query]. The catalog is brought up to date
+   * first, re-reading only the models whose database row or YAML file
+   * changed since the previous call.
+   */
+  cpp::result<ModelCatalog::Response, std::string> ListModels(
+      const ModelCatalog::Query& query);
+
+  /**
+   * Rebuild the catalog item of [model_id] on the next ListModels, for
+   * writers that change its YAML file without touching the database.
+   */
+  void InvalidateModelCatalog(const std::string& model_id);
+
  private:
+  // Catalog item of a model and what it was built from
+  struct CatalogSource {
+    std::string key;
+    ModelCatalog::Entry entry;
+    // local models carry a hardware recommendation refreshed periodically
+    bool estimate = false;
+  };
+
+  cpp::result<void, std::string> SyncModelCatalog();
+
+  CatalogSource BuildCatalogSource(const cortex::db::ModelEntry& model_entry,
+                                   std::string key);
+
+  void AddRecommendation(CatalogSource& source);
+
   /**
    * Handle downloading model which have following pattern: author/model_name
    */
@@ -108,6 +159,10 @@ class ModelService {
   cpp::result<std::string, std::string> HandleCortexsoModel(
       const std::string& modelName);
 
+  // Absolute path of the first file of a downloaded model
+  cpp::result<std::filesystem::path, std::string> GetModelFile(
+      const std::string& model_id) const;
+
   cpp::result<std::optional<std::string>, std::string> MayFallbackToCpu(
       const std::string& model_path, int ngl, int ctx_len, int n_batch = 2048,
       int n_ubatch = 2048, const std::string& kv_cache_type = "f16");
@@ -124,4 +179,17 @@ class ModelService {
    */
   std::unordered_map<std::string, std::shared_ptr<ModelMetadata>>
       loaded_model_metadata_map_;
+  std::unordered_map<std::string, int> loaded_context_lengths_;
+
+  std::mutex tokenizers_mtx_;
+  std::unordered_map<std::string, std::shared_ptr<VocabTokenizer>>
+      tokenizers_;
+
+  ModelCatalog model_catalog_;
+  std::mutex catalog_mtx_;
+  std::unordered_map<std::string, CatalogSource> catalog_sources_;
+  std::optional<uint64_t> catalog_db_version_;
+  // bumped by InvalidateModelCatalog
+  uint64_t catalog_generation_ = 0;
+  std::chrono::steady_clock::time_point catalog_refreshed_at_;
 };
@@ -7,12 +7,17 @@
 #include "utils/file_manager_utils.h"
 #include "utils/huggingface_utils.h"
 #include "utils/logging_utils.h"
+#include "utils/parallel_utils.h"
 #include "utils/string_utils.h"
 #include "utils/url_parser.h"
 
 namespace hu = huggingface_utils;
 
 namespace {
+// Repos (and branches of a repo) synced at once. The HTTP requests actually
+// in flight are bounded by curl_utils.
+constexpr const size_t kMaxConcurrentRepos = 8;
+
 struct ModelInfo {
   std::string id;
   int likes;
@@ -63,7 +68,9 @@ std::vector<ModelInfo> ParseJsonString(const std::string& json_str) {
 
 ModelSourceService::ModelSourceService(
     std::shared_ptr<DatabaseService> db_service)
-    : db_service_(db_service) {
+    : db_service_(db_service),
+      http_cache_path_(file_manager_utils::GetCortexDataPath() / "cache" /
+                       "model_sources") {
   // TODO(sang) temporariy comment out because of race condition bug
   // sync_db_thread_ = std::thread(&ModelSourceService::SyncModelSource, this);
   running_ = true;
@@ -199,26 +206,72 @@ cpp::result<ModelSource, std::string> ModelSourceService::GetModelSource(
   return ms;
 }
 
+cpp::result<std::string, std::string> ModelSourceService::FetchCached(
+    const std::string& url, Fetches& fetches) {
+  auto res = curl_utils::ConditionalGet(url, http_cache_path_);
+  if (res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  if (res->modified) {
+    fetches.changed = true;
+  }
+  auto body = res->body;
+  if (res->cache_stale) {
+    std::lock_guard<std::mutex> l(fetches.mtx);
+    fetches.to_cache.push_back(std::move(res.value()));
+  }
+  return body;
+}
+
+cpp::result<Json::Value, std::string> ModelSourceService::FetchCachedJson(
+    const std::string& url, Fetches& fetches) {
+  auto res = FetchCached(url, fetches);
+  if (res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  Json::Value root;
+  Json::Reader reader;
+  if (!reader.parse(res.value(), root)) {
+    return cpp::fail("JSON from " + url +
+                     " parsing error: " + reader.getFormattedErrorMessages());
+  }
+  return root;
+}
+
+void ModelSourceService::CacheFetched(Fetches& fetches) {
+  if (fetches.db_failed) {
+    return;
+  }
+  std::lock_guard<std::mutex> l(fetches.mtx);
+  for (auto const& res : fetches.to_cache) {
+    curl_utils::CacheConditionalGet(res, http_cache_path_);
+  }
+  fetches.to_cache.clear();
+}
+
 cpp::result<bool, std::string> ModelSourceService::AddHfOrg(
     const std::string& model_source, const std::string& author) {
-  auto res = curl_utils::SimpleGet("https://huggingface.co/api/models?author=" +
-                                   author);
+  Fetches fetches;
+  auto res = FetchCached(hu::GetModelsByAuthorUrl(author), fetches);
   if (res.has_value()) {
     auto models = ParseJsonString(res.value());
     // Add new models
-    for (auto const& m : models) {
-      CTL_DBG(m.id);
-
-      auto author_model = string_utils::SplitBy(m.id, "/");
-      if (author_model.size() == 2) {
-        auto const& author = author_model[0];
-        auto const& model_name = author_model[1];
-        auto r = AddHfRepo(model_source + "/" + model_name, author, model_name);
-        if (r.has_error()) {
-          CTL_WRN(r.error());
-        }
-      }
-    }
+    parallel_utils::ParallelFor(
+        models.size(), kMaxConcurrentRepos, [&](size_t i) {
+          CTL_DBG(models[i].id);
+
+          auto author_model = string_utils::SplitBy(models[i].id, "/");
+          if (author_model.size() == 2) {
+            auto const& author = author_model[0];
+            auto const& model_name = author_model[1];
+            auto r =
+                AddHfRepo(model_source + "/" + model_name, author, model_name);
+            if (r.has_error()) {
+              CTL_WRN(r.error());
+            }
+          }
+        });
+    CacheFetched(fetches);
   } else {
     return cpp::fail(res.error());
   }
@@ -232,30 +285,82 @@ cpp::result<bool, std::string> ModelSourceService::AddHfRepo(
 
   auto model_list_before = db_service_->GetModels(model_source)
                                .value_or(std::vector<cortex::db::ModelEntry>{});
-  std::unordered_set<std::string> updated_model_list;
-  auto add_res = AddRepoSiblings(model_source, author, model_name);
+  // A repo already in the db is only rewritten if its metadata changed
+  Fetches fetches;
+  fetches.changed = model_list_before.empty();
+  auto add_res = AddRepoSiblings(model_source, author, model_name, fetches);
   if (add_res.has_error()) {
     return cpp::fail(add_res.error());
-  } else {
-    updated_model_list = add_res.value();
   }
+  if (!add_res->has_value()) {
+    CTL_DBG("Model source is up to date: " << model_source);
+    CacheFetched(fetches);
+    return true;
+  }
+
+  auto const& updated_model_list = add_res->value();
+  std::lock_guard<std::mutex> l(db_mtx_);
   for (auto const& mid : model_list_before) {
     if (updated_model_list.find(mid.model) == updated_model_list.end()) {
       if (auto del_res = db_service_->DeleteModelEntry(mid.model);
           del_res.has_error()) {
         CTL_INF(del_res.error());
+        fetches.db_failed = true;
       }
     }
   }
+  CacheFetched(fetches);
   return true;
 }
 
-cpp::result<std::unordered_set<std::string>, std::string>
+cpp::result<hu::HuggingFaceSiblingsFileSize, std::string>
+ModelSourceService::GetSiblingsFileSize(const std::string& author,
+                                        const std::string& model_name,
+                                        Fetches& fetches) {
+  auto result =
+      FetchCachedJson(hu::GetModelTreeUrl(author, model_name), fetches);
+  if (result.has_error()) {
+    return cpp::fail("Failed to get model siblings file size: " + author + "/" +
+                     model_name + "/tree/main");
+  }
+  auto r = result.value();
+
+  std::vector<std::string> dirs;
+  for (auto const& j : result.value()) {
+    if (j["type"].asString() == "directory") {
+      dirs.push_back(j["path"].asString());
+    }
+  }
+  std::vector<Json::Value> listings(dirs.size());
+  parallel_utils::ParallelFor(dirs.size(), kMaxConcurrentRepos, [&](size_t i) {
+    if (auto rd = FetchCachedJson(
+            hu::GetModelTreeUrl(author, model_name, "main", dirs[i]), fetches);
+        rd.has_value()) {
+      listings[i] = std::move(rd.value());
+    }
+  });
+  for (auto const& listing : listings) {
+    for (auto const& rdj : listing) {
+      r.append(rdj);
+    }
+  }
+
+  return hu::HuggingFaceSiblingsFileSize::FromJson(r);
+}
+
+cpp::result<std::optional<std::unordered_set<std::string>>, std::string>
 ModelSourceService::AddRepoSiblings(const std::string& model_source,
                                     const std::string& author,
-                                    const std::string& model_name) {
-  std::unordered_set<std::string> res;
-  auto repo_info = hu::GetHuggingFaceModelRepoInfo(author, model_name);
+                                    const std::string& model_name,
+                                    Fetches& fetches) {
+  auto repo_info_json =
+      FetchCachedJson(hu::GetModelRepoInfoUrl(author, model_name), fetches);
+  if (repo_info_json.has_error()) {
+    return cpp::fail("Failed to get model repository info: " + author + "/" +
+                     model_name);
+  }
+  auto repo_info =
+      hu::HuggingFaceModelRepoInfo::FromJson(repo_info_json.value());
   if (repo_info.has_error()) {
     return cpp::fail(repo_info.error());
   }
@@ -266,19 +371,24 @@ ModelSourceService::AddRepoSiblings(const std::string& model_source,
         "supported.");
   }
 
-  auto siblings_fs = hu::GetSiblingsFileSize(author, model_name);
+  auto siblings_fs = GetSiblingsFileSize(author, model_name, fetches);
 
   if (siblings_fs.has_error()) {
     return cpp::fail("Could not get siblings file size: " + author + "/" +
                      model_name);
   }
 
-  auto readme = hu::GetReadMe(author, model_name);
+  auto readme = FetchCached(hu::GetReadMeUrl(author, model_name), fetches);
   std::string desc;
   if (!readme.has_error()) {
     desc = readme.value();
   }
 
+  if (!fetches.changed) {
+    return std::nullopt;
+  }
+
+  std::unordered_set<std::string> res;
   auto meta_json = json_helper::ParseJsonString(repo_info->metadata);
   auto& siblings_fs_v = siblings_fs.value();
   for (auto& m : meta_json["siblings"]) {
@@ -291,6 +401,7 @@ ModelSourceService::AddRepoSiblings(const std::string& model_source,
   meta_json["description"] = desc;
   LOG_DEBUG << meta_json.toStyledString();
 
+  std::lock_guard<std::mutex> l(db_mtx_);
   for (const auto& sibling : repo_info->siblings) {
     if (string_utils::EndsWith(sibling.rfilename, ".gguf")) {
       if (siblings_fs_v.file_sizes.find(sibling.rfilename) !=
@@ -314,6 +425,7 @@ ModelSourceService::AddRepoSiblings(const std::string& model_source,
       if (!db_service_->HasModel(model_id)) {
         if (auto add_res = db_service_->AddModelEntry(e); add_res.has_error()) {
           CTL_INF(add_res.error());
+          fetches.db_failed = true;
         }
       } else {
         if (auto m = db_service_->GetModelInfo(model_id);
@@ -322,6 +434,7 @@ ModelSourceService::AddRepoSiblings(const std::string& model_source,
           if (auto upd_res = db_service_->UpdateModelEntry(model_id, e);
               upd_res.has_error()) {
             CTL_INF(upd_res.error());
+            fetches.db_failed = true;
           }
         }
       }
@@ -334,23 +447,25 @@ ModelSourceService::AddRepoSiblings(const std::string& model_source,
 
 cpp::result<bool, std::string> ModelSourceService::AddCortexsoOrg(
     const std::string& model_source) {
-  auto res = curl_utils::SimpleGet(
-      "https://huggingface.co/api/models?author=cortexso");
+  Fetches fetches;
+  auto res = FetchCached(hu::GetModelsByAuthorUrl("cortexso"), fetches);
   if (res.has_value()) {
     auto models = ParseJsonString(res.value());
-    for (auto const& m : models) {
-      CTL_INF(m.id);
-      auto author_model = string_utils::SplitBy(m.id, "/");
-      if (author_model.size() == 2) {
-        auto const& author = author_model[0];
-        auto const& model_name = author_model[1];
-        auto r = AddCortexsoRepo(model_source + "/" + model_name, author,
-                                 model_name);
-        if (r.has_error()) {
-          CTL_WRN(r.error());
-        }
-      }
-    }
+    parallel_utils::ParallelFor(
+        models.size(), kMaxConcurrentRepos, [&](size_t i) {
+          CTL_INF(models[i].id);
+          auto author_model = string_utils::SplitBy(models[i].id, "/");
+          if (author_model.size() == 2) {
+            auto const& author = author_model[0];
+            auto const& model_name = author_model[1];
+            auto r = AddCortexsoRepo(model_source + "/" + model_name, author,
+                                     model_name);
+            if (r.has_error()) {
+              CTL_WRN(r.error());
+            }
+          }
+        });
+    CacheFetched(fetches);
   } else {
     return cpp::fail(res.error());
   }
@@ -361,33 +476,76 @@ cpp::result<bool, std::string> ModelSourceService::AddCortexsoOrg(
 cpp::result<bool, std::string> ModelSourceService::AddCortexsoRepo(
     const std::string& model_source, const std::string& author,
     const std::string& model_name) {
-  auto branches =
-      huggingface_utils::GetModelRepositoryBranches("cortexso", model_name);
-  if (branches.has_error()) {
-    return cpp::fail(branches.error());
+  // Get models from db
+
+  auto model_list_before = db_service_->GetModels(model_source)
+                               .value_or(std::vector<cortex::db::ModelEntry>{});
+  // A repo already in the db is only rewritten if its metadata changed
+  Fetches fetches;
+  fetches.changed = model_list_before.empty();
+
+  auto refs =
+      FetchCachedJson(hu::GetModelRefsUrl("cortexso", model_name), fetches);
+  if (refs.has_error()) {
+    return cpp::fail("Failed to get model repository branches: cortexso/" +
+                     model_name);
+  }
+  std::vector<std::string> branches;
+  for (auto const& branch : refs.value()["branches"]) {
+    branches.push_back(branch["name"].asString());
   }
 
-  auto repo_info = hu::GetHuggingFaceModelRepoInfo(author, model_name);
+  auto repo_info_json =
+      FetchCachedJson(hu::GetModelRepoInfoUrl(author, model_name), fetches);
+  if (repo_info_json.has_error()) {
+    return cpp::fail("Failed to get model repository info: " + author + "/" +
+                     model_name);
+  }
+  auto repo_info =
+      hu::HuggingFaceModelRepoInfo::FromJson(repo_info_json.value());
   if (repo_info.has_error()) {
     return cpp::fail(repo_info.error());
   }
 
-  auto readme = hu::GetReadMe(author, model_name);
+  auto readme = FetchCached(hu::GetReadMeUrl(author, model_name), fetches);
   std::string desc;
   if (!readme.has_error()) {
     desc = readme.value();
   }
-  // Get models from db
 
-  auto model_list_before = db_service_->GetModels(model_source)
-                               .value_or(std::vector<cortex::db::ModelEntry>{});
-  std::unordered_set<std::string> updated_model_list;
+  // The branches of a repo are listed concurrently
+  std::vector<std::optional<Json::Value>> trees(branches.size());
+  parallel_utils::ParallelFor(
+      branches.size(), kMaxConcurrentRepos, [&](size_t i) {
+        if (auto tree = FetchCachedJson(
+                hu::GetModelTreeUrl("cortexso", model_name, branches[i]),
+                fetches);
+            tree.has_value()) {
+          trees[i] = std::move(tree.value());
+        } else {
+          CTL_INF("Model " + model_name + " not found - branch: " +
+                  branches[i]);
+        }
+      });
+
+  if (!fetches.changed) {
+    CTL_DBG("Model source is up to date: " << model_source);
+    CacheFetched(fetches);
+    return true;
+  }
 
-  for (auto const& [branch, _] : branches.value()) {
-    CTL_INF(branch);
-    auto add_res = AddCortexsoRepoBranch(model_source, author, model_name,
-                                         branch, repo_info->metadata, desc)
-                       .value_or(std::unordered_set<std::string>{});
+  std::unordered_set<std::string> updated_model_list;
+  std::lock_guard<std::mutex> l(db_mtx_);
+  for (size_t i = 0; i < branches.size(); i++) {
+    CTL_INF(branches[i]);
+    if (!trees[i].has_value()) {
+      continue;
+    }
+    auto add_res =
+        AddCortexsoRepoBranch(model_source, author, model_name, branches[i],
+                              trees[i].value(), repo_info->metadata, desc,
+                              fetches)
+            .value_or(std::unordered_set<std::string>{});
     for (auto const& a : add_res) {
       updated_model_list.insert(a);
     }
@@ -399,9 +557,11 @@ cpp::result<bool, std::string> ModelSourceService::AddCortexsoRepo(
       if (auto del_res = db_service_->DeleteModelEntry(mid.model);
           del_res.has_error()) {
         CTL_INF(del_res.error());
+        fetches.db_failed = true;
       }
     }
   }
+  CacheFetched(fetches);
   return true;
 }
 
@@ -410,24 +570,15 @@ ModelSourceService::AddCortexsoRepoBranch(const std::string& model_source,
                                           const std::string& author,
                                           const std::string& model_name,
                                           const std::string& branch,
+                                          const Json::Value& tree,
                                           const std::string& metadata,
-                                          const std::string& desc) {
+                                          const std::string& desc,
+                                          Fetches& fetches) {
   std::unordered_set<std::string> res;
 
-  url_parser::Url url = {
-      .protocol = "https",
-      .host = kHuggingFaceHost,
-      .pathParams = {"api", "models", "cortexso", model_name, "tree", branch},
-  };
-
-  auto result = curl_utils::SimpleGetJson(url.ToFullPath());
-  if (result.has_error()) {
-    return cpp::fail("Model " + model_name + " not found");
-  }
-
   bool has_gguf = false;
   uint64_t model_size = 0;
-  for (const auto& value : result.value()) {
+  for (const auto& value : tree) {
     auto path = value["path"].asString();
     if (path.find(".gguf") != std::string::npos) {
       has_gguf = true;
@@ -458,6 +609,7 @@ ModelSourceService::AddCortexsoRepoBranch(const std::string& model_source,
       if (auto res = db_service_->AddModelEntry(e);
           res.has_error() || !res.value()) {
         CTL_DBG("Cannot add model to db: " << model_id);
+        fetches.db_failed = true;
       }
     } else {
       if (auto m = db_service_->GetModelInfo(model_id);
@@ -465,6 +617,7 @@ ModelSourceService::AddCortexsoRepoBranch(const std::string& model_source,
         if (auto upd_res = db_service_->UpdateModelEntry(model_id, e);
             upd_res.has_error()) {
           CTL_INF(upd_res.error());
+          fetches.db_failed = true;
         }
       }
     }
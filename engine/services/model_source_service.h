@@ -1,9 +1,15 @@
 #pragma once
 #include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <optional>
 #include <thread>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include "services/database_service.h"
+#include "utils/curl_utils.h"
+#include "utils/huggingface_utils.h"
 #include "utils/result.hpp"
 
 struct ModelSourceInfo {
@@ -54,6 +60,32 @@ class ModelSourceService {
   cpp::result<ModelSource, std::string> GetModelSource(const std::string& src);
 
  private:
+  /**
+   * Responses fetched to sync a model source. They are only cached by
+   * CacheFetched once the db holds what was read from them, so that a sync
+   * failing halfway fetches them again instead of skipping them as unchanged.
+   */
+  struct Fetches {
+    // set if a response differs from the cached one
+    std::atomic<bool> changed{false};
+    // set if the db couldn't be updated, nothing is cached then
+    std::atomic<bool> db_failed{false};
+    std::mutex mtx;
+    std::vector<curl_utils::ConditionalGetResult> to_cache;
+  };
+
+  /**
+   * GET [url] through the on-disk HTTP cache, setting [fetches].changed if
+   * the response differs from the cached one.
+   */
+  cpp::result<std::string, std::string> FetchCached(const std::string& url,
+                                                    Fetches& fetches);
+
+  cpp::result<Json::Value, std::string> FetchCachedJson(const std::string& url,
+                                                        Fetches& fetches);
+
+  void CacheFetched(Fetches& fetches);
+
   cpp::result<bool, std::string> AddHfOrg(const std::string& model_source,
                                           const std::string& author);
 
@@ -61,9 +93,17 @@ class ModelSourceService {
                                            const std::string& author,
                                            const std::string& model_name);
 
-  cpp::result<std::unordered_set<std::string>, std::string> AddRepoSiblings(
-      const std::string& model_source, const std::string& author,
-      const std::string& model_name);
+  cpp::result<huggingface_utils::HuggingFaceSiblingsFileSize, std::string>
+  GetSiblingsFileSize(const std::string& author, const std::string& model_name,
+                      Fetches& fetches);
+
+  /**
+   * Add the GGUF files of a repo, returns std::nullopt without touching the
+   * db if nothing changed upstream, unless [fetches].changed was set before.
+   */
+  cpp::result<std::optional<std::unordered_set<std::string>>, std::string>
+  AddRepoSiblings(const std::string& model_source, const std::string& author,
+                  const std::string& model_name, Fetches& fetches);
 
   cpp::result<bool, std::string> AddCortexsoOrg(
       const std::string& model_source);
@@ -76,13 +116,18 @@ class ModelSourceService {
   AddCortexsoRepoBranch(const std::string& model_source,
                         const std::string& author,
                         const std::string& model_name,
-                        const std::string& branch, const std::string& metadata,
-                        const std::string& desc);
+                        const std::string& branch, const Json::Value& tree,
+                        const std::string& metadata, const std::string& desc,
+                        Fetches& fetches);
 
   void SyncModelSource();
 
  private:
   std::shared_ptr<DatabaseService> db_service_ = nullptr;
+  // metadata responses of the hub, revalidated with conditional requests
+  std::filesystem::path http_cache_path_;
+  // repos synced concurrently write to the db one at a time
+  std::mutex db_mtx_;
   std::thread sync_db_thread_;
   std::atomic<bool> running_;
 };
\ No newline at end of file
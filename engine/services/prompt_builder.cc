@@ -0,0 +1,271 @@
+#include "prompt_builder.h"
+#include "utils/logging_utils.h"
+
+namespace {
+constexpr const uint64_t kFnvOffset = 0xcbf29ce484222325ULL;
+
+uint64_t Fnv1a(std::string_view data, uint64_t hash) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+// Only these messages were covered by the append-stability probes
+bool IsPlainMessage(const nlohmann::ordered_json& message) {
+  if (!message.is_object() || message.contains("tool_calls")) {
+    return false;
+  }
+  auto role = message.value("role", "");
+  return role == "user" || role == "assistant";
+}
+
+bool HasSystemMessage(const nlohmann::ordered_json& messages) {
+  return !messages.empty() && messages[0].is_object() &&
+         messages[0].value("role", "") == "system";
+}
+
+/**
+ * The messages rendered around messages[end]: the system message, then the
+ * messages before [end] starting from one at the same position parity as
+ * the first conversation turn, so templates enforcing user/assistant
+ * alternation see a valid conversation.
+ */
+nlohmann::ordered_json Window(const nlohmann::ordered_json& messages,
+                              size_t end) {
+  size_t offset = HasSystemMessage(messages) ? 1 : 0;
+  auto window = nlohmann::ordered_json::array();
+  if (end <= offset) {
+    for (size_t i = 0; i < end; i++) {
+      window.push_back(messages[i]);
+    }
+    return window;
+  }
+  auto start = end - 1 - (end - 1 - offset) % 2;
+  for (size_t i = 0; i < offset; i++) {
+    window.push_back(messages[i]);
+  }
+  for (size_t i = start; i < end; i++) {
+    window.push_back(messages[i]);
+  }
+  return window;
+}
+
+// The text [after] adds to [before], nullopt if it is not an extension
+std::optional<std::string> Delta(const std::string& before,
+                                 std::string after) {
+  if (after.compare(0, before.size(), before) != 0) {
+    return std::nullopt;
+  }
+  return after.substr(before.size());
+}
+
+// Text rendered for messages[index], given everything before it
+std::optional<std::string> MessageDelta(const minja::chat_template& tmpl,
+                                        const nlohmann::ordered_json& messages,
+                                        size_t index) {
+  auto window = Window(messages, index);
+  auto before = tmpl.apply(window, nullptr, false);
+  window.push_back(messages[index]);
+  return Delta(before, tmpl.apply(window, nullptr, false));
+}
+
+// Text of the generation prompt after the first [end] messages
+std::optional<std::string> GenerationDelta(
+    const minja::chat_template& tmpl, const nlohmann::ordered_json& messages,
+    size_t end) {
+  auto window = Window(messages, end);
+  return Delta(tmpl.apply(window, nullptr, false),
+               tmpl.apply(window, nullptr, true));
+}
+
+nlohmann::ordered_json Slice(const nlohmann::ordered_json& messages,
+                             size_t end) {
+  auto res = nlohmann::ordered_json::array();
+  for (size_t i = 0; i < end; i++) {
+    res.push_back(messages[i]);
+  }
+  return res;
+}
+
+nlohmann::ordered_json ProbeMessage(const std::string& role,
+                                    const std::string& content) {
+  return {{"role", role}, {"content", content}};
+}
+}  // namespace
+
+PromptBuilder::PromptBuilder(Config config) : config_{std::move(config)} {}
+
+bool PromptBuilder::IsAppendStable(const minja::chat_template& tmpl) {
+  // Reasoning in past turns is a common reason for a template to render
+  // history differently once the conversation moves on
+  auto conversation = nlohmann::ordered_json::array(
+      {ProbeMessage("user", "probe question one"),
+       ProbeMessage("assistant", "<think>probe thought</think>probe answer"),
+       ProbeMessage("user", "probe question two"),
+       ProbeMessage("assistant", "probe answer two"),
+       ProbeMessage("user", "probe question three")});
+  auto with_system = nlohmann::ordered_json::array(
+      {ProbeMessage("system", "probe system prompt")});
+  for (auto const& m : conversation) {
+    with_system.push_back(m);
+  }
+
+  try {
+    for (auto const& probe : {conversation, with_system}) {
+      auto first = HasSystemMessage(probe) ? 2 : 1;
+      auto prefix = tmpl.apply(Slice(probe, first), nullptr, false);
+      for (size_t end = first; end <= probe.size(); end++) {
+        if (end > static_cast<size_t>(first)) {
+          auto delta = MessageDelta(tmpl, probe, end - 1);
+          if (!delta) {
+            return false;
+          }
+          prefix += *delta;
+        }
+        auto messages = Slice(probe, end);
+        auto generation = GenerationDelta(tmpl, probe, end);
+        if (!generation || prefix != tmpl.apply(messages, nullptr, false) ||
+            prefix + *generation != tmpl.apply(messages, nullptr, true)) {
+          return false;
+        }
+      }
+    }
+  } catch (const std::exception& e) {
+    CTL_DBG("Template rejected the probe conversation: " << e.what());
+    return false;
+  }
+  return true;
+}
+
+cpp::result<std::string, std::string> PromptBuilder::Render(
+    const std::string& tmpl, const nlohmann::ordered_json& messages,
+    const std::string& bos_token, const std::string& eos_token,
+    bool add_bos_token, bool add_eos_token, bool add_generation_prompt) {
+  try {
+    const auto& bos = add_bos_token ? bos_token : "";
+    const auto& eos = add_eos_token ? eos_token : "";
+    auto template_key = kFnvOffset;
+    for (auto const& part : {std::string_view(tmpl), std::string_view(bos),
+                             std::string_view(eos)}) {
+      template_key = Fnv1a(part, template_key);
+      template_key = Fnv1a(std::string_view("\0", 1), template_key);
+    }
+    auto t = GetTemplate(tmpl, bos, eos, template_key);
+    auto const& chat_tmpl = *t->chat_template;
+
+    if (!t->append_stable || !messages.is_array() || messages.empty() ||
+        !IsPlainMessage(messages.back())) {
+      return chat_tmpl.apply(messages, nullptr, add_generation_prompt);
+    }
+
+    // keys[n] identifies the first n messages
+    std::vector<uint64_t> keys{template_key};
+    keys.reserve(messages.size() + 1);
+    for (auto const& m : messages) {
+      keys.push_back(Fnv1a(m.dump(), keys.back()));
+    }
+
+    auto n = messages.size();
+    std::optional<std::string> prefix;
+    size_t cached = n;
+    for (; cached > 0; cached--) {
+      if (prefix = GetPrefix(keys[cached]); prefix) {
+        break;
+      }
+    }
+    for (auto i = cached; i < n && prefix; i++) {
+      auto delta = IsPlainMessage(messages[i])
+                       ? MessageDelta(chat_tmpl, messages, i)
+                       : std::nullopt;
+      if (delta) {
+        *prefix += *delta;
+      } else {
+        prefix.reset();
+      }
+    }
+    if (prefix) {
+      std::lock_guard<std::mutex> l(mtx_);
+      hits_++;
+    } else {
+      prefix = chat_tmpl.apply(messages, nullptr, false);
+    }
+
+    auto generation = add_generation_prompt
+                          ? GenerationDelta(chat_tmpl, messages, n)
+                          : std::optional<std::string>("");
+    if (!generation) {
+      return chat_tmpl.apply(messages, nullptr, add_generation_prompt);
+    }
+    auto prompt = *prefix + *generation;
+    PutPrefix(keys[n], std::move(*prefix));
+    return prompt;
+  } catch (const std::exception& e) {
+    return cpp::fail("Failed to render template: " + std::string(e.what()));
+  }
+}
+
+std::shared_ptr<PromptBuilder::Template> PromptBuilder::GetTemplate(
+    const std::string& tmpl, const std::string& bos_token,
+    const std::string& eos_token, uint64_t template_key) {
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    if (auto it = templates_.find(template_key); it != templates_.end()) {
+      return it->second;
+    }
+  }
+
+  auto chat_tmpl =
+      std::make_shared<minja::chat_template>(tmpl, bos_token, eos_token);
+  auto t = std::make_shared<Template>(
+      Template{.chat_template = chat_tmpl,
+               .append_stable = IsAppendStable(*chat_tmpl)});
+  CTL_INF("Chat template is " << (t->append_stable ? "" : "not ")
+                              << "append-stable, prompt prefixes are "
+                              << (t->append_stable ? "" : "not ")
+                              << "reused");
+  std::lock_guard<std::mutex> l(mtx_);
+  return templates_.emplace(template_key, t).first->second;
+}
+
+std::optional<std::string> PromptBuilder::GetPrefix(uint64_t key) {
+  std::lock_guard<std::mutex> l(mtx_);
+  if (auto it = index_.find(key); it != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->prefix;
+  }
+  return std::nullopt;
+}
+
+void PromptBuilder::PutPrefix(uint64_t key, std::string prefix) {
+  if (prefix.size() > config_.max_bytes) {
+    return;
+  }
+  std::lock_guard<std::mutex> l(mtx_);
+  if (auto it = index_.find(key); it != index_.end()) {
+    bytes_ -= it->second->prefix.size();
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+  bytes_ += prefix.size();
+  lru_.push_front(Node{.key = key, .prefix = std::move(prefix)});
+  index_[key] = lru_.begin();
+
+  while (bytes_ > config_.max_bytes && !lru_.empty()) {
+    auto& last = lru_.back();
+    bytes_ -= last.prefix.size();
+    index_.erase(last.key);
+    lru_.pop_back();
+  }
+}
+
+uint64_t PromptBuilder::GetMemoryBytes() const {
+  std::lock_guard<std::mutex> l(mtx_);
+  return bytes_;
+}
+
+uint64_t PromptBuilder::GetHits() const {
+  std::lock_guard<std::mutex> l(mtx_);
+  return hits_;
+}
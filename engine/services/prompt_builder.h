@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "utils/chat-template.hpp"
+#include "utils/result.hpp"
+
+/**
+ * Renders chat prompts incrementally across the turns of a conversation.
+ *
+ * The prompt of the first n messages, without generation prompt, is cached
+ * under a hash of the template and of those messages. When a later request
+ * extends the same history, only the new messages are rendered: each one in
+ * a small window made of the leading system message and the messages right
+ * before it, the difference between the window rendered with and without the
+ * new message being appended to the cached prefix.
+ *
+ * That only holds for templates which are append-stable, which is verified
+ * once per template by comparing incremental and full renders of probe
+ * conversations. Other templates, and messages the probes don't cover such as
+ * tool calls, always get a full render.
+ */
+class PromptBuilder {
+ public:
+  struct Config {
+    uint64_t max_bytes = 32 * 1024 * 1024;
+  };
+
+  explicit PromptBuilder(Config config);
+
+  cpp::result<std::string, std::string> Render(
+      const std::string& tmpl, const nlohmann::ordered_json& messages,
+      const std::string& bos_token, const std::string& eos_token,
+      bool add_bos_token, bool add_eos_token, bool add_generation_prompt);
+
+  /**
+   * Whether [tmpl] renders a conversation as the concatenation of its
+   * messages, so that a rendered prefix can be reused.
+   */
+  static bool IsAppendStable(const minja::chat_template& tmpl);
+
+  uint64_t GetMemoryBytes() const;
+
+  // Renders served from a cached prefix
+  uint64_t GetHits() const;
+
+ private:
+  struct Template {
+    std::shared_ptr<minja::chat_template> chat_template;
+    bool append_stable;
+  };
+
+  struct Node {
+    uint64_t key;
+    std::string prefix;
+  };
+
+  std::shared_ptr<Template> GetTemplate(const std::string& tmpl,
+                                        const std::string& bos_token,
+                                        const std::string& eos_token,
+                                        uint64_t template_key);
+
+  std::optional<std::string> GetPrefix(uint64_t key);
+
+  void PutPrefix(uint64_t key, std::string prefix);
+
+  Config config_;
+
+  mutable std::mutex mtx_;
+  std::unordered_map<uint64_t, std::shared_ptr<Template>> templates_;
+  std::list<Node> lru_;
+  std::unordered_map<uint64_t, std::list<Node>::iterator> index_;
+  uint64_t bytes_{0};
+  uint64_t hits_{0};
+};
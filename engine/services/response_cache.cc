@@ -0,0 +1,313 @@
+#include "response_cache.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string_view>
+#include "utils/json_helper.h"
+#include "utils/logging_utils.h"
+
+namespace {
+constexpr const int k200OK = 200;
+
+// Fields which don't change what the engine generates
+const std::vector<std::string> kIgnoredFields{"user", "metadata",
+                                              "thread_id"};
+
+// FNV-1a, stable across runs so spilled entries stay valid after a restart
+uint64_t Fnv1a(const std::string& data, uint64_t hash) {
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+std::string ToHex(uint64_t v) {
+  std::ostringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << v;
+  return ss.str();
+}
+
+bool IsFinal(const Json::Value& status) {
+  return status.get("is_done", false).asBool() ||
+         status.get("has_error", false).asBool() ||
+         !status.get("is_stream", false).asBool();
+}
+
+// False if a choice of [res], a response or a stream chunk, ended for another
+// reason than a natural stop, e.g. "length" when it hit the token limit
+bool StoppedNaturally(const Json::Value& res) {
+  if (!res.isObject()) {
+    return true;
+  }
+  auto const& data = res["data"];
+  if (data.isString()) {
+    // stream chunk "data: {...}\n\n"
+    constexpr const std::string_view kPrefix = "data: ";
+    auto s = data.asString();
+    if (s.find("finish_reason") == std::string::npos ||
+        s.compare(0, kPrefix.size(), kPrefix) != 0) {
+      return true;
+    }
+    return StoppedNaturally(
+        json_helper::ParseJsonString(s.substr(kPrefix.size())));
+  }
+  if (!res["choices"].isArray()) {
+    return true;
+  }
+  for (auto const& choice : res["choices"]) {
+    auto const& reason = choice.get("finish_reason", Json::Value());
+    if (reason.isString() && reason.asString() != "stop" &&
+        reason.asString() != "tool_calls") {
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+ResponseCache::ResponseCache(Config config) : config_{std::move(config)} {
+  if (config_.disk_max_bytes > 0) {
+    LoadDiskIndex();
+  }
+}
+
+bool ResponseCache::IsCacheable(const Json::Value& body, bool is_embedding) {
+  if (is_embedding) {
+    return true;
+  }
+  if (body.get("n", 1).asInt() > 1) {
+    return false;
+  }
+  return body.isMember("temperature") && body["temperature"].isNumeric() &&
+         body["temperature"].asDouble() == 0;
+}
+
+std::string ResponseCache::GetFileIdentity(const std::filesystem::path& path) {
+  std::error_code ec;
+  auto mtime = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return "";
+  }
+  auto identity = path.string() + "@" +
+                  std::to_string(mtime.time_since_epoch().count());
+  // models of the python engine are folders
+  if (auto size = std::filesystem::file_size(path, ec); !ec) {
+    identity += ":" + std::to_string(size);
+  }
+  return identity;
+}
+
+std::string ResponseCache::MakeKey(const std::string& kind,
+                                   const Json::Value& body,
+                                   const std::string& model_file) {
+  Json::Value canonical = body;
+  for (auto const& f : kIgnoredFields) {
+    canonical.removeMember(f);
+  }
+  // Json::Value keeps object members sorted, so the dump is canonical. Two
+  // differently seeded hashes make collisions practically impossible.
+  auto data = kind + "\n" + model_file + "\n" +
+              json_helper::DumpJsonString(canonical);
+  return ToHex(Fnv1a(data, 0xcbf29ce484222325ULL)) +
+         ToHex(Fnv1a(data, 0x84222325cbf29ce4ULL));
+}
+
+std::optional<ResponseCache::Entry> ResponseCache::Get(const std::string& key) {
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    if (auto it = index_.find(key); it != index_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second);
+      return it->second->entry;
+    }
+  }
+
+  if (config_.disk_max_bytes == 0) {
+    return std::nullopt;
+  }
+  auto entry = ReadFromDisk(key);
+  if (entry) {
+    // promote back to memory
+    Put(key, *entry);
+  }
+  return entry;
+}
+
+void ResponseCache::Put(const std::string& key, Entry entry) {
+  auto bytes = EntrySize(entry);
+  if (bytes > config_.max_bytes) {
+    return;
+  }
+
+  std::vector<Node> evicted;
+  {
+    std::lock_guard<std::mutex> l(mtx_);
+    if (auto it = index_.find(key); it != index_.end()) {
+      bytes_ -= it->second->bytes;
+      lru_.erase(it->second);
+      index_.erase(it);
+    }
+    lru_.push_front(Node{.key = key, .entry = std::move(entry), .bytes = bytes});
+    index_[key] = lru_.begin();
+    bytes_ += bytes;
+
+    while (bytes_ > config_.max_bytes && !lru_.empty()) {
+      auto& last = lru_.back();
+      bytes_ -= last.bytes;
+      index_.erase(last.key);
+      evicted.push_back(std::move(last));
+      lru_.pop_back();
+    }
+  }
+
+  if (config_.disk_max_bytes > 0 && !evicted.empty()) {
+    Spill(evicted);
+  }
+}
+
+ResponseCache::Callback ResponseCache::Record(
+    const std::string& key, Callback next,
+    std::shared_ptr<RequestCancellation> cancellation) {
+  struct State {
+    Entry entry;
+    bool failed = false;
+  };
+  auto state = std::make_shared<State>();
+  return [this, key, state, next = std::move(next),
+          cancellation = std::move(cancellation)](Json::Value&& status,
+                                                  Json::Value&& res) {
+    if (status.get("has_error", false).asBool() ||
+        status.get("status_code", k200OK).asInt() != k200OK ||
+        !StoppedNaturally(res)) {
+      state->failed = true;
+    }
+    auto final = IsFinal(status);
+    if (!state->failed) {
+      state->entry.emplace_back(status, res);
+    }
+    next(std::move(status), std::move(res));
+    // a stopped request may still end with a regular final chunk
+    if (final && !state->failed &&
+        !(cancellation && cancellation->IsCancelled())) {
+      Put(key, std::move(state->entry));
+    }
+  };
+}
+
+uint64_t ResponseCache::GetMemoryBytes() const {
+  std::lock_guard<std::mutex> l(mtx_);
+  return bytes_;
+}
+
+uint64_t ResponseCache::EntrySize(const Entry& entry) {
+  // rough estimate, the serialized size is what matters for the budget
+  uint64_t n = 0;
+  for (auto const& [status, res] : entry) {
+    n += json_helper::DumpJsonString(status).size() +
+         json_helper::DumpJsonString(res).size();
+  }
+  return n;
+}
+
+std::filesystem::path ResponseCache::DiskFile(const std::string& key) const {
+  return config_.disk_path / (key + ".json");
+}
+
+void ResponseCache::LoadDiskIndex() {
+  std::error_code ec;
+  if (!std::filesystem::exists(config_.disk_path, ec)) {
+    return;
+  }
+  std::vector<std::pair<std::filesystem::file_time_type,
+                        std::pair<std::string, uint64_t>>>
+      files;
+  for (auto const& e :
+       std::filesystem::directory_iterator(config_.disk_path, ec)) {
+    if (!e.is_regular_file() || e.path().extension() != ".json") {
+      continue;
+    }
+    files.push_back({e.last_write_time(ec),
+                     {e.path().stem().string(), e.file_size(ec)}});
+  }
+  std::sort(files.begin(), files.end(),
+            [](auto const& a, auto const& b) { return a.first < b.first; });
+
+  std::lock_guard<std::mutex> l(disk_mtx_);
+  for (auto& [_, f] : files) {
+    disk_lru_.push_back(f);
+    disk_index_[f.first] = std::prev(disk_lru_.end());
+    disk_bytes_ += f.second;
+  }
+  CTL_INF("Response cache has " << disk_index_.size() << " entries on disk, "
+                                << disk_bytes_ << " bytes");
+}
+
+void ResponseCache::Spill(const std::vector<Node>& evicted) {
+  std::lock_guard<std::mutex> l(disk_mtx_);
+  std::error_code ec;
+  std::filesystem::create_directories(config_.disk_path, ec);
+  for (auto const& node : evicted) {
+    if (disk_index_.find(node.key) != disk_index_.end()) {
+      continue;
+    }
+    Json::Value root(Json::arrayValue);
+    for (auto const& [status, res] : node.entry) {
+      Json::Value r;
+      r["status"] = status;
+      r["res"] = res;
+      root.append(std::move(r));
+    }
+    auto data = json_helper::DumpJsonString(root);
+    std::ofstream file(DiskFile(node.key), std::ios::binary);
+    if (!file) {
+      CTL_WRN("Could not write response cache file for " << node.key);
+      continue;
+    }
+    file << data;
+    file.close();
+
+    disk_lru_.emplace_back(node.key, data.size());
+    disk_index_[node.key] = std::prev(disk_lru_.end());
+    disk_bytes_ += data.size();
+  }
+
+  while (disk_bytes_ > config_.disk_max_bytes && !disk_lru_.empty()) {
+    auto& [key, bytes] = disk_lru_.front();
+    std::filesystem::remove(DiskFile(key), ec);
+    disk_bytes_ -= bytes;
+    disk_index_.erase(key);
+    disk_lru_.pop_front();
+  }
+}
+
+std::optional<ResponseCache::Entry> ResponseCache::ReadFromDisk(
+    const std::string& key) {
+  std::lock_guard<std::mutex> l(disk_mtx_);
+  auto it = disk_index_.find(key);
+  if (it == disk_index_.end()) {
+    return std::nullopt;
+  }
+
+  std::ifstream file(DiskFile(key), std::ios::binary);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  auto root = json_helper::ParseJsonString(buffer.str());
+
+  // the entry moves back to memory either way
+  std::error_code ec;
+  std::filesystem::remove(DiskFile(key), ec);
+  disk_bytes_ -= it->second->second;
+  disk_lru_.erase(it->second);
+  disk_index_.erase(it);
+
+  if (!root.isArray() || root.empty()) {
+    CTL_WRN("Invalid response cache file for " << key);
+    return std::nullopt;
+  }
+  Entry entry;
+  for (auto const& r : root) {
+    entry.emplace_back(r["status"], r["res"]);
+  }
+  return entry;
+}
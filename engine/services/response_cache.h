@@ -0,0 +1,107 @@
+#pragma once
+
+#include <json/json.h>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "common/request_cancellation.h"
+
+/**
+ * Exact-match cache for deterministic inference results.
+ *
+ * An entry is the full sequence of (status, result) pairs the engine produced
+ * for a request, so a cached stream is replayed chunk by chunk exactly as the
+ * engine sent it. Entries are kept in memory under a byte budget and evicted
+ * in LRU order; evicted entries can spill to disk under their own budget.
+ */
+class ResponseCache {
+ public:
+  using Result = std::pair<Json::Value, Json::Value>;
+  using Entry = std::vector<Result>;
+  using Callback = std::function<void(Json::Value&&, Json::Value&&)>;
+
+  struct Config {
+    uint64_t max_bytes = 64 * 1024 * 1024;
+    // 0 disables spilling to disk
+    uint64_t disk_max_bytes = 0;
+    std::filesystem::path disk_path;
+  };
+
+  explicit ResponseCache(Config config);
+
+  /**
+   * Embeddings are always deterministic. Completions only are with greedy
+   * sampling (temperature 0) and a single choice. top_k 1 is not enough, some
+   * engines ignore it and still sample with the temperature and seed.
+   */
+  static bool IsCacheable(const Json::Value& body, bool is_embedding);
+
+  /**
+   * Identity of the model file at [path]: the path with its modification
+   * time and size. Empty if the file can't be read.
+   */
+  static std::string GetFileIdentity(const std::filesystem::path& path);
+
+  /**
+   * Canonical key of a request: a hash over the request body with keys in
+   * sorted order, ignoring fields that don't affect the output. [model_file]
+   * is the identity of the model serving it, so that the results of a model
+   * replaced under the same name are not served anymore.
+   */
+  static std::string MakeKey(const std::string& kind, const Json::Value& body,
+                             const std::string& model_file = "");
+
+  std::optional<Entry> Get(const std::string& key);
+
+  void Put(const std::string& key, Entry entry);
+
+  /**
+   * Wrap [next] so the results passing through are stored under [key] once
+   * the request finished successfully: without error, with every choice
+   * stopped by the model (not cut at the token limit), and without
+   * [cancellation] being cancelled.
+   */
+  Callback Record(const std::string& key, Callback next,
+                  std::shared_ptr<RequestCancellation> cancellation = nullptr);
+
+  uint64_t GetMemoryBytes() const;
+
+ private:
+  struct Node {
+    std::string key;
+    Entry entry;
+    uint64_t bytes;
+  };
+
+  static uint64_t EntrySize(const Entry& entry);
+
+  std::filesystem::path DiskFile(const std::string& key) const;
+
+  void LoadDiskIndex();
+
+  void Spill(const std::vector<Node>& evicted);
+
+  std::optional<Entry> ReadFromDisk(const std::string& key);
+
+  Config config_;
+
+  mutable std::mutex mtx_;
+  std::list<Node> lru_;
+  std::unordered_map<std::string, std::list<Node>::iterator> index_;
+  uint64_t bytes_{0};
+
+  // Spilled entries in the order they were written, oldest first
+  std::mutex disk_mtx_;
+  std::list<std::pair<std::string, uint64_t>> disk_lru_;
+  std::unordered_map<std::string,
+                     std::list<std::pair<std::string, uint64_t>>::iterator>
+      disk_index_;
+  uint64_t disk_bytes_{0};
+};
@@ -0,0 +1,69 @@
+#include "session_affinity.h"
+#include <vector>
+
+SessionAffinity::SessionAffinity(Config config) : config_{std::move(config)} {}
+
+void SessionAffinity::SetModelSlots(const std::string& model, int slots) {
+  std::lock_guard<std::mutex> l(mtx_);
+  if (slots <= 0) {
+    models_.erase(model);
+    return;
+  }
+  Model m;
+  m.slots = slots;
+  models_[model] = std::move(m);
+}
+
+void SessionAffinity::RemoveModel(const std::string& model) {
+  std::lock_guard<std::mutex> l(mtx_);
+  models_.erase(model);
+}
+
+std::optional<int> SessionAffinity::Acquire(const std::string& model,
+                                            const std::string& session) {
+  std::lock_guard<std::mutex> l(mtx_);
+  auto it = models_.find(model);
+  if (it == models_.end()) {
+    return std::nullopt;
+  }
+  auto& m = it->second;
+  auto now = Clock::now();
+
+  while (!m.lru.empty() &&
+         now - m.lru.back().last_used > config_.idle_timeout) {
+    m.index.erase(m.lru.back().key);
+    m.lru.pop_back();
+  }
+
+  if (auto s = m.index.find(session); s != m.index.end()) {
+    s->second->last_used = now;
+    m.lru.splice(m.lru.begin(), m.lru, s->second);
+    return s->second->slot;
+  }
+
+  int slot = 0;
+  if (m.lru.size() >= static_cast<size_t>(m.slots)) {
+    slot = m.lru.back().slot;
+    m.index.erase(m.lru.back().key);
+    m.lru.pop_back();
+  } else {
+    std::vector<bool> used(m.slots, false);
+    for (auto const& s : m.lru) {
+      used[s.slot] = true;
+    }
+    while (used[slot]) {
+      slot++;
+    }
+  }
+  m.lru.push_front(Session{.key = session, .slot = slot, .last_used = now});
+  m.index[session] = m.lru.begin();
+  return slot;
+}
+
+size_t SessionAffinity::GetSessionCount(const std::string& model) const {
+  std::lock_guard<std::mutex> l(mtx_);
+  if (auto it = models_.find(model); it != models_.end()) {
+    return it->second.lru.size();
+  }
+  return 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Pins conversations to engine slots so a session keeps hitting the slot
+ * that holds its KV cache.
+ *
+ * Each model has as many slots as it serves requests in parallel. A session
+ * keeps its slot until it has been idle for longer than the idle timeout;
+ * when every slot is taken, the least recently used session gives its slot
+ * up to the new one.
+ */
+class SessionAffinity {
+ public:
+  struct Config {
+    std::chrono::milliseconds idle_timeout{std::chrono::minutes(10)};
+  };
+
+  explicit SessionAffinity(Config config);
+
+  /**
+   * Set the number of slots of [model], which drops its sessions.
+   */
+  void SetModelSlots(const std::string& model, int slots);
+
+  void RemoveModel(const std::string& model);
+
+  /**
+   * The slot pinned to [session] on [model], nullopt if the slots of the
+   * model are unknown.
+   */
+  std::optional<int> Acquire(const std::string& model,
+                             const std::string& session);
+
+  size_t GetSessionCount(const std::string& model) const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Session {
+    std::string key;
+    int slot;
+    Clock::time_point last_used;
+  };
+
+  struct Model {
+    int slots = 0;
+    // most recently used first
+    std::list<Session> lru;
+    std::unordered_map<std::string, std::list<Session>::iterator> index;
+  };
+
+  Config config_;
+  mutable std::mutex mtx_;
+  std::unordered_map<std::string, Model> models_;
+};
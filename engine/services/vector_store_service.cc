@@ -0,0 +1,507 @@
+#include "vector_store_service.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include "utils/logging_utils.h"
+#include "utils/ulid_generator.h"
+
+namespace {
+// Number of chunks sent to the embedding model per request
+constexpr const size_t kEmbeddingBatchSize = 64;
+// Threads running the create and search requests off the IO threads
+constexpr const size_t kRequestThreads = 4;
+
+uint64_t NowSeconds() {
+  return std::chrono::duration_cast<std::chrono::seconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+bool IsUtf8Continuation(char c) {
+  return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+bool IsBlank(const std::string& s) {
+  return std::all_of(s.begin(), s.end(), [](unsigned char c) {
+    return std::isspace(c);
+  });
+}
+}  // namespace
+
+VectorStoreService::VectorStoreService(
+    std::shared_ptr<VectorStoreRepository> repository,
+    std::shared_ptr<FileService> file_service,
+    std::shared_ptr<InferenceService> inference_service,
+    VectorIndex::Config index_config)
+    : repository_{repository},
+      file_service_{file_service},
+      inference_service_{inference_service},
+      index_config_{index_config},
+      requests_{kRequestThreads, "vector_store"} {
+  ResumeIngestion();
+  worker_ = std::thread([this] { WorkerLoop(); });
+}
+
+VectorStoreService::~VectorStoreService() {
+  {
+    std::lock_guard<std::mutex> l(tasks_mtx_);
+    stop_ = true;
+  }
+  tasks_cv_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+std::vector<std::string> VectorStoreService::ChunkText(const std::string& text,
+                                                       size_t max_chars,
+                                                       size_t overlap) {
+  std::vector<std::string> chunks;
+  if (max_chars == 0) {
+    return chunks;
+  }
+  if (overlap >= max_chars) {
+    overlap = max_chars / 2;
+  }
+
+  size_t start = 0;
+  auto n = text.size();
+  while (start < n) {
+    auto end = std::min(start + max_chars, n);
+    if (end < n) {
+      // cut after the last whitespace in the second half of the window
+      auto ws = text.find_last_of(" \t\r\n", end - 1);
+      if (ws != std::string::npos && ws >= start + max_chars / 2) {
+        end = ws + 1;
+      }
+      while (end > start + 1 && IsUtf8Continuation(text[end])) {
+        end--;
+      }
+    }
+    auto chunk = text.substr(start, end - start);
+    if (!IsBlank(chunk)) {
+      chunks.push_back(std::move(chunk));
+    }
+    if (end >= n) {
+      break;
+    }
+
+    // the overlap starts at a word boundary too when there is one
+    auto next = end > overlap ? end - overlap : end;
+    if (auto ws = text.find_first_of(" \t\r\n", next); ws < end) {
+      next = ws + 1;
+    }
+    if (next <= start) {
+      next = end;
+    }
+    while (next < n && IsUtf8Continuation(text[next])) {
+      next++;
+    }
+    start = next;
+  }
+  return chunks;
+}
+
+void VectorStoreService::CreateVectorStore(OpenAi::VectorStore store,
+                                           std::vector<std::string> file_ids,
+                                           CreateCallback callback) {
+  requests_.runTaskInQueue([this, store = std::move(store),
+                            file_ids = std::move(file_ids),
+                            callback = std::move(callback)]() mutable {
+    callback(DoCreateVectorStore(std::move(store), file_ids));
+  });
+}
+
+void VectorStoreService::Search(std::string store_id, std::string query,
+                                size_t max_num_results, float score_threshold,
+                                SearchCallback callback) {
+  requests_.runTaskInQueue([this, store_id = std::move(store_id),
+                            query = std::move(query), max_num_results,
+                            score_threshold, callback = std::move(callback)] {
+    callback(DoSearch(store_id, query, max_num_results, score_threshold));
+  });
+}
+
+cpp::result<OpenAi::VectorStore, std::string>
+VectorStoreService::DoCreateVectorStore(
+    OpenAi::VectorStore store, const std::vector<std::string>& file_ids) {
+  if (store.embedding_model.empty()) {
+    return cpp::fail("An embedding model is required");
+  }
+  store.id = "vs_" + ulid::GenerateUlid();
+  store.created_at = NowSeconds();
+  store.status = "completed";
+  store.usage_bytes = 0;
+  store.file_counts = Json::Value(Json::objectValue);
+
+  if (auto res = repository_->CreateVectorStore(store); res.has_error()) {
+    return cpp::fail("Failed to create vector store: " + res.error());
+  }
+  UpdateFileCounts(store.id);
+  for (auto const& file_id : file_ids) {
+    if (auto res = AddFile(store.id, file_id); res.has_error()) {
+      CTL_WRN("Failed to attach " << file_id << " to " << store.id << ": "
+                                  << res.error());
+    }
+  }
+  return repository_->RetrieveVectorStore(store.id);
+}
+
+cpp::result<std::vector<OpenAi::VectorStore>, std::string>
+VectorStoreService::ListVectorStores(uint8_t limit, const std::string& order,
+                                     const std::string& after) const {
+  return repository_->ListVectorStores(limit, order, after);
+}
+
+cpp::result<OpenAi::VectorStore, std::string>
+VectorStoreService::RetrieveVectorStore(const std::string& store_id) const {
+  return repository_->RetrieveVectorStore(store_id);
+}
+
+cpp::result<void, std::string> VectorStoreService::DeleteVectorStore(
+    const std::string& store_id) {
+  {
+    std::lock_guard<std::mutex> l(stores_mtx_);
+    stores_.erase(store_id);
+  }
+  return repository_->DeleteVectorStore(store_id);
+}
+
+cpp::result<OpenAi::VectorStoreFile, std::string> VectorStoreService::AddFile(
+    const std::string& store_id, const std::string& file_id) {
+  if (auto store = repository_->RetrieveVectorStore(store_id);
+      store.has_error()) {
+    return cpp::fail(store.error());
+  }
+  if (auto file = file_service_->RetrieveFile(file_id); file.has_error()) {
+    return cpp::fail("File not found: " + file_id);
+  }
+  if (auto files = repository_->ListVectorStoreFiles(store_id);
+      files.has_value()) {
+    for (auto& f : files.value()) {
+      // already attached, its chunks are in the index
+      if (f.id == file_id && f.status != "failed") {
+        return std::move(f);
+      }
+    }
+  }
+
+  OpenAi::VectorStoreFile vs_file;
+  vs_file.id = file_id;
+  vs_file.vector_store_id = store_id;
+  vs_file.created_at = NowSeconds();
+  vs_file.status = "in_progress";
+  if (auto res = repository_->SaveVectorStoreFile(vs_file); res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  UpdateFileCounts(store_id);
+
+  {
+    std::lock_guard<std::mutex> l(tasks_mtx_);
+    tasks_.push_back(IngestTask{.store_id = store_id, .file_id = file_id});
+  }
+  tasks_cv_.notify_one();
+  return vs_file;
+}
+
+cpp::result<std::vector<OpenAi::VectorStoreFile>, std::string>
+VectorStoreService::ListFiles(const std::string& store_id) const {
+  return repository_->ListVectorStoreFiles(store_id);
+}
+
+cpp::result<std::vector<VectorStoreService::SearchResult>, std::string>
+VectorStoreService::DoSearch(const std::string& store_id,
+                             const std::string& query, size_t max_num_results,
+                             float score_threshold) {
+  auto store = repository_->RetrieveVectorStore(store_id);
+  if (store.has_error()) {
+    return cpp::fail(store.error());
+  }
+  auto loaded = GetLoadedStore(store_id);
+  if (loaded.has_error()) {
+    return cpp::fail(loaded.error());
+  }
+  auto embedding = Embed(store->embedding_model, {query});
+  if (embedding.has_error()) {
+    return cpp::fail(embedding.error());
+  }
+
+  auto& ls = *loaded.value();
+  std::lock_guard<std::mutex> l(ls.mtx);
+  auto matches =
+      ls.index->Search(embedding->front(), max_num_results, score_threshold);
+
+  std::unordered_map<std::string, std::string> filenames;
+  std::vector<SearchResult> results;
+  for (auto const& m : matches) {
+    if (m.row >= ls.chunks.size()) {
+      continue;
+    }
+    auto const& chunk = ls.chunks[m.row];
+    auto it = filenames.find(chunk.file_id);
+    if (it == filenames.end()) {
+      auto file = file_service_->RetrieveFile(chunk.file_id);
+      it = filenames
+               .emplace(chunk.file_id,
+                        file.has_value() ? file->filename : std::string())
+               .first;
+    }
+    results.push_back(SearchResult{.file_id = chunk.file_id,
+                                   .filename = it->second,
+                                   .score = m.score,
+                                   .text = chunk.text});
+  }
+  return results;
+}
+
+cpp::result<std::shared_ptr<VectorStoreService::LoadedStore>, std::string>
+VectorStoreService::GetLoadedStore(const std::string& store_id) {
+  std::lock_guard<std::mutex> l(stores_mtx_);
+  if (auto it = stores_.find(store_id); it != stores_.end()) {
+    return it->second;
+  }
+
+  auto index =
+      VectorIndex::Open(repository_->GetIndexPath(store_id), index_config_);
+  if (index.has_error()) {
+    return cpp::fail(index.error());
+  }
+  auto chunks = repository_->LoadChunks(store_id);
+  if (chunks.has_error()) {
+    return cpp::fail(chunks.error());
+  }
+
+  // Chunks are written before their vectors; extra chunks belong to an
+  // ingestion that didn't finish
+  auto vector_count = index.value()->Size();
+  if (chunks->size() > vector_count) {
+    CTL_WRN("Dropping " << chunks->size() - vector_count
+                        << " orphan chunks of " << store_id);
+    if (auto res = repository_->TruncateChunks(store_id, vector_count);
+        res.has_error()) {
+      return cpp::fail(res.error());
+    }
+    chunks->resize(vector_count);
+  }
+
+  auto ls = std::make_shared<LoadedStore>();
+  ls->index = std::move(index.value());
+  ls->chunks = std::move(chunks.value());
+  stores_[store_id] = ls;
+  return ls;
+}
+
+cpp::result<std::vector<std::vector<float>>, std::string>
+VectorStoreService::Embed(const std::string& model,
+                          const std::vector<std::string>& inputs) {
+  auto body = std::make_shared<Json::Value>();
+  (*body)["model"] = model;
+  (*body)["input"] = Json::Value(Json::arrayValue);
+  for (auto const& input : inputs) {
+    (*body)["input"].append(input);
+  }
+
+  auto q = std::make_shared<SyncQueue>();
+  auto ir = inference_service_->HandleEmbedding(q, body);
+  if (ir.has_error()) {
+    return cpp::fail("Failed to embed with " + model + ": " +
+                     ir.error().second["message"].asString());
+  }
+  auto [status, res] = q->wait_and_pop();
+  if (status["has_error"].asBool() ||
+      status.get("status_code", 200).asInt() != 200) {
+    return cpp::fail("Failed to embed with " + model + ": " +
+                     res.get("message", res.toStyledString()).asString());
+  }
+
+  auto const& data = res["data"];
+  if (!data.isArray() || data.size() != inputs.size()) {
+    return cpp::fail("Unexpected embedding response from " + model);
+  }
+  std::vector<std::vector<float>> vectors(inputs.size());
+  for (Json::ArrayIndex i = 0; i < data.size(); i++) {
+    auto index = data[i].get("index", i).asUInt();
+    if (index >= vectors.size()) {
+      return cpp::fail("Unexpected embedding response from " + model);
+    }
+    auto const& embedding = data[i]["embedding"];
+    auto& v = vectors[index];
+    v.reserve(embedding.size());
+    for (auto const& x : embedding) {
+      v.push_back(x.asFloat());
+    }
+  }
+  return vectors;
+}
+
+cpp::result<uint64_t, std::string> VectorStoreService::Ingest(
+    const IngestTask& task) {
+  auto store = repository_->RetrieveVectorStore(task.store_id);
+  if (store.has_error()) {
+    return cpp::fail(store.error());
+  }
+  auto loaded = GetLoadedStore(task.store_id);
+  if (loaded.has_error()) {
+    return cpp::fail(loaded.error());
+  }
+  auto& ls = *loaded.value();
+
+  {
+    // A resumed file whose vectors were added before the server stopped,
+    // only its status was lost
+    std::lock_guard<std::mutex> l(ls.mtx);
+    uint64_t usage_bytes = 0;
+    uint64_t chunk_count = 0;
+    for (auto const& chunk : ls.chunks) {
+      if (chunk.file_id == task.file_id) {
+        usage_bytes += chunk.text.size();
+        chunk_count++;
+      }
+    }
+    if (chunk_count > 0) {
+      return usage_bytes +
+             chunk_count * ls.index->Dimensions() * sizeof(float);
+    }
+  }
+
+  auto content = file_service_->RetrieveFileContent(task.file_id);
+  if (content.has_error()) {
+    return cpp::fail(content.error());
+  }
+  std::string text(content->first.get(), content->second);
+  auto texts = ChunkText(text, store->max_chunk_size_chars,
+                         store->chunk_overlap_chars);
+
+  std::vector<std::vector<float>> vectors;
+  vectors.reserve(texts.size());
+  for (size_t i = 0; i < texts.size(); i += kEmbeddingBatchSize) {
+    std::vector<std::string> batch(
+        texts.begin() + i,
+        texts.begin() + std::min(i + kEmbeddingBatchSize, texts.size()));
+    auto res = Embed(store->embedding_model, batch);
+    if (res.has_error()) {
+      return cpp::fail(res.error());
+    }
+    std::move(res->begin(), res->end(), std::back_inserter(vectors));
+  }
+
+  std::vector<OpenAi::VectorStoreChunk> chunks;
+  uint64_t usage_bytes = 0;
+  for (auto& t : texts) {
+    usage_bytes += t.size();
+    chunks.push_back(
+        OpenAi::VectorStoreChunk{.file_id = task.file_id, .text = std::move(t)});
+  }
+
+  std::lock_guard<std::mutex> l(ls.mtx);
+  if (auto res = repository_->AppendChunks(task.store_id, chunks);
+      res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  if (auto res = ls.index->Add(vectors); res.has_error()) {
+    if (auto trunc = repository_->TruncateChunks(task.store_id,
+                                                 ls.index->Size());
+        trunc.has_error()) {
+      CTL_WRN(trunc.error());
+    }
+    return cpp::fail(res.error());
+  }
+  std::move(chunks.begin(), chunks.end(), std::back_inserter(ls.chunks));
+  if (!vectors.empty()) {
+    usage_bytes += vectors.size() * vectors.front().size() * sizeof(float);
+  }
+  return usage_bytes;
+}
+
+void VectorStoreService::UpdateFileCounts(const std::string& store_id) {
+  std::lock_guard<std::mutex> l(metadata_mtx_);
+  auto store = repository_->RetrieveVectorStore(store_id);
+  auto files = repository_->ListVectorStoreFiles(store_id);
+  if (store.has_error() || files.has_error()) {
+    return;
+  }
+
+  Json::Value counts;
+  for (auto const& s : {"in_progress", "completed", "failed", "cancelled"}) {
+    counts[s] = 0;
+  }
+  uint64_t usage_bytes = 0;
+  for (auto const& f : files.value()) {
+    counts[f.status] = counts[f.status].asUInt() + 1;
+    usage_bytes += f.usage_bytes;
+  }
+  counts["total"] = static_cast<Json::UInt>(files->size());
+
+  store->file_counts = counts;
+  store->usage_bytes = usage_bytes;
+  store->status =
+      counts["in_progress"].asUInt() > 0 ? "in_progress" : "completed";
+  if (auto res = repository_->ModifyVectorStore(store.value());
+      res.has_error()) {
+    CTL_WRN("Failed to update vector store " << store_id << ": "
+                                             << res.error());
+  }
+}
+
+void VectorStoreService::ResumeIngestion() {
+  auto stores = repository_->ListVectorStores(0, "asc", "");
+  if (stores.has_error()) {
+    CTL_WRN("Failed to list vector stores: " << stores.error());
+    return;
+  }
+  for (auto const& store : stores.value()) {
+    auto files = repository_->ListVectorStoreFiles(store.id);
+    if (files.has_error()) {
+      continue;
+    }
+    for (auto const& f : files.value()) {
+      if (f.status == "in_progress") {
+        CTL_INF("Resuming indexing of " << f.id << " into " << store.id);
+        tasks_.push_back(IngestTask{.store_id = store.id, .file_id = f.id});
+      }
+    }
+  }
+}
+
+void VectorStoreService::WorkerLoop() {
+  while (true) {
+    IngestTask task;
+    {
+      std::unique_lock<std::mutex> l(tasks_mtx_);
+      tasks_cv_.wait(l, [this] { return stop_ || !tasks_.empty(); });
+      if (stop_) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+
+    CTL_INF("Indexing " << task.file_id << " into " << task.store_id);
+    auto res = Ingest(task);
+
+    auto files = repository_->ListVectorStoreFiles(task.store_id);
+    if (files.has_error()) {
+      // the store was deleted meanwhile
+      continue;
+    }
+    for (auto& f : files.value()) {
+      if (f.id != task.file_id) {
+        continue;
+      }
+      if (res.has_error()) {
+        CTL_WRN("Failed to index " << task.file_id << ": " << res.error());
+        f.status = "failed";
+        f.last_error["code"] = "server_error";
+        f.last_error["message"] = res.error();
+      } else {
+        f.status = "completed";
+        f.usage_bytes = res.value();
+        f.last_error = Json::Value();
+      }
+      if (auto save = repository_->SaveVectorStoreFile(f); save.has_error()) {
+        CTL_WRN(save.error());
+      }
+    }
+    UpdateFileCounts(task.store_id);
+  }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "common/repository/vector_store_repository.h"
+#include "common/vector_store.h"
+#include "services/file_service.h"
+#include "services/inference_service.h"
+#include "trantor/utils/ConcurrentTaskQueue.h"
+#include "utils/result.hpp"
+#include "utils/vector_index.h"
+
+/**
+ * Vector stores for the file_search tool.
+ *
+ * Attached files are split into overlapping chunks, embedded with the store's
+ * embedding model through the InferenceService and appended to the store's
+ * VectorIndex. Ingestion runs on a background worker, so attaching a file
+ * returns right away with status in_progress; files still in progress when
+ * the server stopped are ingested again on start. Creating and searching a
+ * store run on a pool of their own and answer through a callback, since
+ * searching waits for the embedding model.
+ */
+class VectorStoreService {
+ public:
+  struct SearchResult {
+    std::string file_id;
+    std::string filename;
+    float score;
+    std::string text;
+  };
+
+  explicit VectorStoreService(
+      std::shared_ptr<VectorStoreRepository> repository,
+      std::shared_ptr<FileService> file_service,
+      std::shared_ptr<InferenceService> inference_service,
+      VectorIndex::Config index_config = {});
+
+  ~VectorStoreService();
+
+  using CreateCallback =
+      std::function<void(cpp::result<OpenAi::VectorStore, std::string>)>;
+  using SearchCallback = std::function<void(
+      cpp::result<std::vector<SearchResult>, std::string>)>;
+
+  void CreateVectorStore(OpenAi::VectorStore store,
+                         std::vector<std::string> file_ids,
+                         CreateCallback callback);
+
+  cpp::result<std::vector<OpenAi::VectorStore>, std::string> ListVectorStores(
+      uint8_t limit, const std::string& order, const std::string& after) const;
+
+  cpp::result<OpenAi::VectorStore, std::string> RetrieveVectorStore(
+      const std::string& store_id) const;
+
+  cpp::result<void, std::string> DeleteVectorStore(const std::string& store_id);
+
+  cpp::result<OpenAi::VectorStoreFile, std::string> AddFile(
+      const std::string& store_id, const std::string& file_id);
+
+  cpp::result<std::vector<OpenAi::VectorStoreFile>, std::string> ListFiles(
+      const std::string& store_id) const;
+
+  /**
+   * Embed [query] and pass the [max_num_results] most similar chunks
+   * scoring at least [score_threshold] to [callback].
+   */
+  void Search(std::string store_id, std::string query, size_t max_num_results,
+              float score_threshold, SearchCallback callback);
+
+  /**
+   * Split [text] into chunks of at most [max_chars] bytes, consecutive
+   * chunks sharing [overlap] bytes. Cuts prefer whitespace and never split a
+   * UTF-8 sequence.
+   */
+  static std::vector<std::string> ChunkText(const std::string& text,
+                                            size_t max_chars, size_t overlap);
+
+ private:
+  // In-memory view of a store: its index and the chunk of every vector
+  struct LoadedStore {
+    std::mutex mtx;
+    std::unique_ptr<VectorIndex> index;
+    std::vector<OpenAi::VectorStoreChunk> chunks;
+  };
+
+  struct IngestTask {
+    std::string store_id;
+    std::string file_id;
+  };
+
+  cpp::result<OpenAi::VectorStore, std::string> DoCreateVectorStore(
+      OpenAi::VectorStore store, const std::vector<std::string>& file_ids);
+
+  cpp::result<std::vector<SearchResult>, std::string> DoSearch(
+      const std::string& store_id, const std::string& query,
+      size_t max_num_results, float score_threshold);
+
+  cpp::result<std::shared_ptr<LoadedStore>, std::string> GetLoadedStore(
+      const std::string& store_id);
+
+  cpp::result<std::vector<std::vector<float>>, std::string> Embed(
+      const std::string& model, const std::vector<std::string>& inputs);
+
+  cpp::result<uint64_t, std::string> Ingest(const IngestTask& task);
+
+  void UpdateFileCounts(const std::string& store_id);
+
+  // Queue the files left in progress by a previous run
+  void ResumeIngestion();
+
+  void WorkerLoop();
+
+  std::shared_ptr<VectorStoreRepository> repository_;
+  std::shared_ptr<FileService> file_service_;
+  std::shared_ptr<InferenceService> inference_service_;
+  VectorIndex::Config index_config_;
+
+  std::mutex stores_mtx_;
+  std::unordered_map<std::string, std::shared_ptr<LoadedStore>> stores_;
+
+  // serializes read-modify-write of the store objects
+  std::mutex metadata_mtx_;
+
+  std::mutex tasks_mtx_;
+  std::condition_variable tasks_cv_;
+  std::deque<IngestTask> tasks_;
+  bool stop_{false};
+  std::thread worker_;
+
+  // last, so that it is joined before the members its tasks use go away
+  trantor::ConcurrentTaskQueue requests_;
+};
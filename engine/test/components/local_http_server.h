@@ -0,0 +1,135 @@
+#pragma once
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace test_utils {
+// Minimal HTTP/1.1 server standing in for the hub or a provider: one
+// request per connection, answered by [handler_] from the request path and
+// headers
+class LocalHttpServer {
+ public:
+  struct Request {
+    std::string path;
+    std::string if_none_match;
+  };
+  struct Response {
+    int status = 200;
+    std::string etag{};
+    std::string body{};
+  };
+  using Handler = std::function<Response(const Request&)>;
+
+  explicit LocalHttpServer(Handler handler) : handler_{std::move(handler)} {
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(fd_, reinterpret_cast<sockaddr*>(&addr), &len);
+    port_ = ntohs(addr.sin_port);
+    listen(fd_, 16);
+    thread_ = std::thread([this] { Serve(); });
+  }
+
+  // Listen on the Unix domain socket [socket_path] instead of a TCP port
+  LocalHttpServer(Handler handler, const std::string& socket_path)
+      : handler_{std::move(handler)}, port_{0} {
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socket_path.c_str());
+    bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    listen(fd_, 16);
+    thread_ = std::thread([this] { Serve(); });
+  }
+
+  ~LocalHttpServer() {
+    stop_ = true;
+    shutdown(fd_, SHUT_RDWR);
+    close(fd_);
+    thread_.join();
+  }
+
+  std::string Url(const std::string& path) const {
+    return "http://127.0.0.1:" + std::to_string(port_) + path;
+  }
+
+  int requests() const { return requests_; }
+
+ private:
+  void Serve() {
+    while (!stop_) {
+      auto conn = accept(fd_, nullptr, nullptr);
+      if (conn < 0) {
+        continue;
+      }
+      std::string raw;
+      char buf[4096];
+      size_t header_end;
+      while ((header_end = raw.find("\r\n\r\n")) == std::string::npos) {
+        auto n = recv(conn, buf, sizeof(buf), 0);
+        if (n <= 0) {
+          break;
+        }
+        raw.append(buf, n);
+      }
+      // the body is read too, the client may not take an answer before
+      // it is sent
+      size_t content_length = 0;
+      if (auto pos = raw.find("Content-Length: "); pos != std::string::npos) {
+        content_length = std::stoul(raw.substr(pos + 16));
+      }
+      while (header_end != std::string::npos &&
+             raw.size() < header_end + 4 + content_length) {
+        auto n = recv(conn, buf, sizeof(buf), 0);
+        if (n <= 0) {
+          break;
+        }
+        raw.append(buf, n);
+      }
+      requests_++;
+
+      Request req;
+      auto sp = raw.find(' ');
+      req.path = raw.substr(sp + 1, raw.find(' ', sp + 1) - sp - 1);
+      if (auto pos = raw.find("If-None-Match: "); pos != std::string::npos) {
+        pos += 15;
+        req.if_none_match = raw.substr(pos, raw.find("\r\n", pos) - pos);
+      }
+      auto res = handler_(req);
+
+      std::string out = "HTTP/1.1 " + std::to_string(res.status) +
+                        (res.status == 304 ? " Not Modified" : " OK") + "\r\n";
+      if (!res.etag.empty()) {
+        out += "ETag: " + res.etag + "\r\n";
+      }
+      out += "Content-Length: " + std::to_string(res.body.size()) +
+             "\r\nConnection: close\r\n\r\n" + res.body;
+      // the client may have given up on a slow answer
+      send(conn, out.data(), out.size(), MSG_NOSIGNAL);
+      close(conn);
+    }
+  }
+
+  Handler handler_;
+  int fd_;
+  int port_;
+  std::atomic<bool> stop_{false};
+  std::atomic<int> requests_{0};
+  std::thread thread_;
+};
+}  // namespace test_utils
+#endif
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "utils/archive_utils.h"
+
+namespace {
+// Build a tar.gz with the given files in memory
+std::string MakeTarGz(
+    const std::vector<std::pair<std::string, std::string>>& files) {
+  std::string buf(1024 * 1024, '\0');
+  size_t used = 0;
+  auto* a = archive_write_new();
+  archive_write_add_filter_gzip(a);
+  archive_write_set_format_pax_restricted(a);
+  archive_write_open_memory(a, buf.data(), buf.size(), &used);
+  for (auto const& [name, content] : files) {
+    auto* entry = archive_entry_new();
+    archive_entry_set_pathname(entry, name.c_str());
+    archive_entry_set_size(entry, content.size());
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, 0644);
+    archive_write_header(a, entry);
+    archive_write_data(a, content.data(), content.size());
+    archive_entry_free(entry);
+  }
+  archive_write_close(a);
+  archive_write_free(a);
+  buf.resize(used);
+  return buf;
+}
+
+std::string ReadFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+}  // namespace
+
+class ArchiveUtilsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::filesystem::temp_directory_path() / "archive_utils_test";
+    std::filesystem::remove_all(dir_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  std::filesystem::path dir_;
+};
+
+TEST_F(ArchiveUtilsTest, StreamExtractorExtractsChunkedTarGz) {
+  std::string big(300 * 1024, 'x');
+  for (size_t i = 0; i < big.size(); i++) {
+    big[i] = static_cast<char>('a' + (i * 7919) % 26);
+  }
+  auto archive =
+      MakeTarGz({{"engine/lib.so", big}, {"engine/version.txt", "1"}});
+
+  {
+    archive_utils::StreamExtractor extractor(dir_.string(), true);
+    // feed it the way a download does, in small uneven chunks
+    for (size_t pos = 0; pos < archive.size(); pos += 1000) {
+      auto n = std::min<size_t>(1000, archive.size() - pos);
+      ASSERT_TRUE(extractor.Write(archive.data() + pos, n));
+    }
+    EXPECT_TRUE(extractor.Finish());
+  }
+
+  EXPECT_EQ(ReadFile(dir_ / "lib.so"), big);
+  EXPECT_EQ(ReadFile(dir_ / "version.txt"), "1");
+}
+
+TEST_F(ArchiveUtilsTest, StreamExtractorFailsOnTruncatedArchive) {
+  auto archive = MakeTarGz({{"a.txt", std::string(100 * 1024, 'a')}});
+
+  archive_utils::StreamExtractor extractor(dir_.string(), false);
+  extractor.Write(archive.data(), archive.size() / 2);
+  EXPECT_FALSE(extractor.Finish());
+}
+
+TEST_F(ArchiveUtilsTest, StreamExtractorAbortDoesNotBlock) {
+  auto archive = MakeTarGz({{"a.txt", "a"}});
+
+  archive_utils::StreamExtractor extractor(dir_.string(), false);
+  ASSERT_TRUE(extractor.Write(archive.data(), 10));
+  extractor.Abort();
+  // nothing is accepted after the extraction stopped
+  EXPECT_FALSE(extractor.Write(archive.data() + 10, archive.size() - 10));
+}
@@ -0,0 +1,75 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include "services/batch_results.h"
+
+class BatchResultsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::filesystem::temp_directory_path() / "batch_results_test";
+    std::filesystem::remove_all(dir_);
+    std::filesystem::create_directories(dir_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  static void Write(const std::filesystem::path& path,
+                    const std::string& content) {
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    file << content;
+  }
+
+  std::filesystem::path dir_;
+};
+
+TEST_F(BatchResultsTest, CountsTheAnsweredRequests) {
+  BatchResults results(dir_);
+  Write(results.output_path(),
+        "{\"custom_id\":\"a\"}\n{\"custom_id\":\"b\"}\n");
+  Write(results.errors_path(), "{\"custom_id\":\"c\"}\n");
+
+  std::unordered_set<std::string> done_ids;
+  auto counts = results.Load(done_ids);
+  EXPECT_EQ(counts.completed, 2u);
+  EXPECT_EQ(counts.failed, 1u);
+  EXPECT_EQ(done_ids, (std::unordered_set<std::string>{"a", "b", "c"}));
+}
+
+TEST_F(BatchResultsTest, CutsOffAPartlyWrittenLine) {
+  BatchResults results(dir_);
+  std::string complete = "{\"custom_id\":\"a\"}\n";
+  Write(results.output_path(), complete + "{\"custom_id\":\"b\"");
+
+  std::unordered_set<std::string> done_ids;
+  auto counts = results.Load(done_ids);
+  // b is run again
+  EXPECT_EQ(counts.completed, 1u);
+  EXPECT_EQ(done_ids.count("b"), 0u);
+  EXPECT_EQ(std::filesystem::file_size(results.output_path()),
+            complete.size());
+}
+
+TEST_F(BatchResultsTest, NothingAnsweredYet) {
+  std::unordered_set<std::string> done_ids;
+  auto counts = BatchResults(dir_ / "missing").Load(done_ids);
+  EXPECT_EQ(counts.completed, 0u);
+  EXPECT_EQ(counts.failed, 0u);
+  EXPECT_TRUE(done_ids.empty());
+}
+
+TEST_F(BatchResultsTest, ReservesFileIdsOnce) {
+  BatchResults results(dir_);
+  Write(results.output_path(), "{\"custom_id\":\"a\"}\n");
+  // an empty errors file is not stored
+  Write(results.errors_path(), "");
+
+  OpenAi::Batch batch;
+  results.ReserveFileIds(batch);
+  EXPECT_FALSE(batch.output_file_id.empty());
+  EXPECT_TRUE(batch.error_file_id.empty());
+
+  // a finalize resumed after a restart stores it under the same id
+  auto output_file_id = batch.output_file_id;
+  results.ReserveFileIds(batch);
+  EXPECT_EQ(batch.output_file_id, output_file_id);
+}
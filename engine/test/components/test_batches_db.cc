@@ -0,0 +1,116 @@
+#include "database/batches.h"
+#include "gtest/gtest.h"
+
+namespace cortex::db {
+namespace {
+constexpr const auto kTestDb = "./test_batches.db";
+}
+
+class BatchesTestSuite : public ::testing::Test {
+ public:
+  BatchesTestSuite()
+      : db_(kTestDb, SQLite::OPEN_READWRITE | SQLite::OPEN_CREATE),
+        batches_(db_) {}
+  void SetUp() {
+    try {
+      db_.exec(
+          "CREATE TABLE batches ("
+          "id TEXT PRIMARY KEY,"
+          "endpoint TEXT,"
+          "input_file_id TEXT,"
+          "completion_window TEXT,"
+          "status TEXT,"
+          "output_file_id TEXT,"
+          "error_file_id TEXT,"
+          "created_at INTEGER,"
+          "in_progress_at INTEGER,"
+          "completed_at INTEGER,"
+          "failed_at INTEGER,"
+          "cancelled_at INTEGER,"
+          "total INTEGER,"
+          "completed INTEGER,"
+          "failed INTEGER,"
+          "input_offset INTEGER,"
+          "error TEXT,"
+          "metadata TEXT"
+          ")");
+    } catch (const std::exception& e) {}
+  }
+
+  void TearDown() {
+    try {
+      db_.exec("DROP TABLE IF EXISTS batches;");
+    } catch (const std::exception& e) {}
+  }
+
+ protected:
+  static OpenAi::Batch CreateBatch(const std::string& id,
+                                   uint64_t created_at) {
+    OpenAi::Batch batch;
+    batch.id = id;
+    batch.endpoint = "/v1/chat/completions";
+    batch.input_file_id = "file-input";
+    batch.created_at = created_at;
+    batch.metadata["team"] = "search";
+    return batch;
+  }
+
+  SQLite::Database db_;
+  cortex::db::Batches batches_;
+};
+
+TEST_F(BatchesTestSuite, AddsAndRetrievesBatches) {
+  ASSERT_TRUE(batches_.AddBatchEntry(CreateBatch("batch_1", 100)).has_value());
+
+  auto batch = batches_.GetBatchById("batch_1");
+  ASSERT_TRUE(batch.has_value()) << batch.error();
+  EXPECT_EQ(batch->endpoint, "/v1/chat/completions");
+  EXPECT_EQ(batch->input_file_id, "file-input");
+  EXPECT_EQ(batch->status, "validating");
+  EXPECT_EQ(batch->created_at, 100u);
+  EXPECT_EQ(batch->metadata["team"].asString(), "search");
+
+  EXPECT_TRUE(batches_.GetBatchById("batch_2").has_error());
+  // ids are unique
+  EXPECT_TRUE(batches_.AddBatchEntry(CreateBatch("batch_1", 200)).has_error());
+}
+
+TEST_F(BatchesTestSuite, UpdatesTheProgress) {
+  auto batch = CreateBatch("batch_1", 100);
+  ASSERT_TRUE(batches_.AddBatchEntry(batch).has_value());
+
+  batch.status = "finalizing";
+  batch.total = 10;
+  batch.completed = 7;
+  batch.failed = 3;
+  batch.input_offset = 4096;
+  batch.output_file_id = "file-output";
+  ASSERT_TRUE(batches_.UpdateBatchEntry(batch).has_value());
+
+  auto saved = batches_.GetBatchById("batch_1");
+  ASSERT_TRUE(saved.has_value());
+  EXPECT_EQ(saved->status, "finalizing");
+  EXPECT_EQ(saved->total, 10u);
+  EXPECT_EQ(saved->completed, 7u);
+  EXPECT_EQ(saved->failed, 3u);
+  EXPECT_EQ(saved->input_offset, 4096u);
+  EXPECT_EQ(saved->output_file_id, "file-output");
+  EXPECT_TRUE(saved->error_file_id.empty());
+
+  EXPECT_TRUE(
+      batches_.UpdateBatchEntry(CreateBatch("batch_2", 100)).has_error());
+}
+
+TEST_F(BatchesTestSuite, ListsNewestFirst) {
+  ASSERT_TRUE(batches_.AddBatchEntry(CreateBatch("batch_a", 100)).has_value());
+  ASSERT_TRUE(batches_.AddBatchEntry(CreateBatch("batch_b", 300)).has_value());
+  ASSERT_TRUE(batches_.AddBatchEntry(CreateBatch("batch_c", 200)).has_value());
+
+  auto list = batches_.GetBatchList();
+  ASSERT_TRUE(list.has_value());
+  ASSERT_EQ(list->size(), 3u);
+  EXPECT_EQ((*list)[0].id, "batch_b");
+  EXPECT_EQ((*list)[1].id, "batch_c");
+  EXPECT_EQ((*list)[2].id, "batch_a");
+}
+}  // namespace cortex::db
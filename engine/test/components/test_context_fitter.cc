@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <sstream>
+#include "services/context_fitter.h"
+
+namespace {
+// One token per word, the template adds one per message
+size_t CountWords(std::string_view text) {
+  std::istringstream in{std::string(text)};
+  size_t n = 0;
+  for (std::string word; in >> word;) {
+    n++;
+  }
+  return n;
+}
+
+cpp::result<std::string, std::string> Render(
+    const nlohmann::ordered_json& messages) {
+  std::string prompt;
+  for (auto const& message : messages) {
+    prompt += message["role"].get<std::string>() + ": " +
+              message.value("content", "") + "\n";
+  }
+  return prompt;
+}
+
+nlohmann::ordered_json Message(const std::string& role, size_t words) {
+  std::string content;
+  for (size_t i = 0; i < words; i++) {
+    content += "word ";
+  }
+  return {{"role", role}, {"content", content}};
+}
+
+nlohmann::ordered_json Conversation(size_t turns, size_t words) {
+  auto messages = nlohmann::ordered_json::array();
+  messages.push_back(Message("system", 10));
+  for (size_t i = 0; i < turns; i++) {
+    messages.push_back(Message("user", words));
+    messages.push_back(Message("assistant", words));
+  }
+  messages.push_back(Message("user", words));
+  return messages;
+}
+}  // namespace
+
+class ContextFitterTest : public ::testing::Test {
+ protected:
+  ContextFitter fitter_{ContextFitter::Config{}};
+};
+
+TEST_F(ContextFitterTest, ParsesPolicies) {
+  EXPECT_EQ(ContextFitter::ParsePolicy("none"), ContextFitter::Policy::kNone);
+  EXPECT_EQ(ContextFitter::ParsePolicy("error"),
+            ContextFitter::Policy::kError);
+  EXPECT_EQ(ContextFitter::ParsePolicy("truncate"),
+            ContextFitter::Policy::kTruncate);
+  EXPECT_FALSE(ContextFitter::ParsePolicy("drop").has_value());
+}
+
+TEST_F(ContextFitterTest, ShortConversationsPassOnTheEstimate) {
+  auto messages = Conversation(2, 10);
+  auto renders = 0;
+  auto render = [&renders](const nlohmann::ordered_json& m) {
+    renders++;
+    return Render(m);
+  };
+  auto result = fitter_.Fit(ContextFitter::Policy::kTruncate, "model",
+                            messages, {.ctx_len = 4096, .reserved = 512},
+                            CountWords, render);
+  ASSERT_TRUE(result.has_value());
+  EXPECT_FALSE(result->prompt.has_value());
+  EXPECT_EQ(renders, 0);
+  EXPECT_EQ(messages.size(), 6u);
+  // the turns repeat the same texts
+  EXPECT_EQ(fitter_.GetCachedCounts(), 3u);
+}
+
+TEST_F(ContextFitterTest, RejectsLongConversations) {
+  auto messages = Conversation(10, 100);
+  auto result = fitter_.Fit(ContextFitter::Policy::kError, "model", messages,
+                            {.ctx_len = 1000, .reserved = 200}, CountWords,
+                            Render);
+  ASSERT_TRUE(result.has_error());
+  EXPECT_NE(result.error().find("maximum context length is 1000"),
+            std::string::npos);
+  EXPECT_EQ(messages.size(), 22u);
+
+  // nothing happens without a policy
+  EXPECT_TRUE(fitter_
+                  .Fit(ContextFitter::Policy::kNone, "model", messages,
+                       {.ctx_len = 1000}, CountWords, Render)
+                  .has_value());
+}
+
+TEST_F(ContextFitterTest, DropsTheOldestTurns) {
+  auto messages = Conversation(10, 100);
+  auto last = messages.back();
+  auto result = fitter_.Fit(ContextFitter::Policy::kTruncate, "model",
+                            messages, {.ctx_len = 1000, .reserved = 200},
+                            CountWords, Render);
+  ASSERT_TRUE(result.has_value()) << result.error();
+  ASSERT_TRUE(result->prompt.has_value());
+  EXPECT_LE(result->prompt_tokens + 200, 1000u);
+  EXPECT_EQ(result->prompt_tokens, CountWords(*result->prompt));
+  EXPECT_EQ(result->dropped_messages, 22u - messages.size());
+
+  // the system prompt is kept and the history resumes with a user turn
+  EXPECT_EQ(messages[0]["role"], "system");
+  EXPECT_EQ(messages[1]["role"], "user");
+  EXPECT_EQ(messages.back(), last);
+  // as many turns as fit are kept
+  EXPECT_EQ(messages.size(), 8u);
+}
+
+TEST_F(ContextFitterTest, FailsWhenTheLastTurnDoesNotFit) {
+  auto messages = Conversation(3, 50);
+  messages.back() = Message("user", 2000);
+  auto result = fitter_.Fit(ContextFitter::Policy::kTruncate, "model",
+                            messages, {.ctx_len = 1000}, CountWords, Render);
+  ASSERT_TRUE(result.has_error());
+  // everything before it was dropped trying
+  EXPECT_EQ(messages.size(), 2u);
+}
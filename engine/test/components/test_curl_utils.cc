@@ -0,0 +1,173 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include "utils/curl_utils.h"
+#include "utils/file_manager_utils.h"
+
+#if !defined(_WIN32)
+#include <mutex>
+#include <set>
+#include "local_http_server.h"
+
+using test_utils::LocalHttpServer;
+
+class CurlUtilsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    // requests read the proxy settings from the config
+    ASSERT_FALSE(file_manager_utils::CreateConfigFileIfNotExist().has_error());
+    cache_dir_ = std::filesystem::temp_directory_path() / "curl_utils_test";
+    std::filesystem::remove_all(cache_dir_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(cache_dir_); }
+
+  std::filesystem::path cache_dir_;
+};
+
+TEST_F(CurlUtilsTest, ConditionalGetRevalidatesWithEtag) {
+  std::mutex mtx;
+  std::string etag = "\"v1\"";
+  std::string body = R"({"id": "a"})";
+  LocalHttpServer server([&](const LocalHttpServer::Request& req) {
+    std::lock_guard<std::mutex> l(mtx);
+    if (req.if_none_match == etag) {
+      return LocalHttpServer::Response{.status = 304, .etag = etag};
+    }
+    return LocalHttpServer::Response{.etag = etag, .body = body};
+  });
+  auto url = server.Url("/api/models/a");
+
+  auto res = curl_utils::ConditionalGet(url, cache_dir_);
+  ASSERT_TRUE(res.has_value());
+  EXPECT_TRUE(res->modified);
+  EXPECT_EQ(res->body, body);
+  curl_utils::CacheConditionalGet(res.value(), cache_dir_);
+
+  // answered with 304 from the cache
+  res = curl_utils::ConditionalGet(url, cache_dir_);
+  ASSERT_TRUE(res.has_value());
+  EXPECT_FALSE(res->modified);
+  EXPECT_EQ(res->body, body);
+  EXPECT_FALSE(res->cache_stale);
+
+  {
+    std::lock_guard<std::mutex> l(mtx);
+    etag = "\"v2\"";
+    body = R"({"id": "b"})";
+  }
+  res = curl_utils::ConditionalGet(url, cache_dir_);
+  ASSERT_TRUE(res.has_value());
+  EXPECT_TRUE(res->modified);
+  EXPECT_EQ(res->body, R"({"id": "b"})");
+  EXPECT_EQ(server.requests(), 3);
+}
+
+TEST_F(CurlUtilsTest, ConditionalGetDetectsUnchangedBodyWithoutEtag) {
+  LocalHttpServer server([](const LocalHttpServer::Request& req) {
+    return LocalHttpServer::Response{.body = "[]"};
+  });
+  auto url = server.Url("/api/models?author=a");
+
+  auto res = curl_utils::ConditionalGet(url, cache_dir_);
+  ASSERT_TRUE(res.has_value());
+  EXPECT_TRUE(res->modified);
+  curl_utils::CacheConditionalGet(res.value(), cache_dir_);
+  res = curl_utils::ConditionalGet(url, cache_dir_);
+  ASSERT_TRUE(res.has_value());
+  EXPECT_FALSE(res->modified);
+  EXPECT_EQ(res->body, "[]");
+}
+
+TEST_F(CurlUtilsTest, ConditionalGetCachesOnlyWhenAsked) {
+  LocalHttpServer server([](const LocalHttpServer::Request& req) {
+    if (req.if_none_match == "\"v1\"") {
+      return LocalHttpServer::Response{.status = 304, .etag = "\"v1\""};
+    }
+    return LocalHttpServer::Response{.etag = "\"v1\"", .body = "[]"};
+  });
+  auto url = server.Url("/api/models/a");
+
+  auto res = curl_utils::ConditionalGet(url, cache_dir_);
+  ASSERT_TRUE(res.has_value());
+  EXPECT_TRUE(res->cache_stale);
+
+  // not cached, e.g. the db update it was fetched for failed
+  res = curl_utils::ConditionalGet(url, cache_dir_);
+  ASSERT_TRUE(res.has_value());
+  EXPECT_TRUE(res->modified);
+  EXPECT_EQ(res->body, "[]");
+}
+
+TEST_F(CurlUtilsTest, SimpleGetJsonRecursiveListsSubDirectories) {
+  LocalHttpServer server([](const LocalHttpServer::Request& req) {
+    if (req.path == "/tree") {
+      return LocalHttpServer::Response{
+          .body = R"([{"type": "directory", "path": "a"},
+                      {"type": "directory", "path": "b"},
+                      {"type": "file", "path": "x"}])"};
+    }
+    if (req.path == "/tree/a") {
+      return LocalHttpServer::Response{
+          .body = R"([{"type": "directory", "path": "a/c"},
+                      {"type": "file", "path": "a/y"}])"};
+    }
+    if (req.path == "/tree/a/c") {
+      return LocalHttpServer::Response{
+          .body = R"([{"type": "file", "path": "a/c/z"}])"};
+    }
+    return LocalHttpServer::Response{.body = "[]"};
+  });
+
+  auto res = curl_utils::SimpleGetJsonRecursive(server.Url("/tree"));
+  ASSERT_TRUE(res.has_value());
+  std::set<std::string> paths;
+  for (auto const& item : res.value()) {
+    EXPECT_EQ(item["type"].asString(), "file");
+    paths.insert(item["path"].asString());
+  }
+  EXPECT_EQ(paths, (std::set<std::string>{"x", "a/y", "a/c/z"}));
+  EXPECT_EQ(server.requests(), 4);
+}
+
+TEST_F(CurlUtilsTest, GetStatusCodeReportsNotReady) {
+  LocalHttpServer server([](const LocalHttpServer::Request& req) {
+    if (req.path == "/healthz?ready=true") {
+      return LocalHttpServer::Response{.status = 503,
+                                       .body = R"({"ready": false})"};
+    }
+    return LocalHttpServer::Response{.body = "ok"};
+  });
+
+  auto res = curl_utils::GetStatusCode(server.Url("/healthz?ready=true"));
+  ASSERT_TRUE(res.has_value());
+  EXPECT_EQ(res.value(), 503);
+  EXPECT_TRUE(curl_utils::SimpleGet(server.Url("/healthz?ready=true"))
+                  .has_error());
+
+  res = curl_utils::GetStatusCode(server.Url("/healthz"));
+  ASSERT_TRUE(res.has_value());
+  EXPECT_EQ(res.value(), 200);
+  EXPECT_EQ(curl_utils::SimpleGet(server.Url("/healthz")).value(), "ok");
+}
+
+TEST_F(CurlUtilsTest, SimpleRequestOverUnixSocket) {
+  std::filesystem::create_directories(cache_dir_);
+  auto socket_path = (cache_dir_ / "model.sock").string();
+  LocalHttpServer server(
+      [](const LocalHttpServer::Request& req) {
+        return LocalHttpServer::Response{.body = "{\"path\": \"" + req.path +
+                                                 "\"}"};
+      },
+      socket_path);
+
+  auto res = curl_utils::SimpleRequest("http://localhost/v1/health",
+                                       RequestType::GET, "", socket_path);
+  ASSERT_TRUE(res.has_value());
+  EXPECT_EQ(res.value(), R"({"path": "/v1/health"})");
+
+  res = curl_utils::SimpleRequest("http://localhost/v1/health",
+                                  RequestType::GET, "",
+                                  (cache_dir_ / "missing.sock").string());
+  EXPECT_TRUE(res.has_error());
+}
+#endif
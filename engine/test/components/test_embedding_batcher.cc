@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "services/embedding_batcher.h"
+
+namespace {
+std::shared_ptr<Json::Value> CreateRequest(const Json::Value& input) {
+  auto body = std::make_shared<Json::Value>();
+  (*body)["model"] = "model";
+  (*body)["input"] = input;
+  return body;
+}
+
+// Fake engine: one embedding per input, 1 token per character
+void FakeEngine(std::shared_ptr<Json::Value> body, const SchedulingOptions&,
+                EmbeddingBatcher::Callback cb) {
+  Json::Value res;
+  res["object"] = "list";
+  res["data"] = Json::Value(Json::arrayValue);
+  auto const& input = (*body)["input"];
+  uint64_t tokens = 0;
+  for (Json::ArrayIndex i = 0; i < input.size(); i++) {
+    Json::Value e;
+    e["object"] = "embedding";
+    e["index"] = i;
+    e["embedding"].append(static_cast<double>(input[i].asString().size()));
+    res["data"].append(e);
+    tokens += input[i].asString().size();
+  }
+  res["usage"]["prompt_tokens"] = static_cast<Json::UInt64>(tokens);
+  res["usage"]["total_tokens"] = static_cast<Json::UInt64>(tokens);
+  Json::Value status;
+  status["status_code"] = 200;
+  cb(std::move(status), std::move(res));
+}
+}  // namespace
+
+class EmbeddingBatcherTest : public ::testing::Test {};
+
+TEST_F(EmbeddingBatcherTest, CanBatch) {
+  EXPECT_TRUE(EmbeddingBatcher::CanBatch(*CreateRequest("hello")));
+
+  Json::Value arr(Json::arrayValue);
+  arr.append("a");
+  arr.append("b");
+  EXPECT_TRUE(EmbeddingBatcher::CanBatch(*CreateRequest(arr)));
+
+  Json::Value tokens(Json::arrayValue);
+  tokens.append(1);
+  EXPECT_FALSE(EmbeddingBatcher::CanBatch(*CreateRequest(tokens)));
+
+  auto with_user = CreateRequest("hello");
+  (*with_user)["user"] = "someone";
+  EXPECT_FALSE(EmbeddingBatcher::CanBatch(*with_user));
+}
+
+TEST_F(EmbeddingBatcherTest, ScatterRenumbersIndexAndSplitsUsage) {
+  Json::Value res;
+  for (int i = 3; i >= 0; i--) {
+    Json::Value e;
+    e["index"] = i;
+    e["embedding"].append(i);
+    res["data"].append(e);
+  }
+  res["usage"]["prompt_tokens"] = 10;
+  res["usage"]["total_tokens"] = 10;
+
+  auto parts = EmbeddingBatcher::Scatter(res, {1, 3}, {1, 3});
+  ASSERT_EQ(parts.size(), 2u);
+  ASSERT_EQ(parts[0]["data"].size(), 1u);
+  ASSERT_EQ(parts[1]["data"].size(), 3u);
+  EXPECT_EQ(parts[1]["data"][0]["index"].asInt(), 0);
+  EXPECT_EQ(parts[1]["data"][2]["embedding"][0].asInt(), 3);
+  EXPECT_EQ(parts[0]["usage"]["prompt_tokens"].asInt() +
+                parts[1]["usage"]["prompt_tokens"].asInt(),
+            10);
+
+  // mismatched count can't be scattered
+  EXPECT_TRUE(EmbeddingBatcher::Scatter(res, {1, 1}, {1, 1}).empty());
+}
+
+TEST_F(EmbeddingBatcherTest, MergesConcurrentRequests) {
+  std::atomic<int> engine_calls{0};
+  EmbeddingBatcher batcher(
+      {.window_ms = 1000, .max_batch_size = 3},
+      [&engine_calls](std::shared_ptr<Json::Value> body,
+                      const SchedulingOptions& options,
+                      EmbeddingBatcher::Callback cb) {
+        engine_calls++;
+        FakeEngine(body, options, std::move(cb));
+      });
+
+  std::mutex mtx;
+  std::vector<Json::Value> results(2);
+  Json::Value arr(Json::arrayValue);
+  arr.append("bb");
+  arr.append("ccc");
+  batcher.Submit(CreateRequest("a"), {},
+                 [&](Json::Value&&, Json::Value&& res) {
+                   std::lock_guard<std::mutex> l(mtx);
+                   results[0] = res;
+                 });
+  // reaches max_batch_size, flushed without waiting for the window
+  batcher.Submit(CreateRequest(arr), {},
+                 [&](Json::Value&&, Json::Value&& res) {
+                   std::lock_guard<std::mutex> l(mtx);
+                   results[1] = res;
+                 });
+
+  EXPECT_EQ(engine_calls.load(), 1);
+  std::lock_guard<std::mutex> l(mtx);
+  ASSERT_EQ(results[0]["data"].size(), 1u);
+  EXPECT_EQ(results[0]["data"][0]["embedding"][0].asInt(), 1);
+  EXPECT_EQ(results[0]["usage"]["prompt_tokens"].asInt(), 1);
+  ASSERT_EQ(results[1]["data"].size(), 2u);
+  EXPECT_EQ(results[1]["data"][1]["index"].asInt(), 1);
+  EXPECT_EQ(results[1]["data"][1]["embedding"][0].asInt(), 3);
+  EXPECT_EQ(results[1]["usage"]["prompt_tokens"].asInt(), 5);
+}
+
+TEST_F(EmbeddingBatcherTest, FlushesAfterWindow) {
+  std::atomic<bool> done{false};
+  EmbeddingBatcher batcher({.window_ms = 10, .max_batch_size = 32}, FakeEngine);
+  batcher.Submit(CreateRequest("hello"), {},
+                 [&done](Json::Value&&, Json::Value&&) { done = true; });
+  for (int i = 0; i < 200 && !done; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  EXPECT_TRUE(done.load());
+}
+
+TEST_F(EmbeddingBatcherTest, PassesRejectionToEveryRequest) {
+  EmbeddingBatcher batcher(
+      {.window_ms = 1000, .max_batch_size = 2},
+      [](std::shared_ptr<Json::Value>, const SchedulingOptions&,
+         EmbeddingBatcher::Callback cb) {
+        Json::Value status;
+        status["status_code"] = 429;
+        status["retry_after"] = 3;
+        status["is_done"] = true;
+        status["has_error"] = true;
+        Json::Value res;
+        res["message"] = "Too many requests";
+        cb(std::move(status), std::move(res));
+      });
+
+  std::vector<Json::Value> statuses;
+  for (auto input : {"a", "b"}) {
+    batcher.Submit(CreateRequest(input), {},
+                   [&statuses](Json::Value&& status, Json::Value&&) {
+                     statuses.push_back(status);
+                   });
+  }
+  ASSERT_EQ(statuses.size(), 2u);
+  for (auto const& status : statuses) {
+    EXPECT_EQ(status["status_code"].asInt(), 429);
+    EXPECT_EQ(status["retry_after"].asInt(), 3);
+  }
+}
@@ -1,4 +1,5 @@
 
+#include "common/batch.h"
 #include "common/event.h"
 #include "gtest/gtest.h"
 #include "utils/json_helper.h"
@@ -47,3 +48,29 @@ TEST_F(EventTest, EventFromString) {
   auto ev = cortex::event::GetDownloadEventFromJson(root);
   EXPECT_EQ(ev.type_, cortex::event::DownloadEventType::DownloadStarted);
 }
+
+TEST_F(EventTest, BatchEventToJsonString) {
+  OpenAi::Batch batch;
+  batch.id = "batch_123";
+  batch.endpoint = "/v1/chat/completions";
+  batch.input_file_id = "file-abc";
+  batch.status = "in_progress";
+  batch.created_at = 1700000000;
+  batch.in_progress_at = 1700000001;
+  batch.total = 3;
+  batch.completed = 1;
+
+  cortex::event::BatchEvent ev;
+  ev.type_ = cortex::event::BatchEventType::BatchUpdated;
+  ev.batch_ = batch.ToJson().value();
+  auto root = json_helper::ParseJsonString(ev.ToJsonString());
+
+  EXPECT_EQ(root["type"].asString(), "BatchUpdated");
+  EXPECT_EQ(root["batch"]["id"].asString(), "batch_123");
+  EXPECT_EQ(root["batch"]["request_counts"]["total"].asUInt(), 3u);
+  EXPECT_EQ(root["batch"]["request_counts"]["completed"].asUInt(), 1u);
+  EXPECT_TRUE(root["batch"]["output_file_id"].isNull());
+  EXPECT_TRUE(root["batch"]["completed_at"].isNull());
+  EXPECT_TRUE(root["batch"]["errors"].isNull());
+  EXPECT_FALSE(batch.IsFinished());
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "services/extracting_sink.h"
+
+namespace {
+// Build a tar.gz with the given files in memory
+std::string MakeTarGz(
+    const std::vector<std::pair<std::string, std::string>>& files) {
+  std::string buf(1024 * 1024, '\0');
+  size_t used = 0;
+  auto* a = archive_write_new();
+  archive_write_add_filter_gzip(a);
+  archive_write_set_format_pax_restricted(a);
+  archive_write_open_memory(a, buf.data(), buf.size(), &used);
+  for (auto const& [name, content] : files) {
+    auto* entry = archive_entry_new();
+    archive_entry_set_pathname(entry, name.c_str());
+    archive_entry_set_size(entry, content.size());
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, 0644);
+    archive_write_header(a, entry);
+    archive_write_data(a, content.data(), content.size());
+    archive_entry_free(entry);
+  }
+  archive_write_close(a);
+  archive_write_free(a);
+  buf.resize(used);
+  return buf;
+}
+
+std::string ReadFile(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream ss;
+  ss << file.rdbuf();
+  return ss.str();
+}
+
+void WriteFile(const std::filesystem::path& path, const std::string& content) {
+  std::filesystem::create_directories(path.parent_path());
+  std::ofstream file(path, std::ios::binary);
+  file << content;
+}
+}  // namespace
+
+class ExtractingSinkTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::filesystem::temp_directory_path() / "extracting_sink_test";
+    std::filesystem::remove_all(dir_);
+    std::filesystem::create_directories(dir_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  std::filesystem::path dir_;
+};
+
+TEST_F(ExtractingSinkTest, PublishesANewDirectory) {
+  WriteFile(dir_ / "staging" / "lib" / "a.so", "a");
+
+  auto res = PublishDirectory(dir_ / "staging", dir_ / "target");
+  ASSERT_TRUE(res.has_value()) << res.error();
+  EXPECT_EQ(ReadFile(dir_ / "target" / "lib" / "a.so"), "a");
+  EXPECT_FALSE(std::filesystem::exists(dir_ / "staging"));
+}
+
+TEST_F(ExtractingSinkTest, MergesIntoAnExistingDirectory) {
+  // the CUDA dependencies share their folder with other files
+  WriteFile(dir_ / "target" / "libcublas.so", "old");
+  WriteFile(dir_ / "target" / "libcudart.so", "other");
+  WriteFile(dir_ / "target" / "sub" / "kept.txt", "kept");
+  WriteFile(dir_ / "staging" / "libcublas.so", "new");
+  WriteFile(dir_ / "staging" / "sub" / "added.txt", "added");
+
+  auto res = PublishDirectory(dir_ / "staging", dir_ / "target");
+  ASSERT_TRUE(res.has_value()) << res.error();
+  EXPECT_EQ(ReadFile(dir_ / "target" / "libcublas.so"), "new");
+  EXPECT_EQ(ReadFile(dir_ / "target" / "libcudart.so"), "other");
+  EXPECT_EQ(ReadFile(dir_ / "target" / "sub" / "kept.txt"), "kept");
+  EXPECT_EQ(ReadFile(dir_ / "target" / "sub" / "added.txt"), "added");
+  EXPECT_FALSE(std::filesystem::exists(dir_ / "staging"));
+}
+
+TEST_F(ExtractingSinkTest, ExtractsIntoAnExistingDirectory) {
+  WriteFile(dir_ / "deps" / "libcudart.so", "other");
+  auto archive = MakeTarGz({{"libcublas.so", std::string(64 * 1024, 'b')}});
+
+  ExtractingSink sink(dir_ / "deps", false);
+  for (size_t pos = 0; pos < archive.size(); pos += 1000) {
+    auto n = std::min<size_t>(1000, archive.size() - pos);
+    ASSERT_TRUE(sink.Write(archive.data() + pos, n));
+  }
+  auto res = sink.Close(true);
+  ASSERT_TRUE(res.has_value()) << res.error();
+  EXPECT_EQ(ReadFile(dir_ / "deps" / "libcublas.so"),
+            std::string(64 * 1024, 'b'));
+  EXPECT_EQ(ReadFile(dir_ / "deps" / "libcudart.so"), "other");
+  EXPECT_FALSE(std::filesystem::exists(dir_ / "deps.staging"));
+}
+
+TEST_F(ExtractingSinkTest, PartialExtractLeavesTheTargetAlone) {
+  WriteFile(dir_ / "deps" / "libcublas.so", "old");
+  auto archive = MakeTarGz({{"libcublas.so", std::string(100 * 1024, 'b')}});
+
+  {
+    // the archive ends early
+    ExtractingSink sink(dir_ / "deps", false);
+    sink.Write(archive.data(), archive.size() / 2);
+    EXPECT_TRUE(sink.Close(true).has_error());
+  }
+  {
+    // the download fails midway
+    ExtractingSink sink(dir_ / "deps", false);
+    sink.Write(archive.data(), archive.size() / 2);
+    EXPECT_TRUE(sink.Close(false).has_value());
+  }
+  EXPECT_EQ(ReadFile(dir_ / "deps" / "libcublas.so"), "old");
+  EXPECT_FALSE(std::filesystem::exists(dir_ / "deps.staging"));
+}
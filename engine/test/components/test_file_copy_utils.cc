@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include "utils/file_copy_utils.h"
+
+class FileCopyUtilsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::filesystem::temp_directory_path() / "file_copy_utils_test";
+    std::filesystem::create_directories(dir_);
+    src_ = dir_ / "src.gguf";
+    // spans a few chunks of the userspace fallback
+    std::string data(3 * file_copy_utils::kBufferSize + 7, '\0');
+    for (size_t i = 0; i < data.size(); i++) {
+      data[i] = static_cast<char>(i % 251);
+    }
+    std::ofstream(src_, std::ios::binary) << data;
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  static std::string ReadAll(const std::filesystem::path& p) {
+    std::ifstream in(p, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), {});
+  }
+
+  std::filesystem::path dir_;
+  std::filesystem::path src_;
+};
+
+TEST_F(FileCopyUtilsTest, CopiesContentAndReportsProgress) {
+  auto dst = dir_ / "dst.gguf";
+  uint64_t last = 0;
+  auto res = file_copy_utils::CopyFile(src_, dst, [&](uint64_t copied,
+                                                      uint64_t total) {
+    EXPECT_GE(copied, last);
+    EXPECT_EQ(total, std::filesystem::file_size(src_));
+    last = copied;
+    return true;
+  });
+  ASSERT_TRUE(res.has_value()) << res.error();
+  EXPECT_EQ(last, std::filesystem::file_size(src_));
+  EXPECT_EQ(ReadAll(dst), ReadAll(src_));
+}
+
+TEST_F(FileCopyUtilsTest, UserspaceFallbackCanBeCancelled) {
+  auto dst = dir_ / "dst.gguf";
+  auto total = std::filesystem::file_size(src_);
+  auto res = file_copy_utils::CopyWithStreams(
+      src_, dst, total, [](uint64_t, uint64_t) { return false; });
+  EXPECT_TRUE(res.has_error());
+
+  res = file_copy_utils::CopyWithStreams(src_, dst, total,
+                                         [](uint64_t, uint64_t) { return true; });
+  ASSERT_TRUE(res.has_value()) << res.error();
+  EXPECT_EQ(res.value(), file_copy_utils::CopyMethod::kReadWrite);
+  EXPECT_EQ(ReadAll(dst), ReadAll(src_));
+}
+
+TEST_F(FileCopyUtilsTest, FailsOnMissingSource) {
+  auto res = file_copy_utils::CopyFile(dir_ / "missing.gguf", dir_ / "dst",
+                                       [](uint64_t, uint64_t) { return true; });
+  EXPECT_TRUE(res.has_error());
+}
@@ -154,4 +154,104 @@ TEST_F(FunctionCallingUtilsTest, PostProcessResponse) {
                     ["arguments"]
                         .asString(),
             "{\"arg\":\"value\"}");
-}
\ No newline at end of file
+}
+
+TEST_F(FunctionCallingUtilsTest, ToolCallParserHandlesSplitMarkers) {
+  std::string text =
+      "Let me check. <b>ok</b> "
+      "<function=get_weather>{\"city\": \"a<b\"}</function>"
+      "<function=get_time>{}</function> <func";
+  for (size_t step = 1; step <= text.size(); step++) {
+    function_calling_utils::ToolCallParser parser;
+    std::string content;
+    std::vector<std::string> names;
+    std::vector<std::string> arguments;
+    auto collect = [&](function_calling_utils::ToolCallParser::Output out) {
+      content += out.content;
+      for (auto const& delta : out.tool_calls) {
+        auto index = delta["index"].asUInt();
+        if (delta.isMember("id")) {
+          ASSERT_EQ(index, names.size());
+          names.push_back(delta["function"]["name"].asString());
+          arguments.emplace_back();
+        }
+        arguments[index] += delta["function"]["arguments"].asString();
+      }
+    };
+    for (size_t pos = 0; pos < text.size(); pos += step) {
+      collect(parser.Feed(std::string_view(text).substr(pos, step)));
+    }
+    collect(parser.Finish());
+
+    EXPECT_EQ(content, "Let me check. <b>ok</b>  <func") << "step " << step;
+    ASSERT_EQ(names.size(), 2u) << "step " << step;
+    EXPECT_EQ(names[0], "get_weather");
+    EXPECT_EQ(arguments[0], "{\"city\": \"a<b\"}");
+    EXPECT_EQ(names[1], "get_time");
+    EXPECT_EQ(arguments[1], "{}");
+  }
+}
+
+TEST_F(FunctionCallingUtilsTest, PostProcessStreamChunk) {
+  function_calling_utils::ToolCallParser parser;
+  auto chunk = [](const std::string& content, bool last) {
+    Json::Value res;
+    res["data"] = "data: {\"choices\":[{\"delta\":{\"content\":\"" + content +
+                  "\"},\"finish_reason\":" + (last ? "\"stop\"" : "null") +
+                  "}]}\n\n";
+    return res;
+  };
+  auto parse = [](const Json::Value& res) {
+    auto data = res["data"].asString();
+    return function_calling_utils::ParseJsonString(data.substr(6));
+  };
+
+  auto res = chunk("<function=f>{", false);
+  ASSERT_TRUE(function_calling_utils::PostProcessStreamChunk(parser, res));
+  auto delta = parse(res)["choices"][0]["delta"];
+  EXPECT_EQ(delta["content"].asString(), "");
+  EXPECT_EQ(delta["tool_calls"][0]["function"]["name"].asString(), "f");
+  EXPECT_EQ(delta["tool_calls"][1]["function"]["arguments"].asString(), "{");
+
+  res = chunk("}</func", false);
+  ASSERT_TRUE(function_calling_utils::PostProcessStreamChunk(parser, res));
+  // the rest of the closing marker, nothing to send
+  res = chunk("tion>", false);
+  EXPECT_FALSE(function_calling_utils::PostProcessStreamChunk(parser, res));
+
+  res = chunk("", true);
+  ASSERT_TRUE(function_calling_utils::PostProcessStreamChunk(parser, res));
+  EXPECT_EQ(parse(res)["choices"][0]["finish_reason"].asString(),
+            "tool_calls");
+  ASSERT_EQ(parser.calls().size(), 1u);
+  EXPECT_EQ(parser.calls()[0].arguments, "{}");
+}
+
+TEST_F(FunctionCallingUtilsTest, SystemPromptCacheKeysOnToolsAndChoice) {
+  function_calling_utils::SystemPromptCache cache(2);
+  int builds = 0;
+  auto get = [&cache, &builds](const std::string& json) {
+    return *cache.Get(function_calling_utils::ParseJsonString(json), [&] {
+      builds++;
+      return std::to_string(builds);
+    });
+  };
+
+  auto tools = R"({"tools": [{"type": "function",
+                               "function": {"name": "f", "parameters": {}}}]})";
+  EXPECT_EQ(get(tools), "1");
+  // the same tools with the members in another order
+  EXPECT_EQ(get(R"({"tools": [{"function": {"parameters": {}, "name": "f"},
+                               "type": "function"}], "messages": []})"),
+            "1");
+  EXPECT_EQ(cache.hits(), 1u);
+
+  EXPECT_EQ(get(R"({"tools": [{"type": "function",
+                               "function": {"name": "f", "parameters": {}}}],
+                    "tool_choice": "required"})"),
+            "2");
+  EXPECT_EQ(get(R"({"tools": [], "parallel_tool_calls": false})"), "3");
+  EXPECT_EQ(cache.size(), 2u);
+  // evicted as the least recently used
+  EXPECT_EQ(get(tools), "4");
+}
@@ -85,3 +85,19 @@ TEST_F(HuggingFaceUtilTestSuite, TestGetHuggingFaceDownloadUrlWithBranchName) {
 
   EXPECT_EQ(downloadable_url, expected_url);
 }
+
+TEST_F(HuggingFaceUtilTestSuite, TestGetHuggingFaceApiUrls) {
+  EXPECT_EQ(huggingface_utils::GetModelsByAuthorUrl("cortexso"),
+            "https://huggingface.co/api/models?author=cortexso");
+  EXPECT_EQ(huggingface_utils::GetModelRepoInfoUrl("cortexso", "tinyllama"),
+            "https://huggingface.co/api/models/cortexso/tinyllama");
+  EXPECT_EQ(huggingface_utils::GetModelRefsUrl("cortexso", "tinyllama"),
+            "https://huggingface.co/api/models/cortexso/tinyllama/refs");
+  EXPECT_EQ(huggingface_utils::GetModelTreeUrl("cortexso", "tinyllama"),
+            "https://huggingface.co/api/models/cortexso/tinyllama/tree/main");
+  EXPECT_EQ(
+      huggingface_utils::GetModelTreeUrl("cortexso", "tinyllama", "gguf", "a"),
+      "https://huggingface.co/api/models/cortexso/tinyllama/tree/gguf/a");
+  EXPECT_EQ(huggingface_utils::GetReadMeUrl("cortexso", "tinyllama"),
+            "https://huggingface.co/cortexso/tinyllama/raw/main/README.md");
+}
@@ -0,0 +1,241 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "services/inference_scheduler.h"
+
+class InferenceSchedulerTest : public ::testing::Test {
+ protected:
+  std::shared_ptr<InferenceScheduler> CreateScheduler(
+      InferenceScheduler::Config config) {
+    return std::make_shared<InferenceScheduler>(std::move(config));
+  }
+
+  static bool WaitFor(std::function<bool()> pred) {
+    for (int i = 0; i < 200; i++) {
+      if (pred()) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return pred();
+  }
+};
+
+TEST_F(InferenceSchedulerTest, DispatchesInlineWhenSlotIsFree) {
+  auto scheduler = CreateScheduler({.max_concurrency = 1});
+  bool dispatched = false;
+  auto rejection = scheduler->Submit(
+      "model", {},
+      [&dispatched](InferenceScheduler::TicketPtr) { dispatched = true; },
+      nullptr);
+  EXPECT_FALSE(rejection.has_value());
+  EXPECT_TRUE(dispatched);
+  // ticket went out of scope, slot is free again
+  EXPECT_EQ(scheduler->GetInFlight("model"), 0);
+}
+
+TEST_F(InferenceSchedulerTest, RejectsWhenQueueIsFull) {
+  auto scheduler =
+      CreateScheduler({.max_concurrency = 1, .max_queue_size = 1});
+  InferenceScheduler::TicketPtr held;
+  scheduler->Submit(
+      "model", {}, [&held](InferenceScheduler::TicketPtr t) { held = t; },
+      nullptr);
+  EXPECT_EQ(scheduler->GetInFlight("model"), 1);
+
+  auto first = scheduler->Submit(
+      "model", {}, [](InferenceScheduler::TicketPtr) {}, nullptr);
+  EXPECT_FALSE(first.has_value());
+  EXPECT_EQ(scheduler->GetQueued("model"), 1u);
+
+  auto second = scheduler->Submit(
+      "model", {}, [](InferenceScheduler::TicketPtr) {}, nullptr);
+  ASSERT_TRUE(second.has_value());
+  EXPECT_EQ(second->status_code, 429);
+  EXPECT_GE(second->retry_after_s, 1);
+
+  held->Release();
+  EXPECT_TRUE(WaitFor([&] { return scheduler->GetQueued("model") == 0; }));
+}
+
+TEST_F(InferenceSchedulerTest, HigherPriorityGoesFirst) {
+  auto scheduler = CreateScheduler({.max_concurrency = 1});
+  InferenceScheduler::TicketPtr held;
+  scheduler->Submit(
+      "model", {}, [&held](InferenceScheduler::TicketPtr t) { held = t; },
+      nullptr);
+
+  std::mutex mtx;
+  std::vector<std::string> order;
+  auto record = [&](std::string name) {
+    return [&, name](InferenceScheduler::TicketPtr) {
+      std::lock_guard<std::mutex> l(mtx);
+      order.push_back(name);
+    };
+  };
+  scheduler->Submit("model", {.priority = RequestPriority::kLow}, record("low"),
+                    nullptr);
+  scheduler->Submit("model", {.priority = RequestPriority::kHigh},
+                    record("high"), nullptr);
+
+  held->Release();
+  EXPECT_TRUE(WaitFor([&] {
+    std::lock_guard<std::mutex> l(mtx);
+    return order.size() == 2;
+  }));
+  EXPECT_EQ(order[0], "high");
+  EXPECT_EQ(order[1], "low");
+}
+
+TEST_F(InferenceSchedulerTest, WeightedFairnessAcrossClients) {
+  auto scheduler = CreateScheduler(
+      {.max_concurrency = 1, .client_weights = {{"a", 2}, {"b", 1}}});
+  InferenceScheduler::TicketPtr held;
+  scheduler->Submit(
+      "model", {}, [&held](InferenceScheduler::TicketPtr t) { held = t; },
+      nullptr);
+
+  std::mutex mtx;
+  std::vector<std::string> order;
+  std::vector<InferenceScheduler::TicketPtr> tickets;
+  auto record = [&](std::string name) {
+    return [&, name](InferenceScheduler::TicketPtr t) {
+      std::lock_guard<std::mutex> l(mtx);
+      order.push_back(name);
+      tickets.push_back(t);
+    };
+  };
+  for (int i = 0; i < 4; i++) {
+    scheduler->Submit("model", {.client_id = "a"}, record("a"), nullptr);
+    scheduler->Submit("model", {.client_id = "b"}, record("b"), nullptr);
+  }
+
+  // run the queued requests one by one
+  held->Release();
+  for (size_t n = 1; n <= 6; n++) {
+    ASSERT_TRUE(WaitFor([&] {
+      std::lock_guard<std::mutex> l(mtx);
+      return order.size() >= n;
+    }));
+    std::lock_guard<std::mutex> l(mtx);
+    tickets.back()->Release();
+  }
+
+  std::lock_guard<std::mutex> l(mtx);
+  auto count_a = std::count(order.begin(), order.begin() + 6, "a");
+  EXPECT_EQ(count_a, 4);
+}
+
+TEST_F(InferenceSchedulerTest, ExpiresRequestsPastDeadline) {
+  auto scheduler = CreateScheduler({.max_concurrency = 1});
+  InferenceScheduler::TicketPtr held;
+  scheduler->Submit(
+      "model", {}, [&held](InferenceScheduler::TicketPtr t) { held = t; },
+      nullptr);
+
+  std::atomic<int> expired_status{0};
+  bool dispatched = false;
+  scheduler->Submit(
+      "model",
+      {.deadline =
+           std::chrono::steady_clock::now() + std::chrono::milliseconds(20)},
+      [&dispatched](InferenceScheduler::TicketPtr) { dispatched = true; },
+      [&expired_status](const InferenceScheduler::Rejection& r) {
+        expired_status = r.status_code;
+      });
+
+  EXPECT_TRUE(WaitFor([&] { return expired_status.load() != 0; }));
+  EXPECT_EQ(expired_status.load(), 408);
+  EXPECT_EQ(scheduler->GetQueued("model"), 0u);
+  held->Release();
+  EXPECT_FALSE(dispatched);
+}
+
+TEST_F(InferenceSchedulerTest, ModelConcurrencyOverridesDefault) {
+  auto scheduler = CreateScheduler({.max_concurrency = 1});
+  scheduler->SetModelConcurrency("model", 2);
+  std::vector<InferenceScheduler::TicketPtr> held;
+  for (int i = 0; i < 2; i++) {
+    scheduler->Submit(
+        "model", {},
+        [&held](InferenceScheduler::TicketPtr t) { held.push_back(t); },
+        nullptr);
+  }
+  EXPECT_EQ(held.size(), 2u);
+  EXPECT_EQ(scheduler->GetInFlight("model"), 2);
+}
+
+TEST_F(InferenceSchedulerTest, DropsRequestsCancelledWhileQueued) {
+  auto scheduler = CreateScheduler({.max_concurrency = 1});
+  InferenceScheduler::TicketPtr held;
+  scheduler->Submit(
+      "model", {}, [&held](InferenceScheduler::TicketPtr t) { held = t; },
+      nullptr);
+
+  auto cancellation =
+      std::make_shared<RequestCancellation>("req_1", std::nullopt);
+  std::atomic_bool dispatched{false};
+  std::atomic_int expired{0};
+  scheduler->Submit(
+      "model", {.cancellation = cancellation},
+      [&dispatched](InferenceScheduler::TicketPtr) { dispatched = true; },
+      [&expired](const InferenceScheduler::Rejection& r) {
+        expired = r.status_code;
+      });
+  EXPECT_EQ(scheduler->GetQueued("model"), 1u);
+
+  // the client went away while the request waited for the slot
+  cancellation->Cancel(RequestCancellation::Reason::kClientClosed);
+  EXPECT_TRUE(WaitFor([&] { return scheduler->GetQueued("model") == 0; }));
+  held->Release();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(dispatched.load());
+  // whoever waits for its result is answered
+  EXPECT_EQ(expired.load(), 499);
+  EXPECT_EQ(scheduler->GetInFlight("model"), 0);
+}
+
+TEST_F(InferenceSchedulerTest, RejectsRequestsCancelledBeforeSubmit) {
+  auto scheduler = CreateScheduler({.max_concurrency = 1});
+  auto cancellation =
+      std::make_shared<RequestCancellation>("req_1", std::nullopt);
+  cancellation->Cancel(RequestCancellation::Reason::kDeadlineExceeded);
+  bool dispatched = false;
+  auto rejection = scheduler->Submit(
+      "model", {.cancellation = cancellation},
+      [&dispatched](InferenceScheduler::TicketPtr) { dispatched = true; },
+      nullptr);
+  ASSERT_TRUE(rejection.has_value());
+  EXPECT_EQ(rejection->status_code, 408);
+  EXPECT_FALSE(dispatched);
+  EXPECT_EQ(scheduler->GetQueued("model"), 0u);
+}
+
+TEST_F(InferenceSchedulerTest, ForgetsUnloadedModels) {
+  auto scheduler = CreateScheduler({.max_concurrency = 1});
+  scheduler->SetModelConcurrency("idle", 4);
+  scheduler->RemoveModel("idle");
+  EXPECT_EQ(scheduler->GetModelCount(), 0u);
+
+  InferenceScheduler::TicketPtr held;
+  scheduler->Submit(
+      "busy", {}, [&held](InferenceScheduler::TicketPtr t) { held = t; },
+      nullptr);
+  bool dispatched = false;
+  scheduler->Submit(
+      "busy", {},
+      [&dispatched](InferenceScheduler::TicketPtr) { dispatched = true; },
+      nullptr);
+
+  // kept until its requests are done
+  scheduler->RemoveModel("busy");
+  EXPECT_EQ(scheduler->GetModelCount(), 1u);
+  held->Release();
+  EXPECT_TRUE(WaitFor([&] { return scheduler->GetModelCount() == 0; }));
+  EXPECT_TRUE(dispatched);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include "services/model_catalog.h"
+
+namespace {
+ModelCatalog::Entry CreateEntry(const std::string& id,
+                                const std::string& engine,
+                                const std::string& status, uint64_t size) {
+  Json::Value obj;
+  obj["id"] = id;
+  obj["engine"] = engine;
+  return {.id = id,
+          .engine = engine,
+          .status = status,
+          .source = "https://huggingface.co/" + id,
+          .size = size,
+          .object = obj};
+}
+
+std::vector<std::string> Ids(const std::string& body) {
+  Json::Value root;
+  Json::Reader reader;
+  EXPECT_TRUE(reader.parse(body, root));
+  std::vector<std::string> ids;
+  for (auto const& item : root["data"]) {
+    ids.push_back(item["id"].asString());
+  }
+  return ids;
+}
+}  // namespace
+
+class ModelCatalogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    catalog_.Replace({CreateEntry("c", "llama-cpp", "downloaded", 300),
+                      CreateEntry("a", "llama-cpp", "downloaded", 100),
+                      CreateEntry("d", "openai", "remote", 0),
+                      CreateEntry("b", "python-engine", "downloadable", 200)});
+  }
+
+  ModelCatalog catalog_;
+};
+
+TEST_F(ModelCatalogTest, ListsEverythingSortedById) {
+  auto res = catalog_.List({});
+  EXPECT_EQ(Ids(res.body), (std::vector<std::string>{"a", "b", "c", "d"}));
+  EXPECT_EQ(res.etag, catalog_.ETag());
+
+  Json::Value root;
+  Json::Reader reader;
+  ASSERT_TRUE(reader.parse(res.body, root));
+  EXPECT_EQ(root["object"].asString(), "list");
+  EXPECT_EQ(root["result"].asString(), "OK");
+}
+
+TEST_F(ModelCatalogTest, FiltersByColumns) {
+  EXPECT_EQ(Ids(catalog_.List({.engine = "llama-cpp"}).body),
+            (std::vector<std::string>{"a", "c"}));
+  EXPECT_EQ(Ids(catalog_.List({.status = "remote"}).body),
+            (std::vector<std::string>{"d"}));
+  EXPECT_EQ(Ids(catalog_.List({.source = "https://huggingface.co/b"}).body),
+            (std::vector<std::string>{"b"}));
+  EXPECT_EQ(Ids(catalog_.List({.min_size = 150, .max_size = 300}).body),
+            (std::vector<std::string>{"b", "c"}));
+}
+
+TEST_F(ModelCatalogTest, PaginatesAfterId) {
+  Json::Value root;
+  Json::Reader reader;
+  ASSERT_TRUE(reader.parse(catalog_.List({.limit = 2}).body, root));
+  EXPECT_EQ(root["data"].size(), 2u);
+  EXPECT_EQ(root["first_id"].asString(), "a");
+  EXPECT_EQ(root["last_id"].asString(), "b");
+  EXPECT_TRUE(root["has_more"].asBool());
+
+  ASSERT_TRUE(
+      reader.parse(catalog_.List({.after = "b", .limit = 2}).body, root));
+  EXPECT_EQ(root["first_id"].asString(), "c");
+  EXPECT_EQ(root["last_id"].asString(), "d");
+  EXPECT_FALSE(root["has_more"].asBool());
+
+  // the cursor does not have to be an id of the catalog
+  EXPECT_EQ(Ids(catalog_.List({.after = "bb"}).body),
+            (std::vector<std::string>{"c", "d"}));
+}
+
+TEST_F(ModelCatalogTest, ETagChangesOnlyWithContent) {
+  auto etag = catalog_.ETag();
+  EXPECT_FALSE(
+      catalog_.Replace({CreateEntry("a", "llama-cpp", "downloaded", 100),
+                        CreateEntry("b", "python-engine", "downloadable", 200),
+                        CreateEntry("c", "llama-cpp", "downloaded", 300),
+                        CreateEntry("d", "openai", "remote", 0)}));
+  EXPECT_EQ(catalog_.ETag(), etag);
+
+  EXPECT_TRUE(
+      catalog_.Replace({CreateEntry("a", "llama-cpp", "downloaded", 100)}));
+  EXPECT_NE(catalog_.ETag(), etag);
+  EXPECT_EQ(catalog_.Size(), 1u);
+}
+
+TEST_F(ModelCatalogTest, FilteredETagFollowsTheFilteredView) {
+  auto all = catalog_.List({}).etag;
+  auto llama = catalog_.List({.engine = "llama-cpp"}).etag;
+  EXPECT_NE(llama, all);
+  EXPECT_NE(llama, catalog_.List({.engine = "openai"}).etag);
+  EXPECT_EQ(llama, catalog_.List({.engine = "llama-cpp"}).etag);
+
+  // a change outside the view keeps its ETag
+  catalog_.Replace({CreateEntry("c", "llama-cpp", "downloaded", 300),
+                    CreateEntry("a", "llama-cpp", "downloaded", 100),
+                    CreateEntry("e", "openai", "remote", 0)});
+  EXPECT_NE(catalog_.List({}).etag, all);
+  EXPECT_EQ(catalog_.List({.engine = "llama-cpp"}).etag, llama);
+
+  // a change inside it gives it a new one
+  catalog_.Replace({CreateEntry("a", "llama-cpp", "downloaded", 100)});
+  EXPECT_NE(catalog_.List({.engine = "llama-cpp"}).etag, llama);
+}
@@ -100,6 +100,39 @@ TEST_F(ModelsTestSuite, TestDeleteModelEntry) {
   EXPECT_TRUE(model_list_.GetModelInfo(kTestModel.model).has_error());
 }
 
+TEST_F(ModelsTestSuite, TestDeleteModelEntries) {
+  auto second = kTestModel;
+  second.model = "test_model_2";
+  EXPECT_TRUE(model_list_.AddModelEntry(kTestModel).value());
+  EXPECT_TRUE(model_list_.AddModelEntry(second).value());
+
+  auto res = model_list_.DeleteModelEntries(
+      {kTestModel.model, second.model, "non_existent_model"});
+  ASSERT_TRUE(res.has_value());
+  EXPECT_EQ(res.value(), 2);
+  EXPECT_FALSE(model_list_.HasModel(kTestModel.model));
+  EXPECT_FALSE(model_list_.HasModel(second.model));
+}
+
+TEST_F(ModelsTestSuite, TestVersionChangesOnWrite) {
+  auto version = Models::Version();
+  EXPECT_TRUE(model_list_.AddModelEntry(kTestModel).value());
+  EXPECT_GT(Models::Version(), version);
+
+  version = Models::Version();
+  model_list_.GetModelInfo(kTestModel.model);
+  model_list_.LoadModelList();
+  EXPECT_EQ(Models::Version(), version);
+
+  EXPECT_TRUE(
+      model_list_.UpdateModelEntry(kTestModel.model, kTestModel).value());
+  EXPECT_GT(Models::Version(), version);
+
+  version = Models::Version();
+  EXPECT_TRUE(model_list_.DeleteModelEntry(kTestModel.model).value());
+  EXPECT_GT(Models::Version(), version);
+}
+
 TEST_F(ModelsTestSuite, TestPersistence) {
   EXPECT_TRUE(model_list_.AddModelEntry(kTestModel).value());
 
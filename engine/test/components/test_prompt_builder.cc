@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+#include "services/prompt_builder.h"
+
+namespace {
+const std::string kChatMLTemplate =
+    "{% for message in messages %}"
+    "{{ '<|im_start|>' + message['role'] + '\n' + message['content'] + "
+    "'<|im_end|>' + '\n' }}"
+    "{% endfor %}"
+    "{% if add_generation_prompt %}{{ '<|im_start|>assistant\n' }}{% endif %}";
+
+// The system prompt goes into the last user turn, which moves as the
+// conversation grows
+const std::string kLastUserSystemTemplate =
+    "{% set system = messages[0]['content'] "
+    "if messages[0]['role'] == 'system' else '' %}"
+    "{% for message in messages %}"
+    "{% if message['role'] == 'user' %}"
+    "{% if loop.last and system %}{{ '[INST] ' + system + '\\n\\n' + "
+    "message['content'] + ' [/INST]' }}"
+    "{% else %}{{ '[INST] ' + message['content'] + ' [/INST]' }}{% endif %}"
+    "{% elif message['role'] == 'assistant' %}"
+    "{{ message['content'] + '</s>' }}"
+    "{% endif %}"
+    "{% endfor %}";
+
+nlohmann::ordered_json Message(const std::string& role,
+                               const std::string& content) {
+  return {{"role", role}, {"content", content}};
+}
+
+std::string FullRender(const std::string& tmpl,
+                       const nlohmann::ordered_json& messages) {
+  return minja::chat_template(tmpl, "", "").apply(messages, nullptr, true);
+}
+}  // namespace
+
+class PromptBuilderTest : public ::testing::Test {
+ protected:
+  PromptBuilder builder_{PromptBuilder::Config{}};
+};
+
+TEST_F(PromptBuilderTest, DetectsAppendStableTemplates) {
+  EXPECT_TRUE(PromptBuilder::IsAppendStable(
+      minja::chat_template(kChatMLTemplate, "", "")));
+  EXPECT_FALSE(PromptBuilder::IsAppendStable(
+      minja::chat_template(kLastUserSystemTemplate, "", "")));
+}
+
+TEST_F(PromptBuilderTest, ReusesPrefixAcrossTurns) {
+  auto messages = nlohmann::ordered_json::array(
+      {Message("system", "be brief"), Message("user", "hello")});
+  for (int turn = 0; turn < 4; turn++) {
+    auto res = builder_.Render(kChatMLTemplate, messages, "", "", false, false,
+                               true);
+    ASSERT_TRUE(res.has_value()) << res.error();
+    EXPECT_EQ(res.value(), FullRender(kChatMLTemplate, messages));
+    messages.push_back(Message("assistant", "answer " + std::to_string(turn)));
+    messages.push_back(Message("user", "question " + std::to_string(turn)));
+  }
+  // every turn but the first extends the previous one
+  EXPECT_EQ(builder_.GetHits(), 3u);
+  EXPECT_GT(builder_.GetMemoryBytes(), 0u);
+}
+
+TEST_F(PromptBuilderTest, FallsBackToFullRender) {
+  auto messages = nlohmann::ordered_json::array(
+      {Message("system", "be brief"), Message("user", "hello"),
+       Message("assistant", "hi"), Message("user", "bye")});
+  for (int i = 0; i < 2; i++) {
+    auto res = builder_.Render(kLastUserSystemTemplate, messages, "", "", false,
+                               false, true);
+    ASSERT_TRUE(res.has_value()) << res.error();
+    EXPECT_EQ(res.value(), FullRender(kLastUserSystemTemplate, messages));
+  }
+  EXPECT_EQ(builder_.GetHits(), 0u);
+  EXPECT_EQ(builder_.GetMemoryBytes(), 0u);
+}
+
+TEST_F(PromptBuilderTest, EvictsUnderBudget) {
+  PromptBuilder builder{PromptBuilder::Config{.max_bytes = 64}};
+  for (int i = 0; i < 8; i++) {
+    auto messages = nlohmann::ordered_json::array(
+        {Message("user", "conversation " + std::to_string(i))});
+    ASSERT_TRUE(builder
+                    .Render(kChatMLTemplate, messages, "", "", false, false,
+                            true)
+                    .has_value());
+  }
+  EXPECT_LE(builder.GetMemoryBytes(), 64u);
+}
@@ -0,0 +1,176 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "extensions/remote-engine/rate_limiter.h"
+
+using remote_engine::RateLimiter;
+using namespace std::chrono_literals;
+
+namespace {
+using Clock = RateLimiter::Clock;
+
+// Runs the timer tasks on the test thread, each once it is due
+class ManualTimer {
+ public:
+  RateLimiter::TimerFn fn() {
+    return [this](Clock::duration delay, std::function<void()> task) {
+      std::lock_guard<std::mutex> l(mtx_);
+      tasks_.push_back({Clock::now() + delay, std::move(task)});
+    };
+  }
+
+  // Run the tasks until none is left
+  void Run() {
+    while (true) {
+      std::pair<Clock::time_point, std::function<void()>> next;
+      {
+        std::lock_guard<std::mutex> l(mtx_);
+        if (tasks_.empty()) {
+          return;
+        }
+        auto it = std::min_element(
+            tasks_.begin(), tasks_.end(),
+            [](auto const& a, auto const& b) { return a.first < b.first; });
+        next = std::move(*it);
+        tasks_.erase(it);
+      }
+      std::this_thread::sleep_until(next.first);
+      next.second();
+    }
+  }
+
+ private:
+  std::mutex mtx_;
+  std::vector<std::pair<Clock::time_point, std::function<void()>>> tasks_;
+};
+
+// Time until a queued request of [tokens] is answered
+std::chrono::milliseconds Queued(RateLimiter& limiter, ManualTimer& timer,
+                                 int64_t tokens,
+                                 std::optional<RateLimiter::Rejection>*
+                                     rejection = nullptr) {
+  auto begin = Clock::now();
+  std::optional<Clock::time_point> answered;
+  limiter.Acquire(tokens, [&](std::optional<RateLimiter::Rejection> r) {
+    answered = Clock::now();
+    if (rejection != nullptr) {
+      *rejection = std::move(r);
+    } else {
+      EXPECT_EQ(r, std::nullopt);
+    }
+  });
+  timer.Run();
+  EXPECT_TRUE(answered.has_value());
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      answered.value_or(begin) - begin);
+}
+}  // namespace
+
+class RateLimiterTest : public ::testing::Test {
+ protected:
+  ManualTimer timer_;
+};
+
+TEST_F(RateLimiterTest, BurstIsServedThenSmoothed) {
+  // 10 requests per second, half a second of burst
+  RateLimiter limiter(
+      RateLimiter::Config{.requests_per_minute = 600, .burst_seconds = 0.5},
+      timer_.fn());
+  for (int i = 0; i < 5; i++) {
+    EXPECT_TRUE(limiter.TryAcquire(0));
+  }
+  EXPECT_FALSE(limiter.TryAcquire(0));
+
+  auto next = Queued(limiter, timer_, 0);
+  EXPECT_GE(next, 80ms);
+  EXPECT_LT(next, 300ms);
+}
+
+TEST_F(RateLimiterTest, WaitingHoldsNoThread) {
+  RateLimiter limiter(
+      RateLimiter::Config{.requests_per_minute = 600, .burst_seconds = 0.1},
+      timer_.fn());
+  EXPECT_TRUE(limiter.TryAcquire(0));
+  std::vector<int> admitted;
+  for (int i = 0; i < 3; i++) {
+    limiter.Acquire(0, [&admitted, i](auto rejection) {
+      EXPECT_EQ(rejection, std::nullopt);
+      admitted.push_back(i);
+    });
+  }
+  // queued, the calls returned at once
+  EXPECT_TRUE(admitted.empty());
+  EXPECT_EQ(limiter.GetQueueSize(), 3u);
+  // nothing jumps the queue
+  EXPECT_FALSE(limiter.TryAcquire(0));
+  timer_.Run();
+  EXPECT_EQ(admitted, (std::vector<int>{0, 1, 2}));
+}
+
+TEST_F(RateLimiterTest, RejectsWhenTheWaitIsTooLongOrTheQueueFull) {
+  RateLimiter slow(RateLimiter::Config{.requests_per_minute = 60,
+                                       .burst_seconds = 1,
+                                       .max_wait = 50ms},
+                   timer_.fn());
+  EXPECT_TRUE(slow.TryAcquire(0));
+  std::optional<RateLimiter::Rejection> rejection;
+  EXPECT_LT(Queued(slow, timer_, 0, &rejection), 20ms);
+  ASSERT_TRUE(rejection.has_value());
+  EXPECT_EQ(rejection->retry_after_s, 1);
+
+  RateLimiter limiter(RateLimiter::Config{.requests_per_minute = 600,
+                                          .burst_seconds = 0.1,
+                                          .max_queue = 1},
+                      timer_.fn());
+  EXPECT_TRUE(limiter.TryAcquire(0));
+  bool admitted = false;
+  limiter.Acquire(0, [&admitted](auto r) { admitted = !r.has_value(); });
+  EXPECT_EQ(limiter.GetQueueSize(), 1u);
+  rejection.reset();
+  limiter.Acquire(0, [&rejection](auto r) { rejection = std::move(r); });
+  EXPECT_TRUE(rejection.has_value());
+  timer_.Run();
+  EXPECT_TRUE(admitted);
+}
+
+TEST_F(RateLimiterTest, ThrottlingPausesForRetryAfter) {
+  RateLimiter limiter(RateLimiter::Config{}, timer_.fn());
+  EXPECT_TRUE(limiter.TryAcquire(100));
+  limiter.Update(429, {{"retry-after-ms", "150"}});
+  EXPECT_FALSE(limiter.TryAcquire(100));
+  auto paused = Queued(limiter, timer_, 100);
+  EXPECT_GE(paused, 140ms);
+  EXPECT_LT(paused, 400ms);
+}
+
+TEST_F(RateLimiterTest, ProviderHeadersCapTheBudget) {
+  // 1000 tokens per second
+  RateLimiter limiter(RateLimiter::Config{.tokens_per_minute = 60000},
+                      timer_.fn());
+  EXPECT_TRUE(limiter.TryAcquire(1000));
+  limiter.Update(200, {{"x-ratelimit-remaining-tokens", "0"}});
+  auto capped = Queued(limiter, timer_, 200);
+  EXPECT_GE(capped, 150ms);
+  EXPECT_LT(capped, 500ms);
+
+  // the response used fewer tokens than estimated
+  limiter.Adjust(-5000);
+  EXPECT_TRUE(limiter.TryAcquire(4000));
+}
+
+TEST_F(RateLimiterTest, CollectHeaderLowercasesNamesAndTrimsValues) {
+  RateLimiter::Headers headers;
+  for (std::string line :
+       {"HTTP/1.1 100 Continue\r\n", "X-Stale: 1\r\n", "HTTP/1.1 429 Too\r\n",
+        "Retry-After:  2 \r\n", "X-RateLimit-Remaining-Tokens: 10\r\n",
+        "\r\n"}) {
+    EXPECT_EQ(remote_engine::CollectHeader(line.data(), 1, line.size(),
+                                           &headers),
+              line.size());
+  }
+  EXPECT_EQ(headers.size(), 2u);
+  EXPECT_EQ(headers["retry-after"], "2");
+  EXPECT_EQ(headers["x-ratelimit-remaining-tokens"], "10");
+}
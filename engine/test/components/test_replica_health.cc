@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "extensions/python-engine/replica_health.h"
+
+using python_engine::ReplicaHealth;
+using State = ReplicaHealth::State;
+
+class ReplicaHealthTest : public ::testing::Test {
+ protected:
+  ReplicaHealth::Clock::time_point now_ = ReplicaHealth::Clock::now();
+};
+
+TEST_F(ReplicaHealthTest, StartsUntilTheHealthCheckAnswers) {
+  ReplicaHealth health;
+  EXPECT_EQ(health.state(), State::kStarting);
+  // a replica loading its model refuses connections for a while
+  for (int i = 0; i < 2 * ReplicaHealth::kMaxUnhealthyProbes; i++) {
+    health.OnProbe(false);
+  }
+  EXPECT_EQ(health.state(), State::kStarting);
+  EXPECT_FALSE(health.ShouldTerminate());
+
+  health.OnProbe(true);
+  EXPECT_TRUE(health.ready());
+  EXPECT_STREQ(ReplicaHealth::ToString(health.state()), "ready");
+}
+
+TEST_F(ReplicaHealthTest, HungReplicaIsTakenOutThenTerminated) {
+  ReplicaHealth health;
+  health.OnProbe(true);
+
+  // a slow answer now and then is tolerated
+  for (int i = 0; i < ReplicaHealth::kMaxFailedProbes - 1; i++) {
+    health.OnProbe(false);
+  }
+  EXPECT_TRUE(health.ready());
+  health.OnProbe(true);
+
+  for (int i = 0; i < ReplicaHealth::kMaxFailedProbes; i++) {
+    health.OnProbe(false);
+  }
+  EXPECT_EQ(health.state(), State::kUnhealthy);
+  EXPECT_FALSE(health.ShouldTerminate());
+
+  for (int i = ReplicaHealth::kMaxFailedProbes;
+       i < ReplicaHealth::kMaxUnhealthyProbes; i++) {
+    health.OnProbe(false);
+  }
+  EXPECT_TRUE(health.ShouldTerminate());
+}
+
+TEST_F(ReplicaHealthTest, UnhealthyReplicaRecovers) {
+  ReplicaHealth health;
+  health.OnProbe(true);
+  for (int i = 0; i < ReplicaHealth::kMaxFailedProbes; i++) {
+    health.OnProbe(false);
+  }
+  ASSERT_FALSE(health.ready());
+  health.OnProbe(true);
+  EXPECT_TRUE(health.ready());
+  EXPECT_FALSE(health.ShouldTerminate());
+}
+
+TEST_F(ReplicaHealthTest, RestartsWithGrowingBackoff) {
+  ReplicaHealth health;
+  health.OnExit(now_);
+  EXPECT_EQ(health.state(), State::kExited);
+  EXPECT_FALSE(health.ShouldRestart(now_));
+  EXPECT_TRUE(health.ShouldRestart(now_ + std::chrono::seconds(1)));
+
+  health.OnRestart();
+  EXPECT_EQ(health.state(), State::kStarting);
+  EXPECT_EQ(health.restarts(), 1);
+  // exited again before it was ready, the backoff doubles
+  health.OnExit(now_);
+  EXPECT_FALSE(health.ShouldRestart(now_ + std::chrono::seconds(1)));
+  EXPECT_TRUE(health.ShouldRestart(now_ + std::chrono::seconds(2)));
+
+  for (int i = 0; i < 10; i++) {
+    health.OnRestart();
+    health.OnExit(now_);
+  }
+  EXPECT_TRUE(
+      health.ShouldRestart(now_ + ReplicaHealth::kMaxRestartBackoff));
+
+  // being ready resets the backoff
+  health.OnRestart();
+  health.OnProbe(true);
+  health.OnExit(now_);
+  EXPECT_TRUE(health.ShouldRestart(now_ + std::chrono::seconds(1)));
+}
+
+TEST_F(ReplicaHealthTest, ExitedReplicaIgnoresProbes) {
+  ReplicaHealth health;
+  health.OnExit(now_);
+  health.OnProbe(true);
+  EXPECT_EQ(health.state(), State::kExited);
+}
@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include "common/request_cancellation.h"
+
+namespace {
+using Reason = RequestCancellation::Reason;
+}  // namespace
+
+TEST(RequestCancellationTest, CancelsWhenTheClientIsGone) {
+  RequestCancellation cancellation("req_1", std::nullopt);
+  int stopped = 0;
+  cancellation.OnCancel([&stopped] { stopped++; });
+
+  EXPECT_EQ(cancellation.Check(true), Reason::kNone);
+  EXPECT_FALSE(cancellation.IsCancelled());
+  EXPECT_EQ(stopped, 0);
+
+  EXPECT_EQ(cancellation.Check(false), Reason::kClientClosed);
+  EXPECT_EQ(cancellation.reason(), Reason::kClientClosed);
+  EXPECT_EQ(stopped, 1);
+}
+
+TEST(RequestCancellationTest, CancelsPastTheDeadline) {
+  auto now = RequestCancellation::Clock::now();
+  RequestCancellation cancellation("req_1", now + std::chrono::seconds(1));
+  int stopped = 0;
+  cancellation.OnCancel([&stopped] { stopped++; });
+
+  EXPECT_EQ(cancellation.Check(true, now), Reason::kNone);
+  EXPECT_EQ(cancellation.Check(true, now + std::chrono::seconds(2)),
+            Reason::kDeadlineExceeded);
+  EXPECT_EQ(stopped, 1);
+}
+
+TEST(RequestCancellationTest, CancelsOnce) {
+  RequestCancellation cancellation("req_1", std::nullopt);
+  int stopped = 0;
+  cancellation.OnCancel([&stopped] { stopped++; });
+
+  EXPECT_TRUE(cancellation.Cancel(Reason::kDeadlineExceeded));
+  EXPECT_FALSE(cancellation.Cancel(Reason::kClientClosed));
+  // the watch of a cancelled request answers its client once
+  EXPECT_EQ(cancellation.Check(false), Reason::kNone);
+  EXPECT_EQ(cancellation.reason(), Reason::kDeadlineExceeded);
+  EXPECT_EQ(stopped, 1);
+}
+
+TEST(RequestCancellationTest, StopsRequestsStartedAfterTheCancel) {
+  RequestCancellation cancellation("req_1", std::nullopt);
+  cancellation.Cancel(Reason::kClientClosed);
+  bool stopped = false;
+  cancellation.OnCancel([&stopped] { stopped = true; });
+  EXPECT_TRUE(stopped);
+}
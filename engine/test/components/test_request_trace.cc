@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "utils/request_trace.h"
+
+namespace {
+std::string ReadFile(const std::filesystem::path& path) {
+  std::ifstream in(path);
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+}  // namespace
+
+class RequestTraceTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::filesystem::temp_directory_path() / "test_request_trace";
+    std::filesystem::remove_all(dir_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  std::filesystem::path dir_;
+};
+
+TEST_F(RequestTraceTest, ServerTimingListsCompletedStages) {
+  RequestTrace trace("chat_completion", 1, false);
+  {
+    RequestTrace::Span span(&trace, RequestTrace::kRender);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  trace.Begin(RequestTrace::kEngine);
+
+  auto timing = trace.ServerTiming();
+  EXPECT_EQ(timing.find("render;dur="), 0u);
+  // still running
+  EXPECT_EQ(timing.find("engine"), std::string::npos);
+  EXPECT_NE(timing.find(", total;dur="), std::string::npos);
+  auto render_ms = std::stod(timing.substr(std::strlen("render;dur=")));
+  EXPECT_GE(render_ms, 2.0);
+}
+
+TEST_F(RequestTraceTest, FirstRecordWins) {
+  RequestTrace trace("chat_completion", 1, false);
+  trace.Begin(RequestTrace::kFirstToken);
+  trace.End(RequestTrace::kFirstToken);
+  std::string first;
+  trace.AppendChromeEvents(first);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  trace.End(RequestTrace::kFirstToken);
+  std::string second;
+  trace.AppendChromeEvents(second);
+  EXPECT_EQ(first.substr(0, first.find('\n')),
+            second.substr(0, second.find('\n')));
+
+  EXPECT_TRUE(trace.Finish());
+  EXPECT_FALSE(trace.Finish());
+}
+
+TEST_F(RequestTraceTest, SamplesAShareOfTheRequests) {
+  TraceSink sink({.path = dir_ / "trace.json", .sample_rate = 0.25});
+  auto sampled = 0;
+  for (int i = 0; i < 100; i++) {
+    sampled += sink.StartTrace("chat_completion")->sampled();
+  }
+  EXPECT_EQ(sampled, 25);
+
+  TraceSink off({.path = dir_ / "trace.json"});
+  EXPECT_FALSE(off.StartTrace("chat_completion")->sampled());
+}
+
+TEST_F(RequestTraceTest, WritesRotatingChromeTraceFiles) {
+  auto path = dir_ / "trace.json";
+  TraceSink sink(
+      {.path = path, .sample_rate = 1, .max_bytes = 1024, .max_files = 2});
+  for (int i = 0; i < 20; i++) {
+    auto trace = sink.StartTrace("chat \"completion\"");
+    { RequestTrace::Span span(trace.get(), RequestTrace::kParse); }
+    sink.Write(*trace);
+  }
+
+  auto current = ReadFile(path);
+  EXPECT_EQ(current.rfind("[\n", 0), 0u);
+  EXPECT_LE(current.size(), 1024u);
+  EXPECT_NE(current.find("\"name\":\"chat \\\"completion\\\"\""),
+            std::string::npos);
+  EXPECT_NE(current.find("\"name\":\"parse\",\"cat\":\"stage\",\"ph\":\"X\""),
+            std::string::npos);
+  EXPECT_TRUE(std::filesystem::exists(dir_ / "trace.json.1"));
+  EXPECT_FALSE(std::filesystem::exists(dir_ / "trace.json.2"));
+}
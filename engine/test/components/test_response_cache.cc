@@ -0,0 +1,209 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include "services/response_cache.h"
+
+namespace {
+ResponseCache::Entry CreateEntry(const std::string& content) {
+  Json::Value status;
+  status["status_code"] = 200;
+  status["is_done"] = true;
+  status["is_stream"] = false;
+  Json::Value res;
+  res["content"] = content;
+  return {{status, res}};
+}
+}  // namespace
+
+class ResponseCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    disk_path_ = std::filesystem::temp_directory_path() / "response_cache_test";
+    std::filesystem::remove_all(disk_path_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(disk_path_); }
+
+  std::filesystem::path disk_path_;
+};
+
+TEST_F(ResponseCacheTest, IsCacheable) {
+  Json::Value body;
+  EXPECT_TRUE(ResponseCache::IsCacheable(body, true));
+  EXPECT_FALSE(ResponseCache::IsCacheable(body, false));
+
+  body["temperature"] = 0;
+  EXPECT_TRUE(ResponseCache::IsCacheable(body, false));
+  body["n"] = 2;
+  EXPECT_FALSE(ResponseCache::IsCacheable(body, false));
+
+  // engines which ignore top_k still sample with the temperature
+  Json::Value top_k;
+  top_k["temperature"] = 0.7;
+  top_k["top_k"] = 1;
+  EXPECT_FALSE(ResponseCache::IsCacheable(top_k, false));
+}
+
+TEST_F(ResponseCacheTest, KeyIgnoresFieldOrderAndUser) {
+  Json::Value a;
+  a["model"] = "m";
+  a["prompt"] = "hello";
+  Json::Value b;
+  b["prompt"] = "hello";
+  b["model"] = "m";
+  b["user"] = "someone";
+  EXPECT_EQ(ResponseCache::MakeKey("chat", a),
+            ResponseCache::MakeKey("chat", b));
+  EXPECT_NE(ResponseCache::MakeKey("chat", a),
+            ResponseCache::MakeKey("embedding", a));
+
+  b["prompt"] = "hello!";
+  EXPECT_NE(ResponseCache::MakeKey("chat", a),
+            ResponseCache::MakeKey("chat", b));
+}
+
+TEST_F(ResponseCacheTest, KeyChangesWithTheModelFile) {
+  std::filesystem::create_directories(disk_path_);
+  auto model = disk_path_ / "model.gguf";
+  std::ofstream(model) << "weights";
+  auto identity = ResponseCache::GetFileIdentity(model);
+  EXPECT_FALSE(identity.empty());
+  EXPECT_EQ(ResponseCache::GetFileIdentity(model), identity);
+  EXPECT_TRUE(ResponseCache::GetFileIdentity(disk_path_ / "missing").empty());
+
+  // the model is replaced under the same name
+  std::ofstream(model) << "other weights";
+  std::filesystem::last_write_time(
+      model, std::filesystem::last_write_time(model) + std::chrono::hours(1));
+  auto replaced = ResponseCache::GetFileIdentity(model);
+  EXPECT_NE(replaced, identity);
+
+  Json::Value body;
+  body["model"] = "m";
+  body["input"] = "hello";
+  EXPECT_NE(ResponseCache::MakeKey("embedding", body, identity),
+            ResponseCache::MakeKey("embedding", body, replaced));
+  EXPECT_EQ(ResponseCache::MakeKey("embedding", body, identity),
+            ResponseCache::MakeKey("embedding", body, identity));
+}
+
+TEST_F(ResponseCacheTest, RecordsSuccessfulStream) {
+  ResponseCache cache({});
+  int forwarded = 0;
+  auto cb = cache.Record("key", [&forwarded](Json::Value&&, Json::Value&&) {
+    forwarded++;
+  });
+  for (int i = 0; i < 3; i++) {
+    Json::Value status;
+    status["status_code"] = 200;
+    status["is_stream"] = true;
+    status["is_done"] = i == 2;
+    Json::Value res;
+    res["data"] = "data: " + std::to_string(i) + "\n\n";
+    EXPECT_FALSE(cache.Get("key").has_value());
+    cb(std::move(status), std::move(res));
+  }
+  EXPECT_EQ(forwarded, 3);
+  auto entry = cache.Get("key");
+  ASSERT_TRUE(entry.has_value());
+  ASSERT_EQ(entry->size(), 3u);
+  EXPECT_EQ((*entry)[1].second["data"].asString(), "data: 1\n\n");
+}
+
+TEST_F(ResponseCacheTest, DoesNotRecordErrors) {
+  ResponseCache cache({});
+  auto cb = cache.Record("key", [](Json::Value&&, Json::Value&&) {});
+  Json::Value status;
+  status["status_code"] = 400;
+  status["has_error"] = true;
+  cb(std::move(status), Json::Value());
+  EXPECT_FALSE(cache.Get("key").has_value());
+}
+
+TEST_F(ResponseCacheTest, DoesNotRecordTruncatedResults) {
+  ResponseCache cache({});
+  Json::Value status;
+  status["status_code"] = 200;
+
+  Json::Value res;
+  res["choices"][0]["finish_reason"] = "length";
+  cache.Record("length", [](Json::Value&&, Json::Value&&) {})(
+      Json::Value(status), std::move(res));
+  EXPECT_FALSE(cache.Get("length").has_value());
+
+  status["is_stream"] = true;
+  auto cb = cache.Record("stream", [](Json::Value&&, Json::Value&&) {});
+  Json::Value chunk;
+  chunk["data"] =
+      "data: {\"choices\":[{\"finish_reason\":\"length\"}]}\n\n";
+  cb(Json::Value(status), std::move(chunk));
+  status["is_done"] = true;
+  Json::Value done;
+  done["data"] = "data: [DONE]\n\n";
+  cb(Json::Value(status), std::move(done));
+  EXPECT_FALSE(cache.Get("stream").has_value());
+
+  Json::Value stop;
+  stop["choices"][0]["finish_reason"] = "stop";
+  status["is_stream"] = false;
+  cache.Record("stop", [](Json::Value&&, Json::Value&&) {})(
+      Json::Value(status), std::move(stop));
+  EXPECT_TRUE(cache.Get("stop").has_value());
+}
+
+TEST_F(ResponseCacheTest, DoesNotRecordCancelledRequests) {
+  ResponseCache cache({});
+  auto cancellation =
+      std::make_shared<RequestCancellation>("request", std::nullopt);
+  auto cb = cache.Record(
+      "key", [](Json::Value&&, Json::Value&&) {}, cancellation);
+  cancellation->Cancel(RequestCancellation::Reason::kClientClosed);
+  Json::Value status;
+  status["status_code"] = 200;
+  Json::Value res;
+  res["choices"][0]["finish_reason"] = "stop";
+  cb(std::move(status), std::move(res));
+  EXPECT_FALSE(cache.Get("key").has_value());
+}
+
+TEST_F(ResponseCacheTest, EvictsLeastRecentlyUsed) {
+  ResponseCache probe({});
+  probe.Put("probe", CreateEntry("aaaa"));
+  auto entry_bytes = probe.GetMemoryBytes();
+
+  ResponseCache::Config config;
+  config.max_bytes = entry_bytes * 2;
+  ResponseCache cache(config);
+  cache.Put("a", CreateEntry("aaaa"));
+  cache.Put("b", CreateEntry("bbbb"));
+  // touch a so b is the oldest
+  EXPECT_TRUE(cache.Get("a").has_value());
+  cache.Put("c", CreateEntry("cccc"));
+  EXPECT_TRUE(cache.Get("a").has_value());
+  EXPECT_FALSE(cache.Get("b").has_value());
+  EXPECT_TRUE(cache.Get("c").has_value());
+  EXPECT_LE(cache.GetMemoryBytes(), entry_bytes * 2);
+}
+
+TEST_F(ResponseCacheTest, SpillsToDisk) {
+  ResponseCache probe({});
+  probe.Put("probe", CreateEntry("aaaa"));
+  auto entry_bytes = probe.GetMemoryBytes();
+
+  {
+    ResponseCache cache({.max_bytes = entry_bytes,
+                         .disk_max_bytes = 1024 * 1024,
+                         .disk_path = disk_path_});
+    cache.Put("a", CreateEntry("aaaa"));
+    cache.Put("b", CreateEntry("bbbb"));
+    EXPECT_TRUE(std::filesystem::exists(disk_path_ / "a.json"));
+  }
+
+  // spilled entries survive a restart
+  ResponseCache cache({.max_bytes = entry_bytes,
+                       .disk_max_bytes = 1024 * 1024,
+                       .disk_path = disk_path_});
+  auto entry = cache.Get("a");
+  ASSERT_TRUE(entry.has_value());
+  EXPECT_EQ(entry->front().second["content"].asString(), "aaaa");
+}
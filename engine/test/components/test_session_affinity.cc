@@ -0,0 +1,53 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "services/session_affinity.h"
+
+class SessionAffinityTest : public ::testing::Test {
+ protected:
+  SessionAffinity affinity_{
+      SessionAffinity::Config{.idle_timeout = std::chrono::minutes(1)}};
+};
+
+TEST_F(SessionAffinityTest, UnknownModelHasNoSlot) {
+  EXPECT_FALSE(affinity_.Acquire("model", "thread_1").has_value());
+}
+
+TEST_F(SessionAffinityTest, PinsSessionsToSlots) {
+  affinity_.SetModelSlots("model", 2);
+  auto a = affinity_.Acquire("model", "thread_a");
+  auto b = affinity_.Acquire("model", "thread_b");
+  ASSERT_TRUE(a.has_value() && b.has_value());
+  EXPECT_NE(*a, *b);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(affinity_.Acquire("model", "thread_a"), a);
+    EXPECT_EQ(affinity_.Acquire("model", "thread_b"), b);
+  }
+  EXPECT_EQ(affinity_.GetSessionCount("model"), 2u);
+}
+
+TEST_F(SessionAffinityTest, EvictsLeastRecentlyUsedSession) {
+  affinity_.SetModelSlots("model", 2);
+  auto a = affinity_.Acquire("model", "thread_a");
+  auto b = affinity_.Acquire("model", "thread_b");
+  affinity_.Acquire("model", "thread_a");
+
+  // thread_b is the least recently used, its slot goes to thread_c
+  EXPECT_EQ(affinity_.Acquire("model", "thread_c"), b);
+  EXPECT_EQ(affinity_.Acquire("model", "thread_a"), a);
+  EXPECT_EQ(affinity_.GetSessionCount("model"), 2u);
+}
+
+TEST_F(SessionAffinityTest, ReleasesIdleSessions) {
+  SessionAffinity affinity{
+      SessionAffinity::Config{.idle_timeout = std::chrono::milliseconds(20)}};
+  affinity.SetModelSlots("model", 4);
+  affinity.Acquire("model", "thread_a");
+  affinity.Acquire("model", "thread_b");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  // the idle sessions free their slots, the new one takes the first
+  EXPECT_EQ(affinity.Acquire("model", "thread_c"), 0);
+  EXPECT_EQ(affinity.GetSessionCount("model"), 1u);
+
+  affinity.RemoveModel("model");
+  EXPECT_EQ(affinity.GetSessionCount("model"), 0u);
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "utils/sse_parser.h"
+
+namespace {
+struct Received {
+  std::string type;
+  std::string data;
+  std::string id;
+};
+
+// Feeds [body] split every [step] bytes
+std::vector<Received> Parse(std::string_view body, size_t step) {
+  std::vector<Received> events;
+  sse::Parser parser;
+  auto on_event = [&events](const sse::Event& event) {
+    events.push_back({std::string(event.type), std::string(event.data),
+                      std::string(event.id)});
+    return true;
+  };
+  for (size_t pos = 0; pos < body.size(); pos += step) {
+    parser.Feed(body.substr(pos, step), on_event);
+  }
+  parser.Finish(on_event);
+  return events;
+}
+}  // namespace
+
+class SseParserTest : public ::testing::Test {};
+
+TEST_F(SseParserTest, ParsesEventsHoweverTheStreamIsSplit) {
+  std::string body =
+      ": keep-alive\n\n"
+      "data: {\"a\": 1}\n\n"
+      "event: message_start\r\n"
+      "id: 7\r\n"
+      "data:{\"b\": 2}\r\n\r\n"
+      "data: first\n"
+      "data: second\n"
+      "\n"
+      "event: ping\n\n"
+      "data: [DONE]\n\n";
+  for (size_t step = 1; step <= body.size(); step++) {
+    auto events = Parse(body, step);
+    ASSERT_EQ(events.size(), 4u) << "step " << step;
+    EXPECT_EQ(events[0].data, "{\"a\": 1}");
+    EXPECT_EQ(events[0].type, "");
+    EXPECT_EQ(events[1].type, "message_start");
+    EXPECT_EQ(events[1].id, "7");
+    EXPECT_EQ(events[1].data, "{\"b\": 2}");
+    EXPECT_EQ(events[2].data, "first\nsecond");
+    EXPECT_EQ(events[3].data, "[DONE]");
+  }
+}
+
+TEST_F(SseParserTest, OnlyTheIncompleteTailIsKept) {
+  sse::Parser parser;
+  int count = 0;
+  auto on_event = [&count](const sse::Event&) {
+    count++;
+    return true;
+  };
+  parser.Feed("data: 1\n\ndata: 2\n\ndata: 3", on_event);
+  EXPECT_EQ(count, 2);
+  EXPECT_EQ(parser.pending(), 7u);
+  parser.Feed("\n\n", on_event);
+  EXPECT_EQ(count, 3);
+  EXPECT_EQ(parser.pending(), 0u);
+}
+
+TEST_F(SseParserTest, StopsWhenTheHandlerSaysSo) {
+  sse::Parser parser;
+  std::vector<std::string> data;
+  auto on_event = [&data](const sse::Event& event) {
+    data.emplace_back(event.data);
+    return event.data != "[DONE]";
+  };
+  parser.Feed("data: a\n\ndata: [DONE]\n\ndata: b\n\n", on_event);
+  parser.Feed("data: c\n\n", on_event);
+  parser.Finish(on_event);
+  EXPECT_EQ(data, (std::vector<std::string>{"a", "[DONE]"}));
+}
+
+TEST_F(SseParserTest, FinishDispatchesAnUnterminatedEvent) {
+  auto events = Parse("data: a\n\ndata: b", 4);
+  ASSERT_EQ(events.size(), 2u);
+  EXPECT_EQ(events[1].data, "b");
+}
+
+TEST_F(SseParserTest, SerializeWritesOneDataLinePerLine) {
+  EXPECT_EQ(sse::Serialize({.type = "", .data = "{}", .id = ""}),
+            "data: {}\n\n");
+  EXPECT_EQ(sse::Serialize({.type = "delta", .data = "a\nb", .id = ""}),
+            "event: delta\ndata: a\ndata: b\n\n");
+}
@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include "extensions/remote-engine/upstream_router.h"
+
+#if !defined(_WIN32)
+#include <thread>
+#include "local_http_server.h"
+#endif
+
+using remote_engine::RateLimiter;
+using remote_engine::UpstreamRouter;
+using namespace std::chrono_literals;
+
+namespace {
+UpstreamRouter::Config TestConfig() {
+  return UpstreamRouter::Config{.seed = 42};
+}
+
+#if !defined(_WIN32)
+using test_utils::LocalHttpServer;
+
+constexpr const auto kPath = "/v1/chat/completions";
+
+// Stand-in for a provider: answers every request with [status] and [body]
+// after [delay]
+LocalHttpServer::Handler Reply(int status, std::string body,
+                               std::chrono::milliseconds delay = 0ms) {
+  return [status, body = std::move(body), delay](
+             const LocalHttpServer::Request&) {
+    std::this_thread::sleep_for(delay);
+    return LocalHttpServer::Response{.status = status, .body = body};
+  };
+}
+#endif
+}  // namespace
+
+class UpstreamRouterTest : public ::testing::Test {};
+
+TEST_F(UpstreamRouterTest, PickFollowsWeightsAndSkipsTried) {
+  UpstreamRouter router({{.url = "a", .weight = 3}, {.url = "b", .weight = 1}},
+                        TestConfig());
+  int picks[2] = {0, 0};
+  for (int i = 0; i < 4000; i++) {
+    picks[router.Pick({}).value()]++;
+  }
+  EXPECT_NEAR(picks[0] / 4000.0, 0.75, 0.05);
+
+  EXPECT_EQ(router.Pick({0}), 1u);
+  EXPECT_EQ(router.Pick({0, 1}), std::nullopt);
+}
+
+TEST_F(UpstreamRouterTest, FailuresShiftTrafficAndThrottlingCoolsDown) {
+  UpstreamRouter router({{.url = "a"}, {.url = "b"}}, TestConfig());
+  for (int i = 0; i < 10; i++) {
+    router.ReportFailure(0, false);
+  }
+  EXPECT_LT(router.GetHealth(0), 0.2);
+  int picks_a = 0;
+  for (int i = 0; i < 1000; i++) {
+    picks_a += router.Pick({}) == 0u;
+  }
+  EXPECT_LT(picks_a, 200);
+
+  // a throttled upstream is skipped until its cooldown is over, unless
+  // it is the only one left
+  auto now = UpstreamRouter::Clock::now();
+  router.ReportFailure(1, true, 30s, now);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(router.Pick({}, now + 10s), 0u);
+  }
+  EXPECT_EQ(router.Pick({0}, now + 10s), 1u);
+  int picks_b = 0;
+  for (int i = 0; i < 100; i++) {
+    picks_b += router.Pick({}, now + 31s) == 1u;
+  }
+  EXPECT_GT(picks_b, 50);
+}
+
+TEST_F(UpstreamRouterTest, HedgeDelayIsALatencyPercentile) {
+  auto config = TestConfig();
+  config.hedge_percentile = 90;
+  config.hedge_min_samples = 10;
+  UpstreamRouter router({{.url = "a"}}, config);
+  for (int i = 1; i <= 9; i++) {
+    router.ReportSuccess(0, std::chrono::milliseconds(i * 10));
+  }
+  EXPECT_EQ(router.GetHedgeDelay(0), std::nullopt);
+  router.ReportSuccess(0, 100ms);
+  EXPECT_EQ(router.GetHedgeDelay(0), 90ms);
+
+  UpstreamRouter no_hedging({{.url = "a"}}, TestConfig());
+  for (int i = 0; i < 50; i++) {
+    no_hedging.ReportSuccess(0, 10ms);
+  }
+  EXPECT_EQ(no_hedging.GetHedgeDelay(0), std::nullopt);
+}
+
+#if !defined(_WIN32)
+TEST_F(UpstreamRouterTest, PostFailsOverOnServerErrors) {
+  LocalHttpServer failing(Reply(503, R"({"error": "overloaded"})"));
+  LocalHttpServer healthy(Reply(200, R"({"id": "ok"})"));
+  // the failing upstream is all but certain to be tried first
+  UpstreamRouter router({{.url = failing.Url(kPath), .weight = 1000},
+                         {.url = healthy.Url(kPath), .weight = 0.001}},
+                        TestConfig());
+
+  auto res =
+      router.Post(R"({"model": "m"})", {"Content-Type: application/json"});
+  EXPECT_FALSE(res.error) << res.error_message;
+  EXPECT_EQ(res.status_code, 200);
+  EXPECT_EQ(res.body, R"({"id": "ok"})");
+  EXPECT_EQ(res.url, healthy.Url(kPath));
+  EXPECT_EQ(failing.requests(), 1);
+  EXPECT_LT(router.GetHealth(0), 1.0);
+
+  // nothing left to fail over to
+  UpstreamRouter alone({{.url = failing.Url(kPath)}}, TestConfig());
+  res = alone.Post("{}", {});
+  EXPECT_TRUE(res.error);
+  EXPECT_EQ(res.status_code, 503);
+  EXPECT_EQ(res.body, R"({"error": "overloaded"})");
+}
+
+TEST_F(UpstreamRouterTest, PostRespectsTheRateLimitOfEachUpstream) {
+  LocalHttpServer failing(Reply(503, R"({"error": "overloaded"})"));
+  LocalHttpServer throttled(Reply(429, R"({"error": "slow down"})"));
+  LocalHttpServer healthy(Reply(200, R"({"id": "ok"})"));
+  // nothing is queued, the timer is never needed
+  auto no_timer = [](RateLimiter::Clock::duration, std::function<void()>) {};
+  auto exhausted = std::make_shared<RateLimiter>(
+      RateLimiter::Config{.requests_per_minute = 60, .burst_seconds = 1},
+      no_timer);
+  ASSERT_TRUE(exhausted->TryAcquire(0));
+  auto unlimited = std::make_shared<RateLimiter>(RateLimiter::Config{},
+                                                 no_timer);
+  UpstreamRouter router(
+      {{.url = failing.Url(kPath)},
+       {.url = healthy.Url(kPath), .limiter = exhausted},
+       {.url = throttled.Url(kPath), .weight = 0.001, .limiter = unlimited}},
+      TestConfig());
+
+  // the first upstream was admitted by the caller, the healthy one has no
+  // budget left to fail over to
+  auto res = router.Post("{}", {}, nullptr, 0);
+  EXPECT_TRUE(res.error);
+  EXPECT_EQ(healthy.requests(), 0);
+  // the throttled one was tried instead and paused its key
+  EXPECT_EQ(throttled.requests(), 1);
+  EXPECT_EQ(res.status_code, 429);
+  EXPECT_FALSE(unlimited->TryAcquire(0));
+}
+
+TEST_F(UpstreamRouterTest, PostStopsWhenAsked) {
+  LocalHttpServer slow(Reply(200, "slow", 1000ms));
+  UpstreamRouter router({{.url = slow.Url(kPath)}}, TestConfig());
+
+  std::atomic<bool> stopped{false};
+  std::thread stopper([&stopped] {
+    std::this_thread::sleep_for(50ms);
+    stopped = true;
+  });
+  auto begin = std::chrono::steady_clock::now();
+  auto res = router.Post("{}", {}, nullptr, std::nullopt, 0, &stopped);
+  auto elapsed = std::chrono::steady_clock::now() - begin;
+  stopper.join();
+  EXPECT_TRUE(res.error);
+  EXPECT_LT(elapsed, 700ms);
+  // the upstream did nothing wrong
+  EXPECT_EQ(router.GetHealth(0), 1.0);
+}
+
+TEST_F(UpstreamRouterTest, PostHedgesSlowUpstream) {
+  LocalHttpServer slow(Reply(200, "slow", 1000ms));
+  LocalHttpServer fast(Reply(200, "fast"));
+  auto config = TestConfig();
+  config.hedge_percentile = 50;
+  config.hedge_min_samples = 1;
+  UpstreamRouter router({{.url = slow.Url(kPath), .weight = 1000},
+                         {.url = fast.Url(kPath), .weight = 0.001}},
+                        config);
+  // the slow upstream usually answers within 20ms
+  router.ReportSuccess(0, 20ms);
+
+  std::string received;
+  auto begin = std::chrono::steady_clock::now();
+  auto res = router.Post("{}", {}, [&](const char* data, size_t size) {
+    received.append(data, size);
+    return true;
+  });
+  auto elapsed = std::chrono::steady_clock::now() - begin;
+  EXPECT_FALSE(res.error) << res.error_message;
+  EXPECT_EQ(received, "fast");
+  EXPECT_EQ(res.url, fast.Url(kPath));
+  EXPECT_LT(elapsed, 700ms);
+}
+#endif
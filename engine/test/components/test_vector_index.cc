@@ -0,0 +1,172 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include "utils/vector_index.h"
+#include "utils/vector_math.h"
+
+namespace {
+std::vector<std::vector<float>> RandomVectors(size_t n, size_t dim,
+                                              uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::normal_distribution<float> dist;
+  std::vector<std::vector<float>> res(n, std::vector<float>(dim));
+  for (auto& v : res) {
+    for (auto& x : v) {
+      x = dist(gen);
+    }
+  }
+  return res;
+}
+}  // namespace
+
+class VectorIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = std::filesystem::temp_directory_path() / "vector_index_test";
+    std::filesystem::remove_all(dir_);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(dir_); }
+
+  std::filesystem::path dir_;
+};
+
+TEST_F(VectorIndexTest, DotProductMatchesScalar) {
+  // odd sizes exercise the tail loops of the SIMD kernels
+  for (size_t dim : {1, 7, 16, 33, 384, 1027}) {
+    auto v = RandomVectors(2, dim, dim);
+    EXPECT_NEAR(vector_math::DotProduct(v[0].data(), v[1].data(), dim),
+                vector_math::DotProductScalar(v[0].data(), v[1].data(), dim),
+                1e-3);
+  }
+
+  // each kernel on its own, the lengths are no multiple of 8 or 16 so the
+  // tail loops run too
+  for (auto const& kernel : vector_math::SupportedKernels()) {
+    for (size_t dim : {1, 3, 7, 9, 15, 17, 23, 31, 33, 47, 383, 1027}) {
+      auto v = RandomVectors(2, dim, dim + 1);
+      EXPECT_NEAR(kernel.fn(v[0].data(), v[1].data(), dim),
+                  vector_math::DotProductScalar(v[0].data(), v[1].data(), dim),
+                  1e-3)
+          << kernel.name << ", " << dim;
+    }
+  }
+  EXPECT_EQ(vector_math::SupportedKernels().front().name,
+            vector_math::DotProductKernel());
+  EXPECT_EQ(vector_math::SupportedKernels().back().name, "scalar");
+
+#if defined(__x86_64__)
+  // the SIMD kernels are picked at runtime, not from the compile flags
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    EXPECT_NE(vector_math::DotProductKernel(), "scalar");
+  }
+#endif
+
+  std::vector<float> a{3, 4};
+  vector_math::Normalize(a.data(), a.size());
+  EXPECT_NEAR(a[0], 0.6f, 1e-6);
+  EXPECT_NEAR(vector_math::L2Norm(a.data(), a.size()), 1.0f, 1e-6);
+}
+
+TEST_F(VectorIndexTest, SearchReturnsTopKAboveThreshold) {
+  auto index = VectorIndex::Open(dir_, {});
+  ASSERT_TRUE(index.has_value());
+  auto& idx = *index.value();
+
+  ASSERT_TRUE(idx.Add({{1, 0, 0}, {0, 1, 0}, {1, 1, 0}, {0, 0, 1}}));
+  EXPECT_EQ(idx.Size(), 4u);
+  EXPECT_EQ(idx.Dimensions(), 3u);
+
+  auto matches = idx.Search({2, 0, 0}, 2, 0.0f);
+  ASSERT_EQ(matches.size(), 2u);
+  EXPECT_EQ(matches[0].row, 0u);
+  EXPECT_NEAR(matches[0].score, 1.0f, 1e-6);
+  EXPECT_EQ(matches[1].row, 2u);
+
+  matches = idx.Search({1, 0, 0}, 10, 0.9f);
+  ASSERT_EQ(matches.size(), 1u);
+
+  EXPECT_TRUE(idx.Search({1, 0}, 10, 0.0f).empty());
+  EXPECT_TRUE(idx.Add({{1, 0}}).has_error());
+}
+
+TEST_F(VectorIndexTest, PersistsAcrossOpen) {
+  {
+    auto index = VectorIndex::Open(dir_, {});
+    ASSERT_TRUE(index.has_value());
+    ASSERT_TRUE(index.value()->Add({{1, 0}, {0, 1}}));
+  }
+  auto index = VectorIndex::Open(dir_, {});
+  ASSERT_TRUE(index.has_value());
+  EXPECT_EQ(index.value()->Size(), 2u);
+  ASSERT_TRUE(index.value()->Add({{-1, 0}}));
+  auto matches = index.value()->Search({-1, 0}, 1, 0.0f);
+  ASSERT_EQ(matches.size(), 1u);
+  EXPECT_EQ(matches[0].row, 2u);
+}
+
+TEST_F(VectorIndexTest, IvfFindsExactMatches) {
+  const size_t kDim = 32;
+  VectorIndex::Config config{.ivf_min_vectors = 256, .nprobe = 4};
+  auto vectors = RandomVectors(2000, kDim, 42);
+  {
+    auto index = VectorIndex::Open(dir_, config);
+    ASSERT_TRUE(index.has_value());
+    ASSERT_TRUE(index.value()->Add(vectors));
+    EXPECT_TRUE(index.value()->HasIvf());
+  }
+
+  // the index is loaded from disk rather than rebuilt
+  ASSERT_TRUE(std::filesystem::exists(dir_ / "index.bin"));
+  auto index = VectorIndex::Open(dir_, config);
+  ASSERT_TRUE(index.has_value());
+  EXPECT_TRUE(index.value()->HasIvf());
+
+  // a stored vector always lands in its own closest list
+  for (uint32_t row : {0u, 17u, 999u, 1999u}) {
+    auto matches = index.value()->Search(vectors[row], 1, 0.0f);
+    ASSERT_EQ(matches.size(), 1u);
+    EXPECT_EQ(matches[0].row, row);
+    EXPECT_NEAR(matches[0].score, 1.0f, 1e-4);
+  }
+}
+
+TEST_F(VectorIndexTest, CorruptIvfIsRebuilt) {
+  const size_t kDim = 8;
+  VectorIndex::Config config{.ivf_min_vectors = 256, .nprobe = 4};
+  auto vectors = RandomVectors(400, kDim, 7);
+  {
+    auto index = VectorIndex::Open(dir_, config);
+    ASSERT_TRUE(index.has_value());
+    ASSERT_TRUE(index.value()->Add(vectors));
+  }
+
+  // point the first row of the first list past the end of the store
+  {
+    std::fstream file(dir_ / "index.bin",
+                      std::ios::in | std::ios::out | std::ios::binary);
+    char header[24];
+    file.read(header, sizeof(header));
+    uint32_t nlist = 0;
+    std::memcpy(&nlist, header + 12, sizeof(nlist));
+    auto list_offset = sizeof(header) + size_t(nlist) * kDim * sizeof(float);
+    file.seekg(list_offset);
+    uint32_t size = 0;
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    ASSERT_GT(size, 0u);
+    uint32_t row = 1u << 30;
+    file.seekp(list_offset + sizeof(size));
+    file.write(reinterpret_cast<const char*>(&row), sizeof(row));
+  }
+
+  auto index = VectorIndex::Open(dir_, config);
+  ASSERT_TRUE(index.has_value());
+  EXPECT_TRUE(index.value()->HasIvf());
+  for (uint32_t row : {0u, 399u}) {
+    auto matches = index.value()->Search(vectors[row], 1, 0.0f);
+    ASSERT_EQ(matches.size(), 1u);
+    EXPECT_EQ(matches[0].row, row);
+  }
+}
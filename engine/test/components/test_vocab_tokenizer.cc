@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include "utils/vocab_tokenizer.h"
+
+namespace {
+// Byte-level BPE vocabulary: the 256 byte tokens, the merged tokens and a
+// control token
+struct BpeFixture {
+  std::vector<std::string> texts;
+  std::vector<std::string> merges;
+  std::vector<int32_t> types;
+
+  BpeFixture() {
+    uint32_t next = 256;
+    for (uint32_t b = 0; b < 256; b++) {
+      bool printable = (b >= 33 && b <= 126) || (b >= 161 && b <= 172) ||
+                       (b >= 174 && b <= 255);
+      auto cp = printable ? b : next++;
+      std::string s;
+      if (cp < 0x80) {
+        s.push_back(static_cast<char>(cp));
+      } else {
+        s.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+        s.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+      }
+      texts.push_back(s);
+      types.push_back(VocabTokenizer::kNormal);
+    }
+    for (auto const& merge : {"h e", "l l", "he ll", "hell o", "Ġ w",
+                              "o Ġ", "Ġw o"}) {
+      merges.push_back(merge);
+      std::string m = merge;
+      texts.push_back(m.substr(0, m.find(' ')) + m.substr(m.find(' ') + 1));
+      types.push_back(VocabTokenizer::kNormal);
+    }
+    texts.push_back("<|eot|>");
+    types.push_back(VocabTokenizer::kControl);
+  }
+
+  VocabTokenizer::Vocab Vocab() const {
+    VocabTokenizer::Vocab vocab;
+    vocab.model = VocabTokenizer::Model::kBpe;
+    for (auto const& t : texts) {
+      vocab.tokens.push_back(t);
+    }
+    for (auto const& m : merges) {
+      vocab.merges.push_back(m);
+    }
+    vocab.token_types = types;
+    vocab.add_space_prefix = false;
+    return vocab;
+  }
+
+  int32_t Id(const std::string& text) const {
+    return std::find(texts.begin(), texts.end(), text) - texts.begin();
+  }
+};
+
+void WriteString(std::ofstream& out, const std::string& s) {
+  uint64_t n = s.size();
+  out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+  out.write(s.data(), s.size());
+}
+
+template <typename T>
+void Write(std::ofstream& out, T value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void WriteStringArray(std::ofstream& out, const std::string& key,
+                      const std::vector<std::string>& values) {
+  WriteString(out, key);
+  Write<uint32_t>(out, 9);
+  Write<uint32_t>(out, 8);
+  Write<uint64_t>(out, values.size());
+  for (auto const& v : values) {
+    WriteString(out, v);
+  }
+}
+}  // namespace
+
+class VocabTokenizerTest : public ::testing::Test {};
+
+TEST_F(VocabTokenizerTest, BpeMergesWithinWordsAndRoundTrips) {
+  BpeFixture fixture;
+  auto tokenizer = VocabTokenizer::Create(fixture.Vocab(), nullptr);
+  ASSERT_TRUE(tokenizer.has_value()) << tokenizer.error();
+
+  // "o Ġ" is a merge, but the pre-tokenizer keeps the words apart
+  auto ids = tokenizer.value()->Encode("hello world", false, false);
+  std::vector<int32_t> expected{fixture.Id("hello"), fixture.Id("Ġwo"),
+                                fixture.Id("r"), fixture.Id("l"),
+                                fixture.Id("d")};
+  EXPECT_EQ(ids, expected);
+  EXPECT_EQ(tokenizer.value()->Decode(ids, false).value(), "hello world");
+
+  auto text = "  multiple\n\nlines, 12345 and \xC3\xA9t\xC3\xA9 it's";
+  EXPECT_EQ(tokenizer.value()
+                ->Decode(tokenizer.value()->Encode(text, false, false), false)
+                .value(),
+            text);
+  EXPECT_TRUE(tokenizer.value()->Decode({-1}, false).has_error());
+}
+
+TEST_F(VocabTokenizerTest, ControlTokensOnlyWhenParsingSpecials) {
+  BpeFixture fixture;
+  auto tokenizer = VocabTokenizer::Create(fixture.Vocab(), nullptr).value();
+  auto eot = fixture.Id("<|eot|>");
+
+  auto ids = tokenizer->Encode("hello<|eot|>", false, true);
+  EXPECT_EQ(ids, (std::vector<int32_t>{fixture.Id("hello"), eot}));
+  EXPECT_EQ(tokenizer->Decode(ids, true).value(), "hello");
+  EXPECT_EQ(tokenizer->Decode(ids, false).value(), "hello<|eot|>");
+
+  ids = tokenizer->Encode("hello<|eot|>", false, false);
+  EXPECT_EQ(std::count(ids.begin(), ids.end(), eot), 0);
+  EXPECT_EQ(tokenizer->Decode(ids, false).value(), "hello<|eot|>");
+}
+
+TEST_F(VocabTokenizerTest, SentencePieceMergesByScoreWithByteFallback) {
+  std::vector<std::string> texts{"<unk>", "<s>", "</s>"};
+  std::vector<int32_t> types{VocabTokenizer::kUnknown,
+                             VocabTokenizer::kControl,
+                             VocabTokenizer::kControl};
+  std::vector<float> scores{0, 0, 0};
+  for (int b = 0; b < 256; b++) {
+    char name[8];
+    std::snprintf(name, sizeof(name), "<0x%02X>", b);
+    texts.push_back(name);
+    types.push_back(VocabTokenizer::kByte);
+    scores.push_back(0);
+  }
+  float score = -10;
+  for (auto const& t : {"\xE2\x96\x81", "h", "e", "l", "o", "\xE2\x96\x81h",
+                        "\xE2\x96\x81he", "\xE2\x96\x81hel",
+                        "\xE2\x96\x81hell", "\xE2\x96\x81hello"}) {
+    texts.push_back(t);
+    types.push_back(VocabTokenizer::kNormal);
+    scores.push_back(score++);
+  }
+
+  VocabTokenizer::Vocab vocab;
+  vocab.model = VocabTokenizer::Model::kSpm;
+  for (auto const& t : texts) {
+    vocab.tokens.push_back(t);
+  }
+  vocab.token_types = types;
+  vocab.scores = scores;
+  vocab.bos_id = 1;
+  vocab.eos_id = 2;
+  vocab.unk_id = 0;
+  vocab.add_bos = true;
+  auto tokenizer = VocabTokenizer::Create(vocab, nullptr).value();
+
+  auto id = [&texts](const std::string& t) {
+    return static_cast<int32_t>(std::find(texts.begin(), texts.end(), t) -
+                                texts.begin());
+  };
+  auto ids = tokenizer->Encode("hello hi", true, false);
+  EXPECT_EQ(ids, (std::vector<int32_t>{1, id("\xE2\x96\x81hello"),
+                                       id("\xE2\x96\x81h"), id("<0x69>")}));
+  EXPECT_EQ(tokenizer->Decode(ids, true).value(), "hello hi");
+}
+
+TEST_F(VocabTokenizerTest, LoadsTheVocabularyOfAGgufFile) {
+  BpeFixture fixture;
+  auto path = std::filesystem::temp_directory_path() / "test_vocab.gguf";
+  {
+    std::ofstream out(path, std::ios::binary);
+    Write<uint32_t>(out, 0x46554747);
+    Write<uint32_t>(out, 3);
+    Write<uint64_t>(out, 0);
+    Write<uint64_t>(out, 6);
+    WriteString(out, "general.name");
+    Write<uint32_t>(out, 8);
+    WriteString(out, "test");
+    // skipped without being read
+    WriteString(out, "general.layers");
+    Write<uint32_t>(out, 9);
+    Write<uint32_t>(out, 4);
+    Write<uint64_t>(out, 3);
+    for (uint32_t v : {1u, 2u, 3u}) {
+      Write(out, v);
+    }
+    WriteString(out, "tokenizer.ggml.model");
+    Write<uint32_t>(out, 8);
+    WriteString(out, "gpt2");
+    WriteStringArray(out, "tokenizer.ggml.tokens", fixture.texts);
+    WriteStringArray(out, "tokenizer.ggml.merges", fixture.merges);
+    WriteString(out, "tokenizer.ggml.token_type");
+    Write<uint32_t>(out, 9);
+    Write<uint32_t>(out, 5);
+    Write<uint64_t>(out, fixture.types.size());
+    for (auto t : fixture.types) {
+      Write(out, t);
+    }
+  }
+
+  auto tokenizer = VocabTokenizer::Load(path);
+  ASSERT_TRUE(tokenizer.has_value()) << tokenizer.error();
+  EXPECT_EQ(tokenizer.value()->VocabSize(), fixture.texts.size());
+  EXPECT_EQ(tokenizer.value()->Encode("hello<|eot|>", true, true),
+            (std::vector<int32_t>{fixture.Id("hello"), fixture.Id("<|eot|>")}));
+
+  // truncated metadata
+  std::filesystem::resize_file(path, 200);
+  EXPECT_TRUE(VocabTokenizer::Load(path).has_error());
+  std::filesystem::remove(path);
+}
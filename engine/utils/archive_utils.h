@@ -1,10 +1,17 @@
+#pragma once
+
 #include <archive.h>
 #include <archive_entry.h>
 #include <minizip/unzip.h>
 #include <trantor/utils/Logger.h>
+#include <cerrno>
+#include <condition_variable>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include "logging_utils.h"
 
 namespace archive_utils {
@@ -95,23 +102,21 @@ inline bool UnzipFile(const std::string& input_zip_path,
   return true;
 }
 
-inline bool UntarFile(const std::string& input_tar_path,
-                      const std::string& destination_path,
-                      bool ignore_parent_dir) {
-  struct archive* tar_archive = archive_read_new();
-  archive_read_support_format_tar(tar_archive);
-  archive_read_support_filter_gzip(tar_archive);
-
-  if (archive_read_open_filename(tar_archive, input_tar_path.c_str(), 10240) !=
-      ARCHIVE_OK) {
-    LOG_ERROR << "Failed to open tar file: " << input_tar_path << "\n";
-    archive_read_free(tar_archive);
-    return false;
-  }
+inline std::string ErrorString(struct archive* a) {
+  auto err = archive_error_string(a);
+  return err ? err : "unknown error";
+}
 
-  std::filesystem::create_directories(destination_path);
+/**
+ * Write the entries of an opened tar archive to [destination_path]. Returns
+ * ARCHIVE_EOF once the whole archive is extracted.
+ */
+inline int ExtractTarEntries(struct archive* tar_archive,
+                             const std::string& destination_path,
+                             bool ignore_parent_dir) {
   struct archive_entry* entry;
-  while (archive_read_next_header(tar_archive, &entry) == ARCHIVE_OK) {
+  int r;
+  while ((r = archive_read_next_header(tar_archive, &entry)) == ARCHIVE_OK) {
     const char* current_file = archive_entry_pathname(entry);
     auto file_in_tar_path =
         std::filesystem::path(destination_path) / current_file;
@@ -130,27 +135,194 @@ inline bool UntarFile(const std::string& input_tar_path,
       std::ofstream out_file(final_output_path, std::ios::binary);
       if (!out_file.is_open()) {
         LOG_ERROR << "Failed to create file: " << full_path << "\n";
-        archive_read_free(tar_archive);
-        return false;
+        return ARCHIVE_FATAL;
       }
 
       const void* buff;
       size_t size;
       la_int64_t offset;
-      while (archive_read_data_block(tar_archive, &buff, &size, &offset) ==
-             ARCHIVE_OK) {
+      while ((r = archive_read_data_block(tar_archive, &buff, &size,
+                                          &offset)) == ARCHIVE_OK) {
         out_file.write(static_cast<const char*>(buff), size);
       }
+      if (r != ARCHIVE_EOF || !out_file) {
+        LOG_ERROR << "Failed to extract file: " << full_path << "\n";
+        return r == ARCHIVE_EOF ? ARCHIVE_FATAL : r;
+      }
 
       out_file.close();
     }
 
     archive_entry_clear(entry);
   }
+  return r;
+}
+
+inline bool UntarFile(const std::string& input_tar_path,
+                      const std::string& destination_path,
+                      bool ignore_parent_dir) {
+  struct archive* tar_archive = archive_read_new();
+  archive_read_support_format_tar(tar_archive);
+  archive_read_support_filter_gzip(tar_archive);
+
+  if (archive_read_open_filename(tar_archive, input_tar_path.c_str(), 10240) !=
+      ARCHIVE_OK) {
+    LOG_ERROR << "Failed to open tar file: " << input_tar_path << "\n";
+    archive_read_free(tar_archive);
+    return false;
+  }
+
+  std::filesystem::create_directories(destination_path);
+  auto r = ExtractTarEntries(tar_archive, destination_path, ignore_parent_dir);
+  if (r != ARCHIVE_EOF) {
+    LOG_ERROR << "Failed to extract " << input_tar_path << ": "
+              << ErrorString(tar_archive) << "\n";
+    archive_read_free(tar_archive);
+    return false;
+  }
 
   archive_read_free(tar_archive);
   CTL_INF("Extracted successfully " << input_tar_path << " to "
                                     << destination_path << "\n");
   return true;
 }
+
+/**
+ * Extracts a tar or tar.gz archive while it is still being downloaded. The
+ * bytes handed to Write are decompressed and unpacked on a background
+ * thread, so the archive itself never has to be stored.
+ *
+ * Zip archives can't be handled this way, their central directory is only
+ * available once the whole file is there.
+ */
+class StreamExtractor {
+ public:
+  StreamExtractor(const std::string& destination_path, bool ignore_parent_dir)
+      : destination_path_{destination_path},
+        ignore_parent_dir_{ignore_parent_dir} {
+    thread_ = std::thread([this] { Run(); });
+  }
+
+  ~StreamExtractor() { Abort(); }
+
+  StreamExtractor(const StreamExtractor&) = delete;
+  StreamExtractor& operator=(const StreamExtractor&) = delete;
+
+  /**
+   * Queue the next [size] bytes of the archive, blocking while the
+   * extraction is behind. Returns false once the extraction failed.
+   */
+  bool Write(const char* data, size_t size) {
+    std::unique_lock<std::mutex> l(mtx_);
+    cv_.wait(l, [this] { return queued_bytes_ < kMaxQueuedBytes || done_; });
+    if (done_) {
+      // bytes after the end of the archive (padding) are dropped
+      return ok_;
+    }
+    chunks_.emplace_back(data, size);
+    queued_bytes_ += size;
+    cv_.notify_all();
+    return true;
+  }
+
+  /**
+   * Mark the end of the archive and wait for the extraction to complete.
+   */
+  bool Finish() {
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      eof_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    return ok_;
+  }
+
+  /**
+   * Stop the extraction, leaving what was extracted so far.
+   */
+  void Abort() {
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      aborted_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+ private:
+  // bytes downloaded but not extracted yet, before Write blocks
+  static constexpr size_t kMaxQueuedBytes = 32 * 1024 * 1024;
+
+  static la_ssize_t ReadCallback(struct archive* a, void* client_data,
+                                 const void** buffer) {
+    auto* self = static_cast<StreamExtractor*>(client_data);
+    std::unique_lock<std::mutex> l(self->mtx_);
+    self->cv_.wait(l, [self] {
+      return !self->chunks_.empty() || self->eof_ || self->aborted_;
+    });
+    if (self->aborted_) {
+      archive_set_error(a, ECANCELED, "Extraction aborted");
+      return ARCHIVE_FATAL;
+    }
+    if (self->chunks_.empty()) {
+      return 0;
+    }
+    self->current_ = std::move(self->chunks_.front());
+    self->chunks_.pop_front();
+    self->queued_bytes_ -= self->current_.size();
+    self->cv_.notify_all();
+    *buffer = self->current_.data();
+    return static_cast<la_ssize_t>(self->current_.size());
+  }
+
+  void Run() {
+    struct archive* tar_archive = archive_read_new();
+    archive_read_support_format_tar(tar_archive);
+    archive_read_support_filter_gzip(tar_archive);
+
+    auto ok = false;
+    if (archive_read_open(tar_archive, this, nullptr, ReadCallback, nullptr) ==
+        ARCHIVE_OK) {
+      std::filesystem::create_directories(destination_path_);
+      ok = ExtractTarEntries(tar_archive, destination_path_,
+                             ignore_parent_dir_) == ARCHIVE_EOF;
+    }
+    if (ok) {
+      CTL_INF("Extracted successfully to " << destination_path_);
+    } else {
+      LOG_ERROR << "Failed to extract to " << destination_path_ << ": "
+                << ErrorString(tar_archive) << "\n";
+    }
+    archive_read_free(tar_archive);
+
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      done_ = true;
+      ok_ = ok;
+      chunks_.clear();
+      queued_bytes_ = 0;
+    }
+    cv_.notify_all();
+  }
+
+  std::string destination_path_;
+  bool ignore_parent_dir_;
+
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  std::deque<std::string> chunks_;
+  // the chunk libarchive is reading from
+  std::string current_;
+  size_t queued_bytes_ = 0;
+  bool eof_ = false;
+  bool aborted_ = false;
+  bool done_ = false;
+  bool ok_ = false;
+  std::thread thread_;
+};
 }  // namespace archive_utils
@@ -51,6 +51,21 @@ cpp::result<void, std::string> CortexConfigMgr::DumpYamlConfig(
     node["sslKeyPath"] = config.sslKeyPath;
     node["supportedEngines"] = config.supportedEngines;
     node["checkedForSyncHubAt"] = config.checkedForSyncHubAt;
+    node["maxConcurrentRequestsPerModel"] =
+        config.maxConcurrentRequestsPerModel;
+    node["maxQueuedRequestsPerModel"] = config.maxQueuedRequestsPerModel;
+    node["requestQueueTimeoutMs"] = config.requestQueueTimeoutMs;
+    node["clientWeights"] = config.clientWeights;
+    node["embeddingBatchWindowMs"] = config.embeddingBatchWindowMs;
+    node["embeddingMaxBatchSize"] = config.embeddingMaxBatchSize;
+    node["responseCacheEnabled"] = config.responseCacheEnabled;
+    node["responseCacheMaxBytes"] = config.responseCacheMaxBytes;
+    node["responseCacheDiskMaxBytes"] = config.responseCacheDiskMaxBytes;
+    node["batchMaxConcurrentRequests"] = config.batchMaxConcurrentRequests;
+    node["sessionIdleTimeoutSec"] = config.sessionIdleTimeoutSec;
+    node["contextOverflowPolicy"] = config.contextOverflowPolicy;
+    node["traceSampleRate"] = config.traceSampleRate;
+    node["traceMaxBytes"] = config.traceMaxBytes;
 
     out_file << node;
     out_file.close();
@@ -87,7 +102,16 @@ CortexConfig CortexConfigMgr::FromYaml(const std::string& path,
          !node["verifyProxySsl"] || !node["verifyProxyHostSsl"] ||
          !node["supportedEngines"] || !node["sslCertPath"] ||
          !node["sslKeyPath"] || !node["noProxy"] ||
-         !node["checkedForSyncHubAt"]);
+         !node["checkedForSyncHubAt"] ||
+         !node["maxConcurrentRequestsPerModel"] ||
+         !node["maxQueuedRequestsPerModel"] ||
+         !node["requestQueueTimeoutMs"] || !node["clientWeights"] ||
+         !node["embeddingBatchWindowMs"] || !node["embeddingMaxBatchSize"] ||
+         !node["responseCacheEnabled"] || !node["responseCacheMaxBytes"] ||
+         !node["responseCacheDiskMaxBytes"] ||
+         !node["batchMaxConcurrentRequests"] ||
+         !node["sessionIdleTimeoutSec"] || !node["contextOverflowPolicy"] ||
+         !node["traceSampleRate"] || !node["traceMaxBytes"]);
 
     CortexConfig config = {
         .logFolderPath = node["logFolderPath"]
@@ -182,6 +206,55 @@ CortexConfig CortexConfigMgr::FromYaml(const std::string& path,
         .checkedForSyncHubAt = node["checkedForSyncHubAt"]
                                    ? node["checkedForSyncHubAt"].as<uint64_t>()
                                    : default_cfg.checkedForSyncHubAt,
+        .maxConcurrentRequestsPerModel =
+            node["maxConcurrentRequestsPerModel"]
+                ? node["maxConcurrentRequestsPerModel"].as<int>()
+                : default_cfg.maxConcurrentRequestsPerModel,
+        .maxQueuedRequestsPerModel =
+            node["maxQueuedRequestsPerModel"]
+                ? node["maxQueuedRequestsPerModel"].as<int>()
+                : default_cfg.maxQueuedRequestsPerModel,
+        .requestQueueTimeoutMs = node["requestQueueTimeoutMs"]
+                                     ? node["requestQueueTimeoutMs"].as<int>()
+                                     : default_cfg.requestQueueTimeoutMs,
+        .clientWeights =
+            node["clientWeights"]
+                ? node["clientWeights"].as<std::vector<std::string>>()
+                : default_cfg.clientWeights,
+        .embeddingBatchWindowMs = node["embeddingBatchWindowMs"]
+                                      ? node["embeddingBatchWindowMs"].as<int>()
+                                      : default_cfg.embeddingBatchWindowMs,
+        .embeddingMaxBatchSize = node["embeddingMaxBatchSize"]
+                                     ? node["embeddingMaxBatchSize"].as<int>()
+                                     : default_cfg.embeddingMaxBatchSize,
+        .responseCacheEnabled = node["responseCacheEnabled"]
+                                    ? node["responseCacheEnabled"].as<bool>()
+                                    : default_cfg.responseCacheEnabled,
+        .responseCacheMaxBytes =
+            node["responseCacheMaxBytes"]
+                ? node["responseCacheMaxBytes"].as<uint64_t>()
+                : default_cfg.responseCacheMaxBytes,
+        .responseCacheDiskMaxBytes =
+            node["responseCacheDiskMaxBytes"]
+                ? node["responseCacheDiskMaxBytes"].as<uint64_t>()
+                : default_cfg.responseCacheDiskMaxBytes,
+        .batchMaxConcurrentRequests =
+            node["batchMaxConcurrentRequests"]
+                ? node["batchMaxConcurrentRequests"].as<int>()
+                : default_cfg.batchMaxConcurrentRequests,
+        .sessionIdleTimeoutSec = node["sessionIdleTimeoutSec"]
+                                     ? node["sessionIdleTimeoutSec"].as<int>()
+                                     : default_cfg.sessionIdleTimeoutSec,
+        .contextOverflowPolicy =
+            node["contextOverflowPolicy"]
+                ? node["contextOverflowPolicy"].as<std::string>()
+                : default_cfg.contextOverflowPolicy,
+        .traceSampleRate = node["traceSampleRate"]
+                               ? node["traceSampleRate"].as<double>()
+                               : default_cfg.traceSampleRate,
+        .traceMaxBytes = node["traceMaxBytes"]
+                             ? node["traceMaxBytes"].as<uint64_t>()
+                             : default_cfg.traceMaxBytes,
     };
     if (should_update_config) {
       l.unlock();
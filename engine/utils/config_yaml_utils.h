@@ -26,6 +26,19 @@ const std::vector<std::string> kDefaultEnabledOrigins{
 constexpr const auto kDefaultNoProxy = "example.com,::1,localhost,127.0.0.1";
 const std::vector<std::string> kDefaultSupportedEngines{kLlamaEngine,
                                                         kPythonEngine};
+constexpr const int kDefaultMaxConcurrentRequestsPerModel = 0;
+constexpr const int kDefaultMaxQueuedRequestsPerModel = 64;
+constexpr const int kDefaultRequestQueueTimeoutMs = 0;
+constexpr const int kDefaultEmbeddingBatchWindowMs = 0;
+constexpr const int kDefaultEmbeddingMaxBatchSize = 32;
+constexpr const auto kDefaultResponseCacheEnabled = false;
+constexpr const uint64_t kDefaultResponseCacheMaxBytes = 64 * 1024 * 1024;
+constexpr const uint64_t kDefaultResponseCacheDiskMaxBytes = 0u;
+constexpr const int kDefaultBatchMaxConcurrentRequests = 2;
+constexpr const int kDefaultSessionIdleTimeoutSec = 600;
+constexpr const auto kDefaultContextOverflowPolicy = "none";
+constexpr const double kDefaultTraceSampleRate = 0.0;
+constexpr const uint64_t kDefaultTraceMaxBytes = 64 * 1024 * 1024;
 
 struct CortexConfig {
   std::string logFolderPath;
@@ -68,6 +81,57 @@ struct CortexConfig {
   std::string sslKeyPath;
   std::vector<std::string> supportedEngines;
   uint64_t checkedForSyncHubAt;
+
+  /**
+   * Admission control. 0 concurrency means unlimited unless the model sets
+   * n_parallel. Client weights are "client_id=weight" entries.
+   */
+  int maxConcurrentRequestsPerModel;
+  int maxQueuedRequestsPerModel;
+  int requestQueueTimeoutMs;
+  std::vector<std::string> clientWeights;
+
+  /**
+   * Embedding requests arriving within this window are sent to the engine
+   * as one batch, 0 disables batching.
+   */
+  int embeddingBatchWindowMs;
+  int embeddingMaxBatchSize;
+
+  /**
+   * Exact-match cache for deterministic requests. Entries evicted from memory
+   * spill to the data folder when the disk budget is not 0.
+   */
+  bool responseCacheEnabled;
+  uint64_t responseCacheMaxBytes;
+  uint64_t responseCacheDiskMaxBytes;
+
+  /**
+   * Number of requests of a /v1/batches job in flight at once.
+   */
+  int batchMaxConcurrentRequests;
+
+  /**
+   * A conversation keeps its engine slot until it has been idle for this
+   * long, 0 disables session affinity.
+   */
+  int sessionIdleTimeoutSec;
+
+  /**
+   * What to do with chat requests which don't fit the context window of the
+   * model: "none" sends them as they are, "error" rejects them and
+   * "truncate" drops their oldest turns. Requests can override it with
+   * "context_overflow".
+   */
+  std::string contextOverflowPolicy;
+
+  /**
+   * Share of the chat completions whose stage timings are written to
+   * logs/cortex-trace.json, in the Chrome trace format. The file is rotated
+   * once it reaches traceMaxBytes.
+   */
+  double traceSampleRate;
+  uint64_t traceMaxBytes;
 };
 
 class CortexConfigMgr {
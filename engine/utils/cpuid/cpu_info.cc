@@ -69,6 +69,10 @@ bool CpuInfo::has_avx() const {
   return impl->has_avx;
 }
 
+bool CpuInfo::has_fma() const {
+  return impl->has_fma;
+}
+
 bool CpuInfo::has_avx2() const {
   return impl->has_avx2;
 }
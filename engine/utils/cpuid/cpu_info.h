@@ -49,6 +49,9 @@ class CpuInfo {
   /// Return true if the CPU supports Advanced Vector Extensions
   bool has_avx() const;
 
+  /// Return true if the CPU supports Fused Multiply-Add (FMA3)
+  bool has_fma() const;
+
   /// Return true if the CPU supports Advanced Vector Extensions 2
   bool has_avx2() const;
 
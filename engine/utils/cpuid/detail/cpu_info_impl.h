@@ -19,6 +19,7 @@ struct CpuInfo::Impl {
         has_sse4_2(false),
         has_pclmulqdq(false),
         has_avx(false),
+        has_fma(false),
         has_avx2(false),
         has_avx512_f(false),
         has_avx512_dq(false),
@@ -50,6 +51,7 @@ struct CpuInfo::Impl {
   bool has_sse4_2;
   bool has_pclmulqdq;
   bool has_avx;
+  bool has_fma;
   bool has_avx2;
   bool has_avx512_f;
   bool has_avx512_dq;
@@ -22,6 +22,7 @@ void extract_x86_flags(CpuInfo::Impl& info, uint32_t ecx, uint32_t edx) {
   info.has_sse4_2 = (ecx & (1 << 20)) != 0;
   info.has_pclmulqdq = (ecx & (1 << 1)) != 0;
   info.has_avx = (ecx & (1 << 28)) != 0;
+  info.has_fma = (ecx & (1 << 12)) != 0;
   info.has_aes = (ecx & (1 << 25)) != 0;
   info.has_f16c = (ecx & (1 << 29)) != 0;
 }
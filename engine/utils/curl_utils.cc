@@ -1,8 +1,18 @@
 #include "curl_utils.h"
 
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "common/inflight_requests.h"
 #include "utils/engine_constants.h"
 #include "utils/file_manager_utils.h"
+#include "utils/json_helper.h"
 #include "utils/logging_utils.h"
+#include "utils/parallel_utils.h"
 
 #include "utils/string_utils.h"
 #include "utils/url_parser.h"
@@ -69,6 +79,120 @@ void SetUpProxy(CURL* handle, const std::string& url) {
     curl_easy_setopt(handle, CURLOPT_NOPROXY, no_proxy.c_str());
   }
 }
+
+// Upper bound of the GETs issued concurrently by ConditionalGet and
+// SimpleGetJsonRecursive, so that fanning out over a whole organization
+// stays within the rate limits of the hub
+constexpr const size_t kMaxConcurrentGets = 8;
+constexpr const long k304NotModified = 304;
+
+class InFlightLimiter {
+ public:
+  explicit InFlightLimiter(size_t max) : available_{max} {}
+
+  void Acquire() {
+    std::unique_lock<std::mutex> l(mtx_);
+    cv_.wait(l, [this] { return available_ > 0; });
+    available_--;
+  }
+
+  void Release() {
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      available_++;
+    }
+    cv_.notify_one();
+  }
+
+ private:
+  std::mutex mtx_;
+  std::condition_variable cv_;
+  size_t available_;
+};
+
+struct InFlightGuard {
+  static InFlightLimiter& Limiter() {
+    static InFlightLimiter limiter(kMaxConcurrentGets);
+    return limiter;
+  }
+
+  InFlightGuard() { Limiter().Acquire(); }
+  ~InFlightGuard() { Limiter().Release(); }
+};
+
+size_t HeaderCallback(char* buffer, size_t size, size_t nitems,
+                      void* userdata) {
+  auto* headers =
+      static_cast<std::unordered_map<std::string, std::string>*>(userdata);
+  std::string line(buffer, size * nitems);
+  if (string_utils::StartsWith(line, "HTTP/")) {
+    // status line of a new response, e.g. after a redirect
+    headers->clear();
+  } else if (auto pos = line.find(':'); pos != std::string::npos) {
+    auto key = line.substr(0, pos);
+    std::transform(key.begin(), key.end(), key.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    auto value = line.substr(pos + 1);
+    string_utils::Trim(value);
+    (*headers)[key] = value;
+  }
+  return size * nitems;
+}
+
+// FNV-1a, stable across runs so that the cache survives a restart
+std::string GetCacheKey(const std::string& url) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : url) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  std::ostringstream ss;
+  ss << std::hex << std::setw(16) << std::setfill('0') << hash;
+  return ss.str();
+}
+
+Json::Value ReadCacheEntry(const std::filesystem::path& path,
+                           const std::string& url) {
+  std::error_code ec;
+  if (!std::filesystem::exists(path, ec)) {
+    return Json::Value();
+  }
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream ss;
+  ss << file.rdbuf();
+  auto entry = json_helper::ParseJsonString(ss.str());
+  // never answer with the body of another url sharing the hash
+  if (!entry.isObject() || entry["url"].asString() != url) {
+    return Json::Value();
+  }
+  return entry;
+}
+
+void WriteCacheEntry(const std::filesystem::path& path,
+                     const Json::Value& entry) {
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+  // the same url may be fetched by several threads at once
+  auto tmp_path = path;
+  tmp_path += "." +
+              std::to_string(
+                  std::hash<std::thread::id>{}(std::this_thread::get_id())) +
+              ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    file << json_helper::DumpJsonString(entry);
+    if (!file) {
+      CTL_WRN("Failed to write HTTP cache entry: " << tmp_path.string());
+      file.close();
+      std::filesystem::remove(tmp_path, ec);
+      return;
+    }
+  }
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp_path, ec);
+  }
+}
 }  // namespace
 
 std::shared_ptr<Header> GetHeaders(const std::string& url) {
@@ -157,14 +281,15 @@ cpp::result<std::string, std::string> SimpleGet(const std::string& url,
   // Perform the request
   auto res = curl_easy_perform(curl);
 
+  auto http_code = 0L;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
   curl_slist_free_all(curl_headers);
   curl_easy_cleanup(curl);
   if (res != CURLE_OK) {
     return cpp::fail("CURL request failed: " +
                      static_cast<std::string>(curl_easy_strerror(res)));
   }
-  auto http_code = 0;
-  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
   if (http_code >= 400) {
     CTL_ERR("HTTP request failed with status code: " +
             std::to_string(http_code));
@@ -174,9 +299,44 @@ cpp::result<std::string, std::string> SimpleGet(const std::string& url,
   return response->GetData();
 }
 
+cpp::result<long, std::string> GetStatusCode(const std::string& url,
+                                             const int timeout) {
+  auto curl = curl_easy_init();
+
+  if (!curl) {
+    return cpp::fail("Failed to init CURL");
+  }
+
+  auto* response = new CurlResponse();
+  std::shared_ptr<CurlResponse> s(response,
+                                  std::default_delete<CurlResponse>());
+
+  SetUpProxy(curl, url);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlResponse::WriteCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+  if (timeout > 0) {
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+  }
+
+  auto res = curl_easy_perform(curl);
+
+  // read before the handle is cleaned up
+  auto http_code = 0L;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  curl_easy_cleanup(curl);
+
+  if (res != CURLE_OK) {
+    return cpp::fail("CURL request failed: " +
+                     static_cast<std::string>(curl_easy_strerror(res)));
+  }
+  return http_code;
+}
+
 cpp::result<std::string, std::string> SimpleRequest(
     const std::string& url, const RequestType& request_type,
-    const std::string& body) {
+    const std::string& body, const std::string& unix_socket_path,
+    const std::atomic<bool>* stop) {
   auto curl = curl_easy_init();
 
   if (!curl) {
@@ -199,7 +359,11 @@ cpp::result<std::string, std::string> SimpleRequest(
   std::shared_ptr<CurlResponse> s(response,
                                   std::default_delete<CurlResponse>());
 
-  SetUpProxy(curl, url);
+  if (unix_socket_path.empty()) {
+    SetUpProxy(curl, url);
+  } else {
+    curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, unix_socket_path.c_str());
+  }
   curl_easy_setopt(curl, CURLOPT_HTTPHEADER, curl_headers);
   curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
   if (request_type == RequestType::PATCH) {
@@ -216,6 +380,7 @@ cpp::result<std::string, std::string> SimpleRequest(
 
   curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, body.length());
   curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+  AbortTransferOnStop(curl, stop);
 
   // Perform the request
   auto res = curl_easy_perform(curl);
@@ -277,32 +442,59 @@ cpp::result<Json::Value, std::string> SimpleGetJson(const std::string& url,
 
 cpp::result<Json::Value, std::string> SimpleGetJsonRecursive(
     const std::string& url, const int timeout) {
-  auto result = SimpleGetJson(url, timeout);
+  auto result = [&url, timeout]() {
+    InFlightGuard guard;
+    return SimpleGetJson(url, timeout);
+  }();
   if (result.has_error()) {
     return result;
   }
   auto root = result.value();
 
   if (root.isArray()) {
-    for (const auto& value : root) {
-      if (value["type"].asString() == "directory") {
-        auto temp = SimpleGetJsonRecursive(
-            url + "/" +
-                std::filesystem::path(value["path"].asString())
-                    .filename()
-                    .string(),
-            timeout);
-        if (!temp.has_error()) {
-          if (temp.value().isArray()) {
-            for (const auto& item : temp.value()) {
-              root.append(item);
+    auto get_sub_dirs = [](const std::string& parent,
+                           const Json::Value& items) {
+      std::vector<std::string> urls;
+      for (const auto& value : items) {
+        if (value["type"].asString() == "directory") {
+          urls.push_back(parent + "/" +
+                         std::filesystem::path(value["path"].asString())
+                             .filename()
+                             .string());
+        }
+      }
+      return urls;
+    };
+
+    // Walk the tree level by level, the directories of a level are listed
+    // concurrently
+    auto pending = get_sub_dirs(url, root);
+    while (!pending.empty()) {
+      std::vector<Json::Value> listings(pending.size());
+      parallel_utils::ParallelFor(
+          pending.size(), kMaxConcurrentGets, [&](size_t i) {
+            InFlightGuard guard;
+            if (auto temp = SimpleGetJson(pending[i], timeout);
+                temp.has_value()) {
+              listings[i] = std::move(temp.value());
             }
-          } else {
-            root.append(temp.value());
+          });
+
+      std::vector<std::string> next;
+      for (size_t i = 0; i < pending.size(); i++) {
+        if (listings[i].isArray()) {
+          for (const auto& item : listings[i]) {
+            root.append(item);
           }
+          auto sub_dirs = get_sub_dirs(pending[i], listings[i]);
+          next.insert(next.end(), sub_dirs.begin(), sub_dirs.end());
+        } else if (!listings[i].isNull()) {
+          root.append(listings[i]);
         }
       }
+      pending = std::move(next);
     }
+
     for (Json::ArrayIndex i = 0; i < root.size();) {
       if (root[i].isMember("type") && root[i]["type"] == "directory") {
         root.removeIndex(i, nullptr);
@@ -314,6 +506,104 @@ cpp::result<Json::Value, std::string> SimpleGetJsonRecursive(
   return root;
 }
 
+cpp::result<ConditionalGetResult, std::string> ConditionalGet(
+    const std::string& url, const std::filesystem::path& cache_dir,
+    const int timeout) {
+  auto cache_path = cache_dir / (GetCacheKey(url) + ".json");
+  auto cached = ReadCacheEntry(cache_path, url);
+
+  auto curl = curl_easy_init();
+  if (!curl) {
+    return cpp::fail("Failed to init CURL");
+  }
+
+  curl_slist* curl_headers = nullptr;
+  if (auto headers = GetHeaders(url); headers) {
+    for (const auto& [key, value] : headers->m) {
+      auto header = key + ": " + value;
+      curl_headers = curl_slist_append(curl_headers, header.c_str());
+    }
+  }
+  if (cached.isObject()) {
+    if (auto etag = cached["etag"].asString(); !etag.empty()) {
+      auto header = "If-None-Match: " + etag;
+      curl_headers = curl_slist_append(curl_headers, header.c_str());
+    }
+    if (auto lm = cached["last_modified"].asString(); !lm.empty()) {
+      auto header = "If-Modified-Since: " + lm;
+      curl_headers = curl_slist_append(curl_headers, header.c_str());
+    }
+  }
+
+  CurlResponse response;
+  std::unordered_map<std::string, std::string> response_headers;
+
+  SetUpProxy(curl, url);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, curl_headers);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CurlResponse::WriteCallback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response_headers);
+  if (timeout > 0) {
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+  }
+
+  CURLcode res;
+  {
+    InFlightGuard guard;
+    res = curl_easy_perform(curl);
+  }
+
+  auto http_code = 0L;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+  curl_slist_free_all(curl_headers);
+  curl_easy_cleanup(curl);
+
+  if (res != CURLE_OK) {
+    return cpp::fail("CURL request failed: " +
+                     static_cast<std::string>(curl_easy_strerror(res)));
+  }
+  if (http_code == k304NotModified && cached.isObject()) {
+    CTL_DBG("Not modified: " << url);
+    return ConditionalGetResult{.url = url,
+                                .body = cached["body"].asString(),
+                                .modified = false};
+  }
+  if (http_code >= 400) {
+    CTL_ERR("HTTP request failed with status code: " +
+            std::to_string(http_code));
+    return cpp::fail(response.GetData());
+  }
+
+  ConditionalGetResult result{.url = url,
+                              .body = response.GetData(),
+                              .etag = response_headers["etag"],
+                              .last_modified =
+                                  response_headers["last-modified"]};
+  result.modified =
+      !cached.isObject() || cached["body"].asString() != result.body;
+  result.cache_stale = result.modified ||
+                       cached["etag"].asString() != result.etag ||
+                       cached["last_modified"].asString() !=
+                           result.last_modified;
+  return result;
+}
+
+void CacheConditionalGet(const ConditionalGetResult& result,
+                         const std::filesystem::path& cache_dir) {
+  if (!result.cache_stale) {
+    return;
+  }
+  Json::Value entry;
+  entry["url"] = result.url;
+  entry["etag"] = result.etag;
+  entry["last_modified"] = result.last_modified;
+  entry["body"] = result.body;
+  WriteCacheEntry(cache_dir / (GetCacheKey(result.url) + ".json"), entry);
+}
+
 cpp::result<Json::Value, std::string> SimplePostJson(const std::string& url,
                                                      const std::string& body) {
   auto result = SimpleRequest(url, RequestType::POST, body);
@@ -5,6 +5,8 @@
 #include <json/value.h>
 #include <yaml-cpp/node/node.h>
 #include <yaml-cpp/node/parse.h>
+#include <atomic>
+#include <filesystem>
 #include <optional>
 #include <string>
 #include <unordered_map>
@@ -24,9 +26,22 @@ std::shared_ptr<Header> GetHeaders(const std::string& url);
 cpp::result<std::string, std::string> SimpleGet(const std::string& url,
                                                 const int timeout = -1);
 
+/**
+ * Status code of a GET request to [url], whatever its value. Fails only when
+ * no response was received.
+ */
+cpp::result<long, std::string> GetStatusCode(const std::string& url,
+                                             const int timeout = -1);
+
+/**
+ * [unix_socket_path], if set, is the Unix domain socket the request is sent
+ * through instead of the host of [url]; proxies are bypassed in that case.
+ * The request is aborted once [stop] is set.
+ */
 cpp::result<std::string, std::string> SimpleRequest(
     const std::string& url, const RequestType& request_type,
-    const std::string& body = "");
+    const std::string& body = "", const std::string& unix_socket_path = "",
+    const std::atomic<bool>* stop = nullptr);
 
 cpp::result<YAML::Node, std::string> ReadRemoteYaml(const std::string& url);
 
@@ -37,9 +52,47 @@ cpp::result<YAML::Node, std::string> ReadRemoteYaml(const std::string& url);
  */
 cpp::result<Json::Value, std::string> SimpleGetJson(const std::string& url,
                                                     const int timeout = -1);
+
+/**
+ * SimpleGetJsonRecursive lists a Hugging Face tree and all its sub-directories.
+ * Sub-directories of the same level are fetched concurrently.
+ */
 cpp::result<Json::Value, std::string> SimpleGetJsonRecursive(const std::string& url,
                                                     const int timeout = -1);
 
+struct ConditionalGetResult {
+  std::string url{};
+  std::string body{};
+  // false if the body is the same as the cached one, either because the
+  // server answered 304 Not Modified or because it sent identical content
+  bool modified = true;
+  // validators of the response, for CacheConditionalGet
+  std::string etag{};
+  std::string last_modified{};
+  // true if the cache doesn't hold this response yet
+  bool cache_stale = false;
+};
+
+/**
+ * ConditionalGet sends a GET request revalidating the response cached in
+ * [cache_dir] with If-None-Match / If-Modified-Since. A 304 is answered from
+ * the cache.
+ *
+ * ConditionalGet and SimpleGetJsonRecursive are meant to be called from many
+ * threads at once; the requests they have in flight are bounded process-wide.
+ */
+cpp::result<ConditionalGetResult, std::string> ConditionalGet(
+    const std::string& url, const std::filesystem::path& cache_dir,
+    const int timeout = -1);
+
+/**
+ * Cache a 200 response of ConditionalGet along with its ETag and
+ * Last-Modified headers. The caller stores it once it has acted on the body,
+ * so that a failure in between fetches it again instead of getting a 304.
+ */
+void CacheConditionalGet(const ConditionalGetResult& result,
+                         const std::filesystem::path& cache_dir);
+
 cpp::result<Json::Value, std::string> SimplePostJson(
     const std::string& url, const std::string& body = "");
 
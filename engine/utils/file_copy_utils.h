@@ -0,0 +1,192 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include "utils/result.hpp"
+#include "utils/scope_exit.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#elif defined(__APPLE__) && defined(__MACH__)
+#include <sys/clonefile.h>
+#endif
+#endif
+
+/**
+ * Copy of large files with the cheapest mechanism the filesystem offers.
+ *
+ * A reflink shares the extents of the source and is instant. Otherwise the
+ * data is moved in large chunks by the kernel (copy_file_range, then
+ * sendfile), and only as a last resort through a userspace buffer. Progress
+ * is reported after every chunk and the copy stops when the callback
+ * returns false.
+ */
+namespace file_copy_utils {
+enum class CopyMethod { kReflink, kCopyFileRange, kSendfile, kReadWrite };
+
+inline std::string CopyMethodToString(CopyMethod method) {
+  switch (method) {
+    case CopyMethod::kReflink:
+      return "reflink";
+    case CopyMethod::kCopyFileRange:
+      return "copy_file_range";
+    case CopyMethod::kSendfile:
+      return "sendfile";
+    default:
+      return "read_write";
+  }
+}
+
+// Return false to stop the copy
+using ProgressFn = std::function<bool(uint64_t copied, uint64_t total)>;
+
+constexpr const uint64_t kChunkSize = 64 * 1024 * 1024;
+// buffer of the userspace fallback
+constexpr const size_t kBufferSize = 8 * 1024 * 1024;
+
+inline cpp::result<CopyMethod, std::string> CopyWithStreams(
+    const std::filesystem::path& src, const std::filesystem::path& dst,
+    uint64_t total, const ProgressFn& on_progress) {
+  std::ifstream in(src, std::ios::binary);
+  std::ofstream out(dst, std::ios::binary | std::ios::trunc);
+  if (!in || !out) {
+    return cpp::fail("Failed to open " + (!in ? src : dst).string());
+  }
+  std::vector<char> buffer(kBufferSize);
+  uint64_t copied = 0;
+  uint64_t since_report = 0;
+  while (copied < total) {
+    in.read(buffer.data(), static_cast<std::streamsize>(std::min<uint64_t>(
+                               buffer.size(), total - copied)));
+    auto n = in.gcount();
+    if (n <= 0) {
+      return cpp::fail("Source file shrank during the copy");
+    }
+    if (!out.write(buffer.data(), n)) {
+      return cpp::fail("Failed to write " + dst.string());
+    }
+    copied += n;
+    since_report += n;
+    if (since_report >= kChunkSize || copied == total) {
+      since_report = 0;
+      if (!on_progress(copied, total)) {
+        return cpp::fail("Copy cancelled");
+      }
+    }
+  }
+  if (!out.flush()) {
+    return cpp::fail("Failed to write " + dst.string());
+  }
+  return CopyMethod::kReadWrite;
+}
+
+/**
+ * Copy [src] to [dst], replacing it. Returns the mechanism that did the
+ * copy.
+ */
+inline cpp::result<CopyMethod, std::string> CopyFile(
+    const std::filesystem::path& src, const std::filesystem::path& dst,
+    const ProgressFn& on_progress) {
+  std::error_code ec;
+  auto total = std::filesystem::file_size(src, ec);
+  if (ec) {
+    return cpp::fail("Failed to read " + src.string() + ": " + ec.message());
+  }
+
+#if defined(_WIN32)
+  return CopyWithStreams(src, dst, total, on_progress);
+#else
+#if defined(__APPLE__) && defined(__MACH__)
+  // clonefile refuses to replace an existing file
+  std::filesystem::remove(dst, ec);
+  if (clonefile(src.c_str(), dst.c_str(), 0) == 0) {
+    on_progress(total, total);
+    return CopyMethod::kReflink;
+  }
+  return CopyWithStreams(src, dst, total, on_progress);
+#else
+  int in = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+  if (in < 0) {
+    return cpp::fail("Failed to open " + src.string() + ": " +
+                     std::strerror(errno));
+  }
+  auto close_in = cortex::utils::makeScopeExit([in] { close(in); });
+  int out = open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out < 0) {
+    return cpp::fail("Failed to open " + dst.string() + ": " +
+                     std::strerror(errno));
+  }
+  auto close_out = cortex::utils::makeScopeExit([out] { close(out); });
+
+#if defined(FICLONE)
+  if (ioctl(out, FICLONE, in) == 0) {
+    on_progress(total, total);
+    return CopyMethod::kReflink;
+  }
+#endif
+
+  auto method = CopyMethod::kCopyFileRange;
+  std::vector<char> buffer;
+  uint64_t copied = 0;
+  while (copied < total) {
+    auto chunk = std::min<uint64_t>(kChunkSize, total - copied);
+    ssize_t n = -1;
+    if (method == CopyMethod::kCopyFileRange) {
+      n = copy_file_range(in, nullptr, out, nullptr, chunk, 0);
+      // not supported across these filesystems, nothing was copied yet
+      if (n < 0 && copied == 0 &&
+          (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+           errno == EOPNOTSUPP)) {
+        method = CopyMethod::kSendfile;
+        continue;
+      }
+    } else if (method == CopyMethod::kSendfile) {
+      n = sendfile(out, in, nullptr, chunk);
+      if (n < 0 && copied == 0 && (errno == ENOSYS || errno == EINVAL)) {
+        method = CopyMethod::kReadWrite;
+        continue;
+      }
+    } else {
+      buffer.resize(kBufferSize);
+      n = read(in, buffer.data(), std::min<uint64_t>(chunk, buffer.size()));
+      for (ssize_t written = 0; n > 0 && written < n;) {
+        auto w = write(out, buffer.data() + written, n - written);
+        if (w < 0 && errno != EINTR) {
+          return cpp::fail("Failed to write " + dst.string() + ": " +
+                           std::strerror(errno));
+        }
+        written += std::max<ssize_t>(w, 0);
+      }
+    }
+
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return cpp::fail("Failed to copy " + src.string() + ": " +
+                       std::strerror(errno));
+    }
+    if (n == 0) {
+      return cpp::fail("Source file shrank during the copy");
+    }
+    copied += n;
+    if (!on_progress(copied, total)) {
+      return cpp::fail("Copy cancelled");
+    }
+  }
+  return method;
+#endif
+#endif
+}
+}  // namespace file_copy_utils
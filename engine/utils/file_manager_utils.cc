@@ -190,6 +190,25 @@ config_yaml_utils::CortexConfig GetDefaultConfig() {
       .sslKeyPath = "",
       .supportedEngines = config_yaml_utils::kDefaultSupportedEngines,
       .checkedForSyncHubAt = 0u,
+      .maxConcurrentRequestsPerModel =
+          config_yaml_utils::kDefaultMaxConcurrentRequestsPerModel,
+      .maxQueuedRequestsPerModel =
+          config_yaml_utils::kDefaultMaxQueuedRequestsPerModel,
+      .requestQueueTimeoutMs = config_yaml_utils::kDefaultRequestQueueTimeoutMs,
+      .clientWeights = {},
+      .embeddingBatchWindowMs =
+          config_yaml_utils::kDefaultEmbeddingBatchWindowMs,
+      .embeddingMaxBatchSize = config_yaml_utils::kDefaultEmbeddingMaxBatchSize,
+      .responseCacheEnabled = config_yaml_utils::kDefaultResponseCacheEnabled,
+      .responseCacheMaxBytes = config_yaml_utils::kDefaultResponseCacheMaxBytes,
+      .responseCacheDiskMaxBytes =
+          config_yaml_utils::kDefaultResponseCacheDiskMaxBytes,
+      .batchMaxConcurrentRequests =
+          config_yaml_utils::kDefaultBatchMaxConcurrentRequests,
+      .sessionIdleTimeoutSec = config_yaml_utils::kDefaultSessionIdleTimeoutSec,
+      .contextOverflowPolicy = config_yaml_utils::kDefaultContextOverflowPolicy,
+      .traceSampleRate = config_yaml_utils::kDefaultTraceSampleRate,
+      .traceMaxBytes = config_yaml_utils::kDefaultTraceMaxBytes,
   };
 }
 
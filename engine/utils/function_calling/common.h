@@ -1,13 +1,15 @@
 #pragma once
 
 #include <json/json.h>
-#include <regex>
 #include <sstream>
 #include <string>
 #include "llama3.1.h"
+#include "system_prompt_cache.h"
+#include "tool_call_parser.h"
 
 namespace function_calling_utils {
 constexpr auto custom_template_function = "<CUSTOM_FUNCTIONS>";
+constexpr size_t kSystemPromptCacheSize = 64;
 
 constexpr auto gamma_json = R"(
 root   ::= object
@@ -81,24 +83,15 @@ inline std::string ProcessTools(const std::shared_ptr<Json::Value>& request) {
 
 inline Json::Value ParseMultipleFunctionStrings(const std::string& input) {
   Json::Value results(Json::arrayValue);
-
-  // Regular expression to match the function name and arguments
-  std::regex functionRegex("<function=([^>]+)>(.+?)</function>");
-
-  // Iterator for regex matches
-  auto words_begin =
-      std::sregex_iterator(input.begin(), input.end(), functionRegex);
-  auto words_end = std::sregex_iterator();
-
-  for (std::sregex_iterator i = words_begin; i != words_end; ++i) {
-    std::smatch match = *i;
-    if (match.size() == 3) {
-      Json::Value function;
-      function["type"] = "function";
-      function["function"]["name"] = match[1].str();
-      function["function"]["arguments"] = match[2].str();
-      results.append(function);
-    }
+  ToolCallParser parser;
+  parser.Feed(input);
+  parser.Finish();
+  for (auto const& call : parser.calls()) {
+    Json::Value function;
+    function["type"] = "function";
+    function["function"]["name"] = call.name;
+    function["function"]["arguments"] = call.arguments;
+    results.append(function);
   }
 
   return results;
@@ -144,8 +137,12 @@ inline bool IsValidToolChoiceFormat(const Json::Value& root) {
          root["function"].isObject() && root["function"].isMember("name") &&
          root["function"]["name"].isString();
 }
-inline void UpdateMessages(std::string& system_prompt,
-                           std::shared_ptr<Json::Value> request) {
+// The system prompt for the tools, tool_choice and parallel_tool_calls of
+// [request], nothing else of it is read
+inline std::string BuildSystemPrompt(std::shared_ptr<Json::Value> request) {
+  std::string system_prompt =
+      ReplaceCustomFunctions(function_calling_llama3_1_utils::system_prompt,
+                             CreateCustomFunctionsString(request));
   Json::Value tool_choice = request->get("tool_choice", "auto");
   if (tool_choice.isString() && tool_choice.asString() == "required") {
     system_prompt +=
@@ -161,15 +158,15 @@ inline void UpdateMessages(std::string& system_prompt,
   if (!parallel_tool_calls) {
     system_prompt += "\n\nNow this is your first priority: You must call the only one function at a time.";
   }
+  return system_prompt;
+}
 
+inline void UpdateMessages(const std::string& system_prompt,
+                           std::shared_ptr<Json::Value> request) {
   bool tools_call_in_user_message =
       request->get("tools_call_in_user_message", false).asBool();
 
-  bool original_stream_config = (*request).get("stream", false).asBool();
   //   (*request)["grammar"] = function_calling_utils::gamma_json;
-  (*request)["stream"] =
-      false;  //when using function calling, disable stream automatically because we need to parse the response to get function name and params
-
   if (!request->isMember("messages") || !(*request)["messages"].isArray() ||
       (*request)["messages"].empty()) {
     // If no messages, add the system prompt as the first message
@@ -210,8 +207,6 @@ inline void UpdateMessages(std::string& system_prompt,
         (*request)["messages"][(*request)["messages"].size() - 1];
     if (lastMessage.get("role", "") == "tool") {
       lastMessage["role"] = function_calling_llama3_1_utils::tool_role;
-      (*request)["stream"] =
-          original_stream_config;  // if role is tool then should restore stream config to original value
     }
   }
   for (Json::Value& message : (*request)["messages"]) {
@@ -235,13 +230,11 @@ inline void PreprocessRequest(std::shared_ptr<Json::Value> request) {
       return;  // Exit if tool_choice is none
     }
   }
-  std::string customFunctionsString =
-      function_calling_utils::CreateCustomFunctionsString(request);
-  std::string new_system_prompt =
-      function_calling_utils::ReplaceCustomFunctions(
-          function_calling_llama3_1_utils::system_prompt,
-          customFunctionsString);
-  UpdateMessages(new_system_prompt, request);
+  // the same tools come with every turn of a conversation
+  static SystemPromptCache cache(kSystemPromptCacheSize);
+  auto system_prompt =
+      cache.Get(*request, [&request] { return BuildSystemPrompt(request); });
+  UpdateMessages(*system_prompt, request);
 }
 
 inline void PostProcessResponse(Json::Value& response) {
@@ -282,4 +275,62 @@ inline void PostProcessResponse(Json::Value& response) {
 
   // Add any additional post-processing logic here
 }
+
+/**
+ * Rewrites a chunk of a streamed chat completion, moving the function calls
+ * out of the content deltas into tool_calls deltas. [parser] follows the
+ * whole stream. Returns false when nothing is left of the chunk to send.
+ */
+inline bool PostProcessStreamChunk(ToolCallParser& parser,
+                                   Json::Value& response) {
+  constexpr std::string_view kPrefix = "data: ";
+  auto const& data = response["data"];
+  if (!data.isString()) {
+    return true;
+  }
+  std::string_view line = data.asCString();
+  if (line.substr(0, kPrefix.size()) != kPrefix) {
+    return true;
+  }
+  Json::Value chunk;
+  Json::Reader reader;
+  line.remove_prefix(kPrefix.size());
+  if (!reader.parse(line.data(), line.data() + line.size(), chunk) ||
+      !chunk.isObject() || !chunk["choices"].isArray() ||
+      chunk["choices"].empty()) {
+    return true;
+  }
+
+  Json::Value& choice = chunk["choices"][0];
+  Json::Value& delta = choice["delta"];
+  auto out = parser.Feed(delta.get("content", "").asString());
+  auto finished = !choice.get("finish_reason", Json::Value()).isNull();
+  if (finished) {
+    auto rest = parser.Finish();
+    out.content += rest.content;
+    for (auto& call : rest.tool_calls) {
+      out.tool_calls.append(std::move(call));
+    }
+    if (!parser.calls().empty() &&
+        response.get("tool_choice", "auto").isString() &&
+        response.get("tool_choice", "auto").asString() == "auto") {
+      choice["finish_reason"] = "tool_calls";
+    }
+  }
+  if (out.content.empty() && out.tool_calls.empty() && !finished &&
+      delta.isMember("content")) {
+    return false;
+  }
+
+  if (delta.isMember("content") || !out.content.empty()) {
+    delta["content"] = out.content;
+  }
+  if (!out.tool_calls.empty()) {
+    delta["tool_calls"] = std::move(out.tool_calls);
+  }
+  Json::FastWriter writer;
+  writer.omitEndingLineFeed();
+  response["data"] = "data: " + writer.write(chunk) + "\n\n";
+  return true;
+}
 }  // namespace function_calling_utils
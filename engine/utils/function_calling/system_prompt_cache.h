@@ -0,0 +1,149 @@
+#pragma once
+
+#include <json/json.h>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace function_calling_utils {
+
+/**
+ * Memoizes the function calling system prompt, which only depends on the
+ * tools, tool_choice and parallel_tool_calls of a request.
+ *
+ * Agents send the same tool list with every turn, so the prompt is kept in
+ * a bounded LRU under a hash of those fields. The hash walks the JSON
+ * values as they are, objects being iterated in key order, so members
+ * sent in another order still hit and nothing is serialized. A hit is
+ * confirmed by comparing the fields with the ones the prompt was built
+ * from.
+ */
+class SystemPromptCache {
+ public:
+  explicit SystemPromptCache(size_t capacity) : capacity_{capacity} {}
+
+  // The prompt of [request], built by [build] when it is not cached
+  template <typename Build>
+  std::shared_ptr<const std::string> Get(const Json::Value& request,
+                                         Build&& build) {
+    const auto& tools = request["tools"];
+    auto tool_choice = request.get("tool_choice", "auto");
+    auto parallel = request.get("parallel_tool_calls", true).asBool();
+    uint64_t key = Hash(tools, kFnvOffset);
+    key = Hash(tool_choice, key);
+    key = Mix(key, parallel);
+
+    {
+      std::lock_guard<std::mutex> l(mtx_);
+      if (auto it = index_.find(key); it != index_.end()) {
+        auto& entry = *it->second;
+        if (entry.parallel_tool_calls == parallel &&
+            entry.tool_choice == tool_choice && entry.tools == tools) {
+          lru_.splice(lru_.begin(), lru_, it->second);
+          hits_++;
+          return entry.prompt;
+        }
+      }
+    }
+
+    auto prompt = std::make_shared<const std::string>(build());
+    std::lock_guard<std::mutex> l(mtx_);
+    if (auto it = index_.find(key); it != index_.end()) {
+      lru_.erase(it->second);
+      index_.erase(it);
+    }
+    lru_.push_front(Entry{key, tools, tool_choice, parallel, prompt});
+    index_[key] = lru_.begin();
+    while (lru_.size() > capacity_) {
+      index_.erase(lru_.back().key);
+      lru_.pop_back();
+    }
+    return prompt;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> l(mtx_);
+    return lru_.size();
+  }
+
+  uint64_t hits() const {
+    std::lock_guard<std::mutex> l(mtx_);
+    return hits_;
+  }
+
+ private:
+  static constexpr uint64_t kFnvOffset = 0xcbf29ce484222325ULL;
+
+  static uint64_t Fnv1a(std::string_view data, uint64_t hash) {
+    for (unsigned char c : data) {
+      hash ^= c;
+      hash *= 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  static uint64_t Mix(uint64_t hash, uint64_t value) {
+    return Fnv1a(std::string_view(reinterpret_cast<const char*>(&value),
+                                  sizeof(value)),
+                 hash);
+  }
+
+  static uint64_t Hash(const Json::Value& value, uint64_t hash) {
+    hash = Mix(hash, value.type());
+    switch (value.type()) {
+      case Json::intValue:
+        return Mix(hash, static_cast<uint64_t>(value.asInt64()));
+      case Json::uintValue:
+        return Mix(hash, value.asUInt64());
+      case Json::realValue: {
+        uint64_t bits;
+        auto d = value.asDouble();
+        std::memcpy(&bits, &d, sizeof(bits));
+        return Mix(hash, bits);
+      }
+      case Json::booleanValue:
+        return Mix(hash, value.asBool());
+      case Json::stringValue: {
+        const char* begin;
+        const char* end;
+        value.getString(&begin, &end);
+        return Fnv1a(std::string_view(begin, end - begin), hash);
+      }
+      case Json::arrayValue:
+        for (auto const& element : value) {
+          hash = Hash(element, hash);
+        }
+        return Mix(hash, value.size());
+      case Json::objectValue:
+        for (auto it = value.begin(); it != value.end(); ++it) {
+          const char* end;
+          const char* name = it.memberName(&end);
+          hash = Fnv1a(std::string_view(name, end - name), hash);
+          hash = Hash(*it, hash);
+        }
+        return Mix(hash, value.size());
+      default:
+        return hash;
+    }
+  }
+
+  struct Entry {
+    uint64_t key;
+    Json::Value tools;
+    Json::Value tool_choice;
+    bool parallel_tool_calls;
+    std::shared_ptr<const std::string> prompt;
+  };
+
+  size_t capacity_;
+  mutable std::mutex mtx_;
+  std::list<Entry> lru_;
+  std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+  uint64_t hits_{0};
+};
+}  // namespace function_calling_utils
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <json/json.h>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "utils/ulid_generator.h"
+
+namespace function_calling_utils {
+constexpr std::string_view kFunctionOpen = "<function=";
+constexpr std::string_view kFunctionClose = "</function>";
+
+struct FunctionCall {
+  std::string id;
+  std::string name;
+  std::string arguments{};
+};
+
+/**
+ * Extracts the <function=name>arguments</function> calls of a generation
+ * as it is streamed.
+ *
+ * A single pass state machine: text outside the markers is passed through
+ * as content, the name and arguments of a call are turned into OpenAI
+ * tool_calls deltas as they arrive. Only a trailing piece of text which
+ * might be the start of a marker is held back until the next chunk tells
+ * which it is. A call whose closing marker never comes is kept, its
+ * deltas being out already.
+ */
+class ToolCallParser {
+ public:
+  struct Output {
+    std::string content;
+    // tool_calls deltas, each with the index of its call
+    Json::Value tool_calls = Json::Value(Json::arrayValue);
+  };
+
+  Output Feed(std::string_view chunk) {
+    Output out;
+    std::string text;
+    if (!held_.empty()) {
+      text = std::move(held_);
+      held_.clear();
+      text.append(chunk);
+      chunk = text;
+    }
+
+    size_t pos = 0;
+    while (pos < chunk.size()) {
+      switch (state_) {
+        case State::kText:
+          pos = ScanText(chunk, pos, out);
+          break;
+        case State::kName:
+          pos = ScanName(chunk, pos, out);
+          break;
+        case State::kArguments:
+          pos = ScanArguments(chunk, pos, out);
+          break;
+      }
+    }
+    return out;
+  }
+
+  // Flushes what was held back at the end of the generation
+  Output Finish() {
+    Output out;
+    if (state_ == State::kName) {
+      out.content.append(kFunctionOpen).append(name_).append(held_);
+      name_.clear();
+    } else if (state_ == State::kArguments) {
+      EmitArguments(held_, out);
+    } else {
+      out.content.append(held_);
+    }
+    held_.clear();
+    state_ = State::kText;
+    return out;
+  }
+
+  const std::vector<FunctionCall>& calls() const { return calls_; }
+
+ private:
+  enum class State { kText, kName, kArguments };
+
+  // Position of the first '<' of [s] at or after [pos], npos if none
+  static size_t FindMarker(std::string_view s, size_t pos) {
+    auto* p = static_cast<const char*>(
+        std::memchr(s.data() + pos, '<', s.size() - pos));
+    return p == nullptr ? std::string_view::npos : p - s.data();
+  }
+
+  enum class Match { kNo, kPartial, kFull };
+
+  // Whether [rest] starts with [marker], or is cut in the middle of it
+  static Match MatchMarker(std::string_view rest, std::string_view marker) {
+    if (rest.size() < marker.size()) {
+      return marker.substr(0, rest.size()) == rest ? Match::kPartial
+                                                   : Match::kNo;
+    }
+    return rest.substr(0, marker.size()) == marker ? Match::kFull
+                                                   : Match::kNo;
+  }
+
+  size_t ScanText(std::string_view s, size_t pos, Output& out) {
+    while (true) {
+      auto lt = FindMarker(s, pos);
+      if (lt == std::string_view::npos) {
+        out.content.append(s.substr(pos));
+        return s.size();
+      }
+      out.content.append(s.substr(pos, lt - pos));
+      switch (MatchMarker(s.substr(lt), kFunctionOpen)) {
+        case Match::kFull:
+          state_ = State::kName;
+          return lt + kFunctionOpen.size();
+        case Match::kPartial:
+          held_.assign(s.substr(lt));
+          return s.size();
+        case Match::kNo:
+          out.content.push_back('<');
+          pos = lt + 1;
+          break;
+      }
+    }
+  }
+
+  size_t ScanName(std::string_view s, size_t pos, Output& out) {
+    auto* gt = static_cast<const char*>(
+        std::memchr(s.data() + pos, '>', s.size() - pos));
+    if (gt == nullptr) {
+      name_.append(s.substr(pos));
+      return s.size();
+    }
+    size_t end = gt - s.data();
+    name_.append(s.substr(pos, end - pos));
+    if (name_.empty()) {
+      // not a call
+      out.content.append(kFunctionOpen).append(">");
+      state_ = State::kText;
+      return end + 1;
+    }
+
+    calls_.push_back(FunctionCall{.id = "call_" + ulid::GenerateUlid(),
+                                  .name = std::move(name_)});
+    name_.clear();
+    Json::Value delta;
+    delta["index"] = static_cast<Json::UInt>(calls_.size() - 1);
+    delta["id"] = calls_.back().id;
+    delta["type"] = "function";
+    delta["function"]["name"] = calls_.back().name;
+    delta["function"]["arguments"] = "";
+    out.tool_calls.append(std::move(delta));
+    state_ = State::kArguments;
+    return end + 1;
+  }
+
+  size_t ScanArguments(std::string_view s, size_t pos, Output& out) {
+    std::string arguments;
+    while (true) {
+      auto lt = FindMarker(s, pos);
+      if (lt == std::string_view::npos) {
+        arguments.append(s.substr(pos));
+        pos = s.size();
+        break;
+      }
+      arguments.append(s.substr(pos, lt - pos));
+      auto match = MatchMarker(s.substr(lt), kFunctionClose);
+      if (match == Match::kFull) {
+        state_ = State::kText;
+        pos = lt + kFunctionClose.size();
+        break;
+      }
+      if (match == Match::kPartial) {
+        held_.assign(s.substr(lt));
+        pos = s.size();
+        break;
+      }
+      arguments.push_back('<');
+      pos = lt + 1;
+    }
+    EmitArguments(arguments, out);
+    return pos;
+  }
+
+  void EmitArguments(std::string_view arguments, Output& out) {
+    if (arguments.empty()) {
+      return;
+    }
+    calls_.back().arguments.append(arguments);
+    Json::Value delta;
+    delta["index"] = static_cast<Json::UInt>(calls_.size() - 1);
+    delta["function"]["arguments"] = std::string(arguments);
+    out.tool_calls.append(std::move(delta));
+  }
+
+  State state_ = State::kText;
+  // the start of a marker, split by the end of the last chunk
+  std::string held_;
+  std::string name_;
+  std::vector<FunctionCall> calls_;
+};
+}  // namespace function_calling_utils
@@ -62,18 +62,64 @@ struct HuggingFaceSiblingsFileSize {
   }
 };
 
+inline std::string GetModelsByAuthorUrl(const std::string& author) {
+  auto url_obj = url_parser::Url{.protocol = "https",
+                                 .host = kHuggingFaceHost,
+                                 .pathParams = {"api", "models"},
+                                 .queries = {{"author", author}}};
+  return url_obj.ToFullPath();
+}
+
+inline std::string GetModelRepoInfoUrl(const std::string& author,
+                                       const std::string& model_name) {
+  auto url_obj =
+      url_parser::Url{.protocol = "https",
+                      .host = kHuggingFaceHost,
+                      .pathParams = {"api", "models", author, model_name}};
+  return url_obj.ToFullPath();
+}
+
+inline std::string GetModelRefsUrl(const std::string& author,
+                                   const std::string& model_name) {
+  auto url_obj = url_parser::Url{
+      .protocol = "https",
+      .host = kHuggingFaceHost,
+      .pathParams = {"api", "models", author, model_name, "refs"}};
+  return url_obj.ToFullPath();
+}
+
+// Listing of [path] in the tree of [branch], the root if [path] is empty
+inline std::string GetModelTreeUrl(const std::string& author,
+                                   const std::string& model_name,
+                                   const std::string& branch = "main",
+                                   const std::string& path = "") {
+  auto url_obj = url_parser::Url{
+      .protocol = "https",
+      .host = kHuggingFaceHost,
+      .pathParams = {"api", "models", author, model_name, "tree", branch}};
+  if (!path.empty()) {
+    url_obj.pathParams.push_back(path);
+  }
+  return url_obj.ToFullPath();
+}
+
+inline std::string GetReadMeUrl(const std::string& author,
+                                const std::string& model_name) {
+  auto url_obj = url_parser::Url{
+      .protocol = "https",
+      .host = kHuggingFaceHost,
+      .pathParams = {author, model_name, "raw", "main", "README.md"}};
+  return url_obj.ToFullPath();
+}
+
 inline cpp::result<HuggingFaceSiblingsFileSize, std::string>
 GetSiblingsFileSize(const std::string& author, const std::string& model_name,
                     const std::string& branch = "main") {
   if (author.empty() || model_name.empty()) {
     return cpp::fail("Author and model name cannot be empty");
   }
-  auto url_obj = url_parser::Url{
-      .protocol = "https",
-      .host = kHuggingFaceHost,
-      .pathParams = {"api", "models", author, model_name, "tree", branch}};
-
-  auto result = curl_utils::SimpleGetJson(url_obj.ToFullPath());
+  auto result =
+      curl_utils::SimpleGetJson(GetModelTreeUrl(author, model_name, branch));
   if (result.has_error()) {
     return cpp::fail("Failed to get model siblings file size: " + author + "/" +
                      model_name + "/tree/" + branch);
@@ -81,13 +127,8 @@ GetSiblingsFileSize(const std::string& author, const std::string& model_name,
   auto r = result.value();
   for (auto const& j : result.value()) {
     if (j["type"].asString() == "directory") {
-      auto url_obj =
-          url_parser::Url{.protocol = "https",
-                          .host = kHuggingFaceHost,
-                          .pathParams = {"api", "models", author, model_name,
-                                         "tree", branch, j["path"].asString()}};
-
-      auto rd = curl_utils::SimpleGetJson(url_obj.ToFullPath());
+      auto rd = curl_utils::SimpleGetJson(
+          GetModelTreeUrl(author, model_name, branch, j["path"].asString()));
       if (rd.has_value()) {
         for (auto const& rdj : rd.value()) {
           r.append(rdj);
@@ -104,17 +145,7 @@ inline cpp::result<std::string, std::string> GetReadMe(
   if (author.empty() || model_name.empty()) {
     return cpp::fail("Author and model name cannot be empty");
   }
-  auto url_obj = url_parser::Url{.protocol = "https",
-                                 .host = kHuggingFaceHost,
-                                 .pathParams = {
-                                     author,
-                                     model_name,
-                                     "raw",
-                                     "main",
-                                     "README.md",
-                                 }};
-
-  auto result = curl_utils::SimpleGet(url_obj.ToFullPath());
+  auto result = curl_utils::SimpleGet(GetReadMeUrl(author, model_name));
   if (result.has_error()) {
     return cpp::fail("Failed to get model siblings file size: " + author + "/" +
                      model_name + "/raw/main/README.md");
@@ -224,12 +255,7 @@ GetModelRepositoryBranches(const std::string& author,
   if (author.empty() || modelName.empty()) {
     return cpp::fail("Author and model name cannot be empty");
   }
-  auto url_obj = url_parser::Url{
-      .protocol = "https",
-      .host = kHuggingFaceHost,
-      .pathParams = {"api", "models", author, modelName, "refs"}};
-
-  auto result = curl_utils::SimpleGetJson(url_obj.ToFullPath());
+  auto result = curl_utils::SimpleGetJson(GetModelRefsUrl(author, modelName));
   if (result.has_error()) {
     return cpp::fail("Failed to get model repository branches: " + author +
                      "/" + modelName);
@@ -256,12 +282,8 @@ GetHuggingFaceModelRepoInfo(const std::string& author,
   if (author.empty() || modelName.empty()) {
     return cpp::fail("Author and model name cannot be empty");
   }
-  auto url_obj =
-      url_parser::Url{.protocol = "https",
-                      .host = kHuggingFaceHost,
-                      .pathParams = {"api", "models", author, modelName}};
-
-  auto result = curl_utils::SimpleGetJson(url_obj.ToFullPath());
+  auto result =
+      curl_utils::SimpleGetJson(GetModelRepoInfoUrl(author, modelName));
   if (result.has_error()) {
     return cpp::fail("Failed to get model repository info: " + author + "/" +
                      modelName);
@@ -8,6 +8,20 @@
 #include "utils/result.hpp"
 
 namespace jinja {
+inline cpp::result<std::string, std::string> RenderMessages(
+    const std::string& tmpl, const nlohmann::json& messages,
+    const std::string& bos_token, const std::string& eos_token,
+    bool add_bos_token, bool add_eos_token,
+    bool add_generation_prompt = true) {
+  try {
+    minja::chat_template chat_tmpl(tmpl, add_bos_token ? bos_token : "",
+                                   add_eos_token ? eos_token : "");
+    return chat_tmpl.apply(messages, {}, add_generation_prompt);
+  } catch (const std::exception& e) {
+    return cpp::fail("Failed to render template: " + std::string(e.what()));
+  }
+}
+
 inline cpp::result<std::string, std::string> RenderTemplate(
     std::string& tmpl, const Json::Value& data, const std::string& bos_token,
     const std::string& eos_token, bool add_bos_token, bool add_eos_token,
@@ -15,11 +29,9 @@ inline cpp::result<std::string, std::string> RenderTemplate(
   try {
     auto converted_json =
         extensions::TemplateRenderer().ConvertJsonValue(data);
-
-    minja::chat_template chat_tmpl(tmpl, add_bos_token ? bos_token : "",
-                                   add_eos_token ? eos_token : "");
-    return chat_tmpl.apply(converted_json["messages"], {},
-                           add_generation_prompt);
+    return RenderMessages(tmpl, converted_json["messages"], bos_token,
+                          eos_token, add_bos_token, add_eos_token,
+                          add_generation_prompt);
   } catch (const std::exception& e) {
     return cpp::fail("Failed to render template: " + std::string(e.what()));
   }
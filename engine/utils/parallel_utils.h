@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace parallel_utils {
+
+/**
+ * Call fn(i) for every i in [0, n) from up to [max_workers] threads and
+ * return once all calls are done. The calling thread is one of the workers.
+ */
+template <typename Fn>
+void ParallelFor(size_t n, size_t max_workers, Fn&& fn) {
+  std::atomic<size_t> next{0};
+  auto work = [&]() {
+    for (auto i = next++; i < n; i = next++) {
+      fn(i);
+    }
+  };
+
+  auto num_threads = std::min(n, std::max<size_t>(max_workers, 1));
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < num_threads; t++) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+}  // namespace parallel_utils
@@ -0,0 +1,127 @@
+#include "request_trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+// Milliseconds of Server-Timing or microseconds of the trace viewer, down to
+// the nanosecond
+std::string FormatDuration(double value) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.3f", value);
+  return buf;
+}
+
+void AppendEscaped(std::string_view s, std::string& out) {
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out.append(buf);
+    } else {
+      out.push_back(c);
+    }
+  }
+}
+
+void AppendEvent(std::string_view name, std::string_view category,
+                 double ts_us, double dur_us, uint64_t tid,
+                 std::string& out) {
+  out.append("{\"name\":\"");
+  AppendEscaped(name, out);
+  out.append("\",\"cat\":\"").append(category);
+  out.append("\",\"ph\":\"X\",\"ts\":").append(FormatDuration(ts_us));
+  out.append(",\"dur\":").append(FormatDuration(dur_us));
+  out.append(",\"pid\":1,\"tid\":").append(std::to_string(tid));
+  out.append("},\n");
+}
+}  // namespace
+
+RequestTrace::RequestTrace(std::string name, uint64_t id, bool sampled)
+    : name_{std::move(name)},
+      id_{id},
+      sampled_{sampled},
+      start_{Clock::now()},
+      start_us_{std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count()} {}
+
+std::string RequestTrace::ServerTiming() const {
+  std::string out;
+  for (int stage = 0; stage < kStageCount; stage++) {
+    auto begin = begin_[stage].load();
+    auto end = end_[stage].load();
+    if (begin == 0 || end < begin) {
+      continue;
+    }
+    out.append(kStageNames[stage]).append(";dur=");
+    out.append(FormatDuration((end - begin) / 1e6)).append(", ");
+  }
+  std::chrono::duration<double, std::milli> total = Clock::now() - start_;
+  out.append("total;dur=").append(FormatDuration(total.count()));
+  return out;
+}
+
+void RequestTrace::AppendChromeEvents(std::string& out) const {
+  for (int stage = 0; stage < kStageCount; stage++) {
+    auto begin = begin_[stage].load();
+    auto end = end_[stage].load();
+    if (begin == 0 || end < begin) {
+      continue;
+    }
+    AppendEvent(kStageNames[stage], "stage", start_us_ + (begin - 1) / 1e3,
+                (end - begin) / 1e3, id_, out);
+  }
+  std::chrono::duration<double, std::micro> total = Clock::now() - start_;
+  AppendEvent(name_, "request", start_us_, total.count(), id_, out);
+}
+
+TraceSink::TraceSink(Config config) : config_{std::move(config)} {}
+
+std::shared_ptr<RequestTrace> TraceSink::StartTrace(std::string name) {
+  auto id = next_id_.fetch_add(1);
+  // every 1/sample_rate-th request, without a random number generator
+  auto rate = std::clamp(config_.sample_rate, 0.0, 1.0);
+  bool sampled = std::floor(id * rate) != std::floor((id - 1) * rate);
+  return std::make_shared<RequestTrace>(std::move(name), id, sampled);
+}
+
+void TraceSink::Write(const RequestTrace& trace) {
+  std::string events;
+  trace.AppendChromeEvents(events);
+
+  std::lock_guard<std::mutex> l(mtx_);
+  if (!out_.is_open() || bytes_ + events.size() > config_.max_bytes) {
+    Rotate();
+  }
+  if (!out_.is_open()) {
+    return;
+  }
+  out_.write(events.data(), events.size());
+  out_.flush();
+  bytes_ += events.size();
+}
+
+void TraceSink::Rotate() {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  if (out_.is_open()) {
+    out_.close();
+  }
+  // the file of a previous run is rotated too
+  if (fs::exists(config_.path, ec)) {
+    auto rotated = [this](int i) {
+      return fs::path(config_.path.string() + "." + std::to_string(i));
+    };
+    for (int i = config_.max_files - 1; i > 0; i--) {
+      fs::rename(i == 1 ? config_.path : rotated(i - 1), rotated(i), ec);
+    }
+  }
+  fs::create_directories(config_.path.parent_path(), ec);
+  out_.open(config_.path, std::ios::binary | std::ios::trunc);
+  out_ << "[\n";
+  bytes_ = 2;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+/**
+ * Stage timings of one request.
+ *
+ * Each stage has a begin and an end slot in a fixed array, filled with
+ * monotonic offsets from the creation of the trace, so recording a stage
+ * neither allocates nor locks and may happen on any thread: the server
+ * thread, the scheduler or the engine callbacks. The first Begin and the
+ * first End of a stage win, which lets callbacks invoked once per chunk
+ * record the first one only.
+ */
+class RequestTrace {
+ public:
+  enum Stage : uint8_t {
+    // JSON body and raw message parsing
+    kParse,
+    // engine lookup by model id
+    kResolve,
+    // function calling rewrite of the request
+    kPreprocess,
+    // chat template rendering, context window fitting included
+    kRender,
+    // wait for a scheduler slot
+    kQueue,
+    // from dispatch to the last result of the engine
+    kEngine,
+    // from dispatch to the first result of the engine
+    kFirstToken,
+    // from the first to the last chunk written to the client
+    kStream,
+    kStageCount,
+  };
+
+  static constexpr std::array<std::string_view, kStageCount> kStageNames{
+      "parse", "resolve", "preprocess", "render",
+      "queue", "engine",  "ttft",       "stream"};
+
+  // [sampled] traces are written to the trace sink when finished
+  RequestTrace(std::string name, uint64_t id, bool sampled);
+
+  void Begin(Stage stage) { Record(begin_[stage]); }
+
+  void End(Stage stage) { Record(end_[stage]); }
+
+  // Records the stage for the lifetime of the span
+  class Span {
+   public:
+    Span(RequestTrace* trace, Stage stage) : trace_{trace}, stage_{stage} {
+      if (trace_ != nullptr) {
+        trace_->Begin(stage_);
+      }
+    }
+    ~Span() {
+      if (trace_ != nullptr) {
+        trace_->End(stage_);
+      }
+    }
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+   private:
+    RequestTrace* trace_;
+    Stage stage_;
+  };
+
+  /**
+   * Value of a Server-Timing header, in milliseconds, with the stages which
+   * completed and the total so far, e.g. "render;dur=1.204, total;dur=52.1".
+   */
+  std::string ServerTiming() const;
+
+  /**
+   * Appends the request and its completed stages to [out] as Chrome trace
+   * events, one per line, each followed by a comma.
+   */
+  void AppendChromeEvents(std::string& out) const;
+
+  // True the first time only, so that the trace is written once
+  bool Finish() { return !finished_.exchange(true); }
+
+  bool sampled() const { return sampled_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  // nanoseconds since start_ plus one, 0 until recorded
+  using Slot = std::atomic<int64_t>;
+
+  void Record(Slot& slot) {
+    int64_t expected = 0;
+    slot.compare_exchange_strong(
+        expected, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      Clock::now() - start_)
+                          .count() +
+                      1);
+  }
+
+  std::string name_;
+  uint64_t id_;
+  bool sampled_;
+  Clock::time_point start_;
+  // wall clock of start_, in microseconds, for the trace viewer
+  int64_t start_us_;
+  std::array<Slot, kStageCount> begin_{};
+  std::array<Slot, kStageCount> end_{};
+  std::atomic_bool finished_{false};
+};
+
+/**
+ * Rotating file of request traces, in the JSON array format of the Chrome
+ * trace viewer (chrome://tracing, Perfetto), which tolerates the missing
+ * closing bracket of a file still being written.
+ *
+ * Each request is its own row. A file which grows past max_bytes is
+ * renamed with a .1 suffix, older ones shifting up to max_files.
+ */
+class TraceSink {
+ public:
+  struct Config {
+    std::filesystem::path path;
+    // share of the requests written, 0 to 1
+    double sample_rate = 0;
+    uint64_t max_bytes = 64 * 1024 * 1024;
+    int max_files = 3;
+  };
+
+  explicit TraceSink(Config config);
+
+  // A trace for a new request, sampled following the sample rate
+  std::shared_ptr<RequestTrace> StartTrace(std::string name);
+
+  void Write(const RequestTrace& trace);
+
+ private:
+  void Rotate();
+
+  Config config_;
+  std::atomic<uint64_t> next_id_{1};
+  std::mutex mtx_;
+  std::ofstream out_;
+  uint64_t bytes_{0};
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * Incremental parser of text/event-stream bodies.
+ *
+ * Lines are found with memchr and events are handed out as views: the
+ * events completed by a chunk point into the chunk itself, and only the
+ * unterminated tail of a chunk is copied, to be completed by the next ones.
+ * The buffer holding that tail is compacted once its consumed part
+ * outgrows the pending one, so each byte is copied a bounded number of
+ * times however the stream is split. Multi-line data, event types, ids and
+ * comments are handled as in the HTML living standard.
+ */
+namespace sse {
+struct Event {
+  // empty for the default "message" type
+  std::string_view type;
+  // the data lines joined with '\n'
+  std::string_view data;
+  std::string_view id;
+};
+
+// [event] in wire format, terminated by a blank line
+inline std::string Serialize(const Event& event) {
+  std::string out;
+  out.reserve(event.type.size() + event.data.size() + 16);
+  if (!event.type.empty()) {
+    out.append("event: ").append(event.type).append("\n");
+  }
+  size_t pos = 0;
+  while (true) {
+    auto end = event.data.find('\n', pos);
+    out.append("data: ").append(event.data.substr(pos, end - pos)).append("\n");
+    if (end == std::string_view::npos) {
+      break;
+    }
+    pos = end + 1;
+  }
+  out.append("\n");
+  return out;
+}
+
+class Parser {
+ public:
+  /**
+   * Calls [on_event] with each event [chunk] completes. The event is only
+   * valid during the call, which returns false to ignore the rest of the
+   * stream.
+   */
+  template <typename OnEvent>
+  void Feed(std::string_view chunk, OnEvent&& on_event) {
+    if (stopped_) {
+      return;
+    }
+    bool buffered = start_ < buffer_.size();
+    if (buffered) {
+      buffer_.append(chunk);
+    }
+    std::string_view text = buffered ? std::string_view(buffer_) : chunk;
+    size_t event_start = buffered ? start_ : 0;
+    size_t line = buffered ? scan_ : 0;
+
+    while (line < text.size()) {
+      auto* nl = static_cast<const char*>(
+          std::memchr(text.data() + line, '\n', text.size() - line));
+      if (nl == nullptr) {
+        break;
+      }
+      size_t end = nl - text.data();
+      bool blank = end == line || (end == line + 1 && text[line] == '\r');
+      line = end + 1;
+      if (blank) {
+        if (!Dispatch(text.substr(event_start, line - event_start),
+                      on_event)) {
+          Stop();
+          return;
+        }
+        event_start = line;
+      }
+    }
+
+    if (!buffered) {
+      buffer_.assign(text.substr(event_start));
+      start_ = 0;
+      scan_ = line - event_start;
+      return;
+    }
+    start_ = event_start;
+    scan_ = line;
+    if (start_ == buffer_.size()) {
+      buffer_.clear();
+      start_ = scan_ = 0;
+    } else if (start_ >= buffer_.size() - start_) {
+      buffer_.erase(0, start_);
+      scan_ -= start_;
+      start_ = 0;
+    }
+  }
+
+  /**
+   * Dispatches what is left of an event the stream ended without
+   * terminating. Strictly such an event should be dropped, but some servers
+   * close the stream right after the last data line.
+   */
+  template <typename OnEvent>
+  void Finish(OnEvent&& on_event) {
+    if (!stopped_ && start_ < buffer_.size()) {
+      std::string pending = buffer_.substr(start_);
+      Dispatch(pending, on_event);
+    }
+    Stop();
+  }
+
+  // Bytes kept for an event which is not complete yet
+  size_t pending() const { return buffer_.size() - start_; }
+
+ private:
+  template <typename OnEvent>
+  bool Dispatch(std::string_view block, OnEvent&& on_event) {
+    Event event;
+    bool has_data = false;
+    bool joined = false;
+    size_t pos = 0;
+    while (pos < block.size()) {
+      auto* nl = static_cast<const char*>(
+          std::memchr(block.data() + pos, '\n', block.size() - pos));
+      size_t end = nl == nullptr ? block.size() : nl - block.data();
+      auto line = block.substr(pos, end - pos);
+      pos = end + 1;
+      if (!line.empty() && line.back() == '\r') {
+        line.remove_suffix(1);
+      }
+      // blank lines and comments
+      if (line.empty() || line.front() == ':') {
+        continue;
+      }
+
+      auto colon = line.find(':');
+      auto field = line.substr(0, colon);
+      std::string_view value;
+      if (colon != std::string_view::npos) {
+        value = line.substr(colon + 1);
+        if (!value.empty() && value.front() == ' ') {
+          value.remove_prefix(1);
+        }
+      }
+
+      if (field == "data") {
+        if (!has_data) {
+          event.data = value;
+          has_data = true;
+        } else {
+          if (!joined) {
+            data_.assign(event.data);
+            joined = true;
+          }
+          data_.append("\n").append(value);
+        }
+      } else if (field == "event") {
+        event.type = value;
+      } else if (field == "id") {
+        event.id = value;
+      }
+    }
+
+    // an event without data is not dispatched
+    if (!has_data) {
+      return true;
+    }
+    if (joined) {
+      event.data = data_;
+    }
+    return on_event(event);
+  }
+
+  void Stop() {
+    stopped_ = true;
+    buffer_.clear();
+    start_ = scan_ = 0;
+  }
+
+  // the pending event starts at [start_], lines before [scan_] are not
+  // blank
+  std::string buffer_;
+  size_t start_ = 0;
+  size_t scan_ = 0;
+  // multi-line data of the event being dispatched
+  std::string data_;
+  bool stopped_ = false;
+};
+}  // namespace sse
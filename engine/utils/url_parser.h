@@ -40,7 +40,7 @@ struct Url {
   std::vector<std::string> pathParams;
   std::unordered_map<std::string,
                      std::variant<std::string, explicit_int, explicit_bool>>
-      queries;
+      queries{};
 
   std::string GetProtocolAndHost() const { return protocol + "://" + host; }
 
@@ -0,0 +1,454 @@
+#include "vector_index.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <queue>
+#include "utils/logging_utils.h"
+#include "utils/vector_math.h"
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr const auto kVectorsFileName = "vectors.bin";
+constexpr const auto kIndexFileName = "index.bin";
+constexpr const uint32_t kFormatVersion = 1;
+constexpr const int kKmeansIterations = 10;
+// Training on a sample keeps k-means cheap on large stores
+constexpr const size_t kKmeansSamplesPerList = 64;
+
+// Padded to a cache line so the vector data after it stays aligned
+struct VectorsHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t dim;
+  uint32_t reserved;
+  uint64_t count;
+  char padding[40];
+};
+static_assert(sizeof(VectorsHeader) == 64);
+
+struct IndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t dim;
+  uint32_t nlist;
+  uint64_t count;
+};
+
+struct WorseMatch {
+  bool operator()(const VectorIndex::Match& a,
+                  const VectorIndex::Match& b) const {
+    return a.score > b.score;
+  }
+};
+}  // namespace
+
+cpp::result<std::unique_ptr<VectorIndex>, std::string> VectorIndex::Open(
+    const std::filesystem::path& dir, Config config) {
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    return cpp::fail("Failed to create " + dir.string() + ": " + ec.message());
+  }
+  std::unique_ptr<VectorIndex> index(new VectorIndex(dir, config));
+  if (auto res = index->Load(); res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  return index;
+}
+
+VectorIndex::~VectorIndex() {
+  Unmap();
+}
+
+cpp::result<void, std::string> VectorIndex::Load() {
+  if (!std::filesystem::exists(dir_ / kVectorsFileName)) {
+    return {};
+  }
+  if (auto res = Map(); res.has_error()) {
+    return res;
+  }
+  if (count_ >= config_.ivf_min_vectors && !LoadIvf()) {
+    BuildIvf();
+    SaveIvf();
+  }
+  return {};
+}
+
+cpp::result<void, std::string> VectorIndex::Map() {
+  auto path = dir_ / kVectorsFileName;
+#if defined(_WIN32)
+  std::ifstream file(path, std::ios::binary);
+  VectorsHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    return cpp::fail("Failed to read " + path.string());
+  }
+  buffer_.resize(header.count * header.dim);
+  file.read(reinterpret_cast<char*>(buffer_.data()),
+            buffer_.size() * sizeof(float));
+  data_ = buffer_.data();
+#else
+  int fd = open(path.string().c_str(), O_RDONLY);
+  if (fd < 0) {
+    return cpp::fail("Failed to open " + path.string());
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(VectorsHeader)) {
+    close(fd);
+    return cpp::fail("Invalid vector file " + path.string());
+  }
+  auto* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  // the mapping stays valid after the descriptor is closed
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return cpp::fail("Failed to map " + path.string());
+  }
+  mapping_ = addr;
+  mapping_size_ = st.st_size;
+  VectorsHeader header;
+  std::memcpy(&header, addr, sizeof(header));
+  data_ = reinterpret_cast<const float*>(static_cast<const char*>(addr) +
+                                         sizeof(VectorsHeader));
+  if (sizeof(VectorsHeader) + header.count * header.dim * sizeof(float) >
+      mapping_size_) {
+    Unmap();
+    return cpp::fail("Truncated vector file " + path.string());
+  }
+#endif
+  if (std::memcmp(header.magic, "CVEC", 4) != 0 ||
+      header.version != kFormatVersion) {
+    Unmap();
+    return cpp::fail("Unsupported vector file " + path.string());
+  }
+  dim_ = header.dim;
+  count_ = header.count;
+  return {};
+}
+
+void VectorIndex::Unmap() {
+#if !defined(_WIN32)
+  if (mapping_ != nullptr) {
+    munmap(mapping_, mapping_size_);
+  }
+#endif
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+  data_ = nullptr;
+  buffer_.clear();
+}
+
+cpp::result<void, std::string> VectorIndex::Add(
+    const std::vector<std::vector<float>>& vectors) {
+  if (vectors.empty()) {
+    return {};
+  }
+  std::unique_lock<std::shared_mutex> l(mtx_);
+  auto dim = dim_ == 0 ? uint32_t(vectors.front().size()) : dim_;
+  for (auto const& v : vectors) {
+    if (v.size() != dim || dim == 0) {
+      return cpp::fail("Expected vectors of dimension " + std::to_string(dim) +
+                       ", got " + std::to_string(v.size()));
+    }
+  }
+
+  auto path = dir_ / kVectorsFileName;
+  VectorsHeader header{};
+  std::memcpy(header.magic, "CVEC", 4);
+  header.version = kFormatVersion;
+  header.dim = dim;
+  header.count = count_;
+  if (!std::filesystem::exists(path)) {
+    std::ofstream create(path, std::ios::binary);
+    create.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+
+  std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+  if (!file) {
+    return cpp::fail("Failed to open " + path.string());
+  }
+  // Vectors are written before the header count is bumped, so an interrupted
+  // append leaves the store as it was
+  file.seekp(sizeof(VectorsHeader) + count_ * dim * sizeof(float));
+  std::vector<float> row;
+  for (auto const& v : vectors) {
+    row = v;
+    vector_math::Normalize(row.data(), row.size());
+    file.write(reinterpret_cast<const char*>(row.data()),
+               row.size() * sizeof(float));
+  }
+  file.flush();
+  header.count = count_ + vectors.size();
+  file.seekp(0);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.close();
+  if (!file) {
+    return cpp::fail("Failed to write " + path.string());
+  }
+
+  // The grown file is mapped before the old mapping is released, searches
+  // keep using the old one if that fails
+  auto old_count = count_;
+  auto* old_data = data_;
+  auto* old_mapping = mapping_;
+  auto old_mapping_size = mapping_size_;
+  auto old_buffer = std::move(buffer_);
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+  data_ = nullptr;
+  buffer_.clear();
+  if (auto res = Map(); res.has_error()) {
+    data_ = old_data;
+    mapping_ = old_mapping;
+    mapping_size_ = old_mapping_size;
+    buffer_ = std::move(old_buffer);
+    return res;
+  }
+#if !defined(_WIN32)
+  if (old_mapping != nullptr) {
+    munmap(old_mapping, old_mapping_size);
+  }
+#endif
+
+  if (count_ >= config_.ivf_min_vectors) {
+    size_t indexed = 0;
+    for (auto const& list : lists_) {
+      indexed += list.size();
+    }
+    // Re-cluster when the store doubled, the old centroids no longer
+    // describe the data well
+    if (lists_.empty() || count_ >= 2 * indexed) {
+      BuildIvf();
+    } else {
+      AssignToIvf(old_count);
+    }
+    SaveIvf();
+  }
+  return {};
+}
+
+std::vector<VectorIndex::Match> VectorIndex::Search(
+    const std::vector<float>& query, size_t top_k,
+    float score_threshold) const {
+  std::shared_lock<std::shared_mutex> l(mtx_);
+  if (count_ == 0 || top_k == 0 || query.size() != dim_) {
+    return {};
+  }
+  auto q = query;
+  vector_math::Normalize(q.data(), q.size());
+
+  // min-heap of the best matches so far
+  std::priority_queue<Match, std::vector<Match>, WorseMatch> best;
+  auto consider = [&](uint32_t row) {
+    auto score = vector_math::DotProduct(q.data(), Row(row), dim_);
+    if (score < score_threshold) {
+      return;
+    }
+    if (best.size() < top_k) {
+      best.push(Match{.row = row, .score = score});
+    } else if (score > best.top().score) {
+      best.pop();
+      best.push(Match{.row = row, .score = score});
+    }
+  };
+
+  if (lists_.empty()) {
+    for (uint32_t row = 0; row < count_; row++) {
+      consider(row);
+    }
+  } else {
+    auto nlist = lists_.size();
+    std::vector<std::pair<float, uint32_t>> centroid_scores(nlist);
+    for (uint32_t c = 0; c < nlist; c++) {
+      centroid_scores[c] = {
+          vector_math::DotProduct(q.data(), &centroids_[size_t(c) * dim_], dim_),
+          c};
+    }
+    auto nprobe = std::min(std::max<size_t>(config_.nprobe, 1), nlist);
+    std::partial_sort(centroid_scores.begin(),
+                      centroid_scores.begin() + nprobe, centroid_scores.end(),
+                      [](auto const& a, auto const& b) {
+                        return a.first > b.first;
+                      });
+    for (size_t i = 0; i < nprobe; i++) {
+      for (auto row : lists_[centroid_scores[i].second]) {
+        consider(row);
+      }
+    }
+  }
+
+  std::vector<Match> res;
+  res.reserve(best.size());
+  while (!best.empty()) {
+    res.push_back(best.top());
+    best.pop();
+  }
+  std::reverse(res.begin(), res.end());
+  return res;
+}
+
+size_t VectorIndex::Size() const {
+  std::shared_lock<std::shared_mutex> l(mtx_);
+  return count_;
+}
+
+uint32_t VectorIndex::Dimensions() const {
+  std::shared_lock<std::shared_mutex> l(mtx_);
+  return dim_;
+}
+
+bool VectorIndex::HasIvf() const {
+  std::shared_lock<std::shared_mutex> l(mtx_);
+  return !lists_.empty();
+}
+
+uint32_t VectorIndex::NearestCentroid(const float* v) const {
+  uint32_t best = 0;
+  float best_score = -2.0f;
+  for (uint32_t c = 0; c < centroids_.size() / dim_; c++) {
+    auto score = vector_math::DotProduct(v, &centroids_[size_t(c) * dim_], dim_);
+    if (score > best_score) {
+      best_score = score;
+      best = c;
+    }
+  }
+  return best;
+}
+
+void VectorIndex::BuildIvf() {
+  auto nlist = std::max<size_t>(
+      1, std::min<size_t>(count_, std::sqrt(static_cast<double>(count_))));
+
+  // Evenly strided training sample, deterministic so rebuilding an unchanged
+  // store gives the same index
+  auto sample_size = std::min<size_t>(count_, nlist * kKmeansSamplesPerList);
+  std::vector<uint32_t> sample(sample_size);
+  for (size_t i = 0; i < sample_size; i++) {
+    sample[i] = uint32_t(i * count_ / sample_size);
+  }
+
+  centroids_.assign(nlist * dim_, 0.0f);
+  for (size_t c = 0; c < nlist; c++) {
+    std::memcpy(&centroids_[c * dim_], Row(sample[c * sample_size / nlist]),
+                dim_ * sizeof(float));
+  }
+
+  // Spherical k-means: centroids are renormalized so assignment is by cosine
+  std::vector<float> sums(nlist * dim_);
+  std::vector<size_t> sizes(nlist);
+  for (int it = 0; it < kKmeansIterations; it++) {
+    std::fill(sums.begin(), sums.end(), 0.0f);
+    std::fill(sizes.begin(), sizes.end(), 0);
+    for (auto row : sample) {
+      auto c = NearestCentroid(Row(row));
+      auto* v = Row(row);
+      for (uint32_t d = 0; d < dim_; d++) {
+        sums[size_t(c) * dim_ + d] += v[d];
+      }
+      sizes[c]++;
+    }
+    for (size_t c = 0; c < nlist; c++) {
+      // an empty cluster keeps its previous centroid
+      if (sizes[c] == 0) {
+        continue;
+      }
+      std::copy_n(&sums[c * dim_], dim_, &centroids_[c * dim_]);
+      vector_math::Normalize(&centroids_[c * dim_], dim_);
+    }
+  }
+
+  lists_.assign(nlist, {});
+  AssignToIvf(0);
+  CTL_INF("Built IVF index with " << nlist << " lists over " << count_
+                                  << " vectors in " << dir_.string());
+}
+
+void VectorIndex::AssignToIvf(uint32_t from_row) {
+  for (uint32_t row = from_row; row < count_; row++) {
+    lists_[NearestCentroid(Row(row))].push_back(row);
+  }
+}
+
+bool VectorIndex::LoadIvf() {
+  std::ifstream file(dir_ / kIndexFileName, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  IndexHeader header;
+  if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+      std::memcmp(header.magic, "CIVF", 4) != 0 ||
+      header.version != kFormatVersion || header.dim != dim_ ||
+      header.count > count_ || header.nlist == 0) {
+    CTL_WRN("Ignoring stale vector index in " << dir_.string());
+    return false;
+  }
+  centroids_.resize(size_t(header.nlist) * dim_);
+  file.read(reinterpret_cast<char*>(centroids_.data()),
+            centroids_.size() * sizeof(float));
+  lists_.assign(header.nlist, {});
+  // a corrupt index must not point Search past the mapped vectors
+  auto valid = true;
+  for (auto& list : lists_) {
+    uint32_t size = 0;
+    file.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!file || size > header.count) {
+      valid = false;
+      break;
+    }
+    list.resize(size);
+    file.read(reinterpret_cast<char*>(list.data()), size * sizeof(uint32_t));
+    valid = std::all_of(list.begin(), list.end(), [&header](uint32_t row) {
+      return row < header.count;
+    });
+    if (!valid) {
+      break;
+    }
+  }
+  if (!file || !valid) {
+    CTL_WRN("Ignoring corrupt vector index in " << dir_.string());
+    lists_.clear();
+    centroids_.clear();
+    return false;
+  }
+  // vectors appended after the index was last written
+  AssignToIvf(uint32_t(header.count));
+  return true;
+}
+
+void VectorIndex::SaveIvf() const {
+  auto path = dir_ / kIndexFileName;
+  auto tmp_path = dir_ / (std::string(kIndexFileName) + ".tmp");
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    IndexHeader header{};
+    std::memcpy(header.magic, "CIVF", 4);
+    header.version = kFormatVersion;
+    header.dim = dim_;
+    header.nlist = uint32_t(lists_.size());
+    header.count = count_;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(centroids_.data()),
+               centroids_.size() * sizeof(float));
+    for (auto const& list : lists_) {
+      uint32_t size = uint32_t(list.size());
+      file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      file.write(reinterpret_cast<const char*>(list.data()),
+                 size * sizeof(uint32_t));
+    }
+    if (!file) {
+      CTL_WRN("Failed to write vector index " << tmp_path.string());
+      return;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    CTL_WRN("Failed to replace vector index: " << ec.message());
+  }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "utils/result.hpp"
+
+/**
+ * On-disk store of unit-length float32 vectors with an IVF (inverted file)
+ * index on top.
+ *
+ * Vectors live in <dir>/vectors.bin, which is memory-mapped for search so a
+ * store doesn't have to fit in the heap. Small stores are scanned linearly;
+ * once a store reaches Config::ivf_min_vectors the vectors are clustered with
+ * k-means and a query only scans the lists of its nprobe closest centroids.
+ * The clustering is persisted to <dir>/index.bin.
+ */
+class VectorIndex {
+ public:
+  struct Config {
+    // Below this size a linear scan is as fast as probing an index
+    size_t ivf_min_vectors = 4096;
+    // Number of inverted lists scanned per query
+    size_t nprobe = 8;
+  };
+
+  struct Match {
+    // Insertion order of the vector, starting at 0
+    uint32_t row;
+    // Cosine similarity against the query
+    float score;
+  };
+
+  /**
+   * Open the store in [dir], creating it if needed. The dimension is taken
+   * from the first vectors added when the store is empty.
+   */
+  static cpp::result<std::unique_ptr<VectorIndex>, std::string> Open(
+      const std::filesystem::path& dir, Config config);
+
+  ~VectorIndex();
+
+  VectorIndex(const VectorIndex&) = delete;
+  VectorIndex& operator=(const VectorIndex&) = delete;
+
+  /**
+   * Append [vectors], normalized to unit length. All vectors must have the
+   * dimension of the store.
+   */
+  cpp::result<void, std::string> Add(
+      const std::vector<std::vector<float>>& vectors);
+
+  /**
+   * Best [top_k] matches for [query] with a score of at least
+   * [score_threshold], best first.
+   */
+  std::vector<Match> Search(const std::vector<float>& query, size_t top_k,
+                            float score_threshold) const;
+
+  size_t Size() const;
+
+  uint32_t Dimensions() const;
+
+  bool HasIvf() const;
+
+ private:
+  VectorIndex(const std::filesystem::path& dir, Config config)
+      : dir_{dir}, config_{config} {}
+
+  cpp::result<void, std::string> Load();
+
+  cpp::result<void, std::string> Map();
+
+  void Unmap();
+
+  const float* Row(uint32_t row) const { return data_ + size_t(row) * dim_; }
+
+  void BuildIvf();
+
+  void AssignToIvf(uint32_t from_row);
+
+  uint32_t NearestCentroid(const float* v) const;
+
+  bool LoadIvf();
+
+  void SaveIvf() const;
+
+  std::filesystem::path dir_;
+  Config config_;
+
+  mutable std::shared_mutex mtx_;
+  uint32_t dim_{0};
+  uint64_t count_{0};
+
+  // Mapping of vectors.bin; on platforms without mmap the file is read
+  const float* data_{nullptr};
+  void* mapping_{nullptr};
+  size_t mapping_size_{0};
+  std::vector<float> buffer_;
+
+  std::vector<float> centroids_;
+  std::vector<std::vector<uint32_t>> lists_;
+};
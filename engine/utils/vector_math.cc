@@ -0,0 +1,118 @@
+#include "vector_math.h"
+#include "utils/cpuid/cpu_info.h"
+#include "utils/cpuid/platform.h"
+
+#if defined(PLATFORM_X86)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// MSVC accepts the intrinsics of any instruction set without flags, GCC and
+// clang need the target of each kernel
+#if defined(PLATFORM_GCC_COMPATIBLE_X86)
+#define VECTOR_MATH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define VECTOR_MATH_TARGET(isa)
+#endif
+
+namespace vector_math {
+namespace {
+#if defined(PLATFORM_X86)
+VECTOR_MATH_TARGET("avx512f")
+float DotProductAvx512(const float* a, const float* b, size_t n) {
+  size_t i = 0;
+  __m512 acc = _mm512_setzero_ps();
+  for (; i + 16 <= n; i += 16) {
+    acc = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc);
+  }
+  // spilled rather than _mm512_reduce_add_ps, which trips -Wuninitialized in
+  // the headers of GCC 12
+  float lanes[16];
+  _mm512_storeu_ps(lanes, acc);
+  float sum = 0.0f;
+  for (float lane : lanes) {
+    sum += lane;
+  }
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+VECTOR_MATH_TARGET("avx2,fma")
+float DotProductAvx2(const float* a, const float* b, size_t n) {
+  size_t i = 0;
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  for (; i + 16 <= n; i += 16) {
+    acc0 =
+        _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8),
+                           _mm256_loadu_ps(b + i + 8), acc1);
+  }
+  for (; i + 8 <= n; i += 8) {
+    acc0 =
+        _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+  }
+  __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 lo = _mm256_castps256_ps128(acc);
+  __m128 hi = _mm256_extractf128_ps(acc, 1);
+  lo = _mm_add_ps(lo, hi);
+  lo = _mm_hadd_ps(lo, lo);
+  lo = _mm_hadd_ps(lo, lo);
+  float sum = _mm_cvtss_f32(lo);
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+// NEON is part of the aarch64 baseline, no runtime check needed
+float DotProductNeon(const float* a, const float* b, size_t n) {
+  size_t i = 0;
+  float32x4_t acc0 = vdupq_n_f32(0.0f);
+  float32x4_t acc1 = vdupq_n_f32(0.0f);
+  for (; i + 8 <= n; i += 8) {
+    acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+#endif
+
+const Kernel& GetKernel() {
+  static const Kernel kernel = SupportedKernels().front();
+  return kernel;
+}
+}  // namespace
+
+std::vector<Kernel> SupportedKernels() {
+  std::vector<Kernel> kernels;
+#if defined(PLATFORM_X86)
+  cortex::cpuid::CpuInfo cpu;
+  if (cpu.has_avx512_f()) {
+    kernels.push_back({DotProductAvx512, "avx512"});
+  }
+  if (cpu.has_avx2() && cpu.has_fma()) {
+    kernels.push_back({DotProductAvx2, "avx2"});
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  kernels.push_back({DotProductNeon, "neon"});
+#endif
+  kernels.push_back({DotProductScalar, "scalar"});
+  return kernels;
+}
+
+float DotProduct(const float* a, const float* b, size_t n) {
+  return GetKernel().fn(a, b, n);
+}
+
+std::string_view DotProductKernel() {
+  return GetKernel().name;
+}
+}  // namespace vector_math
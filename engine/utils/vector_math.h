@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Similarity kernels for the vector store. The builds target a baseline CPU,
+// so the SIMD kernels are compiled for their instruction set on their own and
+// the widest one the CPU supports is picked at runtime; everything else falls
+// back to the scalar loop.
+namespace vector_math {
+
+inline float DotProductScalar(const float* a, const float* b, size_t n) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+float DotProduct(const float* a, const float* b, size_t n);
+
+// Name of the kernel DotProduct dispatches to: avx512, avx2, neon or scalar
+std::string_view DotProductKernel();
+
+struct Kernel {
+  float (*fn)(const float*, const float*, size_t);
+  std::string_view name;
+};
+
+// Every compiled kernel the CPU can run, widest first, the scalar loop last.
+// DotProduct dispatches to the first one.
+std::vector<Kernel> SupportedKernels();
+
+inline float L2Norm(const float* a, size_t n) {
+  return std::sqrt(DotProduct(a, a, n));
+}
+
+/**
+ * Scale [a] to unit length in place, so cosine similarity against other
+ * normalized vectors is a plain dot product. Zero vectors are left as is.
+ */
+inline void Normalize(float* a, size_t n) {
+  auto norm = L2Norm(a, n);
+  if (norm == 0.0f) {
+    return;
+  }
+  auto inv = 1.0f / norm;
+  for (size_t i = 0; i < n; i++) {
+    a[i] *= inv;
+  }
+}
+
+inline float CosineSimilarity(const float* a, const float* b, size_t n) {
+  auto denom = L2Norm(a, n) * L2Norm(b, n);
+  return denom == 0.0f ? 0.0f : DotProduct(a, b, n) / denom;
+}
+}  // namespace vector_math
@@ -0,0 +1,1000 @@
+#include "vocab_tokenizer.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <queue>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr const uint32_t kGgufMagic = 0x46554747;  // "GGUF"
+constexpr const uint32_t kStringType = 8;
+constexpr const uint32_t kArrayType = 9;
+// U+2581, stands for a space in SentencePiece vocabularies
+constexpr const std::string_view kSpaceMarker = "\xE2\x96\x81";
+
+// Read-only mapping of a whole file
+class MappedFile {
+ public:
+  static cpp::result<std::shared_ptr<MappedFile>, std::string> Open(
+      const std::filesystem::path& path) {
+    auto file = std::shared_ptr<MappedFile>(new MappedFile());
+#if defined(_WIN32)
+    auto handle = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                              nullptr);
+    if (handle == INVALID_HANDLE_VALUE) {
+      return cpp::fail("Failed to open " + path.string());
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+      CloseHandle(handle);
+      return cpp::fail("Failed to read the size of " + path.string());
+    }
+    auto mapping =
+        CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    // the view stays valid after both handles are closed
+    CloseHandle(handle);
+    if (mapping == nullptr) {
+      return cpp::fail("Failed to map " + path.string());
+    }
+    auto* addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (addr == nullptr) {
+      return cpp::fail("Failed to map " + path.string());
+    }
+    file->size_ = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd < 0) {
+      return cpp::fail("Failed to open " + path.string());
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return cpp::fail("Invalid file " + path.string());
+    }
+    auto* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+    if (addr == MAP_FAILED) {
+      return cpp::fail("Failed to map " + path.string());
+    }
+    file->size_ = st.st_size;
+#endif
+    file->data_ = static_cast<const char*>(addr);
+    return file;
+  }
+
+  ~MappedFile() {
+    if (data_ == nullptr) {
+      return;
+    }
+#if defined(_WIN32)
+    UnmapViewOfFile(data_);
+#else
+    munmap(const_cast<char*>(data_), size_);
+#endif
+  }
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile() = default;
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// Bounds-checked cursor over the metadata of a GGUF file
+class GgufCursor {
+ public:
+  GgufCursor(const char* data, size_t size) : p_{data}, end_{data + size} {}
+
+  template <typename T>
+  bool Read(T& value) {
+    if (static_cast<size_t>(end_ - p_) < sizeof(T)) {
+      return false;
+    }
+    std::memcpy(&value, p_, sizeof(T));
+    p_ += sizeof(T);
+    return true;
+  }
+
+  bool ReadString(std::string_view& value) {
+    uint64_t length;
+    if (!Read(length) || static_cast<uint64_t>(end_ - p_) < length) {
+      return false;
+    }
+    value = std::string_view(p_, length);
+    p_ += length;
+    return true;
+  }
+
+  bool ReadStrings(uint32_t type, std::vector<std::string_view>& values) {
+    uint32_t element_type;
+    uint64_t count;
+    if (type != kArrayType || !Read(element_type) ||
+        element_type != kStringType || !Read(count)) {
+      return false;
+    }
+    // each string takes at least its length
+    if (count > static_cast<uint64_t>(end_ - p_) / sizeof(uint64_t)) {
+      return false;
+    }
+    values.resize(count);
+    for (auto& value : values) {
+      if (!ReadString(value)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  template <typename T>
+  bool ReadNumbers(uint32_t type, std::vector<T>& values) {
+    uint32_t element_type;
+    uint64_t count;
+    if (type != kArrayType || !Read(element_type) ||
+        FixedSize(element_type) != sizeof(T) || !Read(count) ||
+        count > static_cast<uint64_t>(end_ - p_) / sizeof(T)) {
+      return false;
+    }
+    values.resize(count);
+    std::memcpy(values.data(), p_, count * sizeof(T));
+    p_ += count * sizeof(T);
+    return true;
+  }
+
+  bool ReadInt(uint32_t type, int64_t& value) {
+    switch (type) {
+      case 4: {
+        uint32_t v;
+        return Read(v) && (value = v, true);
+      }
+      case 5: {
+        int32_t v;
+        return Read(v) && (value = v, true);
+      }
+      case 10: {
+        uint64_t v;
+        return Read(v) && (value = static_cast<int64_t>(v), true);
+      }
+      case 11:
+        return Read(value);
+      default:
+        return SkipValue(type) && (value = -1, true);
+    }
+  }
+
+  bool ReadBool(uint32_t type, std::optional<bool>& value) {
+    uint8_t v;
+    if (type != 7 || !Read(v)) {
+      return SkipValue(type);
+    }
+    value = v != 0;
+    return true;
+  }
+
+  bool SkipValue(uint32_t type) {
+    if (type == kStringType) {
+      std::string_view ignored;
+      return ReadString(ignored);
+    }
+    if (type == kArrayType) {
+      uint32_t element_type;
+      uint64_t count;
+      if (!Read(element_type) || !Read(count)) {
+        return false;
+      }
+      if (auto size = FixedSize(element_type); size > 0) {
+        return Skip(count, size);
+      }
+      for (uint64_t i = 0; i < count; i++) {
+        if (!SkipValue(element_type)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    auto size = FixedSize(type);
+    return size > 0 && Skip(1, size);
+  }
+
+ private:
+  static size_t FixedSize(uint32_t type) {
+    switch (type) {
+      case 0:
+      case 1:
+      case 7:
+        return 1;
+      case 2:
+      case 3:
+        return 2;
+      case 4:
+      case 5:
+      case 6:
+        return 4;
+      case 10:
+      case 11:
+      case 12:
+        return 8;
+      default:
+        return 0;
+    }
+  }
+
+  bool Skip(uint64_t count, size_t size) {
+    if (count > static_cast<uint64_t>(end_ - p_) / size) {
+      return false;
+    }
+    p_ += count * size;
+    return true;
+  }
+
+  const char* p_;
+  const char* end_;
+};
+
+// The GPT-2 byte-level alphabet: printable bytes stand for themselves, the
+// others are shifted past 255
+std::array<uint32_t, 256> MakeByteCodePoints() {
+  std::array<uint32_t, 256> code_points{};
+  uint32_t next = 256;
+  for (uint32_t b = 0; b < 256; b++) {
+    bool printable = (b >= 33 && b <= 126) || (b >= 161 && b <= 172) ||
+                     (b >= 174 && b <= 255);
+    code_points[b] = printable ? b : next++;
+  }
+  return code_points;
+}
+
+const std::array<uint32_t, 256> kByteCodePoints = MakeByteCodePoints();
+
+void AppendUtf8(uint32_t cp, std::string& out) {
+  if (cp < 0x80) {
+    out.push_back(static_cast<char>(cp));
+  } else if (cp < 0x800) {
+    out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  } else {
+    out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+    out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+  }
+}
+
+// Code point at [pos], its length in [len]. Invalid bytes stand for
+// themselves.
+uint32_t DecodeUtf8(std::string_view s, size_t pos, size_t& len) {
+  auto c = static_cast<unsigned char>(s[pos]);
+  if (c < 0x80) {
+    len = 1;
+    return c;
+  }
+  size_t n = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 0;
+  if (n == 0 || pos + n > s.size()) {
+    len = 1;
+    return c;
+  }
+  uint32_t cp = c & (0x3F >> (n - 1));
+  for (size_t i = 1; i < n; i++) {
+    auto cc = static_cast<unsigned char>(s[pos + i]);
+    if ((cc & 0xC0) != 0x80) {
+      len = 1;
+      return c;
+    }
+    cp = (cp << 6) | (cc & 0x3F);
+  }
+  len = n;
+  return cp;
+}
+
+enum CharClass : uint8_t { kEnd, kOther, kLetter, kDigit, kSpace };
+
+std::array<uint8_t, 128> MakeAsciiClasses() {
+  std::array<uint8_t, 128> classes{};
+  for (int c = 0; c < 128; c++) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+      classes[c] = kLetter;
+    } else if (c >= '0' && c <= '9') {
+      classes[c] = kDigit;
+    } else if (c == ' ' || (c >= '\t' && c <= '\r')) {
+      classes[c] = kSpace;
+    } else {
+      classes[c] = kOther;
+    }
+  }
+  return classes;
+}
+
+const std::array<uint8_t, 128> kAsciiClasses = MakeAsciiClasses();
+
+CharClass Classify(uint32_t cp) {
+  if (cp < 0x80) {
+    return static_cast<CharClass>(kAsciiClasses[cp]);
+  }
+  if (cp == 0x85 || cp == 0xA0 || cp == 0x1680 ||
+      (cp >= 0x2000 && cp <= 0x200A) || cp == 0x2028 || cp == 0x2029 ||
+      cp == 0x202F || cp == 0x205F || cp == 0x3000) {
+    return kSpace;
+  }
+  if (cp == 0xB2 || cp == 0xB3 || cp == 0xB9 || (cp >= 0xBC && cp <= 0xBE) ||
+      (cp >= 0x660 && cp <= 0x669) || (cp >= 0x966 && cp <= 0x96F) ||
+      (cp >= 0xFF10 && cp <= 0xFF19)) {
+    return kDigit;
+  }
+  // punctuation and symbols of the common blocks, emoji
+  if ((cp >= 0xA1 && cp <= 0xBF && cp != 0xAA && cp != 0xB5 && cp != 0xBA) ||
+      cp == 0xD7 || cp == 0xF7 || (cp >= 0x300 && cp <= 0x36F) ||
+      (cp >= 0x2010 && cp <= 0x2027) || (cp >= 0x2030 && cp <= 0x205E) ||
+      (cp >= 0x20A0 && cp <= 0x20CF) || (cp >= 0x2190 && cp <= 0x2BFF) ||
+      (cp >= 0x3001 && cp <= 0x303F) || (cp >= 0xFE00 && cp <= 0xFE0F) ||
+      (cp >= 0xFF01 && cp <= 0xFF0F) || (cp >= 0xFF1A && cp <= 0xFF20) ||
+      (cp >= 0x1F000 && cp <= 0x1FAFF)) {
+    return kOther;
+  }
+  return kLetter;
+}
+
+// Class of the code point at [pos], kEnd past the end
+CharClass ClassAt(std::string_view s, size_t pos, size_t& len) {
+  if (pos >= s.size()) {
+    len = 0;
+    return kEnd;
+  }
+  auto c = static_cast<unsigned char>(s[pos]);
+  if (c < 0x80) {
+    len = 1;
+    return static_cast<CharClass>(kAsciiClasses[c]);
+  }
+  return Classify(DecodeUtf8(s, pos, len));
+}
+
+// End of the run of [cls] code points starting at [pos]
+size_t SkipRun(std::string_view s, size_t pos, CharClass cls) {
+  size_t len;
+  while (ClassAt(s, pos, len) == cls) {
+    pos += len;
+  }
+  return pos;
+}
+
+bool IsNewline(char c) {
+  return c == '\r' || c == '\n';
+}
+
+// Length of the 's, 't, 're, 've, 'm, 'll, 'd contraction after a quote
+size_t MatchContraction(std::string_view rest, bool ignore_case) {
+  auto lower = [ignore_case](char c) {
+    return ignore_case && c >= 'A' && c <= 'Z' ? static_cast<char>(c + 32)
+                                               : c;
+  };
+  if (rest.size() >= 2) {
+    char a = lower(rest[0]);
+    char b = lower(rest[1]);
+    if ((a == 'r' && b == 'e') || (a == 'v' && b == 'e') ||
+        (a == 'l' && b == 'l')) {
+      return 2;
+    }
+  }
+  if (!rest.empty()) {
+    char a = lower(rest[0]);
+    if (a == 's' || a == 't' || a == 'm' || a == 'd') {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Splits [s] as the GPT-2 pattern
+ *   's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+ * or, with [llama3], as
+ *   (?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}|
+ *   ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+
+ * would, without backtracking.
+ */
+template <typename Emit>
+void PreTokenize(std::string_view s, bool llama3, Emit&& emit) {
+  size_t pos = 0;
+  size_t len;
+  size_t next_len;
+  while (pos < s.size()) {
+    auto cls = ClassAt(s, pos, len);
+    char c = s[pos];
+
+    if (c == '\'') {
+      if (auto n = MatchContraction(s.substr(pos + 1), llama3); n > 0) {
+        emit(s.substr(pos, n + 1));
+        pos += n + 1;
+        continue;
+      }
+    }
+
+    // letters, after an optional space or, for llama3, any other non-letter
+    size_t start = pos;
+    if (llama3 ? cls != kLetter && cls != kDigit && !IsNewline(c)
+               : c == ' ') {
+      if (ClassAt(s, pos + len, next_len) == kLetter) {
+        start = pos + len;
+      }
+    }
+    if (ClassAt(s, start, next_len) == kLetter) {
+      auto end = SkipRun(s, start, kLetter);
+      emit(s.substr(pos, end - pos));
+      pos = end;
+      continue;
+    }
+
+    // numbers, by three for llama3
+    start = !llama3 && c == ' ' ? pos + 1 : pos;
+    if (ClassAt(s, start, next_len) == kDigit) {
+      auto end = start;
+      for (int i = 0; (!llama3 || i < 3) &&
+                      ClassAt(s, end, next_len) == kDigit;
+           i++) {
+        end += next_len;
+      }
+      emit(s.substr(pos, end - pos));
+      pos = end;
+      continue;
+    }
+
+    // punctuation and symbols, llama3 keeps the newlines which follow
+    start = c == ' ' ? pos + 1 : pos;
+    if (ClassAt(s, start, next_len) == kOther) {
+      auto end = SkipRun(s, start, kOther);
+      while (llama3 && end < s.size() && IsNewline(s[end])) {
+        end++;
+      }
+      emit(s.substr(pos, end - pos));
+      pos = end;
+      continue;
+    }
+
+    // whitespace
+    auto end = pos;
+    auto last = pos;
+    size_t after_newline = 0;
+    while (ClassAt(s, end, next_len) == kSpace) {
+      last = end;
+      end += next_len;
+      if (IsNewline(s[last])) {
+        after_newline = end;
+      }
+    }
+    if (end == pos) {
+      // not reachable with the classes above, but always move on
+      end = pos + len;
+    } else if (llama3 && after_newline > 0) {
+      // \s*[\r\n]+ stops at the last newline
+      end = after_newline;
+    } else if (end < s.size() && last > pos) {
+      // \s+(?!\S) leaves the last space to the next word
+      end = last;
+    }
+    emit(s.substr(pos, end - pos));
+    pos = end;
+  }
+}
+
+bool IsLlama3Split(const std::string& pre) {
+  return pre == "llama3" || pre == "llama-v3" || pre == "llama-bpe" ||
+         pre == "falcon3" || pre == "smaug-bpe";
+}
+
+// Byte of a "<0xAB>" byte token
+std::optional<uint8_t> ParseByteToken(std::string_view piece) {
+  if (piece.size() != 6 || piece.substr(0, 3) != "<0x" || piece[5] != '>') {
+    return std::nullopt;
+  }
+  int value = 0;
+  for (auto c : piece.substr(3, 2)) {
+    value <<= 4;
+    if (c >= '0' && c <= '9') {
+      value |= c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+      value |= c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+      value |= c - 'a' + 10;
+    } else {
+      return std::nullopt;
+    }
+  }
+  return static_cast<uint8_t>(value);
+}
+
+uint64_t PairKey(int32_t left, int32_t right) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(left)) << 32) |
+         static_cast<uint32_t>(right);
+}
+}  // namespace
+
+cpp::result<std::shared_ptr<VocabTokenizer>, std::string>
+VocabTokenizer::Load(const std::filesystem::path& path) {
+  auto file = MappedFile::Open(path);
+  if (file.has_error()) {
+    return cpp::fail(file.error());
+  }
+  auto invalid = [&path] {
+    return cpp::fail("Invalid GGUF metadata in " + path.string());
+  };
+
+  GgufCursor cursor(file.value()->data(), file.value()->size());
+  uint32_t magic;
+  uint32_t version;
+  uint64_t tensor_count;
+  uint64_t kv_count;
+  if (!cursor.Read(magic) || magic != kGgufMagic) {
+    return cpp::fail("Not a GGUF file: " + path.string());
+  }
+  if (!cursor.Read(version) || version < 2 || !cursor.Read(tensor_count) ||
+      !cursor.Read(kv_count)) {
+    return cpp::fail("Unsupported GGUF version in " + path.string());
+  }
+
+  Vocab vocab;
+  std::string_view model;
+  std::string_view pre;
+  std::optional<bool> add_bos;
+  std::optional<bool> add_eos;
+  std::optional<bool> add_space_prefix;
+  for (uint64_t i = 0; i < kv_count; i++) {
+    std::string_view key;
+    uint32_t type;
+    if (!cursor.ReadString(key) || !cursor.Read(type)) {
+      return invalid();
+    }
+    bool ok = true;
+    int64_t id;
+    if (key == "tokenizer.ggml.model" && type == kStringType) {
+      ok = cursor.ReadString(model);
+    } else if (key == "tokenizer.ggml.pre" && type == kStringType) {
+      ok = cursor.ReadString(pre);
+    } else if (key == "tokenizer.ggml.tokens") {
+      ok = cursor.ReadStrings(type, vocab.tokens);
+    } else if (key == "tokenizer.ggml.merges") {
+      ok = cursor.ReadStrings(type, vocab.merges);
+    } else if (key == "tokenizer.ggml.token_type") {
+      ok = cursor.ReadNumbers(type, vocab.token_types);
+    } else if (key == "tokenizer.ggml.scores") {
+      ok = cursor.ReadNumbers(type, vocab.scores);
+    } else if (key == "tokenizer.ggml.bos_token_id") {
+      ok = cursor.ReadInt(type, id) && (vocab.bos_id = id, true);
+    } else if (key == "tokenizer.ggml.eos_token_id") {
+      ok = cursor.ReadInt(type, id) && (vocab.eos_id = id, true);
+    } else if (key == "tokenizer.ggml.unknown_token_id") {
+      ok = cursor.ReadInt(type, id) && (vocab.unk_id = id, true);
+    } else if (key == "tokenizer.ggml.add_bos_token") {
+      ok = cursor.ReadBool(type, add_bos);
+    } else if (key == "tokenizer.ggml.add_eos_token") {
+      ok = cursor.ReadBool(type, add_eos);
+    } else if (key == "tokenizer.ggml.add_space_prefix") {
+      ok = cursor.ReadBool(type, add_space_prefix);
+    } else {
+      ok = cursor.SkipValue(type);
+    }
+    if (!ok) {
+      return invalid();
+    }
+  }
+
+  // the defaults of llama.cpp when the file doesn't say
+  vocab.pre = std::string(pre);
+  if (model == "gpt2") {
+    vocab.model = Model::kBpe;
+    vocab.add_bos = add_bos.value_or(IsLlama3Split(vocab.pre));
+    vocab.add_space_prefix = add_space_prefix.value_or(false);
+  } else if (model == "llama") {
+    vocab.model = Model::kSpm;
+    vocab.add_bos = add_bos.value_or(true);
+    vocab.add_space_prefix = add_space_prefix.value_or(true);
+  } else {
+    return cpp::fail("Unsupported tokenizer model '" + std::string(model) +
+                     "' in " + path.string());
+  }
+  vocab.add_eos = add_eos.value_or(false);
+  return Create(std::move(vocab), std::move(file.value()));
+}
+
+cpp::result<std::shared_ptr<VocabTokenizer>, std::string>
+VocabTokenizer::Create(Vocab vocab, std::shared_ptr<const void> storage) {
+  auto tokenizer = std::shared_ptr<VocabTokenizer>(
+      new VocabTokenizer(std::move(vocab), std::move(storage)));
+  if (auto res = tokenizer->Build(); res.has_error()) {
+    return cpp::fail(res.error());
+  }
+  return tokenizer;
+}
+
+cpp::result<void, std::string> VocabTokenizer::Build() {
+  auto size = static_cast<int64_t>(vocab_.tokens.size());
+  if (size == 0) {
+    return cpp::fail("The vocabulary is empty");
+  }
+  if ((!vocab_.token_types.empty() &&
+       vocab_.token_types.size() != vocab_.tokens.size()) ||
+      (!vocab_.scores.empty() &&
+       vocab_.scores.size() != vocab_.tokens.size())) {
+    return cpp::fail("The token types or scores don't match the vocabulary");
+  }
+  for (auto* id : {&vocab_.bos_id, &vocab_.eos_id, &vocab_.unk_id}) {
+    if (*id >= size) {
+      *id = -1;
+    }
+  }
+
+  ids_.reserve(vocab_.tokens.size());
+  for (int32_t id = 0; id < size; id++) {
+    ids_.emplace(vocab_.tokens[id], id);
+    auto type = TypeOf(id);
+    auto const& piece = vocab_.tokens[id];
+    if ((type == kControl || type == kUserDefined) && !piece.empty()) {
+      specials_[static_cast<unsigned char>(piece[0])].push_back(id);
+    }
+  }
+  for (auto& candidates : specials_) {
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [this](int32_t a, int32_t b) {
+                       return vocab_.tokens[a].size() > vocab_.tokens[b].size();
+                     });
+  }
+
+  std::string scratch;
+  if (vocab_.model == Model::kSpm) {
+    char name[8];
+    for (int b = 0; b < 256; b++) {
+      std::snprintf(name, sizeof(name), "<0x%02X>", b);
+      byte_tokens_[b] = Find(name);
+    }
+    return {};
+  }
+
+  split_ = IsLlama3Split(vocab_.pre) ? Split::kLlama3 : Split::kGpt2;
+  ignore_merges_ = split_ == Split::kLlama3;
+  code_point_bytes_.assign(512, -1);
+  for (int b = 0; b < 256; b++) {
+    scratch.clear();
+    AppendUtf8(kByteCodePoints[b], scratch);
+    byte_tokens_[b] = Find(scratch);
+    code_point_bytes_[kByteCodePoints[b]] = static_cast<int16_t>(b);
+  }
+
+  merges_.reserve(vocab_.merges.size());
+  for (uint32_t rank = 0; rank < vocab_.merges.size(); rank++) {
+    auto const& merge = vocab_.merges[rank];
+    auto space = merge.find(' ', 1);
+    if (space == std::string_view::npos) {
+      continue;
+    }
+    auto left = Find(merge.substr(0, space));
+    auto right = Find(merge.substr(space + 1));
+    scratch.assign(merge.substr(0, space)).append(merge.substr(space + 1));
+    auto result = Find(scratch);
+    if (left >= 0 && right >= 0 && result >= 0) {
+      merges_.emplace(PairKey(left, right), Merge{rank, result});
+    }
+  }
+  return {};
+}
+
+std::vector<int32_t> VocabTokenizer::Encode(std::string_view text,
+                                            bool add_special,
+                                            bool parse_special) const {
+  std::vector<int32_t> out;
+  out.reserve(text.size() / 3 + 2);
+  if (add_special && vocab_.add_bos && vocab_.bos_id >= 0) {
+    out.push_back(vocab_.bos_id);
+  }
+
+  // special tokens split the text in fragments encoded on their own, user
+  // defined ones are always recognized
+  bool first = true;
+  size_t start = 0;
+  size_t pos = 0;
+  while (pos < text.size()) {
+    int32_t match = -1;
+    for (auto id : specials_[static_cast<unsigned char>(text[pos])]) {
+      auto const& piece = vocab_.tokens[id];
+      if ((parse_special || TypeOf(id) == kUserDefined) &&
+          text.substr(pos, piece.size()) == piece) {
+        match = id;
+        break;
+      }
+    }
+    if (match < 0) {
+      pos++;
+      continue;
+    }
+    if (pos > start) {
+      EncodeFragment(text.substr(start, pos - start), first, out);
+    }
+    out.push_back(match);
+    pos += vocab_.tokens[match].size();
+    start = pos;
+    first = true;
+  }
+  if (start < text.size()) {
+    EncodeFragment(text.substr(start), first, out);
+  }
+
+  if (add_special && vocab_.add_eos && vocab_.eos_id >= 0) {
+    out.push_back(vocab_.eos_id);
+  }
+  return out;
+}
+
+void VocabTokenizer::EncodeFragment(std::string_view text, bool first,
+                                    std::vector<int32_t>& out) const {
+  if (vocab_.model == Model::kBpe) {
+    PreTokenize(text, split_ == Split::kLlama3,
+                [this, &out](std::string_view word) {
+                  EncodeBpeWord(word, out);
+                });
+    return;
+  }
+
+  std::string escaped;
+  escaped.reserve(text.size() + text.size() / 4 + kSpaceMarker.size());
+  if (vocab_.add_space_prefix && first) {
+    escaped.append(kSpaceMarker);
+  }
+  for (auto c : text) {
+    if (c == ' ') {
+      escaped.append(kSpaceMarker);
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  EncodeSpm(escaped, out);
+}
+
+void VocabTokenizer::EncodeBpeWord(std::string_view word,
+                                   std::vector<int32_t>& out) const {
+  if (ignore_merges_) {
+    std::string mapped;
+    for (auto c : word) {
+      AppendUtf8(kByteCodePoints[static_cast<unsigned char>(c)], mapped);
+    }
+    if (auto id = Find(mapped); id >= 0) {
+      out.push_back(id);
+      return;
+    }
+  }
+
+  std::vector<int32_t> ids;
+  ids.reserve(word.size());
+  for (auto c : word) {
+    auto id = byte_tokens_[static_cast<unsigned char>(c)];
+    if (id < 0) {
+      id = vocab_.unk_id;
+    }
+    if (id >= 0) {
+      ids.push_back(id);
+    }
+  }
+  if (ids.size() < 2) {
+    out.insert(out.end(), ids.begin(), ids.end());
+    return;
+  }
+
+  // symbols are merged lowest rank first, leftmost first on ties
+  auto n = static_cast<int>(ids.size());
+  std::vector<int> next(n);
+  std::vector<int> prev(n);
+  for (int i = 0; i < n; i++) {
+    next[i] = i + 1 < n ? i + 1 : -1;
+    prev[i] = i - 1;
+  }
+  struct Candidate {
+    uint32_t rank;
+    int left;
+    int32_t left_id;
+    int32_t right_id;
+    int32_t result;
+  };
+  auto later = [](const Candidate& a, const Candidate& b) {
+    return a.rank > b.rank || (a.rank == b.rank && a.left > b.left);
+  };
+  std::priority_queue<Candidate, std::vector<Candidate>, decltype(later)>
+      candidates(later);
+  auto add = [&](int left) {
+    if (left < 0 || next[left] < 0) {
+      return;
+    }
+    auto right = next[left];
+    if (auto it = merges_.find(PairKey(ids[left], ids[right]));
+        it != merges_.end()) {
+      candidates.push(Candidate{it->second.rank, left, ids[left], ids[right],
+                                it->second.result});
+    }
+  };
+  for (int i = 0; i + 1 < n; i++) {
+    add(i);
+  }
+
+  while (!candidates.empty()) {
+    auto candidate = candidates.top();
+    candidates.pop();
+    auto right = next[candidate.left];
+    if (ids[candidate.left] != candidate.left_id || right < 0 ||
+        ids[right] != candidate.right_id) {
+      continue;
+    }
+    ids[candidate.left] = candidate.result;
+    ids[right] = -1;
+    next[candidate.left] = next[right];
+    if (next[right] >= 0) {
+      prev[next[right]] = candidate.left;
+    }
+    add(prev[candidate.left]);
+    add(candidate.left);
+  }
+
+  for (int i = 0; i >= 0; i = next[i]) {
+    out.push_back(ids[i]);
+  }
+}
+
+void VocabTokenizer::EncodeSpm(std::string_view text,
+                               std::vector<int32_t>& out) const {
+  struct Symbol {
+    size_t start;
+    size_t size;
+    int prev;
+    int next;
+  };
+  std::vector<Symbol> symbols;
+  symbols.reserve(text.size());
+  for (size_t pos = 0; pos < text.size();) {
+    size_t len;
+    DecodeUtf8(text, pos, len);
+    auto index = static_cast<int>(symbols.size());
+    symbols.push_back(Symbol{pos, len, index - 1, -1});
+    if (index > 0) {
+      symbols[index - 1].next = index;
+    }
+    pos += len;
+  }
+
+  // the pair making the best scored token is merged first
+  struct Candidate {
+    float score;
+    int left;
+    size_t size;
+  };
+  auto worse = [](const Candidate& a, const Candidate& b) {
+    return a.score < b.score || (a.score == b.score && a.left > b.left);
+  };
+  std::priority_queue<Candidate, std::vector<Candidate>, decltype(worse)>
+      candidates(worse);
+  auto add = [&](int left) {
+    if (left < 0 || symbols[left].next < 0) {
+      return;
+    }
+    auto const& right = symbols[symbols[left].next];
+    auto size = symbols[left].size + right.size;
+    auto id = Find(text.substr(symbols[left].start, size));
+    if (id >= 0) {
+      candidates.push(Candidate{
+          vocab_.scores.empty() ? 0.0f : vocab_.scores[id], left, size});
+    }
+  };
+  for (int i = 0; i + 1 < static_cast<int>(symbols.size()); i++) {
+    add(i);
+  }
+
+  while (!candidates.empty()) {
+    auto candidate = candidates.top();
+    candidates.pop();
+    auto& left = symbols[candidate.left];
+    if (left.size == 0 || left.next < 0 ||
+        left.size + symbols[left.next].size != candidate.size) {
+      continue;
+    }
+    auto& right = symbols[left.next];
+    left.size = candidate.size;
+    right.size = 0;
+    left.next = right.next;
+    if (right.next >= 0) {
+      symbols[right.next].prev = candidate.left;
+    }
+    add(left.prev);
+    add(candidate.left);
+  }
+
+  for (int i = symbols.empty() ? -1 : 0; i >= 0; i = symbols[i].next) {
+    auto piece = text.substr(symbols[i].start, symbols[i].size);
+    if (auto id = Find(piece); id >= 0) {
+      out.push_back(id);
+      continue;
+    }
+    for (auto c : piece) {
+      auto id = byte_tokens_[static_cast<unsigned char>(c)];
+      if (id < 0) {
+        id = vocab_.unk_id;
+      }
+      if (id >= 0) {
+        out.push_back(id);
+      }
+    }
+  }
+}
+
+cpp::result<std::string, std::string> VocabTokenizer::Decode(
+    const std::vector<int32_t>& ids, bool skip_special) const {
+  std::string out;
+  bool at_start = true;
+  for (auto id : ids) {
+    if (id < 0 || static_cast<size_t>(id) >= vocab_.tokens.size()) {
+      return cpp::fail("Invalid token id " + std::to_string(id));
+    }
+    auto type = TypeOf(id);
+    auto piece = vocab_.tokens[id];
+    if (type == kControl) {
+      if (!skip_special) {
+        out.append(piece);
+      }
+      continue;
+    }
+    if (type == kUserDefined || type == kUnknown) {
+      out.append(piece);
+      at_start = false;
+      continue;
+    }
+
+    if (vocab_.model == Model::kSpm) {
+      if (type == kByte) {
+        if (auto byte = ParseByteToken(piece); byte) {
+          out.push_back(static_cast<char>(*byte));
+          at_start = false;
+          continue;
+        }
+      }
+      // the space added in front of the text is not part of it
+      if (at_start && vocab_.add_space_prefix &&
+          piece.substr(0, kSpaceMarker.size()) == kSpaceMarker) {
+        piece.remove_prefix(kSpaceMarker.size());
+      }
+      size_t pos = 0;
+      while (true) {
+        auto marker = piece.find(kSpaceMarker, pos);
+        out.append(piece.substr(pos, marker - pos));
+        if (marker == std::string_view::npos) {
+          break;
+        }
+        out.push_back(' ');
+        pos = marker + kSpaceMarker.size();
+      }
+    } else {
+      for (size_t pos = 0; pos < piece.size();) {
+        size_t len;
+        auto cp = DecodeUtf8(piece, pos, len);
+        if (cp < code_point_bytes_.size() && code_point_bytes_[cp] >= 0) {
+          out.push_back(static_cast<char>(code_point_bytes_[cp]));
+        } else {
+          out.append(piece.substr(pos, len));
+        }
+        pos += len;
+      }
+    }
+    at_start = false;
+  }
+  return out;
+}
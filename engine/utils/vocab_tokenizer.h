@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "utils/result.hpp"
+
+/**
+ * Tokenizer rebuilt from the vocabulary of a GGUF file, so that text can be
+ * counted and split the way llama.cpp does without a round-trip to the
+ * engine.
+ *
+ * The file is memory-mapped and the token texts and merges are used in
+ * place; only lookup tables are built: token text to id and, for BPE
+ * vocabularies, the rank and result of each merge keyed by the ids of the
+ * merged pair. Byte-level BPE (tokenizer.ggml.model "gpt2") and
+ * SentencePiece (model "llama") vocabularies are supported.
+ *
+ * BPE text is pre-tokenized by a hand-written scanner following the GPT-2
+ * or the llama3 split pattern, ASCII being classified through a table.
+ * Code points outside ASCII are classified by a few ranges instead of the
+ * full Unicode categories, so counts for some scripts can be off by a few
+ * tokens.
+ */
+class VocabTokenizer {
+ public:
+  enum class Model { kBpe, kSpm };
+
+  // tokenizer.ggml.token_type
+  enum TokenType : int32_t {
+    kNormal = 1,
+    kUnknown = 2,
+    kControl = 3,
+    kUserDefined = 4,
+    kUnused = 5,
+    kByte = 6,
+  };
+
+  struct Vocab {
+    Model model = Model::kBpe;
+    // tokenizer.ggml.pre, selects the split pattern of BPE vocabularies
+    std::string pre;
+    std::vector<std::string_view> tokens;
+    // empty means all normal
+    std::vector<int32_t> token_types;
+    // merge priorities of SentencePiece vocabularies
+    std::vector<float> scores;
+    // "left right" pairs of BPE vocabularies, by rank
+    std::vector<std::string_view> merges;
+    int32_t bos_id = -1;
+    int32_t eos_id = -1;
+    int32_t unk_id = -1;
+    bool add_bos = false;
+    bool add_eos = false;
+    bool add_space_prefix = true;
+  };
+
+  /**
+   * Tokenizer of the GGUF file at [path], which stays mapped as long as the
+   * tokenizer lives.
+   */
+  static cpp::result<std::shared_ptr<VocabTokenizer>, std::string> Load(
+      const std::filesystem::path& path);
+
+  // [storage] keeps the token texts and merges of [vocab] alive
+  static cpp::result<std::shared_ptr<VocabTokenizer>, std::string> Create(
+      Vocab vocab, std::shared_ptr<const void> storage);
+
+  /**
+   * Token ids of [text]. [add_special] adds the BOS/EOS tokens the model
+   * expects, with [parse_special] control tokens written in the text are
+   * recognized instead of being split as text.
+   */
+  std::vector<int32_t> Encode(std::string_view text, bool add_special,
+                              bool parse_special) const;
+
+  cpp::result<std::string, std::string> Decode(
+      const std::vector<int32_t>& ids, bool skip_special) const;
+
+  // Text of the token as stored in the vocabulary
+  std::string_view Piece(int32_t id) const { return vocab_.tokens[id]; }
+
+  size_t VocabSize() const { return vocab_.tokens.size(); }
+
+ private:
+  enum class Split { kGpt2, kLlama3 };
+
+  struct Merge {
+    uint32_t rank;
+    int32_t result;
+  };
+
+  VocabTokenizer(Vocab vocab, std::shared_ptr<const void> storage)
+      : vocab_{std::move(vocab)}, storage_{std::move(storage)} {}
+
+  cpp::result<void, std::string> Build();
+
+  int32_t TypeOf(int32_t id) const {
+    return vocab_.token_types.empty() ? kNormal : vocab_.token_types[id];
+  }
+
+  int32_t Find(std::string_view text) const {
+    auto it = ids_.find(text);
+    return it == ids_.end() ? -1 : it->second;
+  }
+
+  // Text without special tokens, [first] when it starts the input or
+  // follows a special token
+  void EncodeFragment(std::string_view text, bool first,
+                      std::vector<int32_t>& out) const;
+
+  void EncodeBpeWord(std::string_view word, std::vector<int32_t>& out) const;
+
+  void EncodeSpm(std::string_view text, std::vector<int32_t>& out) const;
+
+  Vocab vocab_;
+  std::shared_ptr<const void> storage_;
+  Split split_ = Split::kGpt2;
+  // whole words found in the vocabulary skip the merges
+  bool ignore_merges_ = false;
+
+  std::unordered_map<std::string_view, int32_t> ids_;
+  // BPE: merges by (left << 32 | right)
+  std::unordered_map<uint64_t, Merge> merges_;
+  // token of each byte, -1 when missing
+  int32_t byte_tokens_[256];
+  // BPE: byte of each code point of the byte-level alphabet, -1 if none
+  std::vector<int16_t> code_point_bytes_;
+  // control and user defined tokens by their first byte, longest first
+  std::vector<int32_t> specials_[256];
+};